@@ -26,5 +26,6 @@ GNU General Public License for more details.
 #define ENGINE_DISABLE_HDTEXTURES	(1<<6)	// disable support of HD-textures in case custom renderer have separate way to load them
 #define ENGINE_COMPUTE_STUDIO_LERP	(1<<7)	// enable MOVETYPE_STEP lerping back in engine
 #define ENGINE_THREADED_MAIN_LOOP	(1<<8) // simulate dedictated thread for main engine loop (prefomance)
+#define ENGINE_PARALLEL_PMOVE	(1<<9)	// PM_Move is reentrant, player moves may run on worker threads (see sv_parallel_pmove)
 
 #endif//FEATURES_H
@@ -260,31 +260,26 @@ bool CCSBot::IsVisible(CBasePlayer *pPlayer, bool testFOV, unsigned char *visPar
 		return false;
 #endif
 
-	Vector spot = pPlayer->pev->origin;
-	unsigned char testVisParts = NONE;
+	const int numParts = 5;
+	Vector spots[numParts];
+	const unsigned char parts[numParts] = { CHEST, HEAD, FEET, LEFT_SIDE, RIGHT_SIDE };
 
 	// finish chest check
-	if (IsVisible(&spot, testFOV))
-		testVisParts |= CHEST;
+	spots[0] = pPlayer->pev->origin;
 
 	// check top of head
-	spot = spot + Vector(0, 0, 25.0f);
-
-	if (IsVisible(&spot, testFOV))
-		testVisParts |= HEAD;
+	spots[1] = spots[0] + Vector(0, 0, 25.0f);
 
 	// check feet
 	const float standFeet = 34.0f;
 	const float crouchFeet = 14.0f;
 
+	spots[2] = spots[1];
+
 	if (pPlayer->pev->flags & FL_DUCKING)
-		spot.z = pPlayer->pev->origin.z - crouchFeet;
+		spots[2].z = pPlayer->pev->origin.z - crouchFeet;
 	else
-		spot.z = pPlayer->pev->origin.z - standFeet;
-
-	// check feet
-	if (IsVisible(&spot, testFOV))
-		testVisParts |= FEET;
+		spots[2].z = pPlayer->pev->origin.z - standFeet;
 
 	// check "edges"
 	const float edgeOffset = 13.0f;
@@ -293,15 +288,53 @@ bool CCSBot::IsVisible(CBasePlayer *pPlayer, bool testFOV, unsigned char *visPar
 
 	Vector2D perp(-dir.y, dir.x);
 
-	spot = pPlayer->pev->origin + Vector(perp.x * edgeOffset, perp.y * edgeOffset, 0);
+	spots[3] = pPlayer->pev->origin + Vector(perp.x * edgeOffset, perp.y * edgeOffset, 0);
+	spots[4] = pPlayer->pev->origin - Vector(perp.x * edgeOffset, perp.y * edgeOffset, 0);
+
+	// same checks as IsVisible(pos), but all lines of sight are traced at once
+	tracerequest_t requests[numParts];
+	TraceResult results[numParts];
+	unsigned char requestParts[numParts];
+	int numRequests = 0;
+
+	// we can't see anything if we're blind
+	if (!IsBlind())
+	{
+		for (int i = 0; i < numParts; i++)
+		{
+			// is it in my general viewcone?
+			if (testFOV && !(const_cast<CCSBot *>(this)->FInViewCone(&spots[i])))
+				continue;
+
+			// check line of sight against smoke
+			if (TheCSBots()->IsLineBlockedBySmoke(&GetEyePosition(), &spots[i]))
+				continue;
+
+			// Must include CONTENTS_MONSTER to pick up all non-brush objects like barrels
+			tracerequest_t *pRequest = &requests[numRequests];
+			pRequest->start = GetEyePosition();
+			pRequest->end = spots[i];
+			pRequest->flags = 1 | 0x100; // ignore_monsters, ignore_glass
+			pRequest->hullNumber = -1;
+			pRequest->pentIgnore = ENT(pev);
 
-	if (IsVisible(&spot, testFOV))
-		testVisParts |= LEFT_SIDE;
+			requestParts[numRequests++] = parts[i];
+		}
+	}
 
-	spot = pPlayer->pev->origin - Vector(perp.x * edgeOffset, perp.y * edgeOffset, 0);
+	unsigned char testVisParts = NONE;
 
-	if (IsVisible(&spot, testFOV))
-		testVisParts |= RIGHT_SIDE;
+	if (numRequests > 0)
+	{
+		// check line of sight
+		UTIL_TraceBatch(requests, numRequests, results);
+
+		for (int i = 0; i < numRequests; i++)
+		{
+			if (results[i].flFraction == 1.0f)
+				testVisParts |= requestParts[i];
+		}
+	}
 
 	if (visParts)
 		*visParts = testVisParts;
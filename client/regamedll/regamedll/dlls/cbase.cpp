@@ -1,4 +1,5 @@
 #include "precompiled.h"
+#include "engine_features.h"
 
 DLL_FUNCTIONS gFunctionTable =
 {
@@ -326,6 +327,28 @@ C_DLLEXPORT int GetNewDLLFunctions(NEW_DLL_FUNCTIONS *pFunctionTable, int *inter
 	return 1;
 }
 
+// Player movement keeps its state per thread (see pm_shared.cpp),
+// so the engine may run moves of far apart players at once
+static unsigned int SV_CheckFeatures()
+{
+	return ENGINE_PARALLEL_PMOVE;
+}
+
+// Engines with the extended physics interface hand us their physics api here.
+// The game keeps engine physics, only the engine features are reported back
+C_DLLEXPORT int Server_GetPhysicsInterface(int iVersion, server_physics_api_t *pfuncs, struct physics_interface_s *pinterface)
+{
+	if (iVersion != SV_PHYSICS_INTERFACE_VERSION || !pfuncs)
+		return 0;
+
+	g_pPhysicsAPI = pfuncs;
+
+	if (pinterface)
+		pinterface->SV_CheckFeatures = SV_CheckFeatures;
+
+	return 1;
+}
+
 int DispatchSpawn(edict_t *pent)
 {
 	CBaseEntity *pEntity = GET_PRIVATE<CBaseEntity>(pent);
@@ -1030,6 +1053,53 @@ void CBaseEntity::TraceAttack(entvars_t *pevAttacker, float flDamage, Vector vec
 }
 
 
+// Pellets of one shot don't see each other, so with "sv_tracebatch 2" the whole group
+// is traced at once against the world as it is at fire time. Otherwise every pellet
+// draws its spread and is traced right before its damage, as it always was
+#define MAX_SHOT_GROUP 16
+
+static int TraceShotGroup(int cShots, const Vector &vecSrc, const Vector &vecDirShooting, const Vector &vecSpread, const Vector &vecRight, const Vector &vecUp, float flDistance, edict_t *pentIgnore, Vector *pDirs, TraceResult *pResults)
+{
+	tracerequest_t requests[MAX_SHOT_GROUP];
+
+	for (int i = 0; i < cShots; i++)
+	{
+		// get circular gaussian spread
+		float x, y, z;
+
+		do
+		{
+			x = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
+			y = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
+			z = x * x + y * y;
+		}
+		while (z > 1);
+
+		pDirs[i] = vecDirShooting + x * vecSpread.x * vecRight + y * vecSpread.y * vecUp;
+
+		requests[i].start = vecSrc;
+		requests[i].end = vecSrc + pDirs[i] * flDistance;
+		requests[i].flags = 0; // dont_ignore_monsters
+		requests[i].hullNumber = -1;
+		requests[i].pentIgnore = pentIgnore;
+	}
+
+	if (cShots == 1)
+	{
+#ifdef REGAMEDLL_ADD
+		gpGlobals->trace_flags = FTRACE_BULLET;
+#endif
+		UTIL_TraceLine(vecSrc, vecSrc + pDirs[0] * flDistance, dont_ignore_monsters, pentIgnore, pResults);
+		return 1;
+	}
+
+#ifdef REGAMEDLL_ADD
+	gpGlobals->trace_flags = FTRACE_BULLET;
+#endif
+	UTIL_TraceBatch(requests, cShots, pResults);
+	return cShots;
+}
+
 LINK_HOOK_CLASS_VOID_CHAIN(CBaseEntity, FireBullets, (ULONG cShots, VectorRef vecSrc, VectorRef vecDirShooting, VectorRef vecSpread, float flDistance, int iBulletType, int iTracerFreq, int iDamage, entvars_t *pevAttacker), cShots, vecSrc, vecDirShooting, vecSpread, flDistance, iBulletType, iTracerFreq, iDamage, pevAttacker)
 
 void CBaseEntity::__API_HOOK(FireBullets)(ULONG cShots, VectorRef vecSrc, VectorRef vecDirShooting, VectorRef vecSpread, float flDistance, int iBulletType, int iTracerFreq, int iDamage, entvars_t *pevAttacker)
@@ -1038,6 +1108,9 @@ void CBaseEntity::__API_HOOK(FireBullets)(ULONG cShots, VectorRef vecSrc, Vector
 	int tracer;
 
 	TraceResult tr;
+	TraceResult results[MAX_SHOT_GROUP];
+	Vector vecDirs[MAX_SHOT_GROUP];
+	int iBatch = 0, numBatch = 0;
 	Vector vecRight, vecUp;
 	bool m_bCreatedShotgunSpark = true;
 
@@ -1057,26 +1130,18 @@ void CBaseEntity::__API_HOOK(FireBullets)(ULONG cShots, VectorRef vecSrc, Vector
 	{
 		int spark = 0;
 
-		// get circular gaussian spread
-		float x, y, z;
-
-		do
+		if (iBatch == numBatch)
 		{
-			x = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
-			y = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
-			z = x * x + y * y;
+			numBatch = TraceShotGroup(UTIL_TraceBatchShots() ? Q_min(cShots - iShot + 1, ULONG(MAX_SHOT_GROUP)) : 1, vecSrc, vecDirShooting, vecSpread, vecRight, vecUp, flDistance, ENT(pev), vecDirs, results);
+			iBatch = 0;
 		}
-		while (z > 1);
 
 		Vector vecDir, vecEnd;
 
-		vecDir = vecDirShooting + x * vecSpread.x * vecRight + y * vecSpread.y * vecUp;
+		vecDir = vecDirs[iBatch];
 		vecEnd = vecSrc + vecDir * flDistance;
 
-#ifdef REGAMEDLL_ADD
-		gpGlobals->trace_flags = FTRACE_BULLET;
-#endif
-		UTIL_TraceLine(vecSrc, vecEnd, dont_ignore_monsters, ENT(pev), &tr);
+		tr = results[iBatch++];
 		tracer = 0;
 
 		if (iTracerFreq != 0 && !(tracerCount++ % iTracerFreq))
@@ -1187,6 +1252,9 @@ void CBaseEntity::__API_HOOK(FireBuckshots)(ULONG cShots, VectorRef vecSrc, Vect
 	int tracer;
 
 	TraceResult tr;
+	TraceResult results[MAX_SHOT_GROUP];
+	Vector vecDirs[MAX_SHOT_GROUP];
+	int iBatch = 0, numBatch = 0;
 	Vector vecRight, vecUp;
 
 	vecRight = gpGlobals->v_right;
@@ -1203,26 +1271,18 @@ void CBaseEntity::__API_HOOK(FireBuckshots)(ULONG cShots, VectorRef vecSrc, Vect
 
 	for (ULONG iShot = 1; iShot <= cShots; iShot++)
 	{
-		// get circular gaussian spread
-		float x, y, z;
-
-		do
+		if (iBatch == numBatch)
 		{
-			x = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
-			y = RANDOM_FLOAT(-0.5, 0.5) + RANDOM_FLOAT(-0.5, 0.5);
-			z = x * x + y * y;
+			numBatch = TraceShotGroup(UTIL_TraceBatchShots() ? Q_min(cShots - iShot + 1, ULONG(MAX_SHOT_GROUP)) : 1, vecSrc, vecDirShooting, vecSpread, vecRight, vecUp, flDistance, ENT(pev), vecDirs, results);
+			iBatch = 0;
 		}
-		while (z > 1);
 
 		Vector vecDir, vecEnd;
 
-		vecDir = vecDirShooting + x * vecSpread.x * vecRight + y * vecSpread.y * vecUp;
+		vecDir = vecDirs[iBatch];
 		vecEnd = vecSrc + vecDir * flDistance;
 
-#ifdef REGAMEDLL_ADD
-		gpGlobals->trace_flags = FTRACE_BULLET;
-#endif
-		UTIL_TraceLine(vecSrc, vecEnd, dont_ignore_monsters, ENT(pev), &tr);
+		tr = results[iBatch++];
 		tracer = 0;
 
 		if (iTracerFreq != 0 && !(tracerCount++ % iTracerFreq))
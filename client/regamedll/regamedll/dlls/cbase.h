@@ -629,6 +629,7 @@ extern CUtlVector<hash_item_t> stringsHashTable;
 
 C_DLLEXPORT int GetEntityAPI(DLL_FUNCTIONS *pFunctionTable, int interfaceVersion);
 C_DLLEXPORT int GetNewDLLFunctions(NEW_DLL_FUNCTIONS *pFunctionTable, int *interfaceVersion);
+C_DLLEXPORT int Server_GetPhysicsInterface(int iVersion, server_physics_api_t *pfuncs, struct physics_interface_s *pinterface);
 
 void REMOVE_ENTITY(edict_t *pEntity);
 
@@ -25,6 +25,7 @@ unsigned int seed_table[256] =
 
 int g_groupmask = 0;
 int g_groupop = 0;
+server_physics_api_t *g_pPhysicsAPI = nullptr;
 
 float UTIL_WeaponTimeBase()
 {
@@ -180,8 +181,52 @@ NOXREF void UTIL_MoveToOrigin(edict_t *pent, const Vector &vecGoal, float flDist
 	MOVE_TO_ORIGIN(pent, rgfl, flDist, iMoveType);
 }
 
+#define MAX_BOX_CANDIDATES 512
+
 int UTIL_EntitiesInBox(CBaseEntity **pList, int listMax, const Vector &mins, const Vector &maxs, int flagMask)
 {
+	static cvar_t *sv_spheregrid = nullptr;
+
+	if (g_pPhysicsAPI && !sv_spheregrid)
+		sv_spheregrid = CVAR_GET_POINTER("sv_spheregrid");
+
+	if (sv_spheregrid && sv_spheregrid->value > 0.0f)
+	{
+		edict_t *pCandidates[MAX_BOX_CANDIDATES];
+		int numCandidates = g_pPhysicsAPI->pfnEntitiesInBox(mins, maxs, pCandidates, ARRAYSIZE(pCandidates));
+
+		// the engine gives a superset in edict order, filter it the same way
+		if (numCandidates >= 0)
+		{
+			int count = 0;
+
+			for (int i = 0; i < numCandidates; i++)
+			{
+				edict_t *pEdict = pCandidates[i];
+
+				if (pEdict->free)
+					continue;
+
+				if (flagMask && !(pEdict->v.flags & flagMask))
+					continue;
+
+				CBaseEntity *pEntity = CBaseEntity::Instance(pEdict);
+				if (!pEntity)
+					continue;
+
+				if (!pEntity->Intersects(mins, maxs))
+					continue;
+
+				pList[count++] = pEntity;
+
+				if (count >= listMax)
+					break;
+			}
+
+			return count;
+		}
+	}
+
 	edict_t *pEdict = INDEXENT(1);
 	int count = 0;
 
@@ -872,6 +917,49 @@ void UTIL_TraceHull(const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTER
 	TRACE_HULL(vecStart, vecEnd, (igmon == ignore_monsters), hullNumber, pentIgnore, ptr);
 }
 
+// Value of the engine "sv_tracebatch" cvar, 0 when the engine has no batched traces
+static float UTIL_TraceBatchMode()
+{
+	static cvar_t *sv_tracebatch = nullptr;
+
+	if (g_pPhysicsAPI && !sv_tracebatch)
+		sv_tracebatch = CVAR_GET_POINTER("sv_tracebatch");
+
+	return sv_tracebatch ? sv_tracebatch->value : 0.0f;
+}
+
+// Pellets of one shot are grouped only at "sv_tracebatch 2", it changes when the spread is drawn
+bool UTIL_TraceBatchShots()
+{
+	return UTIL_TraceBatchMode() >= 2.0f;
+}
+
+// Traces a group of independent lines or hulls, the engine walks its area tree once for the whole group.
+// Results are the same as tracing each request in order with TRACE_LINE or TRACE_HULL
+void UTIL_TraceBatch(const tracerequest_t *pRequests, int count, TraceResult *pResults)
+{
+	if (UTIL_TraceBatchMode() > 0.0f)
+	{
+		g_pPhysicsAPI->pfnTraceBatch(pRequests, count, pResults);
+		return;
+	}
+
+	// the engine resets trace flags after each trace
+	int traceFlags = gpGlobals->trace_flags;
+
+	for (int i = 0; i < count; i++)
+	{
+		const tracerequest_t *pRequest = &pRequests[i];
+
+		gpGlobals->trace_flags = traceFlags;
+
+		if (pRequest->hullNumber < 0)
+			TRACE_LINE(pRequest->start, pRequest->end, pRequest->flags, pRequest->pentIgnore, &pResults[i]);
+		else
+			TRACE_HULL(pRequest->start, pRequest->end, pRequest->flags, pRequest->hullNumber, pRequest->pentIgnore, &pResults[i]);
+	}
+}
+
 void UTIL_TraceModel(const Vector &vecStart, const Vector &vecEnd, int hullNumber, edict_t *pentModel, TraceResult *ptr)
 {
 	TRACE_MODEL(vecStart, vecEnd, hullNumber, pentModel, ptr);
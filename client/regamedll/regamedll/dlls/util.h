@@ -31,6 +31,7 @@
 #include "shake.h"
 #include "activity.h"
 #include "enginecallback.h"
+#include "physint.h"
 #include "utlvector.h"
 
 #define GROUP_OP_AND	0
@@ -246,6 +247,8 @@ void UTIL_ShowMessageAll(const char *pString, bool isHint = false);
 void UTIL_TraceLine(const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, edict_t *pentIgnore, TraceResult *ptr);
 void UTIL_TraceLine(const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, IGNORE_GLASS ignoreGlass, edict_t *pentIgnore, TraceResult *ptr);
 void UTIL_TraceHull(const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, int hullNumber, edict_t *pentIgnore, TraceResult *ptr);
+void UTIL_TraceBatch(const tracerequest_t *pRequests, int count, TraceResult *pResults);
+bool UTIL_TraceBatchShots();
 void UTIL_TraceModel(const Vector &vecStart, const Vector &vecEnd, int hullNumber, edict_t *pentModel, TraceResult *ptr);
 TraceResult UTIL_GetGlobalTrace();
 void UTIL_SetSize(entvars_t *pev, const Vector &vecMin, const Vector &vecMax);
@@ -378,3 +381,4 @@ inline void UTIL_FixupAngles(Vector &v)
 
 extern int g_groupmask;
 extern int g_groupop;
+extern server_physics_api_t *g_pPhysicsAPI;
@@ -0,0 +1,97 @@
+/*
+*
+*   This program is free software; you can redistribute it and/or modify it
+*   under the terms of the GNU General Public License as published by the
+*   Free Software Foundation; either version 2 of the License, or (at
+*   your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful, but
+*   WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software Foundation,
+*   Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+*   In addition, as a special exception, the author gives permission to
+*   link the code of this program with the Half-Life Game Engine ("HL
+*   Engine") and Modified Game Libraries ("MODs") developed by Valve,
+*   L.L.C ("Valve").  You must obey the GNU General Public License in all
+*   respects for all of the code used other than the HL Engine and MODs
+*   from Valve.  If you modify this file, you may extend this exception
+*   to your version of the file, but you are not obligated to do so.  If
+*   you do not wish to do so, delete this exception statement from your
+*   version.
+*
+*/
+
+#ifndef PHYSINT_H
+#define PHYSINT_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+// Server physics interface of the engine. Only the part of the engine api
+// used by the game is described, the layout must match the engine one
+#define SV_PHYSICS_INTERFACE_VERSION	6
+
+// single request for pfnTraceBatch
+typedef struct tracerequest_s
+{
+	vec3_t start;
+	vec3_t end;
+	int flags;				// same as fNoMonsters of TRACE_LINE
+	int hullNumber;			// -1 is line trace, 0-3 as for TRACE_HULL
+	edict_t *pentIgnore;
+} tracerequest_t;
+
+typedef struct server_physics_api_s
+{
+	void (*pfnLinkEdict)(edict_t *ent, qboolean touch_triggers);
+	double (*pfnGetServerTime)();
+	double (*pfnGetFrameTime)();
+	void *(*pfnGetModel)(int modelindex);
+	struct areanode_s *(*pfnGetHeadnode)();
+	int (*pfnServerState)();
+	void (*pfnHost_Error)(const char *error, ...);
+	struct triangleapi_s *pTriAPI;
+	int (*pfnDrawConsoleString)(int x, int y, char *string);
+	void (*pfnDrawSetTextColor)(float r, float g, float b);
+	void (*pfnDrawConsoleStringLen)(const char *string, int *length, int *height);
+	void (*Con_NPrintf)(int pos, char *fmt, ...);
+	void (*Con_NXPrintf)(struct con_nprint_s *info, char *fmt, ...);
+	const char *(*pfnGetLightStyle)(int style);
+	void (*pfnUpdateFogSettings)(unsigned int packed_fog);
+	char **(*pfnGetFilesList)(const char *pattern, int *numFiles, int gamedironly);
+	struct msurface_s *(*pfnTraceSurface)(edict_t *pTextureEntity, const float *v1, const float *v2);
+	const byte *(*pfnGetTextureData)(unsigned int texnum);
+	void *(*pfnMemAlloc)(size_t cb, const char *filename, const int fileline);
+	void (*pfnMemFree)(void *mem, const char *filename, const int fileline);
+
+	// trace the group of lines or hulls with one area tree walk, only present
+	// when "sv_tracebatch" cvar is registered by the engine
+	void (*pfnTraceBatch)(const tracerequest_t *requests, int count, TraceResult *results);
+
+	// edicts which absbox touches the box in edict order, -1 if the list is too
+	// small, only present when "sv_spheregrid" cvar is registered by the engine
+	int (*pfnEntitiesInBox)(const float *mins, const float *maxs, edict_t **list, int maxcount);
+} server_physics_api_t;
+
+// Physics callbacks of the game, the engine passes them zeroed. Only the
+// leading part up to the callbacks the game fills is described
+typedef struct physics_interface_s
+{
+	int version;
+	int (*SV_CreateEntity)(edict_t *pent, const char *szName);
+	int (*SV_PhysicsEntity)(edict_t *pEntity);
+	int (*SV_LoadEntities)(const char *mapname, char *entities);
+	void (*SV_UpdatePlayerBaseVelocity)(edict_t *ent);
+	int (*SV_AllowSaveGame)();
+	int (*SV_TriggerTouch)(edict_t *pent, edict_t *trigger);
+
+	// ENGINE_* flags of engine_features.h
+	unsigned int (*SV_CheckFeatures)();
+} physics_interface_t;
+
+#endif // PHYSINT_H
@@ -9,11 +9,12 @@ int pm_gcTextures = 0;
 char pm_grgszTextureName[MAX_TEXTURES][MAX_TEXTURENAME_LENGHT];
 char pm_grgchTextureType[MAX_TEXTURES];
 
-playermove_t *pmove = nullptr;
-BOOL g_onladder = FALSE;
+// per thread, engines with ENGINE_PARALLEL_PMOVE may run several moves at once
+thread_local playermove_t *pmove = nullptr;
+thread_local BOOL g_onladder = FALSE;
 
 #ifdef REGAMEDLL_API
-static CCSPlayer *pmoveplayer = nullptr;
+static thread_local CCSPlayer *pmoveplayer = nullptr;
 #endif
 
 #ifdef CLIENT_DLL
@@ -170,7 +171,7 @@ LINK_HOOK_VOID_CHAIN(PM_PlayStepSound, (int step, float fvol), step, fvol)
 
 void EXT_FUNC __API_HOOK(PM_PlayStepSound)(int step, float fvol)
 {
-	static int iSkipStep = 0;
+	static thread_local int iSkipStep = 0;
 	int irand;
 
 #ifdef REGAMEDLL_API
@@ -98,4 +98,4 @@ void PM_AirMove(int playerIndex = 0);
 
 const char *PM_ServerVersion();
 
-extern struct playermove_s *pmove;
+extern thread_local struct playermove_s *pmove;
@@ -119,11 +119,13 @@ LOCAL_SRC_FILES := \
            common/net_chan.c \
            common/net_encode.c \
            common/net_huff.c \
+           common/net_lz.c \
            common/network.c \
            common/pm_surface.c \
            common/pm_trace.c \
            common/random.c \
            common/sys_con.c \
+           common/sys_thread.c \
            common/system.c \
            common/titles.c \
            common/world.c \
@@ -54,6 +54,7 @@ convar_t *cl_draw_particles;
 convar_t *cl_lightstyle_lerping;
 convar_t *cl_idealpitchscale;
 convar_t *cl_solid_players;
+convar_t *cl_physentcache;
 convar_t *cl_draw_beams;
 convar_t *cl_cmdrate;
 convar_t *cl_interp;
@@ -887,7 +888,10 @@ void CL_SendConnectPacket( void )
 	{
 		qboolean huff = Cvar_VariableInteger( "cl_enable_compress" );
 		if ( huff )
-			extensions |= NET_EXT_HUFF;
+			extensions |= NET_EXT_HUFF|NET_EXT_HUFF_STATIC;
+
+		if ( Cvar_VariableInteger( "cl_enable_lz" ) )
+			extensions |= NET_EXT_LZ;
 
 		if ( Cvar_VariableInteger( "cl_enable_split" ) )
 		{
@@ -1904,7 +1908,13 @@ void CL_ConnectionlessPacket( netadr_t from, sizebuf_t *msg )
 		}
 
 		Netchan_Setup( NS_CLIENT, &cls.netchan, from, net_qport->integer );
-		cls.splitcompress = false;
+		cls.splitcompress = NET_CODEC_NONE;
+
+		if ( extensions & NET_EXT_LZ )
+		{
+			MsgDev( D_INFO, "^2NET_EXT_LZ enabled^7\n" );
+			cls.netchan.fragcompress = NET_CODEC_LZ;
+		}
 
 		if ( extensions & NET_EXT_SPLIT )
 		{
@@ -1918,10 +1928,15 @@ void CL_ConnectionlessPacket( netadr_t from, sizebuf_t *msg )
 			cls.netchan.split = true;
 			MsgDev( D_INFO, "^2NET_EXT_SPLIT enabled^7 (packet sizes is %d/%d)\n", cl_maxpacket->integer, cls.netchan.maxpacket );
 
-			if ( extensions & NET_EXT_SPLITHUFF )
+			// must match the choice made in SV_DirectConnect
+			if (( extensions & NET_EXT_LZ ) && !( extensions & NET_EXT_HUFF ))
+			{
+				cls.splitcompress = NET_CODEC_LZ;
+			}
+			else if ( extensions & NET_EXT_SPLITHUFF )
 			{
 				MsgDev( D_INFO, "^2NET_EXT_SPLITHUFF enabled^7\n" );
-				cls.splitcompress = true;
+				cls.splitcompress = NET_CODEC_HUFF;
 			}
 		}
 
@@ -1929,7 +1944,13 @@ void CL_ConnectionlessPacket( netadr_t from, sizebuf_t *msg )
 		{
 			MsgDev( D_INFO, "^2NET_EXT_HUFF enabled\n" );
 
-			cls.netchan.compress = true;
+			cls.netchan.compress = NET_CODEC_HUFF;
+
+			if ( extensions & NET_EXT_HUFF_STATIC )
+			{
+				MsgDev( D_INFO, "^2NET_EXT_HUFF_STATIC enabled^7\n" );
+				cls.netchan.compress = NET_CODEC_HUFF_STATIC;
+			}
 		}
 
 		BF_WriteByte( &cls.netchan.message, clc_stringcmd );
@@ -2579,6 +2600,7 @@ void CL_InitLocal( void )
 	cl_nodelta         = Cvar_Get( "cl_nodelta", "0", 0, "disable delta-compression for usercommands" );
 	cl_idealpitchscale = Cvar_Get( "cl_idealpitchscale", "0.8", 0, "how much to look up/down slopes and stairs when not using freelook" );
 	cl_solid_players   = Cvar_Get( "cl_solid_players", "1", 0, "make all players non-solid (can't traceline them)" );
+	cl_physentcache    = Cvar_Get( "cl_physentcache", "1", 0, "keep solid entities collected for prediction until the next server frame arrives" );
 	cl_interp          = Cvar_Get( "ex_interp", "0.01", CVAR_ARCHIVE, "interpolate object positions starting this many seconds in past" );
 	// Cvar_Get( "ex_maxerrordistance", "0", 0, "" );
 	cl_allow_fragment = Cvar_Get( "cl_allow_fragment", "0", CVAR_ARCHIVE | CVAR_PROTECTED, "allow downloading files directly from game server (unstable & unsafe)" );
@@ -2681,6 +2703,7 @@ void CL_InitLocal( void )
 	Cvar_Get( "cl_enable_compress", "0", CVAR_ARCHIVE, "request huffman compression from server" );
 	Cvar_Get( "cl_enable_split", "1", CVAR_ARCHIVE, "request packet split from server" );
 	Cvar_Get( "cl_enable_splitcompress", "0", CVAR_ARCHIVE, "request compressing all splitpackets" );
+	Cvar_Get( "cl_enable_lz", "0", CVAR_ARCHIVE, "request LZ compression of fragments and split packets" );
 
 	Cvar_Get( "cl_maxoutpacket", "0", CVAR_ARCHIVE, "max outcoming packet size (equal cl_maxpacket if 0)" );
 
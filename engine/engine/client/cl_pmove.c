@@ -262,6 +262,22 @@ void ItemPreFrame( local_state_t *from, local_state_t *to, usercmd_t *cmd, int r
 }
 
 
+// entities collected from the last server frame, they are
+// still in the pmove lists behind the world and the players
+static struct
+{
+	qboolean		valid;
+	int		servercount;
+	int		parsecount;
+	int		first_entity;
+	int		num_entities;
+	int		playernum;
+
+	int		numvisent;
+	int		numphysent;
+	int		nummoveent;
+} cl_physentcache_state;
+
 /*
 ====================
 CL_AddLinksToPmove
@@ -272,9 +288,23 @@ collect solid entities
 void CL_AddLinksToPmove( void )
 {
 	cl_entity_t	*check;
-	physent_t		*pe;
+	physent_t		*pe, *vis;
 	int		i, solid, idx;
 
+	// nothing was received since the lists were built
+	if( cl_physentcache->integer && cl_physentcache_state.valid
+	&& cl_physentcache_state.servercount == cl.servercount
+	&& cl_physentcache_state.parsecount == cl.parsecount
+	&& cl_physentcache_state.first_entity == cl.frame.first_entity
+	&& cl_physentcache_state.num_entities == cl.frame.num_entities
+	&& cl_physentcache_state.playernum == cl.playernum )
+	{
+		clgame.pmove->numvisent = cl_physentcache_state.numvisent;
+		clgame.pmove->numphysent = cl_physentcache_state.numphysent;
+		clgame.pmove->nummoveent = cl_physentcache_state.nummoveent;
+		return;
+	}
+
 	for( i = 0; i < cl.frame.num_entities; i++ )
 	{
 		idx = cls.packet_entities[(cl.frame.first_entity + i) % cls.num_client_entities].number;
@@ -302,11 +332,16 @@ void CL_AddLinksToPmove( void )
 		if( solid == SOLID_NOT && ( check->curstate.skin == CONTENTS_NONE || check->curstate.modelindex == 0 ))
 			continue;
 
+		// copied once, other lists take it from visents
+		vis = NULL;
+
 		if( clgame.pmove->numvisent < MAX_PHYSENTS )
 		{
 			pe = &clgame.pmove->visents[clgame.pmove->numvisent];
-			if( CL_CopyEntityToPhysEnt( pe, check ))
-				clgame.pmove->numvisent++;
+			if( !CL_CopyEntityToPhysEnt( pe, check ))
+				continue; // no model
+			vis = pe;
+			clgame.pmove->numvisent++;
 		}
 
 		if( solid == SOLID_BSP || solid == SOLID_BBOX || solid == SOLID_SLIDEBOX || solid == SOLID_CUSTOM )
@@ -315,7 +350,13 @@ void CL_AddLinksToPmove( void )
 			if( clgame.pmove->numphysent < ( MAX_PHYSENTS - cl.maxclients ))
 			{
 				pe = &clgame.pmove->physents[clgame.pmove->numphysent];
-				if( CL_CopyEntityToPhysEnt( pe, check ))
+
+				if( vis )
+				{
+					*pe = *vis;
+					clgame.pmove->numphysent++;
+				}
+				else if( CL_CopyEntityToPhysEnt( pe, check ))
 					clgame.pmove->numphysent++;
 			}
 		}
@@ -324,11 +365,27 @@ void CL_AddLinksToPmove( void )
 			if( clgame.pmove->nummoveent < MAX_MOVEENTS )
 			{
 				pe = &clgame.pmove->moveents[clgame.pmove->nummoveent];
-				if( CL_CopyEntityToPhysEnt( pe, check ))
+
+				if( vis )
+				{
+					*pe = *vis;
+					clgame.pmove->nummoveent++;
+				}
+				else if( CL_CopyEntityToPhysEnt( pe, check ))
 					clgame.pmove->nummoveent++;
 			}
 		}
 	}
+
+	cl_physentcache_state.valid = true;
+	cl_physentcache_state.servercount = cl.servercount;
+	cl_physentcache_state.parsecount = cl.parsecount;
+	cl_physentcache_state.first_entity = cl.frame.first_entity;
+	cl_physentcache_state.num_entities = cl.frame.num_entities;
+	cl_physentcache_state.playernum = cl.playernum;
+	cl_physentcache_state.numvisent = clgame.pmove->numvisent;
+	cl_physentcache_state.numphysent = clgame.pmove->numphysent;
+	cl_physentcache_state.nummoveent = clgame.pmove->nummoveent;
 }
 
 /*
@@ -531,7 +531,7 @@ typedef struct
 	file_t		*demofile;
 	file_t		*demoheader;		// contain demo startup info in case we record a demo on this level
 	qboolean keybind_changed;
-	qboolean splitcompress;			// enabled only on server->client netchan
+	int splitcompress;			// split packet codec, enabled only on server->client netchan
 	qboolean need_save_config;
 	qboolean internetservers_wait;	// internetservers is waiting for dns request
 	qboolean internetservers_pending;	// internetservers is waiting for dns request
@@ -732,6 +732,7 @@ extern convar_t *cl_smoothtime;
 extern convar_t	*cl_crosshair;
 extern convar_t	*cl_testlights;
 extern convar_t	*cl_solid_players;
+extern convar_t	*cl_physentcache;
 extern convar_t	*cl_idealpitchscale;
 extern convar_t	*cl_allow_levelshots;
 extern convar_t	*cl_allow_fragment;
@@ -555,6 +555,8 @@ qboolean NET_CompareAdr( const netadr_t a, const netadr_t b );
 qboolean NET_CompareBaseAdr( const netadr_t a, const netadr_t b );
 qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *length );
 void NET_SendPacket( netsrc_t sock, size_t length, const void *data, netadr_t to );
+void NET_BeginSendBatch( netsrc_t sock );
+void NET_FlushSendBatch( netsrc_t sock );
 
 
 //
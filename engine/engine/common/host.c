@@ -191,6 +191,9 @@ void Host_PrintEngineFeatures( void )
 
 	if( host.features & ENGINE_COMPENSATE_QUAKE_BUG )
 		MsgDev( D_AICONSOLE, "^3EXT:^7 Quake bug compensation enabled\n" );
+
+	if( host.features & ENGINE_PARALLEL_PMOVE )
+		MsgDev( D_AICONSOLE, "^3EXT:^7 Reentrant player movement\n" );
 }
 
 /*
@@ -1458,6 +1461,7 @@ void EXPORT Host_Shutdown( void )
 	Mod_Shutdown();
 	NET_Shutdown();
 	HTTP_Shutdown();
+	Sys_ShutdownThreads();
 	Con_ClearAutoComplete();
 	Cmd_Shutdown();
 	Host_FreeCommon();
@@ -53,6 +53,17 @@ typedef struct wadlist_s
 	int		count;
 } wadlist_t;
 
+// packed clipnode for the trace kernel, 16 bytes
+typedef struct
+{
+	int		children[2];	// negative numbers are contents
+	float		dist;
+	int		plane;		// planenum << 2 | type, non-axial planes have type 3
+} mhullnode_t;
+
+#define HULLNODE_TYPE( n )	((n)->plane & 3)
+#define HULLNODE_PLANE( n )	((n)->plane >> 2)
+
 typedef struct leaflist_s
 {
 	int		count;
@@ -90,12 +101,23 @@ typedef struct
 	vec3_t		mins;		// real accuracy world bounds
 	vec3_t		maxs;
 	vec3_t		size;
+
+	dclipnode_t	*hullsource[2];	// clipnodes of hull 0 and the ones shared by hulls 1-3
+	mhullnode_t	*hullnodes[2];	// packed copy of them
+
+	byte		*visrows;		// uncompressed PVS rows, one per leaf (mod_vismemory)
+	byte		*pasrows;		// uncompressed PAS rows or NULL
+	int		visrowbytes;	// row stride, multiple of 16 bytes
+	uint32_t		*visopen;		// non-solid leafs mask
+	int		*visnodes;	// first and last leaf for each world node
+	mleaf_t		*visleafs;	// leafs the rows are built for
 } world_static_t;
 
 extern world_static_t	world;
 extern byte		*com_studiocache;
 extern model_t		*loadmodel;
 extern convar_t		*mod_studiocache;
+extern convar_t		*mod_vismemory;
 extern int		bmodel_version;	// only actual during loading
 
 //
@@ -126,6 +148,7 @@ mleaf_t *Mod_PointInLeaf( const vec3_t p, mnode_t *node );
 void Mod_TesselatePolygon( msurface_t *surf, model_t *mod, float tessSize );
 int Mod_BoxLeafnums( const vec3_t mins, const vec3_t maxs, short *list, int listsize, int *lastleaf );
 qboolean Mod_BoxVisible( const vec3_t mins, const vec3_t maxs, const byte *visbits );
+int Mod_HeadnodeVisible( mnode_t *node, const byte *visbits, int *lastleaf );
 void Mod_BuildSurfacePolygons( msurface_t *surf, mextrasurf_t *info );
 void Mod_AmbientLevels( const vec3_t p, byte *pvolumes );
 byte *Mod_CompressVis( const byte *in, size_t *size );
@@ -133,6 +156,7 @@ byte *Mod_DecompressVis( const byte *in );
 modtype_t Mod_GetType( int handle );
 model_t *Mod_Handle( int handle );
 struct wadlist_s *Mod_WadList( void );
+const mhullnode_t *Mod_PackedHull( const hull_t *hull );
 
 //
 // mod_studio.c
@@ -145,5 +169,6 @@ void Mod_StudioGetAttachment( const edict_t *e, int iAttachment, float *org, flo
 void Mod_GetBonePosition( const edict_t *e, int iBone, float *org, float *ang );
 hull_t *Mod_HullForStudio( model_t *m, float frame, int seq, vec3_t ang, vec3_t org, vec3_t size, byte *pcnt, byte *pbl, int *hitboxes, edict_t *ed );
 int Mod_HitgroupForStudioHull( int index );
+void Mod_StudioHitboxMask( const vec3_t start, const vec3_t end, int numhitboxes, byte *mask );
 
 #endif//MOD_LOCAL_H
@@ -21,42 +21,57 @@ GNU General Public License for more details.
 
 typedef int (*STUDIOAPI)( int, sv_blending_interface_t**, server_studio_api_t*,  float (*transform)[3][4], float (*bones)[MAXSTUDIOBONES][3][4] );
 
-typedef struct mstudiocache_s
+// hitbox placed by the bones, trace size is not applied yet
+typedef struct
 {
+	vec3_t	normal[3];	// hitbox axes
+	float	distmax[3];	// bbmax planes
+	float	distmin[3];	// bbmin planes
+	uint32_t	group;
+} mstudiobox_t;
+
+// hitboxes of the single entity in the current frame
+typedef struct
+{
+	uint32_t	framecount;
+	int	entnum;
+	model_t	*model;
 	float	frame;
 	int	sequence;
 	vec3_t	angles;
 	vec3_t	origin;
-	vec3_t	size;
 	byte	controler[4];
 	byte	blending[2];
-	model_t	*model;
-	uint32_t	current_hull;
-	uint32_t	current_plane;
-	uint32_t	numhitboxes;
-} mstudiocache_t;
+	int	firstbox;
+	int	numboxes;
+} mstudiopose_t;
 
-#define STUDIO_CACHESIZE		16
-#define STUDIO_CACHEMASK		(STUDIO_CACHESIZE - 1)
+#define STUDIO_POSECACHE		64	// entities remembered in a frame, power of two
+#define STUDIO_MAXBOXES		4096	// hitboxes remembered in a frame
+#define STUDIO_CULL_EPSILON		1.0f	// keep the hitbox cull conservative
 
 // trace global variables
 static sv_blending_interface_t	*pBlendAPI = NULL;
 static studiohdr_t			*mod_studiohdr;
 static matrix3x4			studio_transform;
-static hull_t			cache_hull[MAXSTUDIOBONES];
 static hull_t			studio_hull[MAXSTUDIOBONES];
 static matrix3x4			studio_bones[MAXSTUDIOBONES];
 static uint32_t			studio_hull_hitgroup[MAXSTUDIOBONES];
-static uint32_t			cache_hull_hitgroup[MAXSTUDIOBONES];
-static mstudiocache_t		cache_studio[STUDIO_CACHESIZE];
 static dclipnode_t			studio_clipnodes[6];
 static mplane_t			studio_planes[768];
-static mplane_t			cache_planes[768];
+
+// current hitboxes by axis for the vectorized cull
+static float			studio_cullnormal[3][3][MAXSTUDIOBONES];
+static float			studio_cullmin[3][MAXSTUDIOBONES];
+static float			studio_cullmax[3][MAXSTUDIOBONES];
+static int			studio_numcull;
 
 // current cache state
-static int			cache_current;
-static int			cache_current_hull;
-static int			cache_current_plane;
+static mstudiopose_t		cache_pose[STUDIO_POSECACHE];
+static mstudiobox_t			cache_boxes[STUDIO_MAXBOXES];
+static mstudiobox_t			studio_boxes[MAXSTUDIOBONES];	// uncached pose
+static uint32_t			cache_framecount;
+static int			cache_numboxes;
 
 /*
 ====================
@@ -99,76 +114,30 @@ void Mod_InitStudioHull( void )
 */
 /*
 ====================
-ClearStudioCache
-====================
-*/
-void Mod_ClearStudioCache( void )
-{
-	Q_memset( cache_studio, 0, sizeof( cache_studio ));
-	cache_current_hull = cache_current_plane = 0;
-
-	cache_current = 0;
-}
+Mod_CheckStudioPose
 
-/*
-====================
-AddToStudioCache
+returns the cached pose of the entity or the slot to store it
 ====================
 */
-void Mod_AddToStudioCache( float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *pcontroller, byte *pblending, model_t *model, hull_t *hull, int numhitboxes )
+static mstudiopose_t *Mod_CheckStudioPose( int entnum, model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, byte *pcontroller, byte *pblending, qboolean *found )
 {
-	mstudiocache_t *pCache;
-
-	if( numhitboxes + cache_current_hull >= MAXSTUDIOBONES )
-		Mod_ClearStudioCache();
-
-	cache_current++;
-	pCache = &cache_studio[cache_current & STUDIO_CACHEMASK];
-
-	pCache->frame = frame;
-	pCache->sequence = sequence;
-	VectorCopy( angles, pCache->angles );
-	VectorCopy( origin, pCache->origin );
-	VectorCopy( size, pCache->size );
-
-	Q_memcpy( pCache->controler, pcontroller, 4 );
-	Q_memcpy( pCache->blending, pblending, 2 );
-
-	pCache->model = model;
-	pCache->current_hull = cache_current_hull;
-	pCache->current_plane = cache_current_plane;
-
-	Q_memcpy( &cache_hull[cache_current_hull], hull, numhitboxes * sizeof( hull_t ));
-	Q_memcpy( &cache_planes[cache_current_plane], studio_planes, numhitboxes * sizeof( mplane_t ) * 6 );
-	Q_memcpy( &cache_hull_hitgroup[cache_current_hull], studio_hull_hitgroup, numhitboxes * sizeof( uint32_t ));
+	mstudiopose_t	*pCache;
 
-	cache_current_hull += numhitboxes;
-	cache_current_plane += numhitboxes * 6;
-	pCache->numhitboxes = numhitboxes;
-}
+	// bones are set up at most once per frame for each pose
+	if( cache_framecount != host.framecount )
+	{
+		cache_framecount = host.framecount;
+		cache_numboxes = 0;
+	}
 
-/*
-====================
-CheckStudioCache
-====================
-*/
-mstudiocache_t *Mod_CheckStudioCache( model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *pcontroller, byte *pblending )
-{
-	mstudiocache_t	*pCache;
-	int		i;
+	pCache = &cache_pose[entnum & ( STUDIO_POSECACHE - 1 )];
 
-	for( i = 0; i < STUDIO_CACHESIZE; i++ )
-	{
-		pCache = &cache_studio[(cache_current - i) & STUDIO_CACHEMASK];
+	*found = ( pCache->framecount == cache_framecount && pCache->entnum == entnum && pCache->model == model &&
+		pCache->frame == frame && pCache->sequence == sequence && VectorCompare( angles, pCache->angles ) &&
+		VectorCompare( origin, pCache->origin ) && !Q_memcmp( pCache->controler, pcontroller, 4 ) &&
+		!Q_memcmp( pCache->blending, pblending, 2 ));
 
-		if( pCache->model == model && pCache->frame == frame && pCache->sequence == sequence &&
-		VectorCompare( angles, pCache->angles ) && VectorCompare( origin, pCache->origin ) && VectorCompare( size, pCache->size ) &&
-		!Q_memcmp( pCache->controler, pcontroller, 4 ) && !Q_memcmp( pCache->blending, pblending, 2 ))
-		{
-			return pCache;
-		}
-	}
-	return NULL;
+	return pCache;
 }
 
 /*
@@ -194,6 +163,54 @@ void Mod_SetStudioHullPlane( mplane_t *pl, int bone, int axis, float offset )
 	pl->dist = (pl->normal[0] * studio_bones[bone][0][3]) + (pl->normal[1] * studio_bones[bone][1][3]) + (pl->normal[2] * studio_bones[bone][2][3]) + offset;
 }
 
+/*
+====================
+Mod_SetupStudioBoxes
+
+run bone setup and place the hitboxes, returns hitbox count
+====================
+*/
+static int Mod_SetupStudioBoxes( model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, byte *pcontroller, byte *pblending, edict_t *pEdict, mstudiobox_t *boxes, int maxboxes )
+{
+	vec3_t		angles2;
+	mstudiobbox_t	*phitbox;
+	mplane_t		plane;
+	int		i, j, numboxes;
+
+	mod_studiohdr = Mod_Extradata( model );
+	if( !mod_studiohdr ) return -1; // probably not a studiomodel
+
+	numboxes = min( mod_studiohdr->numhitboxes, MAXSTUDIOBONES );
+	if( numboxes > maxboxes ) return 0;
+
+	ASSERT( pBlendAPI != NULL );
+
+	VectorCopy( angles, angles2 );
+
+	if( !( host.features & ENGINE_COMPENSATE_QUAKE_BUG ))
+		angles2[PITCH] = -angles2[PITCH]; // stupid quake bug
+
+	pBlendAPI->SV_StudioSetupBones( model, frame, sequence, angles2, origin, pcontroller, pblending, -1, pEdict );
+	phitbox = (mstudiobbox_t *)((byte *)mod_studiohdr + mod_studiohdr->hitboxindex);
+
+	for( i = 0; i < numboxes; i++ )
+	{
+		boxes[i].group = phitbox[i].group;
+
+		for( j = 0; j < 3; j++ )
+		{
+			Mod_SetStudioHullPlane( &plane, phitbox[i].bone, j, phitbox[i].bbmax[j] );
+			VectorCopy( plane.normal, boxes[i].normal[j] );
+			boxes[i].distmax[j] = plane.dist;
+
+			Mod_SetStudioHullPlane( &plane, phitbox[i].bone, j, phitbox[i].bbmin[j] );
+			boxes[i].distmin[j] = plane.dist;
+		}
+	}
+
+	return numboxes;
+}
+
 /*
 ====================
 HullForStudio
@@ -203,10 +220,11 @@ NOTE: pEdict may be NULL
 */
 hull_t *Mod_HullForStudio( model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *pcontroller, byte *pblending, int *numhitboxes, edict_t *pEdict )
 {
-	vec3_t		angles2;
-	mstudiocache_t	*bonecache;
-	mstudiobbox_t	*phitbox;
-	int		i, j;
+	mstudiopose_t	*pose = NULL;
+	mstudiobox_t	*boxes;
+	mplane_t		*pl;
+	int		i, j, numboxes;
+	qboolean		found = false;
 	qboolean bSkipShield = 0;
 
 	ASSERT( numhitboxes );
@@ -216,62 +234,200 @@ hull_t *Mod_HullForStudio( model_t *model, float frame, int sequence, vec3_t ang
 	if((sv_skipshield->integer == 1 && pEdict && pEdict->v.gamestate == 1) || sv_skipshield->integer == 2)
 		bSkipShield = 1;
 
-	if( mod_studiocache->integer )
+	if( mod_studiocache->integer && pEdict != NULL )
+		pose = Mod_CheckStudioPose( NUM_FOR_EDICT( pEdict ), model, frame, sequence, angles, origin, pcontroller, pblending, &found );
+
+	if( found )
+	{
+		boxes = &cache_boxes[pose->firstbox];
+		numboxes = pose->numboxes;
+	}
+	else
 	{
-		bonecache = Mod_CheckStudioCache( model, frame, sequence, angles, origin, size, pcontroller, pblending );
+		boxes = studio_boxes;
+		numboxes = -1;
 
-		if( bonecache != NULL )
+		if( pose != NULL )
 		{
-			Q_memcpy( studio_planes, &cache_planes[bonecache->current_plane], bonecache->numhitboxes * sizeof( mplane_t ) * 6 );
-			Q_memcpy( studio_hull_hitgroup, &cache_hull_hitgroup[bonecache->current_hull], bonecache->numhitboxes * sizeof( uint32_t ));
-			Q_memcpy( studio_hull, &cache_hull[bonecache->current_hull], bonecache->numhitboxes * sizeof( hull_t ));
+			// remember the pose while the frame has room for it
+			numboxes = Mod_SetupStudioBoxes( model, frame, sequence, angles, origin, pcontroller, pblending,
+				pEdict, &cache_boxes[cache_numboxes], STUDIO_MAXBOXES - cache_numboxes );
 
-			*numhitboxes = bonecache->numhitboxes;
-			return studio_hull;
+			if( numboxes > 0 )
+			{
+				pose->framecount = cache_framecount;
+				pose->entnum = NUM_FOR_EDICT( pEdict );
+				pose->model = model;
+				pose->frame = frame;
+				pose->sequence = sequence;
+				VectorCopy( angles, pose->angles );
+				VectorCopy( origin, pose->origin );
+				Q_memcpy( pose->controler, pcontroller, 4 );
+				Q_memcpy( pose->blending, pblending, 2 );
+				pose->firstbox = cache_numboxes;
+				pose->numboxes = numboxes;
+
+				boxes = &cache_boxes[cache_numboxes];
+				cache_numboxes += numboxes;
+			}
 		}
+
+		if( numboxes <= 0 )
+			numboxes = Mod_SetupStudioBoxes( model, frame, sequence, angles, origin, pcontroller, pblending, pEdict, studio_boxes, MAXSTUDIOBONES );
 	}
 
-	mod_studiohdr = Mod_Extradata( model );
-	if( !mod_studiohdr ) return NULL; // probably not a studiomodel
+	if( numboxes < 0 ) return NULL;
 
-	ASSERT( pBlendAPI != NULL );
+	// apply the trace size to the placed hitboxes
+	for( i = 0, pl = studio_planes; i < numboxes; i++ )
+	{
+		studio_hull_hitgroup[i] = boxes[i].group;
 
-	VectorCopy( angles, angles2 );
+		for( j = 0; j < 3; j++, pl += 2 )
+		{
+			pl[0].type = pl[1].type = 5;
+			VectorCopy( boxes[i].normal[j], pl[0].normal );
+			VectorCopy( boxes[i].normal[j], pl[1].normal );
+			pl[0].dist = boxes[i].distmax[j];
+			pl[1].dist = boxes[i].distmin[j];
+
+			pl[0].dist += DotProductFabs( pl[0].normal, size );
+			pl[1].dist -= DotProductFabs( pl[1].normal, size );
+
+			studio_cullnormal[j][0][i] = pl[0].normal[0];
+			studio_cullnormal[j][1][i] = pl[0].normal[1];
+			studio_cullnormal[j][2][i] = pl[0].normal[2];
+			studio_cullmax[j][i] = pl[0].dist + STUDIO_CULL_EPSILON;
+			studio_cullmin[j][i] = pl[1].dist - STUDIO_CULL_EPSILON;
+		}
+	}
 
-	if( !( host.features & ENGINE_COMPENSATE_QUAKE_BUG ))
-		angles2[PITCH] = -angles2[PITCH]; // stupid quake bug
+	studio_numcull = numboxes;
 
-	pBlendAPI->SV_StudioSetupBones( model, frame, sequence, angles2, origin, pcontroller, pblending, -1, pEdict );
-	phitbox = (mstudiobbox_t *)((byte *)mod_studiohdr + mod_studiohdr->hitboxindex);
+	// tell trace code about hitbox count
+	*numhitboxes = (bSkipShield == true) ? numboxes - 1 : numboxes;
 
-	for( i = j = 0; i < mod_studiohdr->numhitboxes; i++, j += 6 )
+	return studio_hull;
+}
+
+#if defined( __SSE__ ) || defined( _M_IX86_FP ) || defined( __SSE2__ )
+#include <xmmintrin.h>
+
+/*
+====================
+Mod_CullStudioBoxes4
+
+slab test of the segment against four hitboxes, bit is set for
+every hitbox the segment may reach
+====================
+*/
+static int Mod_CullStudioBoxes4( int first, const vec3_t start, const vec3_t delta )
+{
+	__m128	enter = _mm_setzero_ps();
+	__m128	leave = _mm_set1_ps( 1.0f );
+	__m128	tiny = _mm_set1_ps( 1e-6f );
+	__m128	p, d, lo, hi, t0, t1, parallel;
+	int	j;
+
+	for( j = 0; j < 3; j++ )
 	{
-		studio_hull_hitgroup[i] = phitbox[i].group;
-
-		Mod_SetStudioHullPlane( &studio_planes[j+0], phitbox[i].bone, 0, phitbox[i].bbmax[0] );
-		Mod_SetStudioHullPlane( &studio_planes[j+1], phitbox[i].bone, 0, phitbox[i].bbmin[0] );
-		Mod_SetStudioHullPlane( &studio_planes[j+2], phitbox[i].bone, 1, phitbox[i].bbmax[1] );
-		Mod_SetStudioHullPlane( &studio_planes[j+3], phitbox[i].bone, 1, phitbox[i].bbmin[1] );
-		Mod_SetStudioHullPlane( &studio_planes[j+4], phitbox[i].bone, 2, phitbox[i].bbmax[2] );
-		Mod_SetStudioHullPlane( &studio_planes[j+5], phitbox[i].bone, 2, phitbox[i].bbmin[2] );
-
-		studio_planes[j+0].dist += DotProductFabs( studio_planes[j+0].normal, size );
-		studio_planes[j+1].dist -= DotProductFabs( studio_planes[j+1].normal, size );
-		studio_planes[j+2].dist += DotProductFabs( studio_planes[j+2].normal, size );
-		studio_planes[j+3].dist -= DotProductFabs( studio_planes[j+3].normal, size );
-		studio_planes[j+4].dist += DotProductFabs( studio_planes[j+4].normal, size );
-		studio_planes[j+5].dist -= DotProductFabs( studio_planes[j+5].normal, size );
+		__m128	nx = _mm_loadu_ps( &studio_cullnormal[j][0][first] );
+		__m128	ny = _mm_loadu_ps( &studio_cullnormal[j][1][first] );
+		__m128	nz = _mm_loadu_ps( &studio_cullnormal[j][2][first] );
+
+		p = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, _mm_set1_ps( start[0] )), _mm_mul_ps( ny, _mm_set1_ps( start[1] ))), _mm_mul_ps( nz, _mm_set1_ps( start[2] )));
+		d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, _mm_set1_ps( delta[0] )), _mm_mul_ps( ny, _mm_set1_ps( delta[1] ))), _mm_mul_ps( nz, _mm_set1_ps( delta[2] )));
+
+		// parallel to the slab, any tiny step keeps the test conservative
+		parallel = _mm_cmplt_ps( _mm_max_ps( d, _mm_sub_ps( _mm_setzero_ps(), d )), tiny );
+		d = _mm_or_ps( _mm_and_ps( parallel, tiny ), _mm_andnot_ps( parallel, d ));
+
+		lo = _mm_sub_ps( _mm_loadu_ps( &studio_cullmin[j][first] ), p );
+		hi = _mm_sub_ps( _mm_loadu_ps( &studio_cullmax[j][first] ), p );
+		t0 = _mm_div_ps( lo, d );
+		t1 = _mm_div_ps( hi, d );
+
+		enter = _mm_max_ps( enter, _mm_min_ps( t0, t1 ));
+		leave = _mm_min_ps( leave, _mm_max_ps( t0, t1 ));
 	}
 
-	// tell trace code about hitbox count
-	*numhitboxes = (bSkipShield == true) ? mod_studiohdr->numhitboxes - 1 : mod_studiohdr->numhitboxes;
+	return _mm_movemask_ps( _mm_cmple_ps( enter, leave ));
+}
+#else
+static int Mod_CullStudioBoxes4( int first, const vec3_t start, const vec3_t delta )
+{
+	float	enter[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float	leave[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	float	p, d, t0, t1;
+	int	i, j, bits = 0;
+
+	for( j = 0; j < 3; j++ )
+	{
+		for( i = 0; i < 4; i++ )
+		{
+			const float	*nx = &studio_cullnormal[j][0][first];
+			const float	*ny = &studio_cullnormal[j][1][first];
+			const float	*nz = &studio_cullnormal[j][2][first];
+
+			p = nx[i] * start[0] + ny[i] * start[1] + nz[i] * start[2];
+			d = nx[i] * delta[0] + ny[i] * delta[1] + nz[i] * delta[2];
+
+			// parallel to the slab, any tiny step keeps the test conservative
+			if( fabs( d ) < 1e-6f ) d = 1e-6f;
+
+			t0 = ( studio_cullmin[j][first+i] - p ) / d;
+			t1 = ( studio_cullmax[j][first+i] - p ) / d;
 
-	if( mod_studiocache->integer )
+			enter[i] = max( enter[i], min( t0, t1 ));
+			leave[i] = min( leave[i], max( t0, t1 ));
+		}
+	}
+
+	for( i = 0; i < 4; i++ )
 	{
-		Mod_AddToStudioCache( frame, sequence, angles, origin, size, pcontroller, pblending, model, studio_hull, *numhitboxes );
+		if( enter[i] <= leave[i] )
+			bits |= BIT( i );
 	}
 
-	return studio_hull;
+	return bits;
+}
+#endif
+
+/*
+====================
+Mod_StudioHitboxMask
+
+mark the hitboxes of the last Mod_HullForStudio call the segment may
+touch. The boxes are slightly enlarged, so skipping unmarked hitboxes
+never changes the trace result
+====================
+*/
+void Mod_StudioHitboxMask( const vec3_t start, const vec3_t end, int numhitboxes, byte *mask )
+{
+	vec3_t	delta;
+	int	i, j, bits;
+
+	if( numhitboxes <= 0 )
+		return;
+
+	if( !mod_studiocache->integer )
+	{
+		// reference path, trace every hitbox
+		Q_memset( mask, true, numhitboxes );
+		return;
+	}
+
+	VectorSubtract( end, start, delta );
+	numhitboxes = min( numhitboxes, studio_numcull );
+
+	for( i = 0; i < numhitboxes; i += 4 )
+	{
+		// tail lanes read stale hitboxes, they are ignored below
+		bits = Mod_CullStudioBoxes4( i, start, delta );
+
+		for( j = 0; j < 4 && i + j < numhitboxes; j++ )
+			mask[i+j] = ( bits & BIT( j )) ? true : false;
+	}
 }
 
 /*
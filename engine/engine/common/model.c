@@ -36,6 +36,8 @@ static byte	visdata[MAX_MAP_LEAFS/8];	// intermediate buffer
 int		bmodel_version;		// global stuff to detect bsp version
 char		modelname[64];		// short model name (without path and ext)
 convar_t		*mod_studiocache;
+convar_t		*mod_vismemory;
+convar_t		*mod_buildpas;
 convar_t		*mod_allow_materials;
 convar_t		*r_wadtextures;
 static wadlist_t	wadlist;
@@ -324,6 +326,8 @@ byte *Mod_LeafPVS( mleaf_t *leaf, model_t *model )
 {
 	if( !model || !leaf || leaf == model->leafs || !model->visdata )
 		return Mod_DecompressVis( NULL );
+	if( world.visrows && model->leafs == world.visleafs )
+		return world.visrows + ( leaf - model->leafs ) * world.visrowbytes;
 	return Mod_DecompressVis( leaf->compressed_vis );
 }
 
@@ -337,6 +341,8 @@ byte *Mod_LeafPHS( mleaf_t *leaf, model_t *model )
 {
 	if( !model || !leaf || leaf == model->leafs || !model->visdata )
 		return Mod_DecompressVis( NULL );
+	if( world.pasrows && model->leafs == world.visleafs )
+		return world.pasrows + ( leaf - model->leafs ) * world.visrowbytes;
 	return Mod_DecompressVis( leaf->compressed_pas );
 }
 
@@ -460,6 +466,72 @@ qboolean Mod_BoxVisible( const vec3_t mins, const vec3_t maxs, const byte *visbi
 	return false;
 }
 
+/*
+=============
+Mod_VisWord
+
+32 leaf bits from a vis row, never reads past the row
+=============
+*/
+_inline uint32_t Mod_VisWord( const byte *visbits, int word, int rowbytes )
+{
+	int	ofs = word << 2;
+
+	if( ofs + 4 <= rowbytes )
+		return visbits[ofs] | ( visbits[ofs+1] << 8 ) | ( visbits[ofs+2] << 16 ) | ( (uint32_t)visbits[ofs+3] << 24 );
+
+	return ( ofs + 0 < rowbytes ? visbits[ofs+0] : 0 )
+		| ( ofs + 1 < rowbytes ? visbits[ofs+1] << 8 : 0 )
+		| ( ofs + 2 < rowbytes ? visbits[ofs+2] << 16 : 0 );
+}
+
+/*
+=============
+Mod_HeadnodeVisible
+
+Test all the non-solid leafs under world node against
+vis row by words. Returns -1 if node has no leaf range
+=============
+*/
+int Mod_HeadnodeVisible( mnode_t *node, const byte *visbits, int *lastleaf )
+{
+	int	first, last, rowbytes;
+	int	w, leafnum;
+	uint32_t	bits;
+
+	if( !world.visnodes || !worldmodel || !node || worldmodel->leafs != world.visleafs )
+		return -1;
+
+	if( node->contents < 0 || node < worldmodel->nodes || node >= worldmodel->nodes + worldmodel->numnodes )
+		return -1;
+
+	first = world.visnodes[(node - worldmodel->nodes) * 2 + 0];
+	last = world.visnodes[(node - worldmodel->nodes) * 2 + 1];
+
+	// not a part of world tree
+	if( first == -1 ) return -1;
+
+	rowbytes = (worldmodel->numleafs + 7) >> 3;
+
+	// rows are 1 based, like leafnums
+	for( w = first >> 5; w <= last >> 5; w++ )
+	{
+		bits = Mod_VisWord( visbits, w, rowbytes ) & world.visopen[w];
+		if( w == first >> 5 ) bits &= ~0U << ( first & 31 );
+		if( w == last >> 5 ) bits &= ~0U >> ( 31 - ( last & 31 ));
+		if( !bits ) continue;
+
+		// lowest leaf is the first one in tree order
+		for( leafnum = w << 5; !( bits & 1 ); bits >>= 1 )
+			leafnum++;
+
+		if( lastleaf ) *lastleaf = leafnum;
+		return true;
+	}
+
+	return false;
+}
+
 /*
 ==================
 Mod_AmbientLevels
@@ -539,6 +611,8 @@ void Mod_Init( void )
 {
 	com_studiocache = Mem_AllocPool( "Studio Cache" );
 	mod_studiocache = Cvar_Get( "r_studiocache", "1", CVAR_ARCHIVE, "enables studio cache for speedup tracing hitboxes" );
+	mod_vismemory = Cvar_Get( "mod_vismemory", "0", CVAR_ARCHIVE, "megabytes allowed for uncompressed PVS and PAS rows, 0 is disabled" );
+	mod_buildpas = Cvar_Get( "mod_buildpas", "0", CVAR_ARCHIVE, "build the PAS on map load, sounds and MSG_PAS messages are culled by it then" );
 	r_wadtextures = Cvar_Get( "r_wadtextures", "1", CVAR_ARCHIVE, "completely ignore textures in the wad-files if disabled" );
 
 	if( !Host_IsDedicated() )
@@ -2371,6 +2445,54 @@ static void Mod_LoadEntities( const dlump_t *l )
 	return;	// all done
 }
 
+/*
+=================
+Mod_PackHull
+
+copy world clipnodes with their planes into a compact
+array, so the trace kernel reads one record per node
+=================
+*/
+static void Mod_PackHull( int index, hull_t *hull, int count )
+{
+	mhullnode_t	*out;
+	mplane_t		*plane;
+	int		i;
+
+	if( !world.loading || count <= 0 )
+		return;
+
+	out = Mem_Alloc( loadmodel->mempool, count * sizeof( *out ));
+
+	for( i = 0; i < count; i++ )
+	{
+		plane = hull->planes + hull->clipnodes[i].planenum;
+		out[i].children[0] = hull->clipnodes[i].children[0];
+		out[i].children[1] = hull->clipnodes[i].children[1];
+		out[i].dist = plane->dist;
+		out[i].plane = ( hull->clipnodes[i].planenum << 2 ) | min( plane->type, 3 );
+	}
+
+	world.hullsource[index] = hull->clipnodes;
+	world.hullnodes[index] = out;
+}
+
+/*
+=================
+Mod_PackedHull
+
+returns packed nodes for world hulls or NULL
+=================
+*/
+const mhullnode_t *Mod_PackedHull( const hull_t *hull )
+{
+	if( hull->clipnodes == world.hullsource[1] )
+		return world.hullnodes[1];
+	if( hull->clipnodes == world.hullsource[0] )
+		return world.hullnodes[0];
+	return NULL;
+}
+
 /*
 =================
 Mod_LoadClipnodes
@@ -2425,6 +2547,8 @@ static void Mod_LoadClipnodes( const dlump_t *l )
 		out->children[0] = LittleShort(in->children[0]);
 		out->children[1] = LittleShort(in->children[1]);
 	}
+
+	Mod_PackHull( 1, &loadmodel->hulls[1], count );
 }
 
 /*
@@ -2523,6 +2647,87 @@ static void Mod_MakeHull0( void )
 			else out->children[j] = child - loadmodel->nodes;
 		}
 	}
+
+	Mod_PackHull( 0, hull, count );
+}
+
+typedef struct
+{
+	byte		*uncompressed_vis;
+	byte		*uncompressed_pas;
+	int		*vcounts;		// visible leafs per row
+	int		*hcounts;		// audible leafs per row
+	int		num;
+	int		rowwords;
+} phsjob_t;
+
+#define PHS_JOB_ROWS	64	// rows per job
+
+static int Mod_CountRowBits( const byte *row, int num )
+{
+	int	j, count = 0;
+
+	for( j = 0; j < num; j++ )
+	{
+		if( row[j>>3] & (1<<( j & 7 )))
+			count++;
+	}
+
+	return count;
+}
+
+/*
+=================
+Mod_CalcPHSJob
+
+build PHS rows [index * PHS_JOB_ROWS, index * PHS_JOB_ROWS + PHS_JOB_ROWS)
+each row reads only uncompressed PVS so jobs are independent
+=================
+*/
+static void Mod_CalcPHSJob( void *data, int index )
+{
+	phsjob_t	*job = (phsjob_t *)data;
+	int	rowbytes = job->rowwords * 4;
+	int	i, j, k, l, bitbyte;
+	int	start, end, leafnum;
+	uint32_t	*dest, *src;
+	byte	*scan;
+
+	start = index * PHS_JOB_ROWS;
+	end = min( start + PHS_JOB_ROWS, job->num );
+
+	for( i = start; i < end; i++ )
+	{
+		scan = job->uncompressed_vis + i * rowbytes;
+		dest = (uint32_t *)job->uncompressed_pas + i * job->rowwords;
+
+		Q_memcpy( dest, scan, rowbytes );
+
+		for( j = 0; j < rowbytes; j++ )
+		{
+			bitbyte = scan[j];
+			if( !bitbyte ) continue;
+
+			for( k = 0; k < 8; k++ )
+			{
+				if(!( bitbyte & ( 1<<k )))
+					continue;
+				// or this pvs row into the phs
+				// +1 because pvs is 1 based
+				leafnum = ((j<<3) + k + 1);
+				if( leafnum >= job->num ) continue;
+
+				src = (uint32_t *)job->uncompressed_vis + leafnum * job->rowwords;
+				for( l = 0; l < job->rowwords; l++ )
+					dest[l] |= src[l];
+			}
+		}
+
+		if( i == 0 ) continue;
+
+		job->vcounts[i] = Mod_CountRowBits( scan, job->num );
+		job->hcounts[i] = Mod_CountRowBits( (byte *)dest, job->num );
+	}
 }
 
 /*
@@ -2533,18 +2738,16 @@ Mod_CalcPHS
 void Mod_CalcPHS( void )
 {
 	int	hcount, vcount;
-	int	i, j, k, l, index, num;
+	int	i, num, numjobs;
 	int	rowbytes, rowwords;
-	int	bitbyte, rowsize = 0;
+	int	rowsize = 0;
 	int	*visofs, total_size = 0;
 	byte	*vismap, *vismap_p;
-	byte	*uncompressed_vis;
-	byte	*uncompressed_pas;
 	byte	*compressed_pas;
 	byte	*scan, *comp;
-	uint32_t	*dest, *src;
-	double	timestart;
+	double	timestart, timejobs;
 	size_t	phsdatasize;
+	phsjob_t	job;
 
 	// no worldmodel or no visdata
 	if( !world.loading || !worldmodel || !worldmodel->visdata )
@@ -2564,58 +2767,34 @@ void Mod_CalcPHS( void )
 	phsdatasize = world.visdatasize * 32; // empirically determined
 
 	// allocate pvs and phs data single array
-	visofs = Mem_Alloc( worldmodel->mempool, num * sizeof( int ));
-	uncompressed_vis = Mem_Alloc( worldmodel->mempool, rowbytes * num * 2 );
-	uncompressed_pas = uncompressed_vis + rowbytes * num;
+	visofs = Mem_Alloc( worldmodel->mempool, num * sizeof( int ) * 3 );
+	job.uncompressed_vis = Mem_Alloc( worldmodel->mempool, rowbytes * num * 2 );
+	job.uncompressed_pas = job.uncompressed_vis + rowbytes * num;
+	job.vcounts = visofs + num;
+	job.hcounts = visofs + num * 2;
+	job.rowwords = rowwords;
+	job.num = num;
 	compressed_pas = Mem_Alloc( worldmodel->mempool, phsdatasize );
 	vismap = vismap_p = compressed_pas; // compressed PHS buffer
-	scan = uncompressed_vis;
-	vcount = 0;
+	scan = job.uncompressed_vis;
 
-	// uncompress pvs first
+	// uncompress pvs first (decompression uses a shared buffer)
 	for( i = 0; i < num; i++, scan += rowbytes )
-	{
 		Q_memcpy( scan, Mod_LeafPVS( worldmodel->leafs + i, worldmodel ), rowbytes );
-		if( i == 0 ) continue;
 
-		for( j = 0; j < num; j++ )
-		{
-			if( scan[j>>3] & (1<<( j & 7 )))
-				vcount++;
-		}
-	}
-
-	scan = uncompressed_vis;
-	hcount = 0;
+	// build phs rows in parallel
+	timejobs = Sys_DoubleTime();
+	numjobs = ( num + PHS_JOB_ROWS - 1 ) / PHS_JOB_ROWS;
+	Sys_RunJobs( Mod_CalcPHSJob, &job, numjobs );
+	timejobs = Sys_DoubleTime() - timejobs;
 
-	dest = (uint32_t *)uncompressed_pas;
+	scan = job.uncompressed_pas;
+	hcount = vcount = 0;
 
-	for( i = 0; i < num; i++, dest += rowwords, scan += rowbytes )
+	// compress PHS data back in leaf order
+	for( i = 0; i < num; i++, scan += rowbytes )
 	{
-		Q_memcpy( dest, scan, rowbytes );
-
-		for( j = 0; j < rowbytes; j++ )
-		{
-			bitbyte = scan[j];
-			if( !bitbyte ) continue;
-
-			for( k = 0; k < 8; k++ )
-			{
-				if(!( bitbyte & ( 1<<k )))
-					continue;
-				// or this pvs row into the phs
-				// +1 because pvs is 1 based
-				index = ((j<<3) + k + 1);
-				if( index >= num ) continue;
-
-				src = (uint32_t *)uncompressed_vis + index * rowwords;
-				for( l = 0; l < rowwords; l++ )
-					dest[l] |= src[l];
-			}
-		}
-
-		// compress PHS data back
-		comp = Mod_CompressVis( (byte *)dest, (size_t *)&rowsize );
+		comp = Mod_CompressVis( scan, (size_t *)&rowsize );
 		visofs[i] = vismap_p - vismap; // leaf 0 is a common solid 
 		total_size += rowsize;
 
@@ -2627,13 +2806,8 @@ void Mod_CalcPHS( void )
 		Q_memcpy( vismap_p, comp, rowsize );
 		vismap_p += rowsize; // move pointer
 
-		if( i == 0 ) continue;
-
-		for( j = 0; j < num; j++ )
-		{
-			if(((byte *)dest)[j>>3] & (1<<( j & 7 )))
-				hcount++;
-		}
+		vcount += job.vcounts[i];
+		hcount += job.hcounts[i];
 	}
 
 	// adjust compressed pas data to fit the size
@@ -2644,14 +2818,140 @@ void Mod_CalcPHS( void )
 		worldmodel->leafs[i].compressed_pas = compressed_pas + visofs[i];
 
 	// release uncompressed data
-	Mem_Free( uncompressed_vis );
-	Mem_Free( visofs );	// release vis offsets
+	Mem_Free( job.uncompressed_vis );
+	Mem_Free( visofs );	// release vis offsets and counters
 
 	// NOTE: we don't need to store off pointer to compressed pas-data
 	// because this is will be automatiaclly frees by mempool internal pointer
 	// and we never use this pointer after this point
 	MsgDev( D_NOTE, "Average leaves visible / audible / total: %i / %i / %i\n", vcount / num, hcount / num, num );
-	MsgDev( D_NOTE, "PAS building time: %g secs\n", Sys_DoubleTime() - timestart );
+	MsgDev( D_NOTE, "PAS building time: %g secs (rows %g secs on %i threads)\n", Sys_DoubleTime() - timestart, timejobs, Sys_NumWorkers() + 1 );
+}
+
+/*
+=================
+Mod_NumberNodeLeafs_r
+
+store first and last leaf for each world node, returns false
+if leafs are not numbered in tree order
+=================
+*/
+static qboolean Mod_NumberNodeLeafs_r( mnode_t *node, int *nextleaf )
+{
+	int	index, first;
+
+	if( node->contents < 0 )
+	{
+		mleaf_t	*leaf = (mleaf_t *)node;
+
+		// common solid leaf is shared by many nodes
+		if( leaf == worldmodel->leafs )
+			return true;
+
+		if( leaf - worldmodel->leafs - 1 != *nextleaf )
+			return false;
+
+		if( leaf->contents != CONTENTS_SOLID )
+			world.visopen[*nextleaf >> 5] |= BIT( *nextleaf & 31 );
+		(*nextleaf)++;
+		return true;
+	}
+
+	index = node - worldmodel->nodes;
+	first = *nextleaf;
+
+	if( !Mod_NumberNodeLeafs_r( node->children[0], nextleaf ))
+		return false;
+	if( !Mod_NumberNodeLeafs_r( node->children[1], nextleaf ))
+		return false;
+
+	world.visnodes[index * 2 + 0] = first;
+	world.visnodes[index * 2 + 1] = *nextleaf - 1;
+
+	return true;
+}
+
+/*
+=================
+Mod_BuildVisRows
+
+keep uncompressed PVS and PAS rows of the world in
+a single aligned arena if they fit into mod_vismemory
+=================
+*/
+void Mod_BuildVisRows( void )
+{
+	int	i, num, rowbytes, visbytes;
+	int	numrows, nextleaf;
+	size_t	size, limit;
+	qboolean	haspas;
+	double	timestart;
+	byte	*arena;
+
+	world.visrows = world.pasrows = NULL;
+	world.visnodes = NULL;
+	world.visopen = NULL;
+	world.visleafs = NULL;
+	world.visrowbytes = 0;
+
+	if( !worldmodel || !worldmodel->visdata || !mod_vismemory || mod_vismemory->value <= 0.0f )
+		return;
+
+	timestart = Sys_DoubleTime();
+	num = worldmodel->numleafs;
+
+	// padded to the fatpvs size and 16 bytes to allow wide ops on rows
+	visbytes = (num + 7) >> 3;
+	rowbytes = (((num + 31) >> 3) + 15) & ~15;
+	haspas = ( num > 1 && worldmodel->leafs[1].compressed_pas != NULL );
+	numrows = haspas ? num * 2 : num;
+
+	size = (size_t)rowbytes * numrows;
+	size += worldmodel->numnodes * 2 * sizeof( int );
+	size += rowbytes;	// open leafs mask
+	limit = (size_t)( mod_vismemory->value * 1024.0f * 1024.0f );
+
+	if( size > limit )
+	{
+		MsgDev( D_INFO, "Mod_BuildVisRows: %s required, mod_vismemory allows %s\n", Q_memprint( size ), Q_memprint( limit ));
+		return;
+	}
+
+	arena = Mem_Alloc( worldmodel->mempool, size + 15 );
+	arena = (byte *)(((size_t)arena + 15) & ~15);
+
+	world.visrows = arena;
+	if( haspas ) world.pasrows = arena + (size_t)rowbytes * num;
+	world.visopen = (uint32_t *)( arena + (size_t)rowbytes * numrows );
+	world.visnodes = (int *)( arena + (size_t)rowbytes * ( numrows + 1 ));
+
+	// NOTE: rows are filled through the decompression buffer, so
+	// Mod_LeafPVS must not see the arena yet (world.visleafs is NULL)
+	for( i = 0; i < num; i++ )
+	{
+		Q_memcpy( world.visrows + (size_t)rowbytes * i, Mod_LeafPVS( worldmodel->leafs + i, worldmodel ), visbytes );
+		if( haspas ) Q_memcpy( world.pasrows + (size_t)rowbytes * i, Mod_LeafPHS( worldmodel->leafs + i, worldmodel ), visbytes );
+	}
+
+	for( i = 0; i < worldmodel->numnodes; i++ )
+	{
+		world.visnodes[i * 2 + 0] = -1;
+		world.visnodes[i * 2 + 1] = -1;
+	}
+
+	nextleaf = 0;
+
+	if( !Mod_NumberNodeLeafs_r( worldmodel->nodes, &nextleaf ))
+	{
+		// leafs are not in tree order, node ranges are useless
+		MsgDev( D_NOTE, "Mod_BuildVisRows: leafs are not sorted, node ranges disabled\n" );
+		world.visnodes = NULL;
+	}
+
+	world.visrowbytes = rowbytes;
+	world.visleafs = worldmodel->leafs;
+
+	MsgDev( D_INFO, "Vis rows: %s for %i leafs, building time: %g secs\n", Q_memprint( size ), num, Sys_DoubleTime() - timestart );
 }
 
 /*
@@ -2673,6 +2973,24 @@ void Mod_UnloadBrushModel( model_t *mod )
 
 	if( mod->name[0] != '*' )
 	{
+		// packed hulls are in the model mempool
+		for( i = 0; i < 2; i++ )
+		{
+			if( !world.hullsource[i] ) continue;
+			if( world.hullsource[i] != mod->clipnodes && world.hullsource[i] != mod->hulls[0].clipnodes )
+				continue;
+			world.hullsource[i] = NULL;
+			world.hullnodes[i] = NULL;
+		}
+
+		// vis rows are in the model mempool too
+		if( world.visleafs && world.visleafs == mod->leafs )
+		{
+			world.visrows = world.pasrows = NULL;
+			world.visnodes = NULL;
+			world.visopen = NULL;
+			world.visleafs = NULL;
+		}
 #ifndef XASH_DEDICATED
 		for( i = 0; i < mod->numtextures; i++ )
 		{
@@ -3027,6 +3345,8 @@ Loads in the map and all submodels
 */
 void Mod_LoadWorld( const char *name, uint32_t *checksum, qboolean multiplayer )
 {
+	double	timestart, timeload;
+	double	timecrc, timephs;
 	int	i;
 
 	// now replacement table is invalidate
@@ -3067,15 +3387,27 @@ void Mod_LoadWorld( const char *name, uint32_t *checksum, qboolean multiplayer )
 	world.load_sequence++;	// now all models are invalid
 
 	// load the newmap
+	timestart = Sys_DoubleTime();
 	world.loading = true;
 	worldmodel = Mod_ForName( name, true );
+	timeload = Sys_DoubleTime();
 	CRC32_MapFile( (uint32_t *)&world.checksum, worldmodel->name, multiplayer );
-	world.loading = false;
+	timecrc = Sys_DoubleTime();
 
 	if( checksum ) *checksum = world.checksum;
 		
-	// calc Potentially Hearable Set and compress it
-	Mod_CalcPHS();
+	// calc Potentially Hearable Set and compress it, without it
+	// Mod_LeafPHS sees everything and nothing is culled by PAS
+	// NOTE: Mod_CalcPHS works only while world is loading
+	if( mod_buildpas->integer ) Mod_CalcPHS();
+	timephs = Sys_DoubleTime();
+	world.loading = false;
+
+	// keep uncompressed rows if allowed
+	Mod_BuildVisRows();
+
+	MsgDev( D_INFO, "Mod_LoadWorld: %s loaded in %g secs (bsp %g, crc %g, pas %g, vis rows %g)\n", name,
+		Sys_DoubleTime() - timestart, timeload - timestart, timecrc - timeload, timephs - timecrc, Sys_DoubleTime() - timephs );
 }
 
 /*
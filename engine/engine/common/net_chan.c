@@ -94,11 +94,19 @@ convar_t	*net_qport;
 
 int	net_drop;
 netadr_t	net_from;
+double	net_recvtime;
 netadr_t	net_local;
 sizebuf_t	net_message;
 byte	*net_mempool;
 byte	net_message_buffer[NET_MAX_PAYLOAD];
 
+#define MAX_FRAGBUF_POOL	1024	// keep that many released fragbufs around
+#define MAX_FRAGSOURCE_LOAD	(1024 * 1024)	// bigger files are streamed instead of loaded
+
+static fragbuf_t	*net_fragpool;	// free list of fragbufs
+static int	net_fragpoolsize;
+static fragsource_t	*net_fragsources;	// sources with live fragments
+
 /*
 =================================
 
@@ -115,7 +123,7 @@ Collect fragmrnts with signature 0xFFFFFFFE to single packet
 return true when got full packet
 ======================
 */
-qboolean NetSplit_GetLong( netsplit_t *ns, netadr_t *from, byte *data, size_t *length, qboolean decompress )
+qboolean NetSplit_GetLong( netsplit_t *ns, netadr_t *from, byte *data, size_t *length, int codec )
 {
 	netsplit_packet_t *packet = (netsplit_packet_t*)data;
 	netsplit_chain_packet_t * p;
@@ -181,14 +189,23 @@ qboolean NetSplit_GetLong( netsplit_t *ns, netadr_t *from, byte *data, size_t *l
 
 		ns->total_received += len;
 
-		if( decompress )
-			Huff_DecompressData( p->data, &len );
+		if( codec )
+		{
+			int	outLen = Netchan_DecompressData( codec, p->data, len, data, NET_MAX_PAYLOAD );
+
+			if( outLen < 0 )
+			{
+				MsgDev( D_WARN, "NetSplit_GetLong: corrupted packet from %s\n", NET_AdrToString( *from ));
+				return false;
+			}
+			len = outLen;
+		}
+		else Q_memcpy( data, p->data, len );
 
 		ns->total_received_uncompressed += len;
 		*length = len;
 
 		// MsgDev( D_NOTE, "NetSplit_GetLong: packet from %s, id %d received %d length %d\n", NET_AdrToString( *from ), (int)packet->id, (int)p->received, (int)packet->length );
-		Q_memcpy( data, p->data, len );
 		return true;
 	}
 	else
@@ -205,13 +222,25 @@ NetSplit_SendLong
 Send parts that are less or equal maxpacket
 ======================
 */
-void NetSplit_SendLong( netsrc_t sock, size_t length, void *data, netadr_t to, uint32_t maxpacket, uint32_t id, qboolean compress )
+void NetSplit_SendLong( netsrc_t sock, size_t length, void *data, netadr_t to, uint32_t maxpacket, uint32_t id, int codec )
 {
 	netsplit_packet_t packet = {0};
 	uint32_t part = maxpacket - NETSPLIT_HEADER_SIZE;
+	static byte buffer[NET_MAX_PAYLOAD + NET_CODEC_OVERHEAD];	// caller has the payload on stack already
 
-	if( compress )
-		Huff_CompressData( data, &length );
+	if( codec )
+	{
+		size_t outLen = Netchan_CompressData( codec, data, length, buffer, sizeof( buffer ));
+
+		if( !outLen )
+		{
+			MsgDev( D_ERROR, "NetSplit_SendLong: overflow\n" );
+			return;
+		}
+
+		data = buffer;
+		length = outLen;
+	}
 
 	packet.signature = LittleLong(0xFFFFFFFE);
 	packet.id = LittleLong(id);
@@ -239,6 +268,311 @@ void NetSplit_SendLong( netsrc_t sock, size_t length, void *data, netadr_t to, u
 
 }
 
+/*
+=================================
+
+NETWORK PAYLOAD COMPRESSION
+
+=================================
+*/
+static const char *net_codecnames[NET_CODEC_COUNT] = { "none", "huffman", "static huffman", "lz" };
+static file_t *net_capture;	// outgoing packets are recorded here for net_codecbench
+
+/*
+==============================
+Netchan_CompressData
+
+compress buffer with selected codec, out must have room for NET_MAX_PAYLOAD
+bytes when adaptive huffman is used. Returns output length or 0 on overflow
+==============================
+*/
+size_t Netchan_CompressData( int codec, const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	size_t	outLen;
+
+	switch( codec )
+	{
+	case NET_CODEC_HUFF:
+		// length is stored in 16 bits
+		if( !inLen || inLen > 0xFFFF || inLen > maxOut )
+			return 0;
+		Q_memmove( out, in, inLen );
+		outLen = inLen;
+		Huff_CompressData( out, &outLen );
+		return outLen;
+	case NET_CODEC_HUFF_STATIC:
+		return Huff_CompressStatic( in, inLen, out, maxOut );
+	case NET_CODEC_LZ:
+		return LZ_CompressBlock( in, inLen, out, maxOut );
+	default:
+		if( inLen > maxOut )
+			return 0;
+		Q_memmove( out, in, inLen );
+		return inLen;
+	}
+}
+
+/*
+==============================
+Netchan_DecompressData
+
+Returns decompressed length or -1 on corrupted data
+==============================
+*/
+int Netchan_DecompressData( int codec, const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	size_t	outLen;
+
+	switch( codec )
+	{
+	case NET_CODEC_HUFF:
+		if( inLen > maxOut || maxOut < NET_MAX_PAYLOAD )
+			return -1;
+		Q_memmove( out, in, inLen );
+		outLen = inLen;
+		Huff_DecompressData( out, &outLen );
+		return outLen;
+	case NET_CODEC_HUFF_STATIC:
+		return Huff_DecompressStatic( in, inLen, out, maxOut );
+	case NET_CODEC_LZ:
+		return LZ_DecompressBlock( in, inLen, out, maxOut );
+	default:
+		if( inLen > maxOut )
+			return -1;
+		Q_memmove( out, in, inLen );
+		return inLen;
+	}
+}
+
+/*
+==============================
+Netchan_CompressPacket
+
+compress message in place, beginning from specified offset
+==============================
+*/
+static void Netchan_CompressPacket( int codec, sizebuf_t *msg, int offset )
+{
+	byte	buffer[NET_MAX_MESSAGE];
+	int	inLen = BF_GetNumBytesWritten( msg ) - offset;
+	size_t	outLen;
+
+	if( codec == NET_CODEC_HUFF )
+	{
+		Huff_CompressPacket( msg, offset );
+		return;
+	}
+
+	if( inLen <= 0 ) return;
+
+	outLen = Netchan_CompressData( codec, BF_GetData( msg ) + offset, inLen, buffer, BF_GetMaxBytes( msg ) - offset );
+
+	if( !outLen )
+	{
+		MsgDev( D_ERROR, "Netchan_CompressPacket: overflow\n" );
+		return;
+	}
+
+	Q_memcpy( BF_GetData( msg ) + offset, buffer, outLen );
+	msg->iCurBit = ( offset + outLen ) << 3;
+}
+
+/*
+==============================
+Netchan_DecompressPacket
+
+decompress message in place, beginning from specified offset
+==============================
+*/
+static void Netchan_DecompressPacket( int codec, sizebuf_t *msg, int offset )
+{
+	byte	buffer[NET_MAX_PAYLOAD];
+	int	inLen = BF_GetMaxBytes( msg ) - offset;
+	int	outLen;
+
+	if( codec == NET_CODEC_HUFF )
+	{
+		Huff_DecompressPacket( msg, offset );
+		return;
+	}
+
+	if( inLen <= 0 ) return;
+
+	outLen = Netchan_DecompressData( codec, BF_GetData( msg ) + offset, inLen, buffer, NET_MAX_PAYLOAD - offset );
+
+	if( outLen < 0 )
+	{
+		MsgDev( D_ERROR, "Netchan_DecompressPacket: corrupted data\n" );
+		outLen = 0;
+	}
+
+	Q_memcpy( BF_GetData( msg ) + offset, buffer, outLen );
+	msg->nDataBits = ( offset + outLen ) << 3;
+}
+
+/*
+==============================
+Netchan_CapturePacket
+
+record uncompressed payload as 16-bit length and data
+==============================
+*/
+static void Netchan_CapturePacket( const byte *data, int length )
+{
+	byte	header[2];
+
+	if( length <= 0 || length > 0xFFFF )
+		return;
+
+	header[0] = length & 0xFF;
+	header[1] = length >> 8;
+
+	FS_Write( net_capture, header, sizeof( header ));
+	FS_Write( net_capture, data, length );
+}
+
+/*
+==============================
+Netchan_Capture_f
+
+==============================
+*/
+static void Netchan_Capture_f( void )
+{
+	if( net_capture )
+	{
+		FS_Close( net_capture );
+		net_capture = NULL;
+		Msg( "packet capture stopped\n" );
+	}
+	else if( Cmd_Argc() < 2 )
+	{
+		Msg( "Usage: net_capture <filename>, run without arguments to stop\n" );
+	}
+
+	if( Cmd_Argc() < 2 )
+		return;
+
+	net_capture = FS_Open( Cmd_Argv( 1 ), "wb", true );
+
+	if( !net_capture )
+	{
+		Msg( "net_capture: couldn't open %s\n", Cmd_Argv( 1 ));
+		return;
+	}
+
+	Msg( "capturing outgoing packets to %s\n", Cmd_Argv( 1 ));
+}
+
+/*
+==============================
+Netchan_CodecBench_f
+
+compress and decompress a captured packet corpus with every codec
+==============================
+*/
+static void Netchan_CodecBench_f( void )
+{
+	size_t		*offsets, *lengths, *packedlen;
+	byte		*corpus, *packed, *check;
+	size_t		total, packedsize, pos;
+	int		i, codec, pass, passes;
+	int		count, errors;
+	double		start, ctime, dtime;
+	fs_offset_t	size;
+
+	if( Cmd_Argc() < 2 )
+	{
+		Msg( "Usage: net_codecbench <capture file> [passes]\n" );
+		return;
+	}
+
+	corpus = FS_LoadFile( Cmd_Argv( 1 ), &size, false );
+
+	if( !corpus )
+	{
+		Msg( "net_codecbench: couldn't load %s\n", Cmd_Argv( 1 ));
+		return;
+	}
+
+	passes = ( Cmd_Argc() > 2 ) ? max( Q_atoi( Cmd_Argv( 2 )), 1 ) : 1;
+
+	// count packets
+	for( count = 0, pos = 0; pos + 2 <= size; count++ )
+		pos += 2 + ( corpus[pos] | ( corpus[pos+1] << 8 ));
+
+	offsets = Mem_Alloc( net_mempool, sizeof( size_t ) * ( count + 1 ));
+	lengths = Mem_Alloc( net_mempool, sizeof( size_t ) * ( count + 1 ));
+	packedlen = Mem_Alloc( net_mempool, sizeof( size_t ) * ( count + 1 ));
+
+	for( i = 0, total = 0, pos = 0; i < count; i++ )
+	{
+		lengths[i] = corpus[pos] | ( corpus[pos+1] << 8 );
+		offsets[i] = pos + 2;
+		pos += 2 + lengths[i];
+
+		// truncated capture
+		if( pos > size )
+			break;
+		total += lengths[i];
+	}
+	count = i;
+
+	// adaptive huffman may expand incompressible data
+	packedsize = total * 3 + NET_MAX_PAYLOAD * 2;
+	packed = Mem_Alloc( net_mempool, packedsize );
+	check = Mem_Alloc( net_mempool, NET_MAX_PAYLOAD );
+
+	Msg( "%i packets, %s, %i passes\n", count, Q_pretifymem( total, 2 ), passes );
+	Msg( "codec            ratio   compress    decompress  errors\n" );
+
+	for( codec = NET_CODEC_HUFF; codec < NET_CODEC_COUNT; codec++ )
+	{
+		size_t	packedtotal = 0;
+
+		ctime = dtime = 0.0;
+		errors = 0;
+
+		for( pass = 0; pass < passes; pass++ )
+		{
+			start = Sys_DoubleTime();
+
+			for( i = 0, pos = 0; i < count; i++ )
+			{
+				packedlen[i] = Netchan_CompressData( codec, corpus + offsets[i], lengths[i], packed + pos, packedsize - pos );
+				pos += packedlen[i];
+			}
+
+			ctime += Sys_DoubleTime() - start;
+			packedtotal = pos;
+			start = Sys_DoubleTime();
+
+			for( i = 0, pos = 0; i < count; i++ )
+			{
+				int	outLen = Netchan_DecompressData( codec, packed + pos, packedlen[i], check, NET_MAX_PAYLOAD );
+
+				if( pass == 0 && ( outLen != lengths[i] || Q_memcmp( check, corpus + offsets[i], outLen )))
+					errors++;
+				pos += packedlen[i];
+			}
+
+			dtime += Sys_DoubleTime() - start;
+		}
+
+		Msg( "%-16s %5.1f%%  %6.1f MB/s  %6.1f MB/s  %i\n", net_codecnames[codec],
+			total ? packedtotal * 100.0 / total : 0.0,
+			ctime > 0.0 ? total * passes / ( ctime * 1048576.0 ) : 0.0,
+			dtime > 0.0 ? total * passes / ( dtime * 1048576.0 ) : 0.0, errors );
+	}
+
+	Mem_Free( check );
+	Mem_Free( packed );
+	Mem_Free( packedlen );
+	Mem_Free( lengths );
+	Mem_Free( offsets );
+	Mem_Free( corpus );
+}
+
 /*
 ===============
 Netchan_Init
@@ -261,12 +595,36 @@ void Netchan_Init( void )
 
 	net_mempool = Mem_AllocPool( "Network Pool" );
 
+	Cmd_AddCommand( "net_capture", Netchan_Capture_f, "record outgoing packets to file for net_codecbench" );
+	Cmd_AddCommand( "net_codecbench", Netchan_CodecBench_f, "measure compression ratio and speed of netchan codecs on a capture" );
+
 	Huff_Init ();	// initialize huffman compression
 	BF_InitMasks ();	// initialize bit-masks
 }
 
 void Netchan_Shutdown( void )
 {
+	if( net_capture )
+	{
+		FS_Close( net_capture );
+		net_capture = NULL;
+	}
+
+	Cmd_RemoveCommand( "net_capture" );
+	Cmd_RemoveCommand( "net_codecbench" );
+
+	// file data is not allocated from the network pool
+	while( net_fragsources )
+	{
+		fragsource_t	*src = net_fragsources;
+
+		net_fragsources = src->next;
+		if( src->file ) FS_Close( src->file );
+		if( src->data ) Mem_Free( src->data );
+	}
+
+	net_fragpool = NULL;
+	net_fragpoolsize = 0;
 	Mem_FreePool( &net_mempool );
 }
 
@@ -352,6 +710,216 @@ qboolean Netchan_CanPacket( netchan_t *chan )
 	return false;
 }
 
+/*
+=================================
+
+FRAGMENT BUFFERS
+
+outgoing fragments are views into a reference counted source,
+files are loaded once and shared by every channel sending them
+while their size and time on disk stay the same. Big files are
+kept open and read when the fragment goes out
+
+=================================
+*/
+/*
+==============================
+Netchan_AllocFragSource
+
+takes ownership of data, named sources are shared
+==============================
+*/
+static fragsource_t *Netchan_AllocFragSource( const char *filename, byte *data, int size )
+{
+	fragsource_t	*src;
+
+	src = (fragsource_t *)Mem_Alloc( net_mempool, sizeof( fragsource_t ));
+	if( filename ) Q_strncpy( src->filename, filename, sizeof( src->filename ));
+	src->data = data;
+	src->size = size;
+
+	src->next = net_fragsources;
+	net_fragsources = src;
+
+	return src;
+}
+
+/*
+==============================
+Netchan_LoadFragSource
+
+find file that is already being sent or load it,
+file changed on disk gets the new source
+==============================
+*/
+static fragsource_t *Netchan_LoadFragSource( const char *filename )
+{
+	fragsource_t	*src;
+	fs_offset_t	size, mtime;
+	file_t		*file;
+	byte		*data;
+
+	size = FS_FileSize( filename, false );
+	mtime = FS_FileTime( filename, false );
+
+	if( size <= 0 || size > INT_MAX )
+		return NULL;
+
+	for( src = net_fragsources; src; src = src->next )
+	{
+		if( src->filename[0] && !Q_stricmp( src->filename, filename ) && src->size == size && src->mtime == mtime )
+			return src;
+	}
+
+	if( size > MAX_FRAGSOURCE_LOAD )
+	{
+		if(( file = FS_Open( filename, "rb", false )) == NULL )
+			return NULL;
+
+		src = Netchan_AllocFragSource( filename, NULL, size );
+		src->file = file;
+		src->mtime = mtime;
+		return src;
+	}
+
+	data = FS_LoadFile( filename, &size, false );
+
+	if( !data || size <= 0 )
+	{
+		if( data ) Mem_Free( data );
+		return NULL;
+	}
+
+	src = Netchan_AllocFragSource( filename, data, size );
+	src->mtime = mtime;
+	return src;
+}
+
+/*
+==============================
+Netchan_WriteFragSource
+
+append the data of fragment to the message
+==============================
+*/
+static void Netchan_WriteFragSource( sizebuf_t *msg, fragbuf_t *buf )
+{
+	byte	filebuffer[FRAGMENT_SIZE];
+
+	if( buf->source->data )
+	{
+		BF_WriteBits( msg, buf->source->data + buf->foffset, buf->size << 3 );
+		return;
+	}
+
+	// file was truncated on disk, keep the size promised to the client
+	Q_memset( filebuffer, 0, buf->size );
+	FS_Seek( buf->source->file, buf->foffset, SEEK_SET );
+	FS_Read( buf->source->file, filebuffer, buf->size );
+
+	BF_WriteBits( msg, filebuffer, buf->size << 3 );
+}
+
+/*
+==============================
+Netchan_ReleaseFragSource
+
+==============================
+*/
+static void Netchan_ReleaseFragSource( fragsource_t *src )
+{
+	fragsource_t	**prev;
+
+	if( --src->refcount > 0 )
+		return;
+
+	for( prev = &net_fragsources; *prev; prev = &(*prev)->next )
+	{
+		if( *prev == src )
+		{
+			*prev = src->next;
+			break;
+		}
+	}
+
+	if( src->file ) FS_Close( src->file );
+	if( src->data ) Mem_Free( src->data );
+	Mem_Free( src );
+}
+
+/*
+==============================
+Netchan_AllocFragbuf
+
+==============================
+*/
+fragbuf_t *Netchan_AllocFragbuf( void )
+{
+	fragbuf_t	*buf;
+
+	if( net_fragpool )
+	{
+		buf = net_fragpool;
+		net_fragpool = buf->next;
+		net_fragpoolsize--;
+
+		// frag_message_buf is rewritten by user
+		buf->next = NULL;
+		buf->bufferid = 0;
+		buf->isfile = false;
+		buf->isbuffer = false;
+		buf->filename[0] = '\0';
+		buf->foffset = 0;
+		buf->size = 0;
+		buf->source = NULL;
+	}
+	else
+	{
+		buf = (fragbuf_t *)Mem_Alloc( net_mempool, sizeof( fragbuf_t ));
+	}
+
+	BF_Init( &buf->frag_message, "Frag Message", buf->frag_message_buf, sizeof( buf->frag_message_buf ));
+
+	return buf;
+}
+
+/*
+==============================
+Netchan_FreeFragbuf
+
+==============================
+*/
+void Netchan_FreeFragbuf( fragbuf_t *buf )
+{
+	if( buf->source )
+		Netchan_ReleaseFragSource( buf->source );
+
+	if( net_fragpoolsize >= MAX_FRAGBUF_POOL )
+	{
+		Mem_Free( buf );
+		return;
+	}
+
+	buf->next = net_fragpool;
+	net_fragpool = buf;
+	net_fragpoolsize++;
+}
+
+/*
+==============================
+Netchan_SetFragSource
+
+make fragment a view of source data
+==============================
+*/
+static void Netchan_SetFragSource( fragbuf_t *buf, fragsource_t *src, int offset, int size )
+{
+	src->refcount++;
+	buf->source = src;
+	buf->foffset = offset;
+	buf->size = size;
+}
+
 /*
 ==============================
 Netchan_UnlinkFragment
@@ -375,7 +943,7 @@ void Netchan_UnlinkFragment( fragbuf_t *buf, fragbuf_t **list )
 		*list = buf->next;
 
 		// destroy remnant
-		Mem_Free( buf );
+		Netchan_FreeFragbuf( buf );
 		return;
 	}
 
@@ -387,7 +955,7 @@ void Netchan_UnlinkFragment( fragbuf_t *buf, fragbuf_t **list )
 			search->next = buf->next;
 
 			// destroy remnant
-			Mem_Free( buf );
+			Netchan_FreeFragbuf( buf );
 			return;
 		}
 		search = search->next;
@@ -413,7 +981,7 @@ void Netchan_ClearFragbufs( fragbuf_t **ppbuf )
 	while( buf )
 	{
 		n = buf->next;
-		Mem_Free( buf );
+		Netchan_FreeFragbuf( buf );
 		buf = n;
 	}
 
@@ -428,7 +996,7 @@ Netchan_ClearFragments
 */
 void Netchan_ClearFragments( netchan_t *chan )
 {
-	fragbufwaiting_t	*wait;
+	fragbufwaiting_t	*wait, *next;
 	int		i;
 
 	for( i = 0; i < MAX_STREAMS; i++ )
@@ -437,8 +1005,10 @@ void Netchan_ClearFragments( netchan_t *chan )
 
 		while( wait )
 		{
+			next = wait->next;
 			Netchan_ClearFragbufs( &wait->fragbufs );
-			wait = wait->next;
+			Mem_Free( wait );
+			wait = next;
 		}
 		chan->waitlist[i] = NULL;
 
@@ -519,22 +1089,6 @@ void Netchan_OutOfBandPrint( int net_socket, netadr_t adr, char *format, ... )
 	Netchan_OutOfBand( net_socket, adr, Q_strlen( string ), (byte *)string );
 }
 
-/*
-==============================
-Netchan_AllocFragbuf
-
-==============================
-*/
-fragbuf_t *Netchan_AllocFragbuf( void )
-{
-	fragbuf_t	*buf;
-
-	buf = (fragbuf_t *)Mem_Alloc( net_mempool, sizeof( fragbuf_t ));
-	BF_Init( &buf->frag_message, "Frag Message", buf->frag_message_buf, sizeof( buf->frag_message_buf ));
-
-	return buf;
-}
-
 /*
 ==============================
 Netchan_AddFragbufToTail
@@ -543,24 +1097,17 @@ Netchan_AddFragbufToTail
 */
 void Netchan_AddFragbufToTail( fragbufwaiting_t *wait, fragbuf_t *buf )
 {
-	fragbuf_t	*p;
-
 	buf->next = NULL;
 	wait->fragbufcount++;
 
 	if( !wait->fragbufs )
 	{
-		wait->fragbufs = buf;
+		wait->fragbufs = wait->lastbuf = buf;
 		return;
 	}
 
-	p = wait->fragbufs;
-	while( p->next )
-	{
-		p = p->next;
-	}
-
-	p->next = buf;
+	wait->lastbuf->next = buf;
+	wait->lastbuf = buf;
 }
 
 /*
@@ -718,15 +1265,34 @@ void Netchan_CreateFragments_( qboolean server, netchan_t *chan, sizebuf_t *msg
 	int		remaining;
 	int		bufferid = 1;
 	fragbufwaiting_t	*wait, *p;
+	fragsource_t	*src;
+	byte		*data;
 
 	if( BF_GetNumBytesWritten( msg ) == 0 )
 		return;
 
 	chunksize = bound( 16, net_blocksize->integer, 1400 );
 
-	wait = (fragbufwaiting_t *)Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
-
 	remaining = BF_GetNumBytesWritten( msg );
+	data = Mem_Alloc( net_mempool, remaining + NET_CODEC_OVERHEAD );
+
+	if( chan->fragcompress )
+	{
+		// whole stream is packed once, Netchan_CopyNormalFragments unpacks it
+		remaining = Netchan_CompressData( chan->fragcompress, msg->pData, remaining, data, remaining + NET_CODEC_OVERHEAD );
+
+		if( !remaining )
+		{
+			MsgDev( D_ERROR, "Netchan_CreateFragments: overflow\n" );
+			Mem_Free( data );
+			return;
+		}
+	}
+	else Q_memcpy( data, msg->pData, remaining );
+
+	// fragments only reference the data
+	src = Netchan_AllocFragSource( NULL, data, remaining );
+	wait = (fragbufwaiting_t *)Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
 	pos = 0;
 
 	while( remaining > 0 )
@@ -737,9 +1303,7 @@ void Netchan_CreateFragments_( qboolean server, netchan_t *chan, sizebuf_t *msg
 		buf = Netchan_AllocFragbuf();
 		buf->bufferid = bufferid++;
 
-		// Copy in data
-		BF_Clear( &buf->frag_message );
-		BF_WriteBits( &buf->frag_message, msg->pData + pos, send << 3 );
+		Netchan_SetFragSource( buf, src, pos, send );
 		pos += send;
 
 		Netchan_AddFragbufToTail( wait, buf );
@@ -868,10 +1432,17 @@ void Netchan_CreateFileFragmentsFromBuffer( qboolean server, netchan_t *chan, ch
 	int		bufferid = 1;
 	qboolean		firstfragment = true;
 	fragbufwaiting_t	*wait, *p;
+	fragsource_t	*src;
 	fragbuf_t 	*buf;
+	byte		*data;
 
 	if( !size ) return;
 
+	// single private copy, caller keeps the buffer
+	data = Mem_Alloc( net_mempool, size );
+	Q_memcpy( data, pbuf, size );
+	src = Netchan_AllocFragSource( NULL, data, size );
+
 	chunksize = bound( 16, net_blocksize->integer, 512 );
 	wait = ( fragbufwaiting_t * )Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
 	remaining = size;
@@ -900,10 +1471,7 @@ void Netchan_CreateFileFragmentsFromBuffer( qboolean server, netchan_t *chan, ch
 
 		buf->isbuffer = true;
 		buf->isfile = true;
-		buf->size = send;
-		buf->foffset = pos;
-
-		BF_WriteBits( &buf->frag_message, pbuf + pos, send << 3 );
+		Netchan_SetFragSource( buf, src, pos, send );
 
 		pos += send;
 		remaining -= send;
@@ -943,17 +1511,22 @@ int Netchan_CreateFileFragments( qboolean server, netchan_t *chan, const char *f
 	int		filesize = 0;
 	qboolean		firstfragment = true;
 	fragbufwaiting_t	*wait, *p;
+	fragsource_t	*src;
 	fragbuf_t		*buf;
 
 	chunksize = bound( 16, net_blocksize->integer, 512 );
-	filesize = FS_FileSize( filename, false );
 
-	if( filesize <= 0 )
+	// clients downloading the same file share one copy
+	src = Netchan_LoadFragSource( filename );
+
+	if( !src )
 	{
 		MsgDev( D_WARN, "Unable to open %s for transfer\n", filename );
 		return 0;
 	}
 
+	filesize = src->size;
+
 	wait = (fragbufwaiting_t *)Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
 	remaining = filesize;
 	pos = 0;
@@ -980,9 +1553,8 @@ int Netchan_CreateFileFragments( qboolean server, netchan_t *chan, const char *f
 		}
 
 		buf->isfile = true;
-		buf->size = send;
-		buf->foffset = pos;
 		Q_strncpy( buf->filename, filename, sizeof( buf->filename ));
+		Netchan_SetFragSource( buf, src, pos, send );
 
 		pos += send;
 		remaining -= send;
@@ -1025,7 +1597,7 @@ void Netchan_FlushIncoming( netchan_t *chan, int stream )
 	while( p )
 	{
 		n = p->next;
-		Mem_Free( p );
+		Netchan_FreeFragbuf( p );
 		p = n;
 	}
 	chan->incomingbufs[stream] = NULL;
@@ -1063,7 +1635,7 @@ qboolean Netchan_CopyNormalFragments( netchan_t *chan, sizebuf_t *msg )
 		// copy it in
 		BF_WriteBits( msg, BF_GetData( &p->frag_message ), BF_GetNumBitsWritten( &p->frag_message ));
 
-		Mem_Free( p );
+		Netchan_FreeFragbuf( p );
 		p = n;
 	}
 
@@ -1072,6 +1644,24 @@ qboolean Netchan_CopyNormalFragments( netchan_t *chan, sizebuf_t *msg )
 	// reset flag
 	chan->incomingready[FRAG_NORMAL_STREAM] = false;
 
+	if( chan->fragcompress )
+	{
+		byte	*buffer = Mem_Alloc( net_mempool, NET_MAX_PAYLOAD );
+		int	length;
+
+		length = Netchan_DecompressData( chan->fragcompress, net_message_buffer, BF_GetNumBytesWritten( msg ), buffer, NET_MAX_PAYLOAD );
+
+		BF_Init( msg, "NetMessage", net_message_buffer, sizeof( net_message_buffer ));
+		if( length > 0 ) BF_WriteBytes( msg, buffer, length );
+		Mem_Free( buffer );
+
+		if( length < 0 )
+		{
+			MsgDev( D_ERROR, "Netchan_CopyNormalFragments: corrupted data\n" );
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -1177,7 +1767,7 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 
 		pos += cursize;
 
-		Mem_Free( p );
+		Netchan_FreeFragbuf( p );
 		p = n;
 	}
 
@@ -1416,10 +2006,10 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 			{
 				fragment_size = BF_GetNumBytesWritten( &pbuf->frag_message );
 
-				// files set size a bit differently.
-				if( pbuf->isfile && !pbuf->isbuffer )
+				// shared data is appended after the header
+				if( pbuf->source )
 				{
-					fragment_size = pbuf->size;
+					fragment_size += pbuf->size;
 				}
 			}
 
@@ -1433,27 +2023,17 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 				// which buffer are we sending ?
 				chan->reliable_fragid[i] = MAKE_FRAGID( pbuf->bufferid, chan->fragbufcount[i] );
 
-				// if it's not in-memory, then we'll need to copy it in frame the file handle.
-				if( pbuf->isfile && !pbuf->isbuffer )
-				{
-					byte	filebuffer[2048];
-					file_t	*hfile;
-
-					hfile = FS_Open( pbuf->filename, "rb", false );
-					FS_Seek( hfile, pbuf->foffset, SEEK_SET );
-					FS_Read( hfile, filebuffer, pbuf->size );
-
-					BF_WriteBits( &pbuf->frag_message, filebuffer, pbuf->size << 3 );
-					FS_Close( hfile );
-				}
-
 				// copy frag stuff on top of current buffer
 				BF_StartWriting( &temp, chan->reliable_buf, sizeof( chan->reliable_buf ), chan->reliable_length, -1 );
 
 				BF_WriteBits( &temp, BF_GetData( &pbuf->frag_message ), BF_GetNumBitsWritten( &pbuf->frag_message ));
 
-				chan->reliable_length += BF_GetNumBitsWritten( &pbuf->frag_message );
-				chan->frag_length[i] = BF_GetNumBitsWritten( &pbuf->frag_message );
+				// data goes straight from the shared source
+				if( pbuf->source )
+					Netchan_WriteFragSource( &temp, pbuf );
+
+				chan->frag_length[i] = BF_GetNumBitsWritten( &temp ) - chan->reliable_length;
+				chan->reliable_length += chan->frag_length[i];
 
 				// unlink pbuf
 				Netchan_UnlinkFragment( pbuf, &chan->fragbufs[i] );	
@@ -1560,7 +2140,8 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 	Netchan_UpdateFlow( chan );
 
 	size1 = BF_GetNumBytesWritten( &send );
-	if( chan->compress ) Huff_CompressPacket( &send, hdr_size );
+	if( net_capture ) Netchan_CapturePacket( BF_GetData( &send ) + hdr_size, size1 - hdr_size );
+	if( chan->compress ) Netchan_CompressPacket( chan->compress, &send, hdr_size );
 	size2 = BF_GetNumBytesWritten( &send );
 
 	chan->total_sended += size2;
@@ -1765,7 +2346,7 @@ qboolean Netchan_Process( netchan_t *chan, sizebuf_t *msg )
 	hdr_size = BF_GetNumBytesRead( msg );
 
 	size1 = BF_GetMaxBytes( msg );
-	if( chan->compress ) Huff_DecompressPacket( msg, hdr_size );
+	if( chan->compress ) Netchan_DecompressPacket( chan->compress, msg, hdr_size );
 	size2 = BF_GetMaxBytes( msg );
 
 	chan->total_received += size1;
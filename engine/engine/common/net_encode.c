@@ -26,6 +26,9 @@ GNU General Public License for more details.
 #define DELTA_PATH		"delta.lst"
 
 static qboolean		delta_init = false;
+static qboolean		delta_fastpath = true;	// use compiled tables to skip unchanged fields
+
+#define DELTA_MAX_WORDS		128	// biggest struct that can be compiled, in 32-bit words
  
 // list of all the struct names
 static const delta_field_t cmd_fields[] =
@@ -293,7 +296,7 @@ static const delta_field_t ent_fields[] =
 };
 
 #define D( x, y ) \
-	{ x, y, NUM_FIELDS( y ), 0, NULL, 0, "", 0, false }
+	{ x, y, NUM_FIELDS( y ), 0, NULL, 0, "", 0, false, 0 }
 static delta_info_t dt_info[] =
 {
 D( "event_t", ev_fields ),
@@ -308,6 +311,9 @@ D( "custom_entity_state_t", ent_fields ),
 };
 #undef D
 
+// entity encoders are looked up for each entity, keep them
+static delta_info_t *dt_entity, *dt_entity_player, *dt_entity_custom;
+
 delta_info_t *Delta_FindStruct( const char *name )
 {
 	int	i;
@@ -387,6 +393,51 @@ void Delta_CustomEncode( delta_info_t *dt, const void *from, const void *to )
 	}
 }
 
+/*
+=====================
+Delta_CustomEncodeFields
+
+call custom encode func and keep the private copy of
+inactive fields. Tables without a custom encoder don't
+touch the shared fields so the caller may run on a worker thread
+=====================
+*/
+static void Delta_CustomEncodeFields( delta_info_t *dt, const void *from, const void *to, byte *inactive )
+{
+	int	i;
+
+	if( !dt->userCallback )
+	{
+		Q_memset( inactive, 0, dt->numFields );
+		return;
+	}
+
+	Delta_CustomEncode( dt, from, to );
+
+	for( i = 0; i < dt->numFields; i++ )
+		inactive[i] = dt->pFields[i].bInactive;
+}
+
+/*
+=====================
+Delta_HasEntityEncoders
+
+returns true if the game dll registered a custom encoder
+for any entity table. Such entities must be encoded
+on the main thread
+=====================
+*/
+qboolean Delta_HasEntityEncoders( void )
+{
+	if( dt_entity && dt_entity->userCallback )
+		return true;
+	if( dt_entity_player && dt_entity_player->userCallback )
+		return true;
+	if( dt_entity_custom && dt_entity_custom->userCallback )
+		return true;
+	return false;
+}
+
 delta_field_t *Delta_FindFieldInfo( const delta_field_t *pInfo, const char *fieldName )
 {
 	if( !fieldName || !*fieldName )
@@ -415,6 +466,115 @@ int Delta_IndexForFieldInfo( const delta_field_t *pInfo, const char *fieldName )
 	return -1;
 }
 
+/*
+=====================
+Delta_CompileTable
+
+find out struct words covered by each field, so the encoder
+can skip the fields whose words wasn't changed. Tables with
+string fields or fields outside the struct are not compiled.
+Fields are still sent in table order, the wire format is unchanged
+=====================
+*/
+static void Delta_CompileTable( delta_info_t *dt )
+{
+	delta_t	*pField;
+	int	i, size;
+
+	dt->numWords = 0;
+
+	for( i = 0, pField = dt->pFields; i < dt->numFields; i++, pField++ )
+	{
+		if( pField->flags & DT_BYTE )
+			size = sizeof( byte );
+		else if( pField->flags & DT_SHORT )
+			size = sizeof( short );
+		else if( pField->flags & ( DT_INTEGER|DT_FLOAT|DT_ANGLE|DT_TIMEWINDOW_8|DT_TIMEWINDOW_BIG ))
+			size = sizeof( int );
+		else size = 0; // strings are compared by value
+
+		if( !size || pField->offset < 0 )
+		{
+			// a change of such field is not seen by Delta_ChangedWords,
+			// the table can't take the "nothing changed" shortcut
+			pField->firstWord = pField->lastWord = -1;
+			dt->numWords = 0;
+			return;
+		}
+
+		pField->firstWord = pField->offset >> 2;
+		pField->lastWord = ( pField->offset + size - 1 ) >> 2;
+
+		if( pField->lastWord >= DELTA_MAX_WORDS )
+		{
+			// struct is too big, use the slow path
+			dt->numWords = 0;
+			return;
+		}
+
+		dt->numWords = max( dt->numWords, pField->lastWord + 1 );
+	}
+}
+
+/*
+=====================
+Delta_ChangedWords
+
+mark the struct words that differs,
+returns false if nothing was changed
+=====================
+*/
+static qboolean Delta_ChangedWords( const delta_info_t *dt, const void *from, const void *to, uint32_t *changed )
+{
+	const uint32_t	*a = (const uint32_t *)from;
+	const uint32_t	*b = (const uint32_t *)to;
+	uint32_t		diff = 0;
+	int		i;
+
+	Q_memset( changed, 0, ((dt->numWords + 31) >> 5) * sizeof( uint32_t ));
+
+	for( i = 0; i < dt->numWords; i++ )
+	{
+		if( a[i] == b[i] ) continue;
+		changed[i >> 5] |= BIT( i & 31 );
+		diff = 1;
+	}
+
+	return diff ? true : false;
+}
+
+_inline qboolean Delta_FieldChanged( const delta_t *pField, const uint32_t *changed )
+{
+	int	i;
+
+	if( pField->firstWord < 0 )
+		return true;
+
+	for( i = pField->firstWord; i <= pField->lastWord; i++ )
+	{
+		if( changed[i >> 5] & BIT( i & 31 ))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=====================
+Delta_SetFastPath
+
+enable or disable compiled tables,
+returns previous state
+=====================
+*/
+qboolean Delta_SetFastPath( qboolean enable )
+{
+	qboolean	old = delta_fastpath;
+
+	delta_fastpath = enable;
+	return old;
+}
+
 qboolean Delta_AddField( const char *pStructName, const char *pName, int flags, int bits, float mul, float post_mul )
 {
 	delta_info_t	*dt;
@@ -464,6 +624,8 @@ qboolean Delta_AddField( const char *pStructName, const char *pName, int flags,
 	pField->post_multiplier = post_mul;
 	dt->numFields++;
 
+	Delta_CompileTable( dt );
+
 	return true;
 }
 
@@ -731,6 +893,8 @@ void Delta_ParseTable( char **delta_script, delta_info_t *dt, const char *encode
 		dt->pFields = Z_Realloc( dt->pFields, dt->numFields * sizeof( delta_t ));
 	}
 
+	Delta_CompileTable( dt );
+
 	dt->bInitialized = true; // table is ok
 }
 
@@ -776,6 +940,13 @@ void Delta_InitFields( void )
 	Delta_AddField( "event_t", "velocity[2]", DT_SIGNED | DT_FLOAT, 16, 8.0f, 1.0f );	
 }
 
+static void Delta_FindEntityStructs( void )
+{
+	dt_entity = Delta_FindStruct( "entity_state_t" );
+	dt_entity_player = Delta_FindStruct( "entity_state_player_t" );
+	dt_entity_custom = Delta_FindStruct( "custom_entity_state_t" );
+}
+
 void Delta_Init( void )
 {
 	delta_info_t	*dt;
@@ -783,6 +954,8 @@ void Delta_Init( void )
 	// shutdown it first
 	if( delta_init ) Delta_Shutdown ();
 
+	Delta_FindEntityStructs ();
+
 	Delta_InitFields ();	// initialize fields
 	delta_init = true;
 
@@ -837,6 +1010,8 @@ void Delta_InitClient( void )
 	// already initalized
 	if( delta_init ) return;
 
+	Delta_FindEntityStructs ();
+
 	for( i = 0; i < NUM_FIELDS( dt_info ); i++ )
 	{
 		if( dt_info[i].numFields > 0 )
@@ -861,6 +1036,7 @@ void Delta_Shutdown( void )
 		dt_info[i].customEncode = CUSTOM_NONE;
 		dt_info[i].userCallback = NULL;
 		dt_info[i].funcName[0] = '\0';
+		dt_info[i].numWords = 0;
 
 		if( dt_info[i].pFields )
 		{
@@ -897,14 +1073,14 @@ int Delta_ClampIntegerField( int iValue, qboolean bSigned, int bits )
 
 /*
 =====================
-Delta_CompareField
+Delta_CompareFieldValue
 
-compare fields by offsets
+compare fields by offsets, ignores the field activity
 assume from and to is valid
 TESTTEST: clamp all fields and multiply by specified value before comparing
 =====================
 */
-qboolean Delta_CompareField( delta_t *pField, void *from, void *to, float timebase )
+static qboolean Delta_CompareFieldValue( delta_t *pField, void *from, void *to, float timebase )
 {
 	qboolean	bSigned = ( pField->flags & DT_SIGNED ) ? true : false;
 	float	val_a, val_b;
@@ -914,9 +1090,6 @@ qboolean Delta_CompareField( delta_t *pField, void *from, void *to, float timeba
 	ASSERT( from );
 	ASSERT( to );
 
-	if( pField->bInactive )
-		return true;
-
 	fromF = toF = 0;
 
 	if( pField->flags & DT_BYTE )
@@ -1031,20 +1204,36 @@ qboolean Delta_CompareField( delta_t *pField, void *from, void *to, float timeba
 
 /*
 =====================
-Delta_WriteField
+Delta_CompareField
 
-write fields by offsets
+compare fields by offsets
 assume from and to is valid
 =====================
 */
-qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, void *to, float timebase )
+qboolean Delta_CompareField( delta_t *pField, void *from, void *to, float timebase )
+{
+	if( pField->bInactive )
+		return true;
+
+	return Delta_CompareFieldValue( pField, from, to, timebase );
+}
+
+/*
+=====================
+Delta_WriteFieldValue
+
+write fields by offsets, ignores the field activity
+assume from and to is valid
+=====================
+*/
+static qboolean Delta_WriteFieldValue( sizebuf_t *msg, delta_t *pField, void *from, void *to, float timebase )
 {
 	qboolean		bSigned = ( pField->flags & DT_SIGNED ) ? true : false;
 	float		flValue, flAngle, flTime;
 	uint32_t		iValue;
 	const char	*pStr;
 
-	if( Delta_CompareField( pField, from, to, timebase ))
+	if( Delta_CompareFieldValue( pField, from, to, timebase ))
 	{
 		BF_WriteOneBit( msg, 0 );	// unchanged
 		return false;
@@ -1141,6 +1330,25 @@ qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, void *to
 	return true;
 }
 
+/*
+=====================
+Delta_WriteField
+
+write fields by offsets
+assume from and to is valid
+=====================
+*/
+qboolean Delta_WriteField( sizebuf_t *msg, delta_t *pField, void *from, void *to, float timebase )
+{
+	if( pField->bInactive )
+	{
+		BF_WriteOneBit( msg, 0 );	// unchanged
+		return false;
+	}
+
+	return Delta_WriteFieldValue( msg, pField, from, to, timebase );
+}
+
 /*
 =====================
 Delta_ReadField
@@ -1386,6 +1594,7 @@ void MSG_WriteDeltaEvent( sizebuf_t *msg, event_args_t *from, event_args_t *to )
 {
 	delta_t		*pField;
 	delta_info_t	*dt;
+	byte		inactive[NUM_FIELDS( ev_fields )];
 	int		i;
 
 	dt = Delta_FindStruct( "event_t" );
@@ -1398,12 +1607,13 @@ void MSG_WriteDeltaEvent( sizebuf_t *msg, event_args_t *from, event_args_t *to )
 	ASSERT( pField );
 
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	Delta_CustomEncodeFields( dt, from, to, inactive );
 
 	// process fields
 	for( i = 0; i < dt->numFields; i++, pField++ )
 	{
-		Delta_WriteField( msg, pField, from, to, 0.0f );
+		if( inactive[i] ) BF_WriteOneBit( msg, 0 );
+		else Delta_WriteFieldValue( msg, pField, from, to, 0.0f );
 	}
 }
 
@@ -1679,6 +1889,9 @@ void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *
 {
 	delta_info_t	*dt = NULL;
 	delta_t		*pField;
+	byte		inactive[NUM_FIELDS( ent_fields )];
+	uint32_t		changed[DELTA_MAX_WORDS >> 5];
+	qboolean		compiled;
 	int		i, startBit;
 	int		numChanges = 0;
 
@@ -1724,16 +1937,16 @@ void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *
 	{
 		if( player )
 		{
-			dt = Delta_FindStruct( "entity_state_player_t" );
+			dt = dt_entity_player;
 		}
 		else
 		{
-			dt = Delta_FindStruct( "entity_state_t" );
+			dt = dt_entity;
 		}
 	}
 	else if( to->entityType == ENTITY_BEAM )
 	{
-		dt = Delta_FindStruct( "custom_entity_state_t" );
+		dt = dt_entity_custom;
 	}
 
 	if( !dt || !dt->bInitialized )
@@ -1744,13 +1957,31 @@ void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *
 	pField = dt->pFields;
 	ASSERT( pField );
 
+	compiled = ( delta_fastpath && dt->numWords ) ? true : false;
+
+	// fast path: the whole state is unchanged
+	if( compiled && !Delta_ChangedWords( dt, from, to, changed ))
+	{
+		if( !force )
+		{
+			BF_SeekToBit( msg, startBit );
+			return;
+		}
+
+		for( i = 0; i < dt->numFields; i++ )
+			BF_WriteOneBit( msg, 0 );
+		return;
+	}
+
 	// activate fields and call custom encode func
-	Delta_CustomEncode( dt, from, to );
+	Delta_CustomEncodeFields( dt, from, to, inactive );
 
 	// process fields
 	for( i = 0; i < dt->numFields; i++, pField++ )
 	{
-		if( Delta_WriteField( msg, pField, from, to, timebase ))
+		if( inactive[i] || ( compiled && !Delta_FieldChanged( pField, changed )))
+			BF_WriteOneBit( msg, 0 );
+		else if( Delta_WriteFieldValue( msg, pField, from, to, timebase ))
 			numChanges++;
 	}
 
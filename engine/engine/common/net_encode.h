@@ -67,6 +67,8 @@ typedef struct delta_s
 	float		post_multiplier;	// for DEFINE_DELTA_POST
 	int		bits;		// how many bits we send\receive
 	qboolean		bInactive;	// unsetted by user request
+	int		firstWord;	// struct words covered by field, -1 is always compared
+	int		lastWord;
 } delta_t;
 
 typedef void (*pfnDeltaEncode)( delta_t *pFields, const byte *from, const byte *to );
@@ -84,6 +86,9 @@ typedef struct
 	char		funcName[32];
 	pfnDeltaEncode	userCallback;
 	qboolean		bInitialized;
+
+	// compiled by Delta_CompileTable
+	int		numWords;		// struct words to compare, 0 if not compiled
 } delta_info_t;
 
 //
@@ -102,6 +107,8 @@ void Delta_SetField( delta_t *pFields, const char *fieldname );
 void Delta_UnsetField( delta_t *pFields, const char *fieldname );
 void Delta_SetFieldByIndex( struct delta_s *pFields, int fieldNumber );
 void Delta_UnsetFieldByIndex( struct delta_s *pFields, int fieldNumber );
+qboolean Delta_SetFastPath( qboolean enable );
+qboolean Delta_HasEntityEncoders( void );
 
 // send table over network
 void Delta_WriteTableField( sizebuf_t *msg, int tableIndex, const delta_t *pField );
@@ -490,6 +490,231 @@ static void Huff_EmitByteDynamic( void **tree, int value, byte *buffer )
 
 }
 
+/*
+=======================================================================================
+
+  STATIC HUFFMAN
+
+  canonical codes are built once from the pre-defined frequency table, so
+  each byte costs a single table lookup instead of a tree walk and rebalance.
+  Codes are limited to HUFF_STATIC_BITS so the decoder is one table probe.
+
+=======================================================================================
+*/
+#define HUFF_STATIC_BITS		12
+#define HUFF_STATIC_SIZE		(1<<HUFF_STATIC_BITS)
+#define HUFF_STATIC_HEADER		3		// 23 bits of length and a stored flag
+#define HUFF_STATIC_STORED		(1<<23)
+
+static uint	huffCode[256];			// bit-reversed canonical codes
+static byte	huffLength[256];
+static word	huffDecode[HUFF_STATIC_SIZE];		// symbol | length << 8
+
+/*
+============
+Huff_BuildLengths
+
+Plain Huffman construction, returns the longest code
+============
+*/
+static int Huff_BuildLengths( const int *freq, byte *length )
+{
+	int	weight[512], parent[512];
+	int	i, j, node, depth;
+	int	maxLength = 0;
+
+	for( i = 0; i < 256; i++ )
+		weight[i] = freq[i];
+
+	for( node = 256; node < 511; node++ )
+	{
+		int	n1 = -1, n2 = -1;
+
+		// pick two lightest roots
+		for( j = 0; j < node; j++ )
+		{
+			if( weight[j] < 0 ) continue;
+
+			if( n1 == -1 || weight[j] < weight[n1] )
+				n2 = n1, n1 = j;
+			else if( n2 == -1 || weight[j] < weight[n2] )
+				n2 = j;
+		}
+
+		weight[node] = weight[n1] + weight[n2];
+		parent[n1] = parent[n2] = node;
+		weight[n1] = weight[n2] = -1;
+	}
+
+	for( i = 0; i < 256; i++ )
+	{
+		for( depth = 0, j = i; j != 510; j = parent[j] )
+			depth++;
+		length[i] = depth;
+		maxLength = max( maxLength, depth );
+	}
+
+	return maxLength;
+}
+
+/*
+============
+Huff_BuildStaticCodes
+
+Build length limited canonical codes and decode table
+============
+*/
+static void Huff_BuildStaticCodes( const int *table )
+{
+	int	freq[256], count[HUFF_STATIC_BITS + 1];
+	int	nextCode[HUFF_STATIC_BITS + 1];
+	int	i, j, len, code, rev;
+
+	for( i = 0; i < 256; i++ )
+		freq[i] = max( table[i], 1 );
+
+	// flatten the distribution until the longest code fits
+	while( Huff_BuildLengths( freq, huffLength ) > HUFF_STATIC_BITS )
+	{
+		for( i = 0; i < 256; i++ )
+			freq[i] = ( freq[i] >> 1 ) + 1;
+	}
+
+	Q_memset( count, 0, sizeof( count ));
+	for( i = 0; i < 256; i++ )
+		count[huffLength[i]]++;
+
+	for( code = 0, len = 1; len <= HUFF_STATIC_BITS; len++ )
+	{
+		code = ( code + count[len - 1] ) << 1;
+		nextCode[len] = code;
+	}
+
+	for( i = 0; i < 256; i++ )
+	{
+		len = huffLength[i];
+		code = nextCode[len]++;
+
+		// bits are emitted lsb first
+		for( rev = 0, j = 0; j < len; j++ )
+			rev |= (( code >> j ) & 1 ) << ( len - 1 - j );
+		huffCode[i] = rev;
+
+		for( j = rev; j < HUFF_STATIC_SIZE; j += ( 1 << len ))
+			huffDecode[j] = i | ( len << 8 );
+	}
+}
+
+/*
+============
+Huff_CompressStatic
+
+Compress buffer using the static table, falls back
+to stored data when it doesn't get smaller.
+Returns output length or 0 if out is too small
+============
+*/
+size_t Huff_CompressStatic( const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	uint64_t	bits = 0;
+	size_t	outLen = HUFF_STATIC_HEADER;
+	size_t	limit, i;
+	int	count = 0;
+
+	if( inLen >= HUFF_STATIC_STORED || maxOut < HUFF_STATIC_HEADER )
+		return 0;
+
+	// stop as soon as the output gets larger than stored data
+	limit = min( maxOut, inLen + HUFF_STATIC_HEADER );
+
+	for( i = 0; i < inLen && outLen < limit; i++ )
+	{
+		bits |= (uint64_t)huffCode[in[i]] << count;
+		count += huffLength[in[i]];
+
+		while( count >= 8 && outLen < limit )
+		{
+			out[outLen++] = bits & 0xFF;
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	if( count > 0 && outLen < limit )
+	{
+		out[outLen++] = bits & 0xFF;
+		count = 0;
+	}
+
+	if( i < inLen || count > 0 || outLen >= inLen + HUFF_STATIC_HEADER )
+	{
+		// incompressible, store as is
+		if( inLen + HUFF_STATIC_HEADER > maxOut )
+			return 0;
+
+		Q_memcpy( out + HUFF_STATIC_HEADER, in, inLen );
+		outLen = inLen + HUFF_STATIC_HEADER;
+		inLen |= HUFF_STATIC_STORED;
+	}
+
+	out[0] = inLen & 0xFF;
+	out[1] = ( inLen >> 8 ) & 0xFF;
+	out[2] = ( inLen >> 16 ) & 0xFF;
+
+	return outLen;
+}
+
+/*
+============
+Huff_DecompressStatic
+
+Returns decompressed length or -1 on corrupted data
+============
+*/
+int Huff_DecompressStatic( const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	uint64_t	bits = 0;
+	int	count = 0;
+	size_t	pos, outLen, i;
+	int	entry;
+
+	if( inLen < HUFF_STATIC_HEADER )
+		return -1;
+
+	outLen = in[0] | ( in[1] << 8 ) | ( in[2] << 16 );
+
+	if( outLen & HUFF_STATIC_STORED )
+	{
+		outLen &= ~HUFF_STATIC_STORED;
+		if( outLen > maxOut || outLen > inLen - HUFF_STATIC_HEADER )
+			return -1;
+		Q_memcpy( out, in + HUFF_STATIC_HEADER, outLen );
+		return outLen;
+	}
+
+	if( outLen > maxOut )
+		return -1;
+
+	for( i = 0, pos = HUFF_STATIC_HEADER; i < outLen; i++ )
+	{
+		while( count <= 56 && pos < inLen )
+		{
+			bits |= (uint64_t)in[pos++] << count;
+			count += 8;
+		}
+
+		entry = huffDecode[bits & ( HUFF_STATIC_SIZE - 1 )];
+		if(( entry >> 8 ) > count )
+			return -1; // truncated
+
+		out[i] = entry & 0xFF;
+		bits >>= ( entry >> 8 );
+		count -= ( entry >> 8 );
+	}
+
+	return outLen;
+}
+
 /*
 =======================================================================================
 
@@ -703,5 +928,7 @@ void Huff_Init( void )
 	for( i = 0; i < 256; i++ )
 		for( j = 0; j < huff_tree[i]; j++ )
 			Huff_AddReference( huffTree, i );
+
+	Huff_BuildStaticCodes( huff_tree );
 	huffInit = true;
 }
@@ -0,0 +1,275 @@
+/*
+net_lz.c - LZ compression for large network payloads
+Copyright (C) 2026 nenquen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+#include "netchan.h"
+
+/*
+=======================================================================================
+
+  Byte oriented LZ77 in the LZ4 block layout: every sequence is a token
+  (literal count << 4 | match length - 4), extra length bytes, literals,
+  then a 16-bit offset and extra match length bytes. The last sequence
+  carries literals only. Blocks are prefixed by LZ_HEADER bytes of
+  uncompressed length, top bit set means the data is stored as is.
+
+=======================================================================================
+*/
+#define LZ_HEADER		4
+#define LZ_STORED		(1U<<31)
+#define LZ_HASH_BITS	12
+#define LZ_HASH_SIZE	(1<<LZ_HASH_BITS)
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	65535
+
+_inline uint LZ_Read32( const byte *p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint)p[3] << 24 );
+}
+
+_inline uint LZ_Hash( const byte *p )
+{
+	return ( LZ_Read32( p ) * 2654435761U ) >> ( 32 - LZ_HASH_BITS );
+}
+
+static byte *LZ_WriteLength( byte *op, size_t len )
+{
+	while( len >= 255 )
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+
+	*op++ = (byte)len;
+	return op;
+}
+
+/*
+============
+LZ_EmitSequence
+
+returns NULL if output buffer is too small
+============
+*/
+static byte *LZ_EmitSequence( byte *op, byte *oend, const byte *literals, size_t numLiterals, int offset, size_t matchLen )
+{
+	size_t	extra = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+	byte	*token;
+
+	// worst case for token, lengths, literals and offset
+	if( op + 1 + numLiterals + numLiterals / 255 + 1 + 2 + extra / 255 + 1 > oend )
+		return NULL;
+
+	token = op++;
+
+	if( numLiterals >= 15 )
+	{
+		*token = 15 << 4;
+		op = LZ_WriteLength( op, numLiterals - 15 );
+	}
+	else *token = numLiterals << 4;
+
+	Q_memcpy( op, literals, numLiterals );
+	op += numLiterals;
+
+	if( !matchLen ) return op;
+
+	*op++ = offset & 0xFF;
+	*op++ = offset >> 8;
+
+	if( extra >= 15 )
+	{
+		*token |= 15;
+		op = LZ_WriteLength( op, extra - 15 );
+	}
+	else *token |= extra;
+
+	return op;
+}
+
+static qboolean LZ_ReadLength( const byte **ip, const byte *iend, size_t *len )
+{
+	int	b;
+
+	do
+	{
+		if( *ip >= iend )
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while( b == 255 );
+
+	return true;
+}
+
+/*
+============
+LZ_CompressBlock
+
+Compress buffer with a single hash probe per position.
+Returns output length or 0 if out is too small
+============
+*/
+size_t LZ_CompressBlock( const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	int		table[LZ_HASH_SIZE];
+	const byte	*ip = in, *anchor = in;
+	const byte	*iend = in + inLen;
+	byte		*op = out + LZ_HEADER;
+	byte		*oend;
+	size_t		outLen;
+
+	if( inLen >= LZ_STORED || maxOut < LZ_HEADER )
+		return 0;
+
+	// never produce more than stored data
+	oend = out + min( maxOut, inLen + LZ_HEADER );
+	Q_memset( table, 0xFF, sizeof( table ));
+
+	while( op && ip + LZ_MIN_MATCH <= iend )
+	{
+		uint		h = LZ_Hash( ip );
+		int		ref = table[h];
+		const byte	*match;
+		size_t		len;
+
+		table[h] = ip - in;
+
+		if( ref < 0 || ( ip - in ) - ref > LZ_MAX_OFFSET || LZ_Read32( in + ref ) != LZ_Read32( ip ))
+		{
+			ip++;
+			continue;
+		}
+
+		match = in + ref;
+		len = LZ_MIN_MATCH;
+		while( ip + len < iend && match[len] == ip[len] )
+			len++;
+
+		op = LZ_EmitSequence( op, oend, anchor, ip - anchor, ip - match, len );
+		ip += len;
+		anchor = ip;
+	}
+
+	if( op ) op = LZ_EmitSequence( op, oend, anchor, iend - anchor, 0, 0 );
+
+	if( op )
+	{
+		outLen = op - out;
+	}
+	else
+	{
+		// incompressible, store as is
+		if( inLen + LZ_HEADER > maxOut )
+			return 0;
+
+		Q_memcpy( out + LZ_HEADER, in, inLen );
+		outLen = inLen + LZ_HEADER;
+		inLen |= LZ_STORED;
+	}
+
+	out[0] = inLen & 0xFF;
+	out[1] = ( inLen >> 8 ) & 0xFF;
+	out[2] = ( inLen >> 16 ) & 0xFF;
+	out[3] = ( inLen >> 24 ) & 0xFF;
+
+	return outLen;
+}
+
+/*
+============
+LZ_DecompressBlock
+
+Returns decompressed length or -1 on corrupted data
+============
+*/
+int LZ_DecompressBlock( const byte *in, size_t inLen, byte *out, size_t maxOut )
+{
+	const byte	*ip = in + LZ_HEADER;
+	const byte	*iend = in + inLen;
+	byte		*op = out;
+	size_t		outLen, len;
+	int		token, offset;
+
+	if( inLen < LZ_HEADER )
+		return -1;
+
+	outLen = LZ_Read32( in );
+
+	if( outLen & LZ_STORED )
+	{
+		outLen &= ~LZ_STORED;
+		if( outLen > maxOut || outLen > inLen - LZ_HEADER )
+			return -1;
+		Q_memcpy( out, ip, outLen );
+		return outLen;
+	}
+
+	if( outLen > maxOut )
+		return -1;
+
+	while( ip < iend )
+	{
+		token = *ip++;
+
+		len = token >> 4;
+		if( len == 15 && !LZ_ReadLength( &ip, iend, &len ))
+			return -1;
+
+		if( len > (size_t)( iend - ip ) || len > outLen - ( op - out ))
+			return -1;
+
+		Q_memcpy( op, ip, len );
+		ip += len;
+		op += len;
+
+		if( ip >= iend ) break;
+
+		if( iend - ip < 2 )
+			return -1;
+
+		offset = ip[0] | ( ip[1] << 8 );
+		ip += 2;
+
+		if( offset == 0 || offset > op - out )
+			return -1;
+
+		len = token & 15;
+		if( len == 15 && !LZ_ReadLength( &ip, iend, &len ))
+			return -1;
+		len += LZ_MIN_MATCH;
+
+		if( len > outLen - ( op - out ))
+			return -1;
+
+		if( offset >= len )
+		{
+			Q_memcpy( op, op - offset, len );
+			op += len;
+		}
+		else
+		{
+			const byte	*match = op - offset;
+
+			// overlapped copy repeats the pattern
+			while( len-- ) *op++ = *match++;
+		}
+	}
+
+	if( op - out != outLen )
+		return -1;
+
+	return outLen;
+}
@@ -83,6 +83,17 @@ NET
 #define NET_EXT_HUFF		(1U<<0)
 #define NET_EXT_SPLIT		(1U<<1)
 #define NET_EXT_SPLITHUFF	(1U<<2)
+#define NET_EXT_HUFF_STATIC	(1U<<3)	// static table Huffman for packets, requires NET_EXT_HUFF
+#define NET_EXT_LZ		(1U<<4)	// LZ for fragments and split packets
+
+// payload codecs, NET_CODEC_HUFF is the original adaptive Huffman
+#define NET_CODEC_NONE		0
+#define NET_CODEC_HUFF		1
+#define NET_CODEC_HUFF_STATIC		2
+#define NET_CODEC_LZ		3
+#define NET_CODEC_COUNT		4
+
+#define NET_CODEC_OVERHEAD		4	// max header bytes added to stored data
 
 // message data
 typedef struct
@@ -101,6 +112,18 @@ typedef struct
 	int		totalbytes;
 } flow_t;
 
+// reference counted payload shared by outgoing fragments
+typedef struct fragsource_s
+{
+	struct fragsource_s	*next;		// next shared source
+	int		refcount;		// number of fragments looking at the data
+	char		filename[CS_SIZE];	// empty for private buffers
+	fs_offset_t	mtime;		// file time and size when the source was made
+	byte		*data;		// NULL if the file is streamed
+	file_t		*file;		// big files are read fragment by fragment
+	int		size;
+} fragsource_t;
+
 // generic fragment structure
 typedef struct fragbuf_s
 {
@@ -113,6 +136,7 @@ typedef struct fragbuf_s
 	char		filename[CS_SIZE];	// name of the file to save out on remote host
 	int		foffset;		// offset in file from which to read data  
 	int		size;		// size of data to read at that offset
+	fragsource_t	*source;		// if set, data is source->data + foffset and frag_message holds header only
 } fragbuf_t;
 
 // Waiting list of fragbuf chains
@@ -121,6 +145,7 @@ typedef struct fragbufwaiting_s
 	struct fragbufwaiting_s	*next;	// next chain in waiting list
 	int		fragbufcount;	// number of buffers in this chain
 	fragbuf_t		*fragbufs;	// the actual buffers
+	fragbuf_t		*lastbuf;		// tail of fragbufs chain
 } fragbufwaiting_t;
 
 
@@ -167,7 +192,7 @@ typedef struct netchan_s
 	netadr_t		remote_address;	// address this channel is talking to.  
 	int		qport;		// qport value to write when transmitting
 	
-	qboolean		compress;		// enable huffman compression
+	int		compress;		// packet codec, NET_CODEC_*
 			
 	double		last_received;	// for timeouts
 	double		last_sent;	// for retransmits		
@@ -226,13 +251,15 @@ typedef struct netchan_s
 	size_t		total_received;
 	size_t		total_received_uncompressed;
 	qboolean	split;
-	qboolean	splitcompress;
+	int		splitcompress;	// split packet codec
+	int		fragcompress;	// normal fragment stream codec
 	unsigned int	maxpacket;
 	unsigned int	splitid;
 	netsplit_t netsplit;
 } netchan_t;
 
 extern netadr_t		net_from;
+extern double		net_recvtime;	// host.realtime when last packet has arrived
 extern netadr_t		net_local;
 extern sizebuf_t		net_message;
 extern byte		net_message_buffer[NET_MAX_PAYLOAD];
@@ -261,7 +288,11 @@ void Netchan_Clear( netchan_t *chan );
 void Netchan_ReportFlow( netchan_t *chan );
 
 // packet splitting
-qboolean NetSplit_GetLong(netsplit_t *ns, netadr_t *from, byte *data, size_t *length , qboolean decompress );
+qboolean NetSplit_GetLong(netsplit_t *ns, netadr_t *from, byte *data, size_t *length , int codec );
+
+// payload compression
+size_t Netchan_CompressData( int codec, const byte *in, size_t inLen, byte *out, size_t maxOut );
+int Netchan_DecompressData( int codec, const byte *in, size_t inLen, byte *out, size_t maxOut );
 
 // huffman compression
 void Huff_Init( void );
@@ -269,5 +300,11 @@ void Huff_CompressPacket( sizebuf_t *msg, int offset );
 void Huff_DecompressPacket( sizebuf_t *msg, int offset );
 void Huff_CompressData( byte *data, size_t *length );
 void Huff_DecompressData( byte *data, size_t *length );
+size_t Huff_CompressStatic( const byte *in, size_t inLen, byte *out, size_t maxOut );
+int Huff_DecompressStatic( const byte *in, size_t inLen, byte *out, size_t maxOut );
+
+// lz compression
+size_t LZ_CompressBlock( const byte *in, size_t inLen, byte *out, size_t maxOut );
+int LZ_DecompressBlock( const byte *in, size_t inLen, byte *out, size_t maxOut );
 
 #endif//NET_MSG_H
@@ -13,6 +13,13 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 GNU General Public License for more details.
 */
 
+#if defined( __linux__ ) && !defined( XASH_NO_MMSG )
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	// recvmmsg, sendmmsg
+#endif
+#define HAVE_MMSG
+#endif
+
 #ifdef _WIN32
 // Winsock2
 #include <ws2tcpip.h>
@@ -127,6 +134,8 @@ static convar_t *net_port;
 extern convar_t *net_showpackets;
 static convar_t	*net_fakelag;
 static convar_t	*net_fakeloss;
+static convar_t	*net_batch;
+static convar_t	*net_thread;
 void NET_Restart_f( void );
 
 extern convar_t *host_ver;
@@ -908,7 +917,7 @@ static qboolean NET_LagPacket( qboolean newdata, netsrc_t sock, netadr_t *from,
 
 		newPacketLag = (packetlag_t *)Z_Malloc( sizeof( packetlag_t ));
 		// queue packet to simulate fake lag
-		NET_AddToLagged( sock, &lagdata[sock], newPacketLag, from, *length, data, curtime );
+		NET_AddToLagged( sock, &lagdata[sock], newPacketLag, from, *length, data, net_recvtime );
 	}
 
 	packet = lagdata[sock].next;
@@ -930,6 +939,7 @@ static qboolean NET_LagPacket( qboolean newdata, netsrc_t sock, netadr_t *from,
 	memcpy( data, packet->data, packet->size );
 	memcpy( &net_from, &packet->from, sizeof( netadr_t ));
 	*length = packet->size;
+	net_recvtime = curtime;
 
 	if( packet->data )
 		Mem_Free( packet->data );
@@ -940,6 +950,633 @@ static qboolean NET_LagPacket( qboolean newdata, netsrc_t sock, netadr_t *from,
 }
 
 
+/*
+=============================================================================
+
+BATCHED SOCKET I/O
+
+=============================================================================
+*/
+#define NET_BATCH_RECV	16		// datagrams per recvmmsg
+#define NET_BATCH_SEND	64		// datagrams per sendmmsg
+#define NET_BATCH_BYTES	(256 * 1024)	// queued outgoing data
+
+typedef struct
+{
+	byte		*data[NET_BATCH_RECV];
+	struct sockaddr	addr[NET_BATCH_RECV];
+	int		length[NET_BATCH_RECV];
+	int		count;
+	int		current;
+} net_recvbatch_t;
+
+typedef struct
+{
+	qboolean		active;
+	SOCKET		net_socket;
+	byte		*data;
+	int		datasize;
+	struct sockaddr	addr[NET_BATCH_SEND];
+	netadr_t		to[NET_BATCH_SEND];
+	int		offset[NET_BATCH_SEND];
+	int		length[NET_BATCH_SEND];
+	int		count;
+} net_sendbatch_t;
+
+typedef struct
+{
+	double		recv_calls;
+	double		recv_packets;
+	double		send_calls;
+	double		send_packets;
+	double		starttime;
+	int		startframe;
+} net_iostats_t;
+
+#ifdef HAVE_MMSG
+static volatile qboolean	recvmmsg_supported = true;	// cleared by the receiving thread on ENOSYS
+static qboolean		recvmmsg_noted;		// main thread told about it
+static qboolean		sendmmsg_supported = true;	// cleared if kernel returns ENOSYS
+static net_recvbatch_t	recvbatch[NS_COUNT];
+#endif
+static net_sendbatch_t	sendbatch[NS_COUNT];
+static net_iostats_t	net_iostats;
+
+/*
+====================
+NET_ClearBatches
+
+drop all pending packets, sockets was closed
+====================
+*/
+static void NET_ClearBatches( void )
+{
+	int	i;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+#ifdef HAVE_MMSG
+		recvbatch[i].count = recvbatch[i].current = 0;
+#endif
+		sendbatch[i].count = sendbatch[i].datasize = 0;
+		sendbatch[i].active = false;
+	}
+}
+
+/*
+====================
+NET_RecvFrom
+
+recvfrom wrapper that reads ahead the whole batch of datagrams.
+May run on the network thread, so the syscalls are only added
+to calls, the caller hands them over to net_iostats
+====================
+*/
+static int NET_RecvFrom( netsrc_t sock, SOCKET net_socket, byte *data, struct sockaddr *addr, int *calls )
+{
+	socklen_t	addr_len;
+#ifdef HAVE_MMSG
+	net_recvbatch_t	*b = &recvbatch[sock];
+	struct mmsghdr	msgs[NET_BATCH_RECV];
+	struct iovec	iov[NET_BATCH_RECV];
+	int		i, ret;
+
+	if( b->current < b->count )
+	{
+		// deliver the queued datagram
+		i = b->current++;
+		Q_memcpy( data, b->data[i], b->length[i] );
+		*addr = b->addr[i];
+		return b->length[i];
+	}
+
+	if( net_batch->integer && recvmmsg_supported )
+	{
+		Q_memset( msgs, 0, sizeof( msgs ));
+
+		for( i = 0; i < NET_BATCH_RECV; i++ )
+		{
+			if( !b->data[i] ) b->data[i] = Z_Malloc( NET_MAX_PAYLOAD );
+			iov[i].iov_base = b->data[i];
+			iov[i].iov_len = NET_MAX_PAYLOAD;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &b->addr[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof( b->addr[i] );
+		}
+
+		ret = recvmmsg( net_socket, msgs, NET_BATCH_RECV, MSG_DONTWAIT, NULL );
+		(*calls)++;
+
+		if( ret > 0 )
+		{
+			for( i = 0; i < ret; i++ )
+				b->length[i] = msgs[i].msg_len;
+
+			b->count = ret;
+			b->current = 1;
+
+			Q_memcpy( data, b->data[0], b->length[0] );
+			*addr = b->addr[0];
+			return b->length[0];
+		}
+
+		if( ret == 0 || errno != ENOSYS )
+			return SOCKET_ERROR; // errno is kept for caller
+
+		// NET_GetPacket tells about it
+		recvmmsg_supported = false;
+	}
+#endif
+	addr_len = sizeof( *addr );
+	(*calls)++;
+
+	return pRecvFrom( net_socket, data, NET_MAX_PAYLOAD, 0, addr, &addr_len );
+}
+
+/*
+====================
+NET_SendError
+
+returns true if error is not silent
+====================
+*/
+static qboolean NET_SendError( netadr_t to )
+{
+#ifdef _WIN32
+	int err = WSAGetLastError();
+
+	// WSAEWOULDBLOCK is silent
+	if (err == WSAEWOULDBLOCK)
+		return false;
+
+	// some PPP links don't allow broadcasts
+	if ((err == WSAEADDRNOTAVAIL) && ((to.type == NA_BROADCAST) || (to.type == NA_BROADCAST_IPX)))
+		return false;
+
+	return true;
+#else
+	// WSAEWOULDBLOCK is silent
+	if( errno == EWOULDBLOCK )
+		return false;
+
+	// some PPP links don't allow broadcasts
+	if(( errno == EADDRNOTAVAIL ) && (( to.type == NA_BROADCAST ) || ( to.type == NA_BROADCAST_IPX )))
+		return false;
+
+	return true;
+#endif
+}
+
+/*
+====================
+NET_FlushSendBatch
+
+send all the queued datagrams and stop batching
+====================
+*/
+void NET_FlushSendBatch( netsrc_t sock )
+{
+	net_sendbatch_t	*b = &sendbatch[sock];
+	int		i = 0, ret;
+#ifdef HAVE_MMSG
+	struct mmsghdr	msgs[NET_BATCH_SEND];
+	struct iovec	iov[NET_BATCH_SEND];
+
+	Q_memset( msgs, 0, sizeof( msgs ));
+
+	for( i = 0; i < b->count; i++ )
+	{
+		iov[i].iov_base = b->data + b->offset[i];
+		iov[i].iov_len = b->length[i];
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &b->addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof( b->addr[i] );
+	}
+
+	for( i = 0; i < b->count && sendmmsg_supported; )
+	{
+		ret = sendmmsg( b->net_socket, msgs + i, b->count - i, 0 );
+		net_iostats.send_calls++;
+
+		if( ret > 0 )
+		{
+			net_iostats.send_packets += ret;
+			i += ret;
+			continue;
+		}
+
+		if( errno == ENOSYS )
+		{
+			MsgDev( D_NOTE, "NET_FlushSendBatch: sendmmsg is not supported, using sendto\n" );
+			sendmmsg_supported = false;
+			break;
+		}
+
+		// skip the failed datagram
+		if( NET_SendError( b->to[i] ))
+			MsgDev( D_ERROR, "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( b->to[i] ));
+		i++;
+	}
+#endif
+	// send the rest one by one
+	for( ; i < b->count; i++ )
+	{
+		ret = pSendTo( b->net_socket, b->data + b->offset[i], b->length[i], 0, &b->addr[i], sizeof( b->addr[i] ));
+		net_iostats.send_calls++;
+		net_iostats.send_packets++;
+
+		if( ret < 0 && NET_SendError( b->to[i] ))
+			MsgDev( D_ERROR, "NET_SendPacket: %s to %s\n", NET_ErrorString(), NET_AdrToString( b->to[i] ));
+	}
+
+	b->count = b->datasize = 0;
+	b->active = false;
+}
+
+/*
+====================
+NET_BeginSendBatch
+
+queue all the outgoing datagrams until NET_FlushSendBatch
+====================
+*/
+void NET_BeginSendBatch( netsrc_t sock )
+{
+#ifdef HAVE_MMSG
+	net_sendbatch_t	*b = &sendbatch[sock];
+
+	if( b->count ) NET_FlushSendBatch( sock );
+
+	if( !net_batch->integer || !sendmmsg_supported )
+		return;
+
+	if( !b->data ) b->data = Z_Malloc( NET_BATCH_BYTES );
+	b->active = true;
+#endif
+}
+
+/*
+====================
+NET_QueuePacket
+
+returns false if packet should be sent immediately
+====================
+*/
+static qboolean NET_QueuePacket( netsrc_t sock, SOCKET net_socket, const void *data, size_t length, struct sockaddr *addr, netadr_t to )
+{
+	net_sendbatch_t	*b = &sendbatch[sock];
+
+	if( !b->active || length > NET_BATCH_BYTES )
+		return false;
+
+	// socket was changed or queue is full
+	if( b->count && ( b->net_socket != net_socket || b->count == NET_BATCH_SEND || b->datasize + length > NET_BATCH_BYTES ))
+	{
+		NET_FlushSendBatch( sock );
+		b->active = true;
+	}
+
+	b->net_socket = net_socket;
+	b->addr[b->count] = *addr;
+	b->to[b->count] = to;
+	b->offset[b->count] = b->datasize;
+	b->length[b->count] = length;
+	Q_memcpy( b->data + b->datasize, data, length );
+	b->datasize += length;
+	b->count++;
+
+	return true;
+}
+
+/*
+====================
+NET_IOStats_f
+
+====================
+*/
+void NET_IOStats_f( void )
+{
+	double	time = host.realtime - net_iostats.starttime;
+	int	frames = host.framecount - net_iostats.startframe;
+#ifdef HAVE_MMSG
+	Msg( "batched i/o: %s\n", ( net_batch->integer && recvmmsg_supported && sendmmsg_supported ) ? "enabled" : "disabled" );
+#else
+	Msg( "batched i/o: not supported\n" );
+#endif
+
+	if( time > 0.0 && frames > 0 )
+	{
+		Msg( "recv: %.0f packets/sec, %.2f syscalls per frame, %.2f packets per syscall\n", net_iostats.recv_packets / time,
+			net_iostats.recv_calls / frames, net_iostats.recv_calls ? net_iostats.recv_packets / net_iostats.recv_calls : 0.0 );
+		Msg( "send: %.0f packets/sec, %.2f syscalls per frame, %.2f packets per syscall\n", net_iostats.send_packets / time,
+			net_iostats.send_calls / frames, net_iostats.send_calls ? net_iostats.send_packets / net_iostats.send_calls : 0.0 );
+	}
+
+	// start the new measure
+	Q_memset( &net_iostats, 0, sizeof( net_iostats ));
+	net_iostats.starttime = host.realtime;
+	net_iostats.startframe = host.framecount;
+}
+
+/*
+=============================================================================
+
+NETWORK THREAD
+
+=============================================================================
+*/
+#define NET_RING_SIZE	(1024 * 1024)	// per socket, must be multiple of 8
+#define NET_RING_WRAP	-1		// the rest of ring is unused
+
+#ifdef _WIN32
+#define NET_Barrier()	MemoryBarrier()
+#else
+#define NET_Barrier()	__sync_synchronize()
+#endif
+
+// packet header in the ring, followed by packet data
+typedef struct
+{
+	int		length;
+	int		calls;		// recv syscalls since the previous packet
+	double		time;		// Sys_DoubleTime on arrival
+	struct sockaddr	addr;
+} net_ringmsg_t;
+
+#define NET_RING_MSGSIZE( len )	(( sizeof( net_ringmsg_t ) + ( len ) + 7 ) & ~7 )
+
+// single producer (network thread) single consumer (main thread) queue
+typedef struct
+{
+	byte		*data;
+	volatile int	head;		// written by network thread only
+	volatile int	tail;		// written by main thread only
+	int		dropped;		// ring was full
+} net_ring_t;
+
+static struct
+{
+	void		*thread;
+	volatile qboolean	quit;
+	net_ring_t	rings[NS_COUNT];
+} net_iothread;
+
+/*
+====================
+NET_RingReserve
+
+returns the place for the biggest packet or NULL if ring is full
+====================
+*/
+static net_ringmsg_t *NET_RingReserve( net_ring_t *ring )
+{
+	int	need = NET_RING_MSGSIZE( NET_MAX_PAYLOAD );
+	int	head = ring->head;
+	int	tail = ring->tail;
+
+	NET_Barrier();
+
+	if( head >= tail )
+	{
+		if( head + need < NET_RING_SIZE )
+			return (net_ringmsg_t *)( ring->data + head );
+
+		// start over if the beginning is free
+		if( need >= tail ) return NULL;
+
+		// reader wraps by itself if there is no room for header
+		if( head + sizeof( net_ringmsg_t ) <= NET_RING_SIZE )
+			((net_ringmsg_t *)( ring->data + head ))->length = NET_RING_WRAP;
+
+		return (net_ringmsg_t *)ring->data;
+	}
+
+	if( head + need < tail )
+		return (net_ringmsg_t *)( ring->data + head );
+
+	return NULL;
+}
+
+static void NET_RingCommit( net_ring_t *ring, net_ringmsg_t *msg )
+{
+	// packet data must be visible before the head is moved
+	NET_Barrier();
+	ring->head = ((byte *)msg - ring->data ) + NET_RING_MSGSIZE( msg->length );
+}
+
+/*
+====================
+NET_RingRead
+
+main thread: fetch the next packet, returns SOCKET_ERROR if ring is empty
+====================
+*/
+static int NET_RingRead( net_ring_t *ring, byte *data, struct sockaddr *addr, double *time, int *calls )
+{
+	net_ringmsg_t	*msg;
+	int		tail = ring->tail;
+	int		length;
+
+	if( tail == ring->head )
+		return SOCKET_ERROR;
+
+	NET_Barrier();
+
+	if( tail + sizeof( net_ringmsg_t ) > NET_RING_SIZE )
+		tail = 0;
+
+	msg = (net_ringmsg_t *)( ring->data + tail );
+	if( msg->length == NET_RING_WRAP )
+	{
+		tail = 0;
+		msg = (net_ringmsg_t *)ring->data;
+	}
+
+	length = msg->length;
+	Q_memcpy( data, msg + 1, length );
+	*addr = msg->addr;
+	*time = msg->time;
+	*calls = msg->calls;
+
+	// we are done with this packet
+	NET_Barrier();
+	ring->tail = tail + NET_RING_MSGSIZE( length );
+
+	return length;
+}
+
+/*
+====================
+NET_IODrain
+
+network thread: move the datagrams of the socket to the ring,
+returns false if the ring is full
+====================
+*/
+static qboolean NET_IODrain( netsrc_t sock, int *calls )
+{
+	net_ringmsg_t	*msg;
+	int		ret;
+
+	while( 1 )
+	{
+		if(( msg = NET_RingReserve( &net_iothread.rings[sock] )) == NULL )
+			return false;
+
+		ret = NET_RecvFrom( sock, ip_sockets[sock], (byte *)( msg + 1 ), &msg->addr, calls );
+		if( ret < 0 ) return true; // would block or error
+
+		msg->length = ret;
+		msg->calls = *calls;
+		msg->time = Sys_DoubleTime();
+		*calls = 0;
+		NET_RingCommit( &net_iothread.rings[sock], msg );
+	}
+}
+
+/*
+====================
+NET_IOThread
+
+owns the sockets while running, reads and timestamps
+all the incoming packets. Nothing shared is written here
+but the rings, syscall counts go along with the packets
+====================
+*/
+static void NET_IOThread( void *unused )
+{
+	struct timeval	timeout;
+	fd_set		fdset;
+	int		i, maxfd, numfds;
+	int		calls[NS_COUNT];
+	qboolean		full[NS_COUNT];
+	qboolean		stalled;
+
+	Q_memset( calls, 0, sizeof( calls ));
+	Q_memset( full, 0, sizeof( full ));
+
+	while( !net_iothread.quit )
+	{
+		// main thread is stalled, the kernel and the recvmmsg batch keep
+		// the datagrams until the ring has room. select won't wake up
+		// for the batched ones, so these sockets are polled instead
+		for( i = 0, stalled = false; i < NS_COUNT; i++ )
+		{
+			if( !full[i] ) continue;
+
+			if( ip_sockets[i] && !NET_IODrain( i, &calls[i] ))
+				stalled = true;
+			else full[i] = false;
+		}
+
+		FD_ZERO( &fdset );
+		maxfd = numfds = 0;
+
+		for( i = 0; i < NS_COUNT; i++ )
+		{
+			if( !ip_sockets[i] || full[i] ) continue;
+			FD_SET( ip_sockets[i], &fdset );
+			maxfd = max( maxfd, ip_sockets[i] );
+			numfds++;
+		}
+
+		if( !numfds )
+		{
+			Sys_Sleep( 1 );
+			continue;
+		}
+
+		// wake up periodically to check for quit, or soon
+		// to poll the full rings again
+		timeout.tv_sec = 0;
+		timeout.tv_usec = stalled ? 1000 : 10000;
+
+		if( pSelect( maxfd + 1, &fdset, NULL, NULL, &timeout ) <= 0 )
+			continue;
+
+		for( i = 0; i < NS_COUNT; i++ )
+		{
+			if( !ip_sockets[i] || full[i] || !FD_ISSET( ip_sockets[i], &fdset ))
+				continue;
+
+			if( !NET_IODrain( i, &calls[i] ))
+			{
+				net_iothread.rings[i].dropped++;
+				full[i] = true;
+			}
+		}
+	}
+}
+
+/*
+====================
+NET_StopThread
+
+give the sockets back to the main thread
+====================
+*/
+static void NET_StopThread( void )
+{
+	int	i;
+
+	if( !net_iothread.thread )
+		return;
+
+	net_iothread.quit = true;
+	Sys_WaitThread( net_iothread.thread );
+	net_iothread.thread = NULL;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		if( net_iothread.rings[i].dropped )
+			MsgDev( D_WARN, "NET_StopThread: %s queue was full %i times\n", i == NS_SERVER ? "server" : "client", net_iothread.rings[i].dropped );
+		net_iothread.rings[i].head = net_iothread.rings[i].tail = 0;
+		net_iothread.rings[i].dropped = 0;
+	}
+}
+
+/*
+====================
+NET_StartThread
+
+====================
+*/
+static void NET_StartThread( void )
+{
+	int	i;
+
+	if( net_iothread.thread || !net_thread->integer )
+		return;
+
+	if( !ip_sockets[NS_SERVER] && !ip_sockets[NS_CLIENT] )
+		return;
+
+	for( i = 0; i < NS_COUNT; i++ )
+	{
+		if( !net_iothread.rings[i].data )
+			net_iothread.rings[i].data = Z_Malloc( NET_RING_SIZE );
+		net_iothread.rings[i].head = net_iothread.rings[i].tail = 0;
+#ifdef HAVE_MMSG
+		// thread can't allocate memory
+		{
+			int	j;
+
+			for( j = 0; j < NET_BATCH_RECV; j++ )
+				if( !recvbatch[i].data[j] ) recvbatch[i].data[j] = Z_Malloc( NET_MAX_PAYLOAD );
+		}
+#endif
+	}
+
+	net_iothread.quit = false;
+	net_iothread.thread = Sys_CreateThread( NET_IOThread, NULL );
+
+	if( !net_iothread.thread )
+		MsgDev( D_ERROR, "NET_StartThread: couldn't create network thread\n" );
+	else MsgDev( D_INFO, "Network thread started\n" );
+}
+
 /*
 ==================
 NET_GetPacket
@@ -951,9 +1588,8 @@ qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *lengt
 {
 	int 		ret = SOCKET_ERROR;
 	struct sockaddr	addr;
-	socklen_t	addr_len;
 	int		net_socket = 0;
-	int		protocol;
+	int		protocol, calls;
 
 	Q_memset( &addr, 0, sizeof( struct sockaddr ) );
 
@@ -964,6 +1600,7 @@ qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *lengt
 
 	if( NET_GetLoopPacket( sock, from, data, length ))
 	{
+		net_recvtime = host.realtime;
 		NET_LagPacket( true, sock, from, length, data );
 		return true;
 	}
@@ -974,8 +1611,33 @@ qboolean NET_GetPacket( netsrc_t sock, netadr_t *from, byte *data, size_t *lengt
 
 		if( !net_socket ) continue;
 
-		addr_len = sizeof( addr );
-		ret = pRecvFrom( net_socket, data, NET_MAX_PAYLOAD, 0, (struct sockaddr *)&addr, &addr_len );
+		calls = 0;
+
+		if( net_iothread.thread )
+		{
+			double	time;
+
+			ret = NET_RingRead( &net_iothread.rings[sock], data, &addr, &time, &calls );
+			if( NET_IsSocketError( ret )) return false; // queue is empty, same as EWOULDBLOCK
+
+			// packet may wait for the whole frame
+			net_recvtime = host.realtime - ( Sys_DoubleTime() - time );
+		}
+		else
+		{
+			ret = NET_RecvFrom( sock, net_socket, data, &addr, &calls );
+			net_recvtime = host.realtime;
+		}
+
+		net_iostats.recv_calls += calls;
+		if( !NET_IsSocketError( ret )) net_iostats.recv_packets++;
+#ifdef HAVE_MMSG
+		if( !recvmmsg_supported && !recvmmsg_noted )
+		{
+			MsgDev( D_NOTE, "NET_GetPacket: recvmmsg is not supported, using recvfrom\n" );
+			recvmmsg_noted = true;
+		}
+#endif
 
 		NET_SockadrToNetadr( &addr, from );
 
@@ -1054,7 +1716,12 @@ void NET_SendPacket( netsrc_t sock, size_t length, const void *data, netadr_t to
 
 	NET_NetadrToSockadr( &to, &addr );
 
+	if( NET_QueuePacket( sock, net_socket, data, length, &addr, to ))
+		return;
+
 	ret = pSendTo( net_socket, data, length, 0, &addr, sizeof( addr ));
+	net_iostats.send_calls++;
+	net_iostats.send_packets++;
 
 #ifdef _WIN32
 	if (ret == SOCKET_ERROR)
@@ -1303,6 +1970,9 @@ void NET_Config( qboolean multiplayer, qboolean changeport )
 
 	old_config = multiplayer;
 
+	// sockets may be closed or reopened
+	NET_StopThread ();
+
 	if( !multiplayer && !Host_IsDedicated() )
 	{	
 		int	i;
@@ -1330,7 +2000,11 @@ void NET_Config( qboolean multiplayer, qboolean changeport )
 		}
 	}
 
+	NET_ClearBatches ();
 	NET_ClearLoopback ();
+
+	if( multiplayer || Host_IsDedicated( ))
+		NET_StartThread ();
 }
 
 /*
@@ -1393,6 +2067,9 @@ void NET_Init( void )
 
 	net_fakelag = Cvar_Get( "net_fakelag", "0", 0, "lag all incoming network data (including loopback) by xxx ms." );
 	net_fakeloss = Cvar_Get( "net_fakeloss", "0", 0, "act like we dropped the packet this % of the time." );
+	net_batch = Cvar_Get( "net_batch", "1", 0, "read and send datagrams in batches where the system supports it" );
+	net_thread = Cvar_Get( "net_thread", "0", CVAR_ARCHIVE, "read incoming packets on a dedicated thread (applied on net_restart)" );
+	Cmd_AddCommand( "net_iostats", NET_IOStats_f, "show packets per second and socket calls per frame" );
 
 	// prepare some network data
 	for( i = 0; i < NS_COUNT; i++ )
@@ -1421,6 +2098,7 @@ void NET_Shutdown( void )
 
 	Cmd_RemoveCommand( "net_showip" );
 	Cmd_RemoveCommand( "net_restart" );
+	Cmd_RemoveCommand( "net_iostats" );
 
 	NET_ClearLagData( true, true );
 
@@ -17,9 +17,31 @@ GNU General Public License for more details.
 #define PM_LOCAL_H
 
 #include "pm_defs.h"
+#include "mod_local.h"
 
 typedef int (*pfnIgnore)( physent_t *pe );	// custom trace filter
 
+// trace state shared by trace_t and pmtrace_t users
+typedef struct
+{
+	qboolean		allsolid;
+	qboolean		startsolid;
+	qboolean		inopen, inwater;
+	float		fraction;
+	vec3_t		endpos;
+	vec3_t		normal;		// impact plane
+	float		dist;
+} hulltrace_t;
+
+#define HULLTRACE_LOAD( ht, tr )	((ht)->allsolid = (tr)->allsolid, (ht)->startsolid = (tr)->startsolid, \
+				(ht)->inopen = (tr)->inopen, (ht)->inwater = (tr)->inwater, (ht)->fraction = (tr)->fraction, \
+				VectorCopy( (tr)->endpos, (ht)->endpos ), VectorCopy( (tr)->plane.normal, (ht)->normal ), \
+				(ht)->dist = (tr)->plane.dist )
+#define HULLTRACE_STORE( ht, tr )	((tr)->allsolid = (ht)->allsolid, (tr)->startsolid = (ht)->startsolid, \
+				(tr)->inopen = (ht)->inopen, (tr)->inwater = (ht)->inwater, (tr)->fraction = (ht)->fraction, \
+				VectorCopy( (ht)->endpos, (tr)->endpos ), VectorCopy( (ht)->normal, (tr)->plane.normal ), \
+				(tr)->plane.dist = (ht)->dist )
+
 //
 // pm_trace.c
 //
@@ -29,6 +51,7 @@ hull_t *PM_HullForBsp( physent_t *pe, playermove_t *pmove, float *offset );
 pmtrace_t PM_PlayerTraceExt( playermove_t *pm, vec3_t p1, vec3_t p2, int flags, int numents, physent_t *ents, int ignore_pe, pfnIgnore pmFilter );
 int PM_TestPlayerPosition( playermove_t *pmove, vec3_t pos, pmtrace_t *ptrace, pfnIgnore pmFilter );
 int PM_HullPointContents( hull_t *hull, int num, const vec3_t p );
+qboolean PM_HullTrace( hull_t *hull, const mhullnode_t *packed, int num, float p1f, float p2f, const vec3_t start, const vec3_t end, hulltrace_t *trace );
 
 //
 // pm_surface.c
@@ -22,9 +22,21 @@ GNU General Public License for more details.
 #include "studio.h"
 #include "world.h"
 
-static mplane_t	pm_boxplanes[6];
-static dclipnode_t	pm_boxclipnodes[6];
-static hull_t	pm_boxhull;
+#define MAX_HULL_STACK	64
+
+typedef struct
+{
+	int		num;		// node that splits the segment
+	int		side;		// near side
+	float		frac;
+	float		p1f, p2f, midf;
+	vec3_t		p1, p2, mid;
+} hullstack_t;
+
+// one box per thread, player moves may run on workers
+static mplane_t	pm_boxplanes[MAX_WORKERS+1][6];
+static dclipnode_t	pm_boxclipnodes[MAX_WORKERS+1][6];
+static hull_t	pm_boxhull[MAX_WORKERS+1];
 
 void Pmove_Init( void )
 {
@@ -41,26 +53,29 @@ can just be stored out and get a proper hull_t structure.
 */
 void PM_InitBoxHull( void )
 {
-	int	i, side;
+	int	i, j, side;
 
-	pm_boxhull.clipnodes = pm_boxclipnodes;
-	pm_boxhull.planes = pm_boxplanes;
-	pm_boxhull.firstclipnode = 0;
-	pm_boxhull.lastclipnode = 5;
-
-	for( i = 0; i < 6; i++ )
+	for( j = 0; j < MAX_WORKERS + 1; j++ )
 	{
-		pm_boxclipnodes[i].planenum = i;
+		pm_boxhull[j].clipnodes = pm_boxclipnodes[j];
+		pm_boxhull[j].planes = pm_boxplanes[j];
+		pm_boxhull[j].firstclipnode = 0;
+		pm_boxhull[j].lastclipnode = 5;
+
+		for( i = 0; i < 6; i++ )
+		{
+			pm_boxclipnodes[j][i].planenum = i;
 
-		side = i & 1;
+			side = i & 1;
 
-		pm_boxclipnodes[i].children[side] = CONTENTS_EMPTY;
-		if( i != 5 ) pm_boxclipnodes[i].children[side^1] = i + 1;
-		else pm_boxclipnodes[i].children[side^1] = CONTENTS_SOLID;
+			pm_boxclipnodes[j][i].children[side] = CONTENTS_EMPTY;
+			if( i != 5 ) pm_boxclipnodes[j][i].children[side^1] = i + 1;
+			else pm_boxclipnodes[j][i].children[side^1] = CONTENTS_SOLID;
 
-		pm_boxplanes[i].type = i>>1;
-		pm_boxplanes[i].normal[i>>1] = 1.0f;
-		pm_boxplanes[i].signbits = 0;
+			pm_boxplanes[j][i].type = i>>1;
+			pm_boxplanes[j][i].normal[i>>1] = 1.0f;
+			pm_boxplanes[j][i].signbits = 0;
+		}
 	}
 }
 
@@ -74,37 +89,84 @@ BSP trees instead of being compared directly.
 */
 hull_t *PM_HullForBox( const vec3_t mins, const vec3_t maxs )
 {
-	pm_boxplanes[0].dist = maxs[0];
-	pm_boxplanes[1].dist = mins[0];
-	pm_boxplanes[2].dist = maxs[1];
-	pm_boxplanes[3].dist = mins[1];
-	pm_boxplanes[4].dist = maxs[2];
-	pm_boxplanes[5].dist = mins[2];
-
-	return &pm_boxhull;
+	int	thread = Sys_WorkerIndex();
+	mplane_t	*planes = pm_boxplanes[thread];
+
+	planes[0].dist = maxs[0];
+	planes[1].dist = mins[0];
+	planes[2].dist = maxs[1];
+	planes[3].dist = mins[1];
+	planes[4].dist = maxs[2];
+	planes[5].dist = mins[2];
+
+	return &pm_boxhull[thread];
 }
 
 /*
 ==================
-PM_HullPointContents
+PM_HullNode
 
+fetch the node from packed array or unpack it
 ==================
 */
-int PM_HullPointContents( hull_t *hull, int num, const vec3_t p )
+_inline const mhullnode_t *PM_HullNode( const hull_t *hull, const mhullnode_t *packed, int num, mhullnode_t *out )
 {
-	mplane_t		*plane;
+	const dclipnode_t	*node;
+	const mplane_t	*plane;
 
-	if( !hull || !hull->planes )	// fantom bmodels?
-		return CONTENTS_NONE;
+	if( packed ) return packed + num;
+
+	node = hull->clipnodes + num;
+	plane = hull->planes + node->planenum;
+	out->children[0] = node->children[0];
+	out->children[1] = node->children[1];
+	out->dist = plane->dist;
+	out->plane = ( node->planenum << 2 ) | min( plane->type, 3 );
+
+	return out;
+}
+
+_inline float PM_HullNodeDiff( const hull_t *hull, const mhullnode_t *node, const vec3_t p )
+{
+	int	type = HULLNODE_TYPE( node );
+
+	if( type < 3 ) return p[type] - node->dist;
+	return DotProduct( p, hull->planes[HULLNODE_PLANE( node )].normal ) - node->dist;
+}
+
+/*
+==================
+PM_HullNodeContents
+
+==================
+*/
+static int PM_HullNodeContents( const hull_t *hull, const mhullnode_t *packed, int num, const vec3_t p )
+{
+	const mhullnode_t	*node;
+	mhullnode_t	temp;
 
 	while( num >= 0 )
 	{
-		plane = &hull->planes[hull->clipnodes[num].planenum];
-		num = hull->clipnodes[num].children[PlaneDiff( p, plane ) < 0];
+		node = PM_HullNode( hull, packed, num, &temp );
+		num = node->children[PM_HullNodeDiff( hull, node, p ) < 0];
 	}
 	return num;
 }
 
+/*
+==================
+PM_HullPointContents
+
+==================
+*/
+int PM_HullPointContents( hull_t *hull, int num, const vec3_t p )
+{
+	if( !hull || !hull->planes )	// fantom bmodels?
+		return CONTENTS_NONE;
+
+	return PM_HullNodeContents( hull, Mod_PackedHull( hull ), num, p );
+}
+
 /*
 ==================
 PM_HullForBsp
@@ -167,145 +229,200 @@ hull_t *PM_HullForStudio( physent_t *pe, playermove_t *pmove, int *numhitboxes )
 
 	return Mod_HullForStudio( pe->studiomodel, pe->frame, pe->sequence, pe->angles, pe->origin, size, pe->controller, pe->blending, numhitboxes, NULL );
 }
-/* "Not a number" possible here.
- * Enable this macro to debug it */
-#ifdef DEBUGNAN
-static void _assertNAN(const char *f, int l, const char *x)
-{
-	MsgDev( D_WARN, "NAN detected at %s:%i (%s)\n", f, l, x );
-}
-#define ASSERTNAN(x) if( !finitef(x) ) _assertNAN( __FILE__, __LINE__, #x );
-#else
-#define ASSERTNAN(x)
-#endif
 /*
 ==================
-PM_RecursiveHullCheck
+PM_HullTrace
+
+iterative hull trace shared by server and pmove, the stack
+keeps the nodes where the segment was split to pass them
+after the near side is done. packed can be NULL
 ==================
 */
-qboolean PM_RecursiveHullCheck( hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, pmtrace_t *trace )
+qboolean PM_HullTrace( hull_t *hull, const mhullnode_t *packed, int num, float p1f, float p2f, const vec3_t start, const vec3_t end, hulltrace_t *trace )
 {
-	dclipnode_t	*node;
-	mplane_t		*plane;
-	float		t1, t2;
-	float		frac, midf;
-	int		side;
-	vec3_t		mid;
-
-	// check for empty
-	if( num < 0 )
+	hullstack_t	stack[MAX_HULL_STACK], *s;
+	const mhullnode_t	*node;
+	mhullnode_t	temp;
+	float		t1, t2, frac, midf;
+	const float	*normal;
+	int		depth = 0;
+	int		side, type;
+	vec3_t		p1, p2, mid;
+	qboolean		result;
+
+	VectorCopy( start, p1 );
+	VectorCopy( end, p2 );
+descend:
+	while( num >= 0 )
 	{
-		if( num != CONTENTS_SOLID )
+		if( num < hull->firstclipnode || num > hull->lastclipnode )
+			Host_Error( "PM_HullTrace: bad node number %i\n", num );
+
+		// find the point distances
+		node = PM_HullNode( hull, packed, num, &temp );
+		type = HULLNODE_TYPE( node );
+
+		if( type < 3 )
 		{
-			trace->allsolid = false;
-			if( num == CONTENTS_EMPTY )
-				trace->inopen = true;
-			else trace->inwater = true;
+			t1 = p1[type] - node->dist;
+			t2 = p2[type] - node->dist;
+		}
+		else
+		{
+			normal = hull->planes[HULLNODE_PLANE( node )].normal;
+			t1 = DotProduct( normal, p1 ) - node->dist;
+			t2 = DotProduct( normal, p2 ) - node->dist;
 		}
-		else trace->startsolid = true;
-		return true; // empty
-	}
 
-	if( hull->firstclipnode >= hull->lastclipnode )
-	{
-		// studiotrace issues
-		trace->allsolid = false;
-		trace->inopen = true;
-		return true;
-	}
+		if( t1 >= 0.0f && t2 >= 0.0f )
+		{
+			num = node->children[0];
+			continue;
+		}
 
-	if( num < hull->firstclipnode || num > hull->lastclipnode )
-		Host_Error( "PM_RecursiveHullCheck: bad node number %i\n", num );
+		if( t1 < 0.0f && t2 < 0.0f )
+		{
+			num = node->children[1];
+			continue;
+		}
 
-	// find the point distances
-	node = hull->clipnodes + num;
-	plane = hull->planes + node->planenum;
+		// very deep tree, let the nested call finish this node
+		if( depth == MAX_HULL_STACK )
+		{
+			result = PM_HullTrace( hull, packed, num, p1f, p2f, p1, p2, trace );
+			goto unwind;
+		}
 
-	if( plane->type < 3 )
-	{
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
+		// put the crosspoint DIST_EPSILON pixels on the near side
+		side = (t1 < 0.0f);
+
+		if( side ) frac = ( t1 + DIST_EPSILON ) / ( t1 - t2 );
+		else frac = ( t1 - DIST_EPSILON ) / ( t1 - t2 );
+
+		if( frac < 0.0f ) frac = 0.0f;
+		if( frac > 1.0f ) frac = 1.0f;
+
+		midf = p1f + ( p2f - p1f ) * frac;
+		VectorLerp( p1, frac, p2, mid );
+
+		// remember the far side
+		s = &stack[depth++];
+		s->num = num;
+		s->side = side;
+		s->frac = frac;
+		s->p1f = p1f;
+		s->p2f = p2f;
+		s->midf = midf;
+		VectorCopy( p1, s->p1 );
+		VectorCopy( p2, s->p2 );
+		VectorCopy( mid, s->mid );
+
+		// move up to the node
+		num = node->children[side];
+		p2f = midf;
+		VectorCopy( mid, p2 );
 	}
-	else
+
+	// check for empty
+	if( num != CONTENTS_SOLID )
 	{
-		t1 = DotProduct( plane->normal, p1 ) - plane->dist;
-		t2 = DotProduct( plane->normal, p2 ) - plane->dist;
+		trace->allsolid = false;
+		if( num == CONTENTS_EMPTY )
+			trace->inopen = true;
+		else trace->inwater = true;
 	}
+	else trace->startsolid = true;
+	result = true;
+unwind:
+	while( depth > 0 )
+	{
+		s = &stack[--depth];
 
-	ASSERTNAN( t1 )
-	ASSERTNAN( t2 )
+		// impact was found on the near side
+		if( !result ) continue;
 
-	if( t1 >= 0.0f && t2 >= 0.0f )
-		return PM_RecursiveHullCheck( hull, node->children[0], p1f, p2f, p1, p2, trace );
-	if( t1 < 0.0f && t2 < 0.0f )
-		return PM_RecursiveHullCheck( hull, node->children[1], p1f, p2f, p1, p2, trace );
+		node = PM_HullNode( hull, packed, s->num, &temp );
 
-	ASSERTNAN( t1 )
-	ASSERTNAN( t2 )
+		if( PM_HullNodeContents( hull, packed, node->children[s->side^1], s->mid ) != CONTENTS_SOLID )
+		{
+			// go past the node
+			num = node->children[s->side^1];
+			p1f = s->midf;
+			p2f = s->p2f;
+			VectorCopy( s->mid, p1 );
+			VectorCopy( s->p2, p2 );
+			goto descend;
+		}
 
-	// put the crosspoint DIST_EPSILON pixels on the near side
-	side = (t1 < 0.0f);
+		result = false;
 
-	if( side ) frac = ( t1 + DIST_EPSILON ) / ( t1 - t2 );
-	else frac = ( t1 - DIST_EPSILON ) / ( t1 - t2 );
+		// never got out of the solid area
+		if( trace->allsolid )
+			continue;
 
-	ASSERTNAN( frac )
+		// the other side of the node is solid, this is the impact point
+		normal = hull->planes[HULLNODE_PLANE( node )].normal;
 
-	if( frac < 0.0f ) frac = 0.0f;
-	if( frac > 1.0f ) frac = 1.0f;
+		if( !s->side )
+		{
+			VectorCopy( normal, trace->normal );
+			trace->dist = node->dist;
+		}
+		else
+		{
+			VectorNegate( normal, trace->normal );
+			trace->dist = -node->dist;
+		}
 
-	midf = p1f + ( p2f - p1f ) * frac;
-	VectorLerp( p1, frac, p2, mid );
+		frac = s->frac;
+		midf = s->midf;
+		VectorCopy( s->mid, mid );
 
-	// move up to the node
-	if( !PM_RecursiveHullCheck( hull, node->children[side], p1f, midf, p1, mid, trace ))
-		return false;
+		while( PM_HullNodeContents( hull, packed, hull->firstclipnode, mid ) == CONTENTS_SOLID )
+		{
+			// shouldn't really happen, but does occasionally
+			frac -= 0.1f;
 
-	// this recursion can not be optimized because mid would need to be duplicated on a stack
-	if( PM_HullPointContents( hull, node->children[side^1], mid ) != CONTENTS_SOLID )
-	{
-		// go past the node
-		return PM_RecursiveHullCheck( hull, node->children[side^1], midf, p2f, mid, p2, trace );
-	}	
+			if( ( frac < 0.0f ) || IS_NAN( frac ))
+			{
+				MsgDev( D_WARN, "trace backed up past 0.0\n" );
+				break;
+			}
 
-	// never got out of the solid area
-	if( trace->allsolid )
-		return false;
+			midf = s->p1f + ( s->p2f - s->p1f ) * frac;
+			VectorLerp( s->p1, frac, s->p2, mid );
+		}
 
-	// the other side of the node is solid, this is the impact point
-	if( !side )
-	{
-		VectorCopy( plane->normal, trace->plane.normal );
-		trace->plane.dist = plane->dist;
-	}
-	else
-	{
-		VectorNegate( plane->normal, trace->plane.normal );
-		trace->plane.dist = -plane->dist;
+		trace->fraction = midf;
+		VectorCopy( mid, trace->endpos );
 	}
 
-	while( PM_HullPointContents( hull, hull->firstclipnode, mid ) == CONTENTS_SOLID )
-	{
-		ASSERTNAN( frac )
-		// shouldn't really happen, but does occasionally
-		frac -= 0.1f;
+	return result;
+}
 
-		if( ( frac < 0.0f )  || IS_NAN( frac ) )
-		{
-			trace->fraction = midf;
-			VectorCopy( mid, trace->endpos );
-			MsgDev( D_WARN, "trace backed up past 0.0\n" );
-			return false;
-		}
+/*
+==================
+PM_RecursiveHullCheck
+==================
+*/
+qboolean PM_RecursiveHullCheck( hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, pmtrace_t *trace )
+{
+	hulltrace_t	ht;
+	qboolean		result;
 
-		midf = p1f + ( p2f - p1f ) * frac;
-		VectorLerp( p1, frac, p2, mid );
+	if( num >= 0 && hull->firstclipnode >= hull->lastclipnode )
+	{
+		// studiotrace issues
+		trace->allsolid = false;
+		trace->inopen = true;
+		return true;
 	}
 
-	trace->fraction = midf;
-	VectorCopy( mid, trace->endpos );
+	HULLTRACE_LOAD( &ht, trace );
+	result = PM_HullTrace( hull, Mod_PackedHull( hull ), num, p1f, p2f, p1, p2, &ht );
+	HULLTRACE_STORE( &ht, trace );
 
-	return false;
+	return result;
 }
 
 pmtrace_t PM_PlayerTraceExt( playermove_t *pmove, vec3_t start, vec3_t end, int flags, int numents, physent_t *ents, int ignore_pe, pfnIgnore pmFilter )
@@ -465,10 +582,17 @@ pmtrace_t PM_PlayerTraceExt( playermove_t *pmove, vec3_t start, vec3_t end, int
 		}
 		else
 		{
+			byte	hitmask[MAXSTUDIOBONES];
 			int	last_hitgroup;
 
+			Mod_StudioHitboxMask( start_l, end_l, hullcount, hitmask );
+
 			for( last_hitgroup = 0, j = 0; j < hullcount; j++ )
 			{
+				// segment can't reach it, first hitbox always sets the initial trace
+				if( j > 0 && !hitmask[j] )
+					continue;
+
 				Q_memset( &trace_hitbox, 0, sizeof( trace_hitbox ));
 				VectorCopy( end, trace_hitbox.endpos );
 				trace_hitbox.allsolid = true;
@@ -0,0 +1,409 @@
+/*
+sys_thread.c - worker threads for parallel engine jobs
+Copyright (C) 2026 nenquen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+#include "mathlib.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#define mutex_t		pthread_mutex_t
+#define cond_t		pthread_cond_t
+#define thread_t		pthread_t
+#define mutex_init( x )	pthread_mutex_init( x, NULL )
+#define mutex_free( x )	pthread_mutex_destroy( x )
+#define mutex_lock		pthread_mutex_lock
+#define mutex_unlock	pthread_mutex_unlock
+#define cond_init( x )	pthread_cond_init( x, NULL )
+#define cond_free( x )	pthread_cond_destroy( x )
+#define cond_wait( c, m )	pthread_cond_wait( c, m )
+#define cond_signal		pthread_cond_signal
+#define cond_broadcast	pthread_cond_broadcast
+#define THREAD_FUNC		void *
+#define THREAD_RETURN	return NULL
+#else // WIN32
+#define mutex_t		CRITICAL_SECTION
+#define cond_t		CONDITION_VARIABLE
+#define thread_t		HANDLE
+#define mutex_init( x )	InitializeCriticalSection( x )
+#define mutex_free( x )	DeleteCriticalSection( x )
+#define mutex_lock		EnterCriticalSection
+#define mutex_unlock	LeaveCriticalSection
+#define cond_init( x )	InitializeConditionVariable( x )
+#define cond_free( x )
+#define cond_wait( c, m )	SleepConditionVariableCS( c, m, INFINITE )
+#define cond_signal		WakeConditionVariable
+#define cond_broadcast	WakeAllConditionVariable
+#define THREAD_FUNC		DWORD WINAPI
+#define THREAD_RETURN	return 0
+#endif
+
+typedef struct
+{
+	pfnJobFunc	func;
+	void		*data;
+	int		count;
+	int		next;		// next job index to pick
+	int		done;		// number of finished jobs
+} sys_jobbatch_t;
+
+static struct
+{
+	qboolean		initialized;
+	qboolean		quit;
+	volatile qboolean	running;		// batch is in progress
+	int		numworkers;
+	thread_t		threads[MAX_WORKERS];
+#ifdef _WIN32
+	DWORD		threadids[MAX_WORKERS];	// for Sys_WorkerIndex
+#endif
+	mutex_t		lock;
+	cond_t		wake;		// workers are waiting for a new batch
+	cond_t		finished;		// caller is waiting for the batch completion
+	sys_jobbatch_t	batch;
+} sys_jobs;
+
+/*
+================
+Sys_NumCPUs
+
+================
+*/
+int Sys_NumCPUs( void )
+{
+	int	count = 1;
+#ifdef _WIN32
+	SYSTEM_INFO	info;
+
+	GetSystemInfo( &info );
+	count = info.dwNumberOfProcessors;
+#elif defined( _SC_NPROCESSORS_ONLN )
+	count = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+	return max( count, 1 );
+}
+
+/*
+================
+Sys_RunNextJob
+
+pick a single job from current batch, called with locked mutex
+================
+*/
+static qboolean Sys_RunNextJob( void )
+{
+	sys_jobbatch_t	*b = &sys_jobs.batch;
+	int		index;
+
+	if( !b->func || b->next >= b->count )
+		return false;
+
+	index = b->next++;
+	mutex_unlock( &sys_jobs.lock );
+
+	b->func( b->data, index );
+
+	mutex_lock( &sys_jobs.lock );
+	if( ++b->done == b->count )
+		cond_broadcast( &sys_jobs.finished );
+
+	return true;
+}
+
+static THREAD_FUNC Sys_WorkerThread( void *unused )
+{
+	mutex_lock( &sys_jobs.lock );
+
+	while( !sys_jobs.quit )
+	{
+		if( !Sys_RunNextJob( ))
+			cond_wait( &sys_jobs.wake, &sys_jobs.lock );
+	}
+
+	mutex_unlock( &sys_jobs.lock );
+	THREAD_RETURN;
+}
+
+/*
+================
+Sys_InitThreads
+
+start the worker pool, -numthreads overrides the cpu count
+================
+*/
+void Sys_InitThreads( void )
+{
+	char	parm[16];
+	int	i, count;
+
+	if( sys_jobs.initialized )
+		return;
+
+	if( Sys_GetParmFromCmdLine( "-numthreads", parm ))
+		count = Q_atoi( parm );
+	else count = Sys_NumCPUs();
+
+	// caller thread is working too
+	count = bound( 0, count - 1, MAX_WORKERS );
+
+	mutex_init( &sys_jobs.lock );
+	cond_init( &sys_jobs.wake );
+	cond_init( &sys_jobs.finished );
+	sys_jobs.quit = false;
+	sys_jobs.numworkers = 0;
+	sys_jobs.initialized = true;
+
+	for( i = 0; i < count; i++ )
+	{
+#ifdef _WIN32
+		sys_jobs.threads[i] = CreateThread( NULL, 0, Sys_WorkerThread, NULL, 0, &sys_jobs.threadids[i] );
+		if( !sys_jobs.threads[i] ) break;
+#else
+		if( pthread_create( &sys_jobs.threads[i], NULL, Sys_WorkerThread, NULL ))
+			break;
+#endif
+		sys_jobs.numworkers++;
+	}
+
+	MsgDev( D_INFO, "Sys_InitThreads: %i worker threads\n", sys_jobs.numworkers );
+}
+
+/*
+================
+Sys_ShutdownThreads
+
+================
+*/
+void Sys_ShutdownThreads( void )
+{
+	int	i;
+
+	if( !sys_jobs.initialized )
+		return;
+
+	mutex_lock( &sys_jobs.lock );
+	sys_jobs.quit = true;
+	cond_broadcast( &sys_jobs.wake );
+	mutex_unlock( &sys_jobs.lock );
+
+	for( i = 0; i < sys_jobs.numworkers; i++ )
+	{
+#ifdef _WIN32
+		WaitForSingleObject( sys_jobs.threads[i], INFINITE );
+		CloseHandle( sys_jobs.threads[i] );
+#else
+		pthread_join( sys_jobs.threads[i], NULL );
+#endif
+	}
+
+	cond_free( &sys_jobs.finished );
+	cond_free( &sys_jobs.wake );
+	mutex_free( &sys_jobs.lock );
+	Q_memset( &sys_jobs, 0, sizeof( sys_jobs ));
+}
+
+/*
+================
+Sys_NumWorkers
+
+================
+*/
+int Sys_NumWorkers( void )
+{
+	Sys_InitThreads();
+	return sys_jobs.numworkers;
+}
+
+/*
+================
+Sys_JobsRunning
+
+true while a batch is processed, shared data must be locked
+================
+*/
+qboolean Sys_JobsRunning( void )
+{
+	return sys_jobs.running;
+}
+
+/*
+================
+Sys_WorkerIndex
+
+1 + index of the worker running the caller, 0 for the
+thread that started the batch or when nothing is running
+================
+*/
+int Sys_WorkerIndex( void )
+{
+	int	i;
+
+	if( !sys_jobs.running )
+		return 0;
+
+	for( i = 0; i < sys_jobs.numworkers; i++ )
+	{
+#ifdef _WIN32
+		if( sys_jobs.threadids[i] == GetCurrentThreadId( ))
+			return i + 1;
+#else
+		if( pthread_equal( sys_jobs.threads[i], pthread_self( )))
+			return i + 1;
+#endif
+	}
+
+	return 0;
+}
+
+/*
+================
+Sys_RunJobs
+
+call func( data, i ) for each i in [0, count) across the worker pool
+and wait for completion. Jobs must not call back into the game dlls
+unless the dll declared it safe (see ENGINE_PARALLEL_PMOVE)
+================
+*/
+void Sys_RunJobs( pfnJobFunc func, void *data, int count )
+{
+	sys_jobbatch_t	*b = &sys_jobs.batch;
+	int		i;
+
+	if( count <= 0 ) return;
+
+	Sys_InitThreads();
+
+	// nested batches or single job is executed in place
+	if( !sys_jobs.numworkers || sys_jobs.running || count == 1 )
+	{
+		for( i = 0; i < count; i++ )
+			func( data, i );
+		return;
+	}
+
+	mutex_lock( &sys_jobs.lock );
+
+	b->func = func;
+	b->data = data;
+	b->count = count;
+	b->next = 0;
+	b->done = 0;
+	sys_jobs.running = true;
+	cond_broadcast( &sys_jobs.wake );
+
+	while( Sys_RunNextJob( ));
+
+	while( b->done < b->count )
+		cond_wait( &sys_jobs.finished, &sys_jobs.lock );
+
+	b->func = NULL;
+	sys_jobs.running = false;
+
+	mutex_unlock( &sys_jobs.lock );
+}
+
+/*
+================
+Sys_CreateMutex
+
+================
+*/
+void *Sys_CreateMutex( void )
+{
+	mutex_t	*mutex = Z_Malloc( sizeof( mutex_t ));
+
+	mutex_init( mutex );
+	return mutex;
+}
+
+void Sys_DestroyMutex( void *mutex )
+{
+	if( !mutex ) return;
+	mutex_free( (mutex_t *)mutex );
+	Mem_Free( mutex );
+}
+
+void Sys_LockMutex( void *mutex )
+{
+	mutex_lock( (mutex_t *)mutex );
+}
+
+void Sys_UnlockMutex( void *mutex )
+{
+	mutex_unlock( (mutex_t *)mutex );
+}
+
+typedef struct
+{
+	thread_t		handle;
+	pfnThreadFunc	func;
+	void		*data;
+} sys_thread_t;
+
+static THREAD_FUNC Sys_ThreadStart( void *data )
+{
+	sys_thread_t	*thread = (sys_thread_t *)data;
+
+	thread->func( thread->data );
+	THREAD_RETURN;
+}
+
+/*
+================
+Sys_CreateThread
+
+start a dedicated thread, returns NULL on failure
+================
+*/
+void *Sys_CreateThread( pfnThreadFunc func, void *data )
+{
+	sys_thread_t	*thread = Z_Malloc( sizeof( sys_thread_t ));
+
+	thread->func = func;
+	thread->data = data;
+#ifdef _WIN32
+	thread->handle = CreateThread( NULL, 0, Sys_ThreadStart, thread, 0, NULL );
+	if( !thread->handle )
+#else
+	if( pthread_create( &thread->handle, NULL, Sys_ThreadStart, thread ))
+#endif
+	{
+		Mem_Free( thread );
+		return NULL;
+	}
+
+	return thread;
+}
+
+/*
+================
+Sys_WaitThread
+
+wait for thread function to return and release the thread
+================
+*/
+void Sys_WaitThread( void *thread )
+{
+	sys_thread_t	*t = (sys_thread_t *)thread;
+
+	if( !t ) return;
+#ifdef _WIN32
+	WaitForSingleObject( t->handle, INFINITE );
+	CloseHandle( t->handle );
+#else
+	pthread_join( t->handle, NULL );
+#endif
+	Mem_Free( t );
+}
@@ -113,8 +113,30 @@ void Sys_PrintLog( const char *pMsg );
 void Sys_InitLog( void );
 void Sys_CloseLog( void );
 void Sys_Quit( void );
+extern qboolean error_on_exit;
 int Sys_LogFileNo( void );
 
+//
+// sys_thread.c
+//
+#define MAX_WORKERS		16	// worker threads besides the caller
+
+typedef void (*pfnJobFunc)( void *data, int index );
+typedef void (*pfnThreadFunc)( void *data );
+int Sys_NumCPUs( void );
+void Sys_InitThreads( void );
+void Sys_ShutdownThreads( void );
+int Sys_NumWorkers( void );
+qboolean Sys_JobsRunning( void );
+int Sys_WorkerIndex( void );
+void Sys_RunJobs( pfnJobFunc func, void *data, int count );
+void *Sys_CreateMutex( void );
+void Sys_DestroyMutex( void *mutex );
+void Sys_LockMutex( void *mutex );
+void Sys_UnlockMutex( void *mutex );
+void *Sys_CreateThread( pfnThreadFunc func, void *data );
+void Sys_WaitThread( void *thread );
+
 //
 // sys_con.c
 //
@@ -33,8 +33,19 @@ ENTITY AREA CHECKING
 ===============================================================================
 */
 #define MAX_TOTAL_ENT_LEAFS		128
-#define AREA_NODES			32
-#define AREA_DEPTH			4
+#define AREA_NODES			1024	// uniform tree and adaptive leaf splits
+#define AREA_DEPTH			4	// uniformly subdivided levels
+#define AREA_MAX_DEPTH		16
+#define AREA_MIN_SIZE		32.0f	// don't split nodes smaller than twice that
+#define MAX_TRACE_BATCH		64	// traces sharing one area tree walk
+#define MAX_BATCH_TOUCH		512	// edicts gathered for them
+#define TRACE_CACHE_SIZE		1024	// game dll traces remembered for one frame, power of two
+#define SPHERE_GRID_SIZE		1024	// edict grid buckets, power of two
+#define SPHERE_GRID_CELL		256.0f	// grid cell, bigger edicts are always tested
+#define SPHERE_GRID_CELLS		64	// queries covering more cells use the full scan
+#define STRING_INDEX_SIZE		1024	// buckets per indexed entvars string
+#define STRING_INDEX_FIELDS		3	// classname, targetname, target
+#define STRING_INDEX_FRESH		256	// edicts allocated in one frame synced on each lookup
 
 #include "lightstyle.h"
 
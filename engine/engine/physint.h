@@ -37,6 +37,16 @@ typedef struct areanode_s
 	link_t		water_edicts;	// func water
 } areanode_t;
 
+// single request for pfnTraceBatch
+typedef struct tracerequest_s
+{
+	vec3_t		start;
+	vec3_t		end;
+	int		flags;		// fNoMonsters and FMOVE_* bits as for pfnTraceLine
+	int		hullNumber;	// -1 is line trace, 0-3 as for pfnTraceHull
+	edict_t		*pentIgnore;
+} tracerequest_t;
+
 typedef struct server_physics_api_s
 {
 	// unlink edict from old position and link onto new
@@ -65,6 +75,14 @@ typedef struct server_physics_api_s
 	// static allocations
 	void	*(*pfnMemAlloc)( size_t cb, const char *filename, const int fileline );
 	void	(*pfnMemFree)( void *mem, const char *filename, const int fileline );
+
+	// trace the group of lines or hulls with one area tree walk, presence is
+	// advertised by "sv_tracebatch" cvar, results are in the same order
+	void	(*pfnTraceBatch)( const tracerequest_t *requests, int count, TraceResult *results );
+
+	// edicts which absbox touches the box in edict order, -1 if the list is too
+	// small or the grid is disabled, presence is advertised by "sv_spheregrid" cvar
+	int	(*pfnEntitiesInBox)( const float *mins, const float *maxs, edict_t **list, int maxcount );
 } server_physics_api_t;
 
 // physic callbacks
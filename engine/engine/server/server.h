@@ -38,6 +38,20 @@ extern int SV_UPDATE_BACKUP;
 #define MAX_LOCALINFO 4096
 extern char localinfo[MAX_LOCALINFO];
 
+// features which mode 2 compares the results with the reference path
+typedef enum
+{
+	CHECK_TRACECACHE = 0,
+	CHECK_STRINGINDEX,
+	CHECK_SPHEREGRID,
+	CHECK_PHYSENTCACHE,
+	CHECK_PUSHGRID,
+	CHECK_PARALLEL_SEND,
+	CHECK_PARALLEL_PMOVE,
+	CHECK_DELTARING,		// no check of its own, sv_verify turns it on
+	CHECK_COUNT
+} sv_check_t;
+
 // hostflags
 #define SVF_SKIPLOCALHOST	BIT( 0 )
 #define SVF_PLAYERSONLY	BIT( 1 )
@@ -194,6 +208,9 @@ typedef struct
 
 	int  		num_entities;
 	int  		first_entity;		// into the circular sv_packet_entities[]
+	int		sequence;			// netchan outgoing sequence of this frame
+	qboolean		acked;			// client reported it as a valid delta base
+	qboolean		fullupdate;		// wasn't delta compressed
 } client_frame_t;
 
 typedef struct sv_client_s
@@ -318,6 +335,80 @@ typedef struct
 	int		fixangle;
 } sv_pushed_t;
 
+// fields the physics of a resting edict depends on
+typedef struct
+{
+	vec3_t		origin;
+	vec3_t		angles;
+	vec3_t		velocity;
+	vec3_t		avelocity;
+	vec3_t		basevelocity;
+	float		nextthink;
+	float		air_finished;
+	float		pain_finished;
+	float		health;
+	int		flags;
+	int		movetype;
+	int		solid;
+	int		waterlevel;
+	int		watertype;
+	edict_t		*groundentity;
+} sv_sleepkey_t;
+
+// solid edict as it was linked last time, changes invalidate cached traces
+typedef struct
+{
+	vec3_t		absmin;
+	vec3_t		absmax;
+	vec3_t		angles;
+	int		modelindex;
+	int		linkclass;
+} sv_linkstate_t;
+
+// box the leafnums was found for, see SV_LinkEdict
+typedef struct
+{
+	qboolean		leafvalid;
+	vec3_t		leafmin;
+	vec3_t		leafmax;
+	int		leafheadnode;
+	int		leafcount;
+} sv_leafcache_t;
+
+// sphere grid bucket, see SV_LinkSphereGrid
+typedef struct
+{
+	int		gridbucket;	// bucket + 1, 0 is not linked
+	int		gridprev;
+	int		gridnext;
+	vec3_t		gridmin;
+	vec3_t		gridmax;
+} sv_gridlink_t;
+
+// string index buckets, see SV_SyncEdictStrings
+typedef struct
+{
+	string_t		strvalue[STRING_INDEX_FIELDS];
+	int		strbucket[STRING_INDEX_FIELDS];	// bucket + 1, 0 is not linked
+	int		strprev[STRING_INDEX_FIELDS];
+	int		strnext[STRING_INDEX_FIELDS];
+} sv_stringlink_t;
+
+// pmove snapshot, see SV_CopyCachedPhysEnt
+typedef struct
+{
+	int		physframe;	// frame the slot belongs to
+	int		physslot;		// index in svgame.physcache
+	qboolean		physvalid;	// edict was not relinked since snapshot
+} sv_physlink_t;
+
+// resting edict skipped by SV_Physics, see SV_StillAsleep
+typedef struct
+{
+	qboolean		asleep;
+	sv_sleepkey_t	sleepkey;		// fields that wake it up when changed
+} sv_sleepstate_t;
+
 typedef struct
 {
 	qboolean		active;
@@ -334,6 +425,29 @@ typedef struct
 	vec3_t		finalpos;
 } sv_interp_t;
 
+#define SV_UNLAG_HISTORY	512		// must be power of two
+#define SV_UNLAG_MASK	(SV_UNLAG_HISTORY - 1)
+#define SV_UNLAG_INTERVAL	(1.0 / 256.0)	// closer samples are merged
+
+// sv_unlagframe_t->flags
+#define UNLAG_PRESENT	BIT( 0 )		// player was spawned
+#define UNLAG_NOINTERP	BIT( 1 )		// dead or EF_NOINTERP
+
+typedef struct
+{
+	double		time;			// host.realtime of the sample
+	byte		flags[MAX_CLIENTS];
+	vec3_t		origin[MAX_CLIENTS];
+} sv_unlagframe_t;
+
+// player positions in server time for lag compensation
+typedef struct
+{
+	sv_unlagframe_t	frames[SV_UNLAG_HISTORY];
+	int		head;			// samples taken, newest is (head - 1) & SV_UNLAG_MASK
+	double		lastbreak[MAX_CLIENTS];	// interpolation can't start before this sample
+} sv_unlaghistory_t;
+
 typedef struct
 {
 	// user messages stuff
@@ -358,14 +472,26 @@ typedef struct
 		void	*vp;			// acess by offset in bytes
 	};
 	int		numEntities;		// actual entities count
+	sv_linkstate_t	*linkstate;		// [maxEntities] for trace cache
+	sv_leafcache_t	*leafcache;		// [maxEntities] leafs of the last link
+	sv_gridlink_t	*gridlinks;		// [maxEntities] sphere grid chains
+	sv_stringlink_t	*stringlinks;		// [maxEntities] string index chains
+	sv_physlink_t	*physlinks;		// [maxEntities] physent snapshot slots
+	sv_sleepstate_t	*sleepstate;		// [maxEntities] resting edicts
+	int		*spherelist;		// [maxEntities] sphere and box query candidates
+	physent_t		*physcache;		// [maxEntities] physent snapshots of this frame
 
 	movevars_t	movevars;			// curstate
 	movevars_t	oldmovevars;		// oldstate
 	playermove_t	*pmove;			// pmove state
 	sv_interp_t	interp[MAX_CLIENTS];	// interpolate clients
+	sv_unlaghistory_t	unlag;			// positions the interp is built from
 
-	sv_pushed_t	pushed[MAX_PUSHED_ENTS];	// no reason to keep array for all edicts
-						// 256 it should be enough for any game situation
+	sv_pushed_t	*pushed;			// rollback arena of pushers, grown on demand
+	int		maxpushed;		// starts from MAX_PUSHED_ENTS
+	edict_t		**pushlist;		// [maxEntities] pusher candidates
+	edict_t		*pushcheck;		// edict being moved by a pusher
+	int		pushrelinks;		// links of other edicts, see SV_PushMove
 	vec3_t		player_mins[MAX_MAP_HULLS];	// 4 hulls allowed
 	vec3_t		player_maxs[MAX_MAP_HULLS];	// 4 hulls allowed
 
@@ -436,11 +562,27 @@ extern	convar_t		*serverinfo;
 extern	convar_t		*sv_failuretime;
 extern	convar_t		*sv_unlag;
 extern	convar_t		*sv_novis;
+extern	convar_t		*sv_vispass;
+extern	convar_t		*sv_parallel_send;
+extern	convar_t		*sv_deltacache_enable;
+extern	convar_t		*sv_entbudget;
+extern	convar_t		*sv_deltaring;
+extern	convar_t		*sv_areasplit;
+extern	convar_t		*sv_tracebatch;
+extern	convar_t		*sv_tracecache;
+extern	convar_t		*sv_linkcache;
+extern	convar_t		*sv_spheregrid;
+extern	convar_t		*sv_stringindex;
+extern	convar_t		*sv_physentcache;
+extern	convar_t		*sv_parallel_pmove;
+extern	convar_t		*sv_sleep;
+extern	convar_t		*sv_pushgrid;
 extern	convar_t		*sv_maxunlag;
 extern	convar_t		*sv_maxrate;
 extern	convar_t		*sv_minrate;
 extern	convar_t		*sv_unlagpush;
 extern	convar_t		*sv_unlagsamples;
+extern	convar_t		*sv_unlagcone;
 extern	convar_t		*sv_allow_upload;
 extern	convar_t		*sv_allow_download;
 extern	convar_t		*sv_allow_fragment;
@@ -478,6 +620,7 @@ extern	convar_t		*mp_logfile;
 extern	convar_t		*sv_fixmulticast;
 extern	convar_t		*sv_allow_split;
 extern	convar_t		*sv_allow_compress;
+extern	convar_t		*sv_allow_lz;
 extern	convar_t		*sv_maxpacket;
 extern	convar_t		*sv_forcesimulating;
 extern	convar_t		*sv_nat;
@@ -510,6 +653,9 @@ void SV_PrepWorldFrame( void );
 void SV_ProcessFile( sv_client_t *cl, char *filename );
 void SV_SendResourceList_f( sv_client_t *cl );
 void SV_AddToMaster( netadr_t from, sizebuf_t *msg );
+void SV_CheckMismatch( sv_check_t check );
+void SV_PrintMismatches( sv_check_t check );
+void SV_Verify_f( void );
 
 //
 // sv_init.c
@@ -538,6 +684,9 @@ void SV_Impact( edict_t *e1, edict_t *e2, trace_t *trace );
 qboolean SV_CanPushed( edict_t *ent );
 void SV_FreeOldEntities( void );
 void SV_CheckAllEnts( void );
+void SV_WakeEdict( edict_t *ent );
+void SV_SleepStats_f( void );
+void SV_PushStats_f( void );
 
 //
 // sv_move.c
@@ -581,6 +730,9 @@ void SV_ConnectionlessPacket( netadr_t from, sizebuf_t *msg );
 edict_t *SV_FakeConnect( const char *netname );
 void SV_ExecuteClientCommand( sv_client_t *cl, char *s );
 void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed );
+void SV_QueueCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed );
+qboolean SV_ClientHasQueuedCmds( sv_client_t *cl );
+void SV_RunQueuedCmds( void );
 qboolean SV_IsPlayerIndex( int idx );
 void SV_InitClientMove( void );
 void SV_UpdateServerInfo( void );
@@ -613,6 +765,14 @@ void SV_BuildClientFrame( sv_client_t *client );
 void SV_InactivateClients( void );
 void SV_SendMessagesToAll( void );
 void SV_SkipUpdates( void );
+void SV_VisStats_f( void );
+void SV_SendStats_f( void );
+void SV_BudgetStats_f( void );
+void SV_ClearEntityBudget( sv_client_t *cl );
+void SV_DeltaRingStats_f( void );
+void SV_AckClientFrame( sv_client_t *cl, int sequence );
+void SV_DeltaBench_f( void );
+void SV_DeltaCacheStats_f( void );
 
 //
 // sv_game.c
@@ -626,8 +786,13 @@ void SV_InitEdict( edict_t *pEdict );
 const char *SV_ClassName( const edict_t *e );
 void SV_SetModel( edict_t *ent, const char *name );
 void SV_CopyTraceToGlobal( trace_t *trace );
+void SV_ConvertTrace( TraceResult *dst, trace_t *src );
 void SV_SetMinMaxSize( edict_t *e, const float *min, const float *max );
 edict_t *SV_FindEntityByString( edict_t *pStartEdict, const char *pszField, const char *pszValue );
+void SV_SyncEdictStrings( edict_t *ent );
+void SV_UpdateStringIndex( void );
+void SV_ClearStringIndex( void );
+void SV_StringIndexStats_f( void );
 void SV_PlaybackEventFull( int flags, const edict_t *pInvoker, word eventindex, float delay, float *origin,
 	float *angles, float fparam1, float fparam2, int iparam1, int iparam2, int bparam1, int bparam2 );
 void SV_PlaybackReliableEvent( sizebuf_t *msg, word eventindex, float delay, event_args_t *args );
@@ -691,17 +856,40 @@ void SV_InitSaveRestore( void );
 //
 void SV_GetTrueOrigin( sv_client_t *cl, int edictnum, vec3_t origin );
 void SV_GetTrueMinMax( sv_client_t *cl, int edictnum, vec3_t mins, vec3_t maxs );
+void SV_NewPhysEntFrame( void );
+void SV_DirtyPhysEnt( edict_t *ent );
+void SV_PhysEntStats_f( void );
+void SV_PMoveStats_f( void );
+void SV_ClearUnlagHistory( void );
+void SV_RecordUnlagHistory( void );
+void SV_UnlagStats_f( void );
 
 //
 // sv_world.c
 //
 void SV_ClearWorld( void );
+void SV_UpdateAreaNodes( void );
+void SV_TraceBench_f( void );
+void SV_HullBench_f( void );
+void SV_HitboxBench_f( void );
+void SV_TraceCacheStats_f( void );
+void SV_NewTraceCacheFrame( void );
+void SV_LinkStats_f( void );
+void SV_NewLinkFrame( void );
+void SV_LinkSphereGrid( edict_t *ent );
+void SV_UnlinkSphereGrid( edict_t *ent );
+void SV_UpdateSphereGrid( void );
+edict_t *SV_FindEntityInSphere( edict_t *pStartEdict, const vec3_t org, float radius );
+int SV_EntitiesInBox( const vec3_t mins, const vec3_t maxs, edict_t **list, int maxcount );
+void SV_SphereBench_f( void );
 void SV_UnlinkEdict( edict_t *ent );
 qboolean SV_HeadnodeVisible( mnode_t *node, byte *visbits, int *lastleaf );
 void SV_ClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 void SV_CustomClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 trace_t SV_TraceHull( edict_t *ent, int hullNum, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end );
 trace_t SV_Move( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e );
+trace_t SV_CachedMove( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e );
+void SV_MoveBatch( const tracerequest_t *requests, int count, trace_t *traces );
 trace_t SV_MoveNoEnts( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e );
 const char *SV_TraceTexture( edict_t *ent, const vec3_t start, const vec3_t end );
 msurface_t *SV_TraceSurface( edict_t *ent, const vec3_t start, const vec3_t end );
@@ -432,6 +432,7 @@ gotnewcl:
 	newcl->frames = (client_frame_t *)Z_Malloc( sizeof( client_frame_t ) * SV_UPDATE_BACKUP );
 	newcl->userid = g_userid++;	// create unique userid
 	newcl->authentication_method = 2;
+	SV_ClearEntityBudget( newcl );
 
 	// initailize netchan here because SV_DropClient will clear network buffer
 	Netchan_Setup( NS_SERVER, &newcl->netchan, from, qport );
@@ -439,7 +440,17 @@ gotnewcl:
 	if( sv_allow_compress->integer && ( requested_extensions & NET_EXT_HUFF ) )
 	{
 		extensions |= NET_EXT_HUFF;
-		newcl->netchan.compress = true;
+		newcl->netchan.compress = NET_CODEC_HUFF;
+
+		// newer clients prefer the static table
+		if( requested_extensions & NET_EXT_HUFF_STATIC )
+			newcl->netchan.compress = NET_CODEC_HUFF_STATIC, extensions |= NET_EXT_HUFF_STATIC;
+	}
+
+	if( sv_allow_lz->integer && ( requested_extensions & NET_EXT_LZ ))
+	{
+		extensions |= NET_EXT_LZ;
+		newcl->netchan.fragcompress = NET_CODEC_LZ;
 	}
 
 	if( sv_allow_split->integer && ( requested_extensions & NET_EXT_SPLIT ) )
@@ -453,9 +464,12 @@ gotnewcl:
 
 		newcl->netchan.split = true, extensions |= NET_EXT_SPLIT;
 
-		if( sv_allow_compress->integer && sv_allow_split->integer &&
+		// packets that are already compressed gain nothing from LZ
+		if( newcl->netchan.fragcompress && !newcl->netchan.compress )
+			newcl->netchan.splitcompress = NET_CODEC_LZ;
+		else if( sv_allow_compress->integer && sv_allow_split->integer &&
 			 ( requested_extensions & NET_EXT_SPLITHUFF ) && !( requested_extensions & NET_EXT_HUFF ) )
-			newcl->netchan.splitcompress = true, extensions |= NET_EXT_SPLITHUFF;
+			newcl->netchan.splitcompress = NET_CODEC_HUFF, extensions |= NET_EXT_SPLITHUFF;
 	}
 
 	BF_Init( &newcl->datagram, "Datagram", newcl->datagram_buf, sizeof( newcl->datagram_buf )); // datagram buf
@@ -1429,6 +1443,9 @@ void SV_PutClientInServer( sv_client_t *cl )
 	cl->last_movetime = 0.0;
 	cl->next_movetime = 0.0;
 
+	// edict numbers are reused by the new level
+	SV_ClearEntityBudget( cl );
+
 	cl->state = cs_spawned;
 
 	if( !cl->fakeclient )
@@ -3610,6 +3627,10 @@ static void SV_ParseClientMove( sv_client_t *cl, sizebuf_t *msg )
 
 	player = cl->edict;
 
+	// second move of the frame starts from the state the first one left
+	if( SV_ClientHasQueuedCmds( cl ))
+		SV_RunQueuedCmds();
+
 	frame = &cl->frames[cl->netchan.incoming_acknowledged & SV_UPDATE_MASK];
 	Q_memset( &nullcmd, 0, sizeof( usercmd_t ));
 	Q_memset( cmds, 0, sizeof( cmds ));
@@ -3694,21 +3715,21 @@ static void SV_ParseClientMove( sv_client_t *cl, sizebuf_t *msg )
 	{
 		while( net_drop > numbackup )
 		{
-			SV_RunCmd( cl, &cl->lastcmd, 0 );
+			SV_QueueCmd( cl, &cl->lastcmd, 0 );
 			net_drop--;
 		}
 
 		while( net_drop > 0 )
 		{
 			i = net_drop + newcmds - 1;
-			SV_RunCmd( cl, &cmds[i], cl->netchan.incoming_sequence - i );
+			SV_QueueCmd( cl, &cmds[i], cl->netchan.incoming_sequence - i );
 			net_drop--;
 		}
 	}
 
 	for( i = newcmds - 1; i >= 0; i-- )
 	{
-		SV_RunCmd( cl, &cmds[i], cl->netchan.incoming_sequence - i );
+		SV_QueueCmd( cl, &cmds[i], cl->netchan.incoming_sequence - i );
 	}
 
 	cl->lastcmd = cmds[0];
@@ -3798,7 +3819,7 @@ void SV_ExecuteClientMessage( sv_client_t *cl, sizebuf_t *msg )
 	frame = &cl->frames[cl->netchan.incoming_acknowledged & SV_UPDATE_MASK];
 
 	// raw ping doesn't factor in message interval, either
-	frame->ping_time = host.realtime - frame->senttime - cl->cl_updaterate;
+	frame->ping_time = net_recvtime - frame->senttime - cl->cl_updaterate;
 
 	// on first frame ( no senttime ) don't skew ping
 	if( frame->senttime == 0.0f )
@@ -3846,6 +3867,7 @@ void SV_ExecuteClientMessage( sv_client_t *cl, sizebuf_t *msg )
 			break;
 		case clc_delta:
 			cl->delta_sequence = BF_ReadByte( msg );
+			SV_AckClientFrame( cl, cl->delta_sequence );
 			break;
 		case clc_move:
 			if( move_issued ) return; // someone is trying to cheat...
@@ -3853,6 +3875,7 @@ void SV_ExecuteClientMessage( sv_client_t *cl, sizebuf_t *msg )
 			SV_ParseClientMove( cl, msg );
 			break;
 		case clc_stringcmd:
+			SV_RunQueuedCmds(); // commands may look at the player
 			s = BF_ReadString( msg );
 			// malicious users may try using too many string commands
 			if( ++stringCmdCount < 8 ) SV_ExecuteClientCommand( cl, s );
@@ -1414,6 +1414,25 @@ void SV_InitOperatorCommands( void )
 	Cmd_AddCommand( "entpatch", SV_EntPatch_f, "write entity patch to allow external editing" );
 	Cmd_AddCommand( "edicts_info", SV_EdictsInfo_f, "show info about edicts" );
 	Cmd_AddCommand( "entity_info", SV_EntityInfo_f, "show more info about edicts" );
+	Cmd_AddCommand( "sv_visstats", SV_VisStats_f, "show entities tested vs accepted per client" );
+	Cmd_AddCommand( "sv_sendstats", SV_SendStats_f, "show parallel snapshot encoding stats" );
+	Cmd_AddCommand( "sv_budgetstats", SV_BudgetStats_f, "show snapshot rate budget stats" );
+	Cmd_AddCommand( "sv_deltaringstats", SV_DeltaRingStats_f, "show delta base selection stats" );
+	Cmd_AddCommand( "sv_tracebench", SV_TraceBench_f, "compare trace candidates of the fixed and adaptive area trees" );
+	Cmd_AddCommand( "sv_hullbench", SV_HullBench_f, "measure world hull traces per second" );
+	Cmd_AddCommand( "sv_hitboxbench", SV_HitboxBench_f, "compare studio hitbox traces with and without the hitbox cache" );
+	Cmd_AddCommand( "sv_tracecachestats", SV_TraceCacheStats_f, "print and reset the trace cache hit rate" );
+	Cmd_AddCommand( "sv_linkstats", SV_LinkStats_f, "print and reset full and skipped edict relinks" );
+	Cmd_AddCommand( "sv_spherebench", SV_SphereBench_f, "compare radius searches through the edict grid and full scan" );
+	Cmd_AddCommand( "sv_stringindexstats", SV_StringIndexStats_f, "print and reset indexed and scanned edict string lookups" );
+	Cmd_AddCommand( "sv_physentstats", SV_PhysEntStats_f, "print and reset physents copied from frame snapshot" );
+	Cmd_AddCommand( "sv_pmovestats", SV_PMoveStats_f, "print and reset player moves run on worker threads" );
+	Cmd_AddCommand( "sv_unlagstats", SV_UnlagStats_f, "print and reset lag compensation counters" );
+	Cmd_AddCommand( "sv_sleepstats", SV_SleepStats_f, "print awake and asleep edicts of the last frame" );
+	Cmd_AddCommand( "sv_pushstats", SV_PushStats_f, "print and reset edicts tested by pushers" );
+	Cmd_AddCommand( "sv_verify", SV_Verify_f, "run frames with the checks of all sv_* 2 modes and report the mismatches" );
+	Cmd_AddCommand( "sv_deltabench", SV_DeltaBench_f, "time interpreted vs compiled entity delta encoders" );
+	Cmd_AddCommand( "sv_deltacachestats", SV_DeltaCacheStats_f, "show shared entity delta cache hits and misses" );
 	Cmd_AddCommand( "save", SV_Save_f, "save the game to a file" );
 	Cmd_AddCommand( "load", SV_Load_f, "load a saved game file" );
 	Cmd_AddCommand( "savequick", SV_QuickSave_f, "save the game to the quicksave" );
@@ -1467,6 +1486,25 @@ void SV_KillOperatorCommands( void )
 	Cmd_RemoveCommand( "entpatch" );
 	Cmd_RemoveCommand( "edicts_info" );
 	Cmd_RemoveCommand( "entity_info" );
+	Cmd_RemoveCommand( "sv_visstats" );
+	Cmd_RemoveCommand( "sv_sendstats" );
+	Cmd_RemoveCommand( "sv_budgetstats" );
+	Cmd_RemoveCommand( "sv_deltaringstats" );
+	Cmd_RemoveCommand( "sv_tracebench" );
+	Cmd_RemoveCommand( "sv_hullbench" );
+	Cmd_RemoveCommand( "sv_hitboxbench" );
+	Cmd_RemoveCommand( "sv_tracecachestats" );
+	Cmd_RemoveCommand( "sv_linkstats" );
+	Cmd_RemoveCommand( "sv_spherebench" );
+	Cmd_RemoveCommand( "sv_stringindexstats" );
+	Cmd_RemoveCommand( "sv_physentstats" );
+	Cmd_RemoveCommand( "sv_pmovestats" );
+	Cmd_RemoveCommand( "sv_unlagstats" );
+	Cmd_RemoveCommand( "sv_sleepstats" );
+	Cmd_RemoveCommand( "sv_pushstats" );
+	Cmd_RemoveCommand( "sv_verify" );
+	Cmd_RemoveCommand( "sv_deltabench" );
+	Cmd_RemoveCommand( "sv_deltacachestats" );
 	Cmd_RemoveCommand( "sendreconnect" );
 
 	if( Host_IsDedicated() )
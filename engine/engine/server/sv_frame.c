@@ -24,9 +24,137 @@ typedef struct
 	entity_state_t	entities[MAX_VISIBLE_PACKET];	
 } sv_ents_t;
 
+// ReGameDLL extension: entity bypasses PVS check in AddToFullPack
+#define EF_FORCEVISIBILITY	BIT( 11 )
+
+#define VIS_ENTWORDS	(MAX_EDICTS >> 5)
+
+// entities bucketed by the BSP leafs they touch, rebuilt once per send frame
+typedef struct
+{
+	qboolean		valid;		// only between SV_BuildVisIndex and the end of send frame
+	int		numleafs;
+	int		*leaf_first;	// [numleafs + 2] offsets into leaf_ents
+	int		leaf_alloc;
+	int		*leaf_ents;	// entity numbers grouped by leaf
+	int		ents_alloc;
+	int		num_always;
+	int		num_bucketed;
+	uint32_t		always[VIS_ENTWORDS];	// entities who can't be culled by leafs
+	uint32_t		cursent[MAX_CLIENTS][VIS_ENTWORDS];	// accepted in current client frame
+	uint32_t		lastsent[MAX_CLIENTS][VIS_ENTWORDS];	// accepted in last client frame
+} sv_visindex_t;
+
+typedef struct
+{
+	int		tested;		// AddToFullPack calls in last frame
+	int		accepted;		// entities accepted in last frame
+	double		total_tested;
+	double		total_accepted;
+	int		numframes;
+} sv_visstats_t;
+
+// client datagram in progress for parallel send
+typedef struct
+{
+	sv_client_t	*cl;
+	client_frame_t	*frame;		// NULL if client was dropped
+	client_frame_t	*from;		// delta frame or NULL for full update
+	int		next_entities;	// ring head when the serial send would encode
+	qboolean		send_pings;
+	qboolean		encoded;		// already encoded on the main thread
+	sizebuf_t		msg;
+	sizebuf_t		ents;		// packet entities encoded by worker
+	sizebuf_t		verify;		// serial encoding for sv_parallel_send 2
+	byte		*msg_buf;
+	byte		*ents_buf;
+	byte		*verify_buf;
+	byte		*ring_buf;	// SV_ChooseDeltaFrame encodes the candidates here
+} sv_sendslot_t;
+
+typedef struct
+{
+	int		numframes;
+	int		numclients;	// snapshots encoded in parallel
+	int		inplace;		// snapshots encoded on the main thread
+	int		verified;
+	double		encodetime;
+	int		budgeted;		// snapshots that didn't fit the client rate
+	int		deferred;		// entity updates postponed by priority
+	int		replaced;		// entities swapped out of a full packet list
+} sv_sendstats_t;
+
+#define PRIORITY_ALWAYS	1e30f		// own and view entity are never deferred
+#define BUDGET_OVERHEAD	48		// bytes reserved for events, pings and packet header
+
+// viewer of the snapshot being built, used to score entities
+typedef struct
+{
+	vec3_t		origin;
+	vec3_t		forward;
+	int		clientnum;
+	int		clientent;
+	int		viewent;
+} sv_entview_t;
+
+#define DELTA_CACHE_SLOTS	4096		// must be power of two
+#define DELTA_CACHE_BYTES	(512 * 1024)	// encoded bits storage
+#define DELTA_CACHE_MAXBITS	8192		// biggest entity delta we can cache
+
+// encoded entity delta that can be shared between clients
+typedef struct
+{
+	int		framenum;		// slot is empty if not equal to current frame
+	uint32_t		hash;
+	qboolean		force;
+	qboolean		player;
+	qboolean		measured;		// added by the budget pass, not counted yet
+	int		offset;		// into bits storage
+	int		numbits;
+	entity_state_t	from;
+	entity_state_t	to;
+} sv_deltaentry_t;
+
+typedef struct
+{
+	sv_deltaentry_t	*slots;
+	byte		*data;
+	int		datasize;		// used bytes in data
+	int		numentries;
+	int		framenum;
+	void		*lock;
+
+	int		hits;		// last frame
+	int		misses;
+	int		full;		// not stored, cache is full
+	double		total_hits;
+	double		total_misses;
+	int		numframes;
+} sv_deltacache_t;
+
 static byte *clientpvs;	// FatPVS
 static byte *clientphs;	// FatPHS
 
+static sv_visindex_t	sv_visindex;
+static sv_visstats_t	sv_visstats[MAX_CLIENTS];
+static sv_sendslot_t	sv_sendslots[MAX_CLIENTS];
+static sv_sendstats_t	sv_sendstats;
+static sv_deltacache_t	sv_deltacache;
+static sv_entview_t	sv_entview;
+static int		sv_ringpicks[MAX_CLIENTS];	// frames delta compressed against an older base
+static byte		*sv_ringbuf;		// SV_ChooseDeltaFrame scratch of the serial send
+static byte		sv_starve[MAX_CLIENTS][MAX_EDICTS];	// frames an entity update was deferred
+
+// min-heap of the full packet list by priority, built when the list overflows
+typedef struct
+{
+	int		count;		// 0 if not built for this snapshot
+	int		slots[MAX_VISIBLE_PACKET];
+	float		priority[MAX_VISIBLE_PACKET];	// by packet slot
+} sv_prioheap_t;
+
+static sv_prioheap_t	sv_prioheap;
+
 int	c_fullsend;	// just a debug counter
 
 /*
@@ -49,6 +177,322 @@ static int SV_EntityNumbers( const void *a, const void *b )
 	return 1;
 }
 
+/*
+=============
+SV_BuildVisIndex
+
+Bucket all networkable entities by their PVS leafs
+so every client only visits the entities whose leafs
+intersect his PVS. Entities that can't be culled by
+leafs (headnode linked, portals, beams etc) are always tested
+=============
+*/
+static void SV_BuildVisIndex( void )
+{
+	sv_visindex_t	*vi = &sv_visindex;
+	int		e, i, leafnum;
+	int		numleafs, total;
+	edict_t		*ent;
+
+	vi->valid = false;
+
+	if( !sv_vispass->integer || !sv.worldmodel || svgame.numEntities > MAX_EDICTS )
+		return;
+
+	numleafs = sv.worldmodel->numleafs;
+
+	if( vi->leaf_alloc < numleafs + 2 )
+	{
+		vi->leaf_alloc = numleafs + 2;
+		vi->leaf_first = Z_Realloc( vi->leaf_first, vi->leaf_alloc * sizeof( int ));
+	}
+
+	Q_memset( vi->leaf_first, 0, ( numleafs + 2 ) * sizeof( int ));
+	Q_memset( vi->always, 0, sizeof( vi->always ));
+	vi->numleafs = numleafs;
+	vi->num_always = vi->num_bucketed = 0;
+	total = 0;
+
+	// count entities per leaf
+	for( e = 1; e < svgame.numEntities; e++ )
+	{
+		ent = EDICT_NUM( e );
+		if( ent->free ) continue;
+
+		// no model - rejected by any AddToFullPack
+		if( !ent->v.modelindex ) continue;
+
+		if( ent->headnode >= 0 || ent->num_leafs <= 0 || ent->num_leafs > MAX_ENT_LEAFS
+		|| ( ent->v.flags & FL_CUSTOMENTITY ) || ( ent->v.effects & ( EF_MERGE_VISIBILITY|EF_REQUEST_PHS|EF_FORCEVISIBILITY )))
+		{
+			vi->always[e >> 5] |= BIT( e & 31 );
+			vi->num_always++;
+			continue;
+		}
+
+		for( i = 0; i < ent->num_leafs; i++ )
+		{
+			leafnum = ent->leafnums[i];
+
+			if( leafnum < 0 || leafnum >= numleafs )
+			{
+				vi->always[e >> 5] |= BIT( e & 31 );
+				vi->num_always++;
+				break;
+			}
+		}
+
+		if( i != ent->num_leafs )
+			continue;
+
+		for( i = 0; i < ent->num_leafs; i++ )
+			vi->leaf_first[ent->leafnums[i] + 2]++;
+		total += ent->num_leafs;
+		vi->num_bucketed++;
+	}
+
+	for( i = 2; i < numleafs + 2; i++ )
+		vi->leaf_first[i] += vi->leaf_first[i - 1];
+
+	if( vi->ents_alloc < total )
+	{
+		vi->ents_alloc = total;
+		vi->leaf_ents = Z_Realloc( vi->leaf_ents, vi->ents_alloc * sizeof( int ));
+	}
+
+	// fill the buckets (leaf_first[leaf + 1] is used as cursor)
+	for( e = 1; e < svgame.numEntities; e++ )
+	{
+		ent = EDICT_NUM( e );
+		if( ent->free || !ent->v.modelindex ) continue;
+		if( vi->always[e >> 5] & BIT( e & 31 )) continue;
+
+		for( i = 0; i < ent->num_leafs; i++ )
+			vi->leaf_ents[vi->leaf_first[ent->leafnums[i] + 1]++] = e;
+	}
+
+	vi->valid = true;
+}
+
+/*
+=============
+SV_GatherVisCandidates
+
+returns false if client should test all the entities
+=============
+*/
+static qboolean SV_GatherVisCandidates( int clientnum, edict_t *pClient, const byte *pvs, uint32_t *candidates )
+{
+	sv_visindex_t	*vi = &sv_visindex;
+	int		i, j, k, leafnum;
+	int		rowbytes, e;
+
+	if( !vi->valid || !pvs || clientnum < 0 || clientnum >= MAX_CLIENTS )
+		return false;
+
+	Q_memcpy( candidates, vi->always, sizeof( vi->always ));
+
+	// entities that was sent last time should be tested again
+	// to keep game-side "recently in PVS" logic working
+	for( i = 0; i < VIS_ENTWORDS; i++ )
+		candidates[i] |= vi->lastsent[clientnum][i];
+
+	// host always passed
+	e = NUM_FOR_EDICT( pClient );
+	candidates[e >> 5] |= BIT( e & 31 );
+
+	rowbytes = ( vi->numleafs + 7 ) >> 3;
+
+	for( i = 0; i < rowbytes; i++ )
+	{
+		if( !pvs[i] ) continue;
+
+		for( j = 0; j < 8; j++ )
+		{
+			if(!( pvs[i] & BIT( j )))
+				continue;
+
+			leafnum = ( i << 3 ) + j;
+			if( leafnum >= vi->numleafs ) break;
+
+			for( k = vi->leaf_first[leafnum]; k < vi->leaf_first[leafnum + 1]; k++ )
+			{
+				e = vi->leaf_ents[k];
+				candidates[e >> 5] |= BIT( e & 31 );
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+=============
+SV_VisStats_f
+
+=============
+*/
+void SV_VisStats_f( void )
+{
+	sv_visstats_t	*st;
+	sv_client_t	*cl;
+	int		i;
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	Msg( "vis pass: %s\n", sv_vispass->integer ? "enabled" : "disabled" );
+	Msg( "num name                             tested accepted avg tested avg accepted\n" );
+	Msg( "--- -------------------------------- ------ -------- ---------- ------------\n" );
+
+	for( i = 0, cl = svs.clients; i < sv_maxclients->integer && i < MAX_CLIENTS; i++, cl++ )
+	{
+		if( cl->state != cs_spawned || cl->fakeclient )
+			continue;
+
+		st = &sv_visstats[i];
+
+		Msg( "%3i %-32s %6i %8i %10.1f %12.1f\n", i, cl->name, st->tested, st->accepted,
+			st->numframes ? st->total_tested / st->numframes : 0.0,
+			st->numframes ? st->total_accepted / st->numframes : 0.0 );
+	}
+
+	if( sv_vispass->integer )
+		Msg( "%i entities bucketed by leafs, %i always tested\n", sv_visindex.num_bucketed, sv_visindex.num_always );
+}
+
+/*
+=============
+SV_EntityPriority
+
+score entity by distance, view cone, type and
+the number of frames it was starved
+=============
+*/
+static float SV_EntityPriority( const entity_state_t *state )
+{
+	sv_entview_t	*view = &sv_entview;
+	vec3_t		center, delta;
+	float		dist, priority;
+
+	if( state->number == view->clientent || state->number == view->viewent )
+		return PRIORITY_ALWAYS;
+
+	// brush models are positioned by their bounds
+	VectorAverage( state->mins, state->maxs, center );
+	VectorAdd( center, state->origin, center );
+	VectorSubtract( center, view->origin, delta );
+
+	dist = VectorLength( delta );
+	priority = 1.0f / ( 1.0f + dist * ( 1.0f / 512.0f ));
+
+	// outside of ~120 degrees view cone
+	if( dist > 1.0f && DotProduct( delta, view->forward ) < dist * 0.5f )
+		priority *= 0.5f;
+
+	if( SV_IsPlayerIndex( state->number ))
+		priority *= 4.0f;
+	else if( !VectorIsNull( state->velocity ))
+		priority *= 2.0f;
+	else if( state->entityType == ENTITY_BEAM )
+		priority *= 0.5f;
+
+	if( view->clientnum < MAX_CLIENTS )
+		priority *= 1.0f + sv_starve[view->clientnum][state->number];
+
+	return priority;
+}
+
+/*
+=============
+SV_PriorityLess
+
+lower priority first, then lower slot as the linear scan picks
+=============
+*/
+_inline qboolean SV_PriorityLess( const sv_prioheap_t *heap, int a, int b )
+{
+	float	pa = heap->priority[heap->slots[a]];
+	float	pb = heap->priority[heap->slots[b]];
+
+	return ( pa < pb || ( pa == pb && heap->slots[a] < heap->slots[b] )) ? true : false;
+}
+
+/*
+=============
+SV_PrioritySiftDown
+
+=============
+*/
+static void SV_PrioritySiftDown( sv_prioheap_t *heap, int i )
+{
+	int	child, tmp;
+
+	while(( child = i * 2 + 1 ) < heap->count )
+	{
+		if( child + 1 < heap->count && SV_PriorityLess( heap, child + 1, child ))
+			child++;
+
+		if( !SV_PriorityLess( heap, child, i ))
+			break;
+
+		tmp = heap->slots[i];
+		heap->slots[i] = heap->slots[child];
+		heap->slots[child] = tmp;
+		i = child;
+	}
+}
+
+/*
+=============
+SV_ReplaceLowestPriority
+
+packet list is full, new entity sits in the spare slot
+at the end and may replace the least important one.
+Priorities don't change while the packet is built, so
+they are scored once and kept in the heap
+=============
+*/
+static void SV_ReplaceLowestPriority( sv_ents_t *ents )
+{
+	sv_prioheap_t	*heap = &sv_prioheap;
+	entity_state_t	*state = &ents->entities[ents->num_entities];
+	float		priority, lowest;
+	int		i, slot;
+
+	if( !heap->count )
+	{
+		for( i = 0; i < ents->num_entities; i++ )
+		{
+			heap->priority[i] = SV_EntityPriority( &ents->entities[i] );
+			heap->slots[i] = i;
+		}
+
+		heap->count = ents->num_entities;
+
+		for( i = heap->count / 2 - 1; i >= 0; i-- )
+			SV_PrioritySiftDown( heap, i );
+	}
+
+	slot = heap->slots[0];
+	lowest = heap->priority[slot];
+
+	if( lowest >= PRIORITY_ALWAYS )
+		return;
+
+	priority = SV_EntityPriority( state );
+	if( priority <= lowest )
+		return;
+
+	ents->entities[slot] = *state;
+	heap->priority[slot] = priority;
+	SV_PrioritySiftDown( heap, 0 );
+	sv_sendstats.replaced++;
+}
+
 /*
 =============
 SV_AddEntitiesToPacket
@@ -60,10 +504,14 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 	edict_t		*ent;
 	byte		*pset;
 	qboolean		fullvis = false;
+	qboolean		culled = false;
+	uint32_t		candidates[VIS_ENTWORDS];
+	sv_visstats_t	*stats = NULL;
 	sv_client_t	*netclient;
 	sv_client_t	*cl = NULL;
 	entity_state_t	*state;
 	int		e, player;
+	int		clientnum;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -97,8 +545,28 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 	svgame.dllFuncs.pfnSetupVisibility( pViewEnt, pClient, &clientpvs, &clientphs );
 	if( !clientpvs ) fullvis = true;
 
+	clientnum = cl - svs.clients;
+	if( clientnum < MAX_CLIENTS )
+		stats = &sv_visstats[clientnum];
+
+	if( !fullvis )
+		culled = SV_GatherVisCandidates( clientnum, pClient, clientpvs, candidates );
+
 	for( e = 1; e < svgame.numEntities; e++ )
 	{
+		if( culled )
+		{
+			// skip the empty words quickly
+			if( !candidates[e >> 5] )
+			{
+				e |= 31;
+				continue;
+			}
+
+			if(!( candidates[e >> 5] & BIT( e & 31 )))
+				continue;
+		}
+
 		ent = EDICT_NUM( e );
 		if( ent->free ) continue;
 
@@ -115,12 +583,18 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 		netclient = SV_ClientFromEdict( ent, true );
 		player = ( netclient != NULL );
 
+		if( stats ) stats->tested++;
+
 		// add entity to the net packet
 		if( svgame.dllFuncs.pfnAddToFullPack( state, e, ent, pClient, sv.hostflags, player, pset ))
 		{
 			// to prevent adds it twice through portals
 			ent->v.pushmsec = sv.net_framenum;
 
+			if( stats ) stats->accepted++;
+			if( clientnum < MAX_CLIENTS )
+				sv_visindex.cursent[clientnum][e >> 5] |= BIT( e & 31 );
+
 			if( netclient && netclient->modelindex ) // apply custom model if present
 				state->modelindex = netclient->modelindex;
 
@@ -140,6 +614,11 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 				c_fullsend++;		// debug counter
 				
 			}
+			else if( sv_entbudget->integer )
+			{
+				// visibility list is full, keep the most important ones
+				SV_ReplaceLowestPriority( ents );
+			}
 			else
 			{
 				// visibility list is full
@@ -169,47 +648,370 @@ Encode a client frame onto the network channel
 */
 /*
 =============
-SV_EmitPacketEntities
+SV_ClearDeltaCache
 
-Writes a delta update of an entity_state_t list to the message->
+cache is valid for a single send frame
 =============
 */
-void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
+static void SV_ClearDeltaCache( void )
+{
+	sv_deltacache_t	*dc = &sv_deltacache;
+
+	if( dc->framenum )
+	{
+		dc->total_hits += dc->hits;
+		dc->total_misses += dc->misses;
+		dc->numframes++;
+	}
+
+	dc->hits = dc->misses = dc->full = 0;
+	dc->numentries = dc->datasize = 0;
+	dc->framenum++;
+
+	if( !sv_deltacache_enable->integer || dc->slots )
+		return;
+
+	dc->slots = Z_Malloc( DELTA_CACHE_SLOTS * sizeof( sv_deltaentry_t ));
+	dc->data = Z_Malloc( DELTA_CACHE_BYTES );
+	dc->lock = Sys_CreateMutex();
+}
+
+static uint32_t SV_DeltaHash( const entity_state_t *from, const entity_state_t *to, qboolean force, qboolean player )
+{
+	const uint32_t	*a = (const uint32_t *)from;
+	const uint32_t	*b = (const uint32_t *)to;
+	uint32_t		hash = 2166136261U;
+	int		i;
+
+	// FNV-1a by words
+	for( i = 0; i < sizeof( entity_state_t ) / sizeof( uint32_t ); i++ )
+	{
+		hash = ( hash ^ a[i] ) * 16777619U;
+		hash = ( hash ^ b[i] ) * 16777619U;
+	}
+
+	return hash ^ ( force << 1 ) ^ player;
+}
+
+/*
+=============
+SV_WriteDeltaEntityCached
+
+Clients who has acknowledged the same state will get the same bits,
+so encode the transition once per frame and copy it to the others.
+The budget pass measures the updates, its lookups are not counted
+and the first real use of its entry is counted as a miss
+=============
+*/
+static void SV_WriteDeltaEntityCached( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean player, qboolean measure )
+{
+	sv_deltacache_t	*dc = &sv_deltacache;
+	sv_deltaentry_t	*entry;
+	byte		buf[DELTA_CACHE_MAXBITS >> 3];
+	qboolean		locked;
+	uint32_t		hash;
+	sizebuf_t		delta;
+	int		slot;
+
+	if( !sv_deltacache_enable->integer || !dc->slots )
+	{
+		MSG_WriteDeltaEntity( from, to, msg, force, player, sv.time );
+		return;
+	}
+
+	hash = SV_DeltaHash( from, to, force, player );
+	locked = Sys_JobsRunning();
+
+	if( locked ) Sys_LockMutex( dc->lock );
+
+	for( slot = hash & ( DELTA_CACHE_SLOTS - 1 ); ; slot = ( slot + 1 ) & ( DELTA_CACHE_SLOTS - 1 ))
+	{
+		entry = &dc->slots[slot];
+		if( entry->framenum != dc->framenum )
+			break; // empty
+
+		if( entry->hash != hash || entry->force != force || entry->player != player )
+			continue;
+
+		if( memcmp( &entry->to, to, sizeof( *to )) || memcmp( &entry->from, from, sizeof( *from )))
+			continue;
+
+		BF_WriteBits( msg, dc->data + entry->offset, entry->numbits );
+
+		if( !measure )
+		{
+			if( entry->measured ) dc->misses++;
+			else dc->hits++;
+			entry->measured = false;
+		}
+
+		if( locked ) Sys_UnlockMutex( dc->lock );
+		return;
+	}
+
+	if( !measure ) dc->misses++;
+	if( locked ) Sys_UnlockMutex( dc->lock );
+
+	BF_Init( &delta, "DeltaCache", buf, sizeof( buf ));
+	MSG_WriteDeltaEntity( from, to, &delta, force, player, sv.time );
+	BF_WriteBits( msg, buf, BF_GetNumBitsWritten( &delta ));
+
+	if( BF_CheckOverflow( &delta ))
+	{
+		msg->bOverflow = true;
+		return;
+	}
+
+	if( locked ) Sys_LockMutex( dc->lock );
+
+	// keep the table sparse
+	if( dc->numentries >= ( DELTA_CACHE_SLOTS >> 1 ) || dc->datasize + BF_GetNumBytesWritten( &delta ) > DELTA_CACHE_BYTES )
+	{
+		dc->full++;
+	}
+	else
+	{
+		// another thread may add it meanwhile, it's harmless
+		for( slot = hash & ( DELTA_CACHE_SLOTS - 1 ); dc->slots[slot].framenum == dc->framenum; slot = ( slot + 1 ) & ( DELTA_CACHE_SLOTS - 1 ));
+
+		entry = &dc->slots[slot];
+		entry->framenum = dc->framenum;
+		entry->hash = hash;
+		entry->force = force;
+		entry->player = player;
+		entry->measured = measure;
+		entry->from = *from;
+		entry->to = *to;
+		entry->offset = dc->datasize;
+		entry->numbits = BF_GetNumBitsWritten( &delta );
+
+		Q_memcpy( dc->data + dc->datasize, buf, BF_GetNumBytesWritten( &delta ));
+		dc->datasize += BF_GetNumBytesWritten( &delta );
+		dc->numentries++;
+	}
+
+	if( locked ) Sys_UnlockMutex( dc->lock );
+}
+
+/*
+=============
+SV_DeltaCacheStats_f
+
+=============
+*/
+void SV_DeltaCacheStats_f( void )
+{
+	sv_deltacache_t	*dc = &sv_deltacache;
+	double		total;
+
+	Msg( "delta cache: %s\n", sv_deltacache_enable->integer ? "enabled" : "disabled" );
+	Msg( "last frame: %i hits, %i misses, %i not stored, %i bytes used\n", dc->hits, dc->misses, dc->full, dc->datasize );
+
+	total = dc->total_hits + dc->total_misses;
+	if( total > 0.0 )
+	{
+		Msg( "%i frames: %.0f hits, %.0f misses, %.1f%% hit rate\n", dc->numframes,
+			dc->total_hits, dc->total_misses, dc->total_hits * 100.0 / total );
+	}
+}
+
+/*
+=============
+SV_GetDeltaFrame
+
+returns the frame acknowledged by client
+or NULL if full update is required. next_entities is
+the head of the entities ring at the time of encoding
+=============
+*/
+static client_frame_t *SV_GetDeltaFrame( sv_client_t *cl, int next_entities )
+{
+	client_frame_t	*from;
+
+	if( cl->delta_sequence == -1 )
+		return NULL;
+
+	from = &cl->frames[cl->delta_sequence & SV_UPDATE_MASK];
+
+	// slot was reused since then
+	if(( from->sequence & 0xFF ) != cl->delta_sequence )
+		return NULL;
+
+	// the snapshot's entities may still have rolled off the buffer, though
+	if( from->first_entity <= next_entities - svs.num_client_entities )
+	{
+		MsgDev( D_WARN, "%s: delta request from out of date entities.\n", cl->name );
+		return NULL;
+	}
+
+	return from;
+}
+
+static void SV_WritePacketEntities( sv_client_t *cl, client_frame_t *from, client_frame_t *to, sizebuf_t *msg, qboolean measure );
+
+/*
+=============
+SV_AckClientFrame
+
+client has this frame and can delta from it
+=============
+*/
+void SV_AckClientFrame( sv_client_t *cl, int sequence )
+{
+	client_frame_t	*frame;
+
+	if( sequence < 0 || !cl->frames )
+		return;
+
+	frame = &cl->frames[sequence & SV_UPDATE_MASK];
+
+	if(( frame->sequence & 0xFF ) == sequence )
+		frame->acked = true;
+}
+
+/*
+=============
+SV_ChooseDeltaFrame
+
+try recent acknowledged frames as delta base and pick
+the smallest encoding. Can be called from worker threads,
+each caller gives its own NET_MAX_PAYLOAD scratch buffer.
+A measure pick isn't counted in the stats
+=============
+*/
+static client_frame_t *SV_ChooseDeltaFrame( sv_client_t *cl, client_frame_t *from, client_frame_t *to, int next_entities, byte *scratch_buf, qboolean measure )
+{
+	client_frame_t	*frame, *best = from;
+	int		bestbits, bits;
+	int		i, window, numents;
+	int		maxents;
+	sizebuf_t		scratch;
+
+	if( !from || sv_deltaring->integer <= 0 )
+		return from;
+
+	// candidates must fit the client delta window and its entities ring
+	window = min( sv_deltaring->integer, SV_UPDATE_BACKUP - 2 );
+	maxents = SV_UPDATE_BACKUP * 64 - 128;
+
+	BF_Init( &scratch, "DeltaRing", scratch_buf, NET_MAX_PAYLOAD );
+	SV_WritePacketEntities( cl, from, to, &scratch, true );
+	bestbits = BF_CheckOverflow( &scratch ) ? INT_MAX : BF_GetNumBitsWritten( &scratch );
+	numents = to->num_entities;
+
+	for( i = 1; i <= window; i++ )
+	{
+		frame = &cl->frames[( to->sequence - i ) & SV_UPDATE_MASK];
+
+		if( frame->sequence != to->sequence - i )
+			break;
+
+		numents += frame->num_entities;
+		if( numents > maxents )
+			break;
+
+		// the snapshot's entities have rolled off the buffer
+		if( frame->first_entity <= next_entities - svs.num_client_entities )
+			break;
+
+		if( frame != from && frame->acked )
+		{
+			BF_Clear( &scratch );
+			SV_WritePacketEntities( cl, frame, to, &scratch, true );
+			bits = BF_GetNumBitsWritten( &scratch );
+
+			if( !BF_CheckOverflow( &scratch ) && bits < bestbits )
+			{
+				bestbits = bits;
+				best = frame;
+			}
+		}
+
+		// don't look beyond a level change or reconnect
+		if( frame->fullupdate ) break;
+	}
+
+	if( best != from && !measure && cl - svs.clients < MAX_CLIENTS )
+		sv_ringpicks[cl - svs.clients]++;
+
+	return best;
+}
+
+/*
+=============
+SV_OldestDeltaEntity
+
+returns the first ring entity that SV_ChooseDeltaFrame may read
+=============
+*/
+static int SV_OldestDeltaEntity( sv_client_t *cl, client_frame_t *from, client_frame_t *to, int next_entities )
+{
+	client_frame_t	*frame;
+	int		i, window, numents;
+	int		maxents, oldest;
+
+	if( !from ) return to->first_entity;
+
+	oldest = min( from->first_entity, to->first_entity );
+	if( sv_deltaring->integer <= 0 )
+		return oldest;
+
+	// same walk as SV_ChooseDeltaFrame
+	window = min( sv_deltaring->integer, SV_UPDATE_BACKUP - 2 );
+	maxents = SV_UPDATE_BACKUP * 64 - 128;
+	numents = to->num_entities;
+
+	for( i = 1; i <= window; i++ )
+	{
+		frame = &cl->frames[( to->sequence - i ) & SV_UPDATE_MASK];
+
+		if( frame->sequence != to->sequence - i )
+			break;
+
+		numents += frame->num_entities;
+		if( numents > maxents )
+			break;
+
+		if( frame->first_entity <= next_entities - svs.num_client_entities )
+			break;
+
+		if( frame != from && frame->acked )
+			oldest = min( oldest, frame->first_entity );
+
+		if( frame->fullupdate ) break;
+	}
+
+	return oldest;
+}
+
+/*
+=============
+SV_WritePacketEntities
+
+Writes a delta update of an entity_state_t list to the message.
+Doesn't touch the shared server state, so can be called from worker threads.
+Measure encodings don't count in the delta cache stats
+=============
+*/
+static void SV_WritePacketEntities( sv_client_t *cl, client_frame_t *from, client_frame_t *to, sizebuf_t *msg, qboolean measure )
 {
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
-	client_frame_t	*from;
 	qboolean player = false;
 
 	// this is the frame that we are going to delta update from
-	if( cl->delta_sequence != -1 )
+	if( from != NULL )
 	{
-		from = &cl->frames[cl->delta_sequence & SV_UPDATE_MASK];
 		from_num_entities = from->num_entities;
 
-		// the snapshot's entities may still have rolled off the buffer, though
-		if( from->first_entity <= svs.next_client_entities - svs.num_client_entities )
-		{
-			MsgDev( D_WARN, "%s: delta request from out of date entities.\n", cl->name );
-
-			from = NULL;
-			from_num_entities = 0;
-
-			BF_WriteByte( msg, svc_packetentities );
-			BF_WriteWord( msg, to->num_entities );
-		}
-		else
-		{
-			BF_WriteByte( msg, svc_deltapacketentities );
-			BF_WriteWord( msg, to->num_entities );
-			BF_WriteByte( msg, cl->delta_sequence );
-		}
+		BF_WriteByte( msg, svc_deltapacketentities );
+		BF_WriteWord( msg, to->num_entities );
+		BF_WriteByte( msg, from->sequence & 0xFF );
 	}
 	else
 	{
-		from = NULL;
 		from_num_entities = 0;
 
 		BF_WriteByte( msg, svc_packetentities );
@@ -250,7 +1052,7 @@ void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg
 			// delta update from old position
 			// because the force parm is false, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity( oldent, newent, msg, false, player, sv.time );
+			SV_WriteDeltaEntityCached( oldent, newent, msg, false, player, measure );
 			oldindex++;
 			newindex++;
 			continue;
@@ -259,7 +1061,7 @@ void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg
 		if( newnum < oldnum )
 		{	
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity( &svs.baselines[newnum], newent, msg, true, player, sv.time );
+			SV_WriteDeltaEntityCached( &svs.baselines[newnum], newent, msg, true, player, measure );
 			newindex++;
 			continue;
 		}
@@ -272,14 +1074,173 @@ void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg
 				force = true;	// entity completely removed from server
 			else force = false;		// just removed from delta-message 
 
-			// remove from message
-			MSG_WriteDeltaEntity( oldent, NULL, msg, force, false, sv.time );
-			oldindex++;
-			continue;
+			// remove from message
+			MSG_WriteDeltaEntity( oldent, NULL, msg, force, false, sv.time );
+			oldindex++;
+			continue;
+		}
+	}
+
+	BF_WriteWord( msg, 0 ); // end of packetentities
+}
+
+/*
+=============
+SV_EmitPacketEntities
+
+Writes a delta update of an entity_state_t list to the message->
+=============
+*/
+void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
+{
+	client_frame_t	*from = SV_GetDeltaFrame( cl, svs.next_client_entities );
+
+	to->fullupdate = ( from == NULL );
+
+	if( sv_deltaring->integer > 0 && !sv_ringbuf )
+		sv_ringbuf = Z_Malloc( NET_MAX_PAYLOAD );
+
+	from = SV_ChooseDeltaFrame( cl, from, to, svs.next_client_entities, sv_ringbuf, false );
+	SV_WritePacketEntities( cl, from, to, msg, false );
+}
+
+/*
+=============
+SV_CollectDeltaPairs
+
+gather from->to entity transitions of the last two frames sent to each client
+=============
+*/
+static int SV_CollectDeltaPairs( entity_state_t **from, entity_state_t **to, int maxpairs )
+{
+	client_frame_t	*oldframe, *newframe;
+	entity_state_t	*oldent, *newent;
+	int		oldindex, newindex;
+	int		i, numpairs = 0;
+	sv_client_t	*cl;
+
+	for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+	{
+		if( cl->state != cs_spawned || cl->fakeclient )
+			continue;
+
+		newframe = &cl->frames[(cl->netchan.outgoing_sequence - 1) & SV_UPDATE_MASK];
+		oldframe = &cl->frames[(cl->netchan.outgoing_sequence - 2) & SV_UPDATE_MASK];
+
+		// frames are rolled off the buffer
+		if( oldframe->first_entity <= svs.next_client_entities - svs.num_client_entities )
+			continue;
+
+		for( newindex = oldindex = 0; newindex < newframe->num_entities && numpairs < maxpairs; newindex++ )
+		{
+			newent = &svs.packet_entities[(newframe->first_entity + newindex) % svs.num_client_entities];
+			oldent = NULL;
+
+			while( oldindex < oldframe->num_entities )
+			{
+				oldent = &svs.packet_entities[(oldframe->first_entity + oldindex) % svs.num_client_entities];
+				if( oldent->number >= newent->number ) break;
+				oldindex++;
+			}
+
+			if( oldindex >= oldframe->num_entities || oldent->number != newent->number )
+				oldent = &svs.baselines[newent->number];
+
+			from[numpairs] = oldent;
+			to[numpairs] = newent;
+			numpairs++;
+		}
+	}
+
+	return numpairs;
+}
+
+/*
+=============
+SV_DeltaBench_f
+
+compare interpreted and compiled entity encoders
+=============
+*/
+void SV_DeltaBench_f( void )
+{
+	entity_state_t	**from, **to;
+	int		i, j, numpairs, iterations;
+	int		mismatches = 0;
+	double		start, time[2];
+	byte		*buf[2];
+	sizebuf_t		msg[2];
+	qboolean		fastpath;
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	iterations = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : 100;
+	iterations = bound( 1, iterations, 10000 );
+
+	from = Z_Malloc( MAX_EDICTS * sizeof( entity_state_t* ));
+	to = Z_Malloc( MAX_EDICTS * sizeof( entity_state_t* ));
+	numpairs = SV_CollectDeltaPairs( from, to, MAX_EDICTS );
+
+	if( !numpairs )
+	{
+		Msg( "no entities were sent yet\n" );
+		Mem_Free( from );
+		Mem_Free( to );
+		return;
+	}
+
+	buf[0] = Z_Malloc( NET_MAX_PAYLOAD );
+	buf[1] = Z_Malloc( NET_MAX_PAYLOAD );
+	fastpath = Delta_SetFastPath( false );
+
+	// 0 - interpreted, 1 - compiled
+	for( j = 0; j < 2; j++ )
+	{
+		Delta_SetFastPath( j );
+		BF_Init( &msg[j], "DeltaBench", buf[j], NET_MAX_PAYLOAD );
+		start = Sys_DoubleTime();
+
+		for( i = 0; i < numpairs * iterations; i++ )
+		{
+			// keep room for the biggest delta
+			if( BF_GetNumBytesWritten( &msg[j] ) > NET_MAX_PAYLOAD - 1024 )
+				BF_Clear( &msg[j] );
+			MSG_WriteDeltaEntity( from[i % numpairs], to[i % numpairs], &msg[j], false, SV_IsPlayerIndex( to[i % numpairs]->number ), sv.time );
+		}
+
+		time[j] = Sys_DoubleTime() - start;
+	}
+
+	// check the output of last iteration
+	for( i = 0; i < numpairs; i++ )
+	{
+		for( j = 0; j < 2; j++ )
+		{
+			Delta_SetFastPath( j );
+			Q_memset( buf[j], 0, 1024 );
+			BF_Init( &msg[j], "DeltaBench", buf[j], 1024 );
+			MSG_WriteDeltaEntity( from[i], to[i], &msg[j], true, SV_IsPlayerIndex( to[i]->number ), sv.time );
 		}
+
+		if( BF_GetNumBitsWritten( &msg[0] ) != BF_GetNumBitsWritten( &msg[1] ) || memcmp( buf[0], buf[1], BF_GetNumBytesWritten( &msg[0] )))
+			mismatches++;
 	}
 
-	BF_WriteWord( msg, 0 ); // end of packetentities
+	Delta_SetFastPath( fastpath );
+
+	Msg( "%i entities x %i iterations\n", numpairs, iterations );
+	Msg( "interpreted: %.1f ns per entity\n", time[0] * 1e9 / ((double)numpairs * iterations ));
+	Msg( "compiled:    %.1f ns per entity\n", time[1] * 1e9 / ((double)numpairs * iterations ));
+	if( mismatches ) Msg( "^1%i encodings are mismatched!\n", mismatches );
+
+	Mem_Free( buf[0] );
+	Mem_Free( buf[1] );
+	Mem_Free( from );
+	Mem_Free( to );
 }
 
 /*
@@ -531,38 +1492,209 @@ void SV_WriteClientdataToMessage( sv_client_t *cl, sizebuf_t *msg )
 	BF_WriteOneBit( msg, 0 );
 }
 
+/*
+=============
+SV_ComparePriority
+
+=============
+*/
+static float	*sv_sortpriority;
+
+static int SV_ComparePriority( const void *a, const void *b )
+{
+	float	pa = sv_sortpriority[*(const int *)a];
+	float	pb = sv_sortpriority[*(const int *)b];
+
+	if( pa > pb ) return -1;
+	if( pa < pb ) return 1;
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=============
+SV_ClearEntityBudget
+
+new owner of the client slot starts without starved entities
+=============
+*/
+void SV_ClearEntityBudget( sv_client_t *cl )
+{
+	int	clientnum = cl - svs.clients;
+
+	if( clientnum >= 0 && clientnum < MAX_CLIENTS )
+		Q_memset( sv_starve[clientnum], 0, sizeof( sv_starve[clientnum] ));
+}
+
+/*
+=============
+SV_BudgetClientFrame
+
+when the snapshot doesn't fit into the client rate, send the
+most important entity updates and keep the acknowledged state
+for the rest. Starved entities get promoted in the next frames
+=============
+*/
+static void SV_BudgetClientFrame( sv_client_t *cl, sv_ents_t *ents, int reserved )
+{
+	static entity_state_t	*oldstates[MAX_VISIBLE_PACKET];
+	static float		priority[MAX_VISIBLE_PACKET];
+	static int		cost[MAX_VISIBLE_PACKET];
+	static int		order[MAX_VISIBLE_PACKET];
+	static byte		scratch_buf[2048];
+	client_frame_t		*from;
+	entity_state_t		*newent, *oldent;
+	sizebuf_t			scratch;
+	int			budget, total;
+	int			i, j, oldindex;
+	int			clientnum = cl - svs.clients;
+	byte			*starve;
+
+	if( !sv_entbudget->integer || !ents->num_entities || clientnum >= MAX_CLIENTS )
+		return;
+
+	// local client is never choked
+	if( cl->netchan.rate <= 0.0 || NET_IsLocalAddress( cl->netchan.remote_address ))
+		return;
+
+	starve = sv_starve[clientnum];
+	budget = cl->netchan.rate * max( cl->cl_updaterate, host.frametime );
+	budget -= reserved + BF_GetNumBytesWritten( &cl->datagram ) + BUDGET_OVERHEAD;
+	budget = max( budget, 0 ) << 3;
+
+	from = SV_GetDeltaFrame( cl, svs.next_client_entities );
+	BF_Init( &scratch, "EntityCost", scratch_buf, sizeof( scratch_buf ));
+
+	// measure every update against the state the client has
+	for( i = 0, oldindex = 0, total = 0; i < ents->num_entities; i++ )
+	{
+		newent = &ents->entities[i];
+		oldstates[i] = NULL;
+
+		while( from && oldindex < from->num_entities )
+		{
+			oldent = &svs.packet_entities[(from->first_entity+oldindex)%svs.num_client_entities];
+			if( oldent->number > newent->number ) break;
+			oldindex++;
+
+			if( oldent->number == newent->number )
+			{
+				oldstates[i] = oldent;
+				break;
+			}
+		}
+
+		BF_Clear( &scratch );
+
+		// deltas are cached, so the real encode will reuse these bits
+		if( oldstates[i] ) SV_WriteDeltaEntityCached( oldstates[i], newent, &scratch, false, SV_IsPlayerIndex( newent->number ), true );
+		else SV_WriteDeltaEntityCached( &svs.baselines[newent->number], newent, &scratch, true, SV_IsPlayerIndex( newent->number ), true );
+
+		cost[i] = BF_CheckOverflow( &scratch ) ? sizeof( scratch_buf ) << 3 : BF_GetNumBitsWritten( &scratch );
+		total += cost[i];
+	}
+
+	if( total <= budget )
+	{
+		for( i = 0; i < ents->num_entities; i++ )
+			starve[ents->entities[i].number] = 0;
+		return;
+	}
+
+	for( i = 0; i < ents->num_entities; i++ )
+	{
+		priority[i] = SV_EntityPriority( &ents->entities[i] );
+		order[i] = i;
+	}
+
+	sv_sortpriority = priority;
+	qsort( order, ents->num_entities, sizeof( order[0] ), SV_ComparePriority );
+
+	for( i = 0; i < ents->num_entities; i++ )
+	{
+		j = order[i];
+		newent = &ents->entities[j];
+
+		if( !cost[j] || cost[j] <= budget || priority[j] == PRIORITY_ALWAYS )
+		{
+			budget -= cost[j];
+			starve[newent->number] = 0;
+			continue;
+		}
+
+		// client keeps what it has, or doesn't see the entity yet
+		if( starve[newent->number] < 255 )
+			starve[newent->number]++;
+		sv_sendstats.deferred++;
+
+		if( oldstates[j] ) *newent = *oldstates[j];
+		else newent->number = -1;
+	}
+
+	// remove deferred new entities, order is kept
+	for( i = j = 0; i < ents->num_entities; i++ )
+	{
+		if( ents->entities[i].number == -1 )
+			continue;
+		if( i != j ) ents->entities[j] = ents->entities[i];
+		j++;
+	}
+
+	ents->num_entities = j;
+	sv_sendstats.budgeted++;
+}
+
 /*
 ==================
-SV_WriteEntitiesToClient
+SV_SetupClientFrame
 
+collect visible entities into the client frame,
+returns NULL if client was dropped
 ==================
 */
-void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
+static client_frame_t *SV_SetupClientFrame( sv_client_t *cl, int reserved, qboolean *send_pings )
 {
 	edict_t		*clent;
 	edict_t		*viewent;	// may be NULL
 	client_frame_t	*frame;
 	entity_state_t	*state;
 	static sv_ents_t	frame_ents;
-	int		i, send_pings;
+	int		i;
 
 	clent = cl->edict;
 	if(	!SV_IsValidEdict( clent ) )
 	{
 		SV_DropClient ( cl );
-		return;
+		return NULL;
 	}
 	viewent = cl->pViewEntity;	// himself or trigger_camera
 
 	frame = &cl->frames[cl->netchan.outgoing_sequence & SV_UPDATE_MASK];
+	frame->sequence = cl->netchan.outgoing_sequence;
+	frame->acked = false;
 
-	send_pings = SV_ShouldUpdatePing( cl );
+	*send_pings = SV_ShouldUpdatePing( cl );
 
 	sv.net_framenum++;	// now all portal-through entities are invalidate
 	sv.hostflags &= ~SVF_PORTALPASS;
 
 	// clear everything in this snapshot
 	frame_ents.num_entities = c_fullsend = 0;
+	sv_prioheap.count = 0;
+
+	i = cl - svs.clients;
+	if( i < MAX_CLIENTS )
+	{
+		sv_visstats[i].tested = sv_visstats[i].accepted = 0;
+		Q_memset( sv_visindex.cursent[i], 0, sizeof( sv_visindex.cursent[i] ));
+	}
+
+	// setup the viewer for entity priorities
+	if( !SV_IsValidEdict( viewent )) viewent = clent;
+	VectorAdd( viewent->v.origin, viewent->v.view_ofs, sv_entview.origin );
+	AngleVectors( clent->v.v_angle, sv_entview.forward, NULL, NULL );
+	sv_entview.clientnum = i;
+	sv_entview.clientent = NUM_FOR_EDICT( clent );
+	sv_entview.viewent = NUM_FOR_EDICT( viewent );
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
@@ -574,6 +1706,9 @@ void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
 	// of an entity being included twice.
 	qsort( frame_ents.entities, frame_ents.num_entities, sizeof( frame_ents.entities[0] ), SV_EntityNumbers );
 
+	// fit the snapshot into client rate
+	SV_BudgetClientFrame( cl, &frame_ents, reserved );
+
 	// copy the entity states out
 	frame->num_entities = 0;
 
@@ -602,6 +1737,32 @@ void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
 		frame->num_entities++;
 	}
 
+	i = cl - svs.clients;
+	if( i < MAX_CLIENTS )
+	{
+		sv_visstats[i].total_tested += sv_visstats[i].tested;
+		sv_visstats[i].total_accepted += sv_visstats[i].accepted;
+		sv_visstats[i].numframes++;
+		Q_memcpy( sv_visindex.lastsent[i], sv_visindex.cursent[i], sizeof( sv_visindex.lastsent[i] ));
+	}
+
+	return frame;
+}
+
+/*
+==================
+SV_WriteEntitiesToClient
+
+==================
+*/
+void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
+{
+	client_frame_t	*frame;
+	qboolean		send_pings;
+
+	frame = SV_SetupClientFrame( cl, BF_GetNumBytesWritten( msg ), &send_pings );
+	if( !frame ) return;
+
 	SV_EmitPacketEntities( cl, frame, msg );
 	SV_EmitEvents( cl, frame, msg );
 	if( send_pings ) SV_EmitPings( msg );
@@ -614,6 +1775,30 @@ FRAME UPDATES
 
 ===============================================================================
 */
+/*
+=======================
+SV_TransmitClientDatagram
+=======================
+*/
+static void SV_TransmitClientDatagram( sv_client_t *cl, sizebuf_t *msg )
+{
+	// copy the accumulated multicast datagram
+	// for this client out to the message
+	if( BF_CheckOverflow( &cl->datagram )) MsgDev( D_WARN, "datagram overflowed for %s\n", cl->name );
+	else BF_WriteBits( msg, BF_GetData( &cl->datagram ), BF_GetNumBitsWritten( &cl->datagram ));
+	BF_Clear( &cl->datagram );
+
+	if( BF_CheckOverflow( msg ))
+	{	
+		// must have room left for the packet header
+		MsgDev( D_WARN, "msg overflowed for %s\n", cl->name );
+		BF_Clear( msg );
+	}
+
+	// send the datagram
+	Netchan_TransmitBits( &cl->netchan, BF_GetNumBitsWritten( msg ), BF_GetData( msg ));
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -637,21 +1822,248 @@ void SV_SendClientDatagram( sv_client_t *cl )
 	SV_WriteClientdataToMessage( cl, &msg );
 	SV_WriteEntitiesToClient( cl, &msg );
 
-	// copy the accumulated multicast datagram
-	// for this client out to the message
-	if( BF_CheckOverflow( &cl->datagram )) MsgDev( D_WARN, "datagram overflowed for %s\n", cl->name );
-	else BF_WriteBits( &msg, BF_GetData( &cl->datagram ), BF_GetNumBitsWritten( &cl->datagram ));
-	BF_Clear( &cl->datagram );
+	SV_TransmitClientDatagram( cl, &msg );
+}
 
-	if( BF_CheckOverflow( &msg ))
-	{	
-		// must have room left for the packet header
-		MsgDev( D_WARN, "msg overflowed for %s\n", cl->name );
-		BF_Clear( &msg );
+/*
+=======================
+SV_PrepareClientDatagram
+
+parallel send, first pass: call the game dll and build client frame.
+The delta frame is picked here, as the serial send would do. Packet
+entities are encoded later by SV_EncodeClientJob unless the frames
+they need may be overwritten by the clients that follow
+=======================
+*/
+static void SV_PrepareClientDatagram( sv_client_t *cl, sv_sendslot_t *slot )
+{
+	int	margin;
+
+	if( !slot->msg_buf )
+	{
+		slot->msg_buf = Z_Malloc( NET_MAX_PAYLOAD );
+		slot->ents_buf = Z_Malloc( NET_MAX_PAYLOAD );
 	}
 
-	// send the datagram
-	Netchan_TransmitBits( &cl->netchan, BF_GetNumBitsWritten( &msg ), BF_GetData( &msg ));
+	if( sv_deltaring->integer > 0 && !slot->ring_buf )
+		slot->ring_buf = Z_Malloc( NET_MAX_PAYLOAD );
+
+	svs.currentPlayer = cl;
+	svs.currentPlayerNum = (cl - svs.clients);
+
+	BF_Init( &slot->msg, "Datagram", slot->msg_buf, NET_MAX_PAYLOAD );
+	BF_Init( &slot->ents, "PacketEntities", slot->ents_buf, NET_MAX_PAYLOAD );
+
+	// always send servertime at new frame
+	BF_WriteByte( &slot->msg, svc_time );
+	BF_WriteFloat( &slot->msg, sv.time );
+
+	SV_WriteClientdataToMessage( cl, &slot->msg );
+
+	slot->cl = cl;
+	slot->from = NULL;
+	slot->encoded = false;
+	slot->frame = SV_SetupClientFrame( cl, BF_GetNumBytesWritten( &slot->msg ), &slot->send_pings );
+	if( !slot->frame ) return;
+
+	slot->next_entities = svs.next_client_entities;
+	slot->from = SV_GetDeltaFrame( cl, slot->next_entities );
+	slot->frame->fullupdate = ( slot->from == NULL );
+
+	if( sv_parallel_send->integer == 2 )
+	{
+		client_frame_t	*from;
+
+		// reference encoding, exactly what SV_SendClientDatagram would write.
+		// It's not counted in the stats, the encoding that is sent will be
+		if( !slot->verify_buf ) slot->verify_buf = Z_Malloc( NET_MAX_PAYLOAD );
+		Q_memset( slot->verify_buf, 0, NET_MAX_PAYLOAD );
+		Q_memset( slot->ents_buf, 0, NET_MAX_PAYLOAD );
+		BF_Init( &slot->verify, "VerifyEntities", slot->verify_buf, NET_MAX_PAYLOAD );
+		from = SV_ChooseDeltaFrame( cl, slot->from, slot->frame, slot->next_entities, slot->ring_buf, true );
+		SV_WritePacketEntities( cl, from, slot->frame, &slot->verify, true );
+	}
+
+	// each client that follows may add a full packet to the ring
+	margin = ( sv_maxclients->integer - svs.currentPlayerNum - 1 ) * MAX_VISIBLE_PACKET;
+
+	if( SV_OldestDeltaEntity( cl, slot->from, slot->frame, slot->next_entities ) <= slot->next_entities + margin - svs.num_client_entities )
+	{
+		slot->from = SV_ChooseDeltaFrame( cl, slot->from, slot->frame, slot->next_entities, slot->ring_buf, false );
+		SV_WritePacketEntities( cl, slot->from, slot->frame, &slot->ents, false );
+		slot->encoded = true;
+		sv_sendstats.inplace++;
+	}
+}
+
+/*
+=======================
+SV_EncodeClientJob
+
+parallel send, second pass: runs on worker threads, or on the main
+thread if the game dll has custom entity encoders
+=======================
+*/
+static void SV_EncodeClientJob( void *data, int index )
+{
+	sv_sendslot_t	*slot = (sv_sendslot_t *)data + index;
+
+	if( !slot->frame || slot->encoded )
+		return;
+
+	slot->from = SV_ChooseDeltaFrame( slot->cl, slot->from, slot->frame, slot->next_entities, slot->ring_buf, false );
+	SV_WritePacketEntities( slot->cl, slot->from, slot->frame, &slot->ents, false );
+}
+
+/*
+=======================
+SV_VerifyClientEncode
+
+compare the parallel encoding against the serial one
+=======================
+*/
+static void SV_VerifyClientEncode( sv_sendslot_t *slot )
+{
+	int	numbits = BF_GetNumBitsWritten( &slot->verify );
+
+	sv_sendstats.verified++;
+
+	if( numbits != BF_GetNumBitsWritten( &slot->ents ) || memcmp( slot->verify_buf, slot->ents_buf, ( numbits + 7 ) >> 3 ))
+	{
+		MsgDev( D_ERROR, "SV_VerifyClientEncode: snapshot mismatch for %s\n", slot->cl->name );
+		SV_CheckMismatch( CHECK_PARALLEL_SEND );
+
+		// trust the serial encoder
+		Q_memcpy( slot->ents_buf, slot->verify_buf, ( numbits + 7 ) >> 3 );
+		BF_SeekToBit( &slot->ents, numbits );
+		slot->ents.bOverflow = slot->verify.bOverflow;
+	}
+}
+
+/*
+=======================
+SV_FinishClientDatagram
+
+parallel send, last pass: append the encoded entities,
+events and pings in the client order and transmit
+=======================
+*/
+static void SV_FinishClientDatagram( sv_sendslot_t *slot )
+{
+	sv_client_t	*cl = slot->cl;
+
+	svs.currentPlayer = cl;
+	svs.currentPlayerNum = (cl - svs.clients);
+
+	if( slot->frame )
+	{
+		if( sv_parallel_send->integer == 2 )
+			SV_VerifyClientEncode( slot );
+
+		if( BF_CheckOverflow( &slot->ents ))
+			slot->msg.bOverflow = true;
+		else BF_WriteBits( &slot->msg, BF_GetData( &slot->ents ), BF_GetNumBitsWritten( &slot->ents ));
+
+		SV_EmitEvents( cl, slot->frame, &slot->msg );
+		if( slot->send_pings ) SV_EmitPings( &slot->msg );
+	}
+
+	SV_TransmitClientDatagram( cl, &slot->msg );
+}
+
+/*
+=======================
+SV_SendParallelDatagrams
+
+encode packet entities of all the prepared clients at once.
+Custom entity encoders live in the game dll and can't be
+called from worker threads
+=======================
+*/
+static void SV_SendParallelDatagrams( int numslots )
+{
+	double	start;
+	int	i;
+
+	start = Sys_DoubleTime();
+
+	if( Delta_HasEntityEncoders( ))
+	{
+		for( i = 0; i < numslots; i++ )
+			SV_EncodeClientJob( sv_sendslots, i );
+	}
+	else Sys_RunJobs( SV_EncodeClientJob, sv_sendslots, numslots );
+
+	sv_sendstats.encodetime += Sys_DoubleTime() - start;
+	sv_sendstats.numframes++;
+	sv_sendstats.numclients += numslots;
+
+	for( i = 0; i < numslots; i++ )
+		SV_FinishClientDatagram( &sv_sendslots[i] );
+}
+
+/*
+=======================
+SV_SendStats_f
+
+=======================
+*/
+void SV_SendStats_f( void )
+{
+	const char	*mode;
+
+	switch( sv_parallel_send->integer )
+	{
+	case 0: mode = "disabled"; break;
+	case 2: mode = "verify"; break;
+	default: mode = "enabled"; break;
+	}
+
+	Msg( "parallel send: %s, %i worker threads\n", mode, Sys_NumWorkers( ));
+
+	if( !sv_sendstats.numframes )
+		return;
+
+	Msg( "%i frames, %i snapshots, %.3f ms encode per frame\n", sv_sendstats.numframes, sv_sendstats.numclients,
+		sv_sendstats.encodetime * 1000.0 / sv_sendstats.numframes );
+	if( sv_sendstats.inplace )
+		Msg( "%i snapshots encoded in place to keep their delta frames\n", sv_sendstats.inplace );
+	if( sv_sendstats.verified )
+		Msg( "%i snapshots verified\n", sv_sendstats.verified );
+	SV_PrintMismatches( CHECK_PARALLEL_SEND );
+}
+
+/*
+=======================
+SV_BudgetStats_f
+
+=======================
+*/
+void SV_BudgetStats_f( void )
+{
+	Msg( "entity budget: %s\n", sv_entbudget->integer ? "enabled" : "disabled" );
+	Msg( "%i snapshots over client rate, %i entity updates deferred\n", sv_sendstats.budgeted, sv_sendstats.deferred );
+	Msg( "%i entities replaced in full packet lists\n", sv_sendstats.replaced );
+}
+
+/*
+=======================
+SV_DeltaRingStats_f
+
+=======================
+*/
+void SV_DeltaRingStats_f( void )
+{
+	sv_client_t	*cl;
+	int		i;
+
+	Msg( "delta ring: %i frames\n", sv_deltaring->integer );
+
+	for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+	{
+		if( cl->state != cs_spawned ) continue;
+		Msg( "%s: %i snapshots against an older base, last delta %i\n", cl->name, sv_ringpicks[i], cl->delta_sequence );
+	}
 }
 
 /*
@@ -738,7 +2150,8 @@ SV_SendClientMessages
 void SV_SendClientMessages( void )
 {
 	sv_client_t	*cl;
-	int		i;
+	qboolean		parallel;
+	int		i, numslots = 0;
 
 	svs.currentPlayer = NULL;
 	svs.currentPlayerNum = 0;
@@ -748,6 +2161,15 @@ void SV_SendClientMessages( void )
 
 	SV_UpdateToReliableMessages ();
 
+	// all the client datagrams are sent at once
+	NET_BeginSendBatch( NS_SERVER );
+
+	// bucket entities by leafs once for all the clients
+	SV_BuildVisIndex();
+
+	parallel = sv_parallel_send->integer ? true : false;
+	SV_ClearDeltaCache();
+
 	// send a message to each connected client
 	for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
 	{
@@ -817,7 +2239,8 @@ void SV_SendClientMessages( void )
 
 		if( cl->state == cs_spawned )
 		{
-			SV_SendClientDatagram( cl );
+			if( parallel ) SV_PrepareClientDatagram( cl, &sv_sendslots[numslots++] );
+			else SV_SendClientDatagram( cl );
 		}
 		else
 		{
@@ -826,6 +2249,13 @@ void SV_SendClientMessages( void )
 		}
 	}
 
+	if( numslots ) SV_SendParallelDatagrams( numslots );
+
+	NET_FlushSendBatch( NS_SERVER );
+
+	// entities can be moved after this point
+	sv_visindex.valid = false;
+
 	// reset current client
 	svs.currentPlayer = NULL;
 	svs.currentPlayerNum = 0;
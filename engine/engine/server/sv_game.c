@@ -33,6 +33,8 @@ static vec3_t viewPoint[MAX_CLIENTS];
 static byte *bitvector;
 static int fatbytes;
 
+static void SV_AddFreshEdict( edict_t *ent );
+
 // exports
 typedef void (__cdecl *LINK_ENTITY_FUNC)( entvars_t *pev );
 #ifdef _WIN32
@@ -868,6 +870,12 @@ void SV_InitEdict( edict_t *pEdict )
 
 	pEdict->v.pContainingEntity = pEdict; // make cross-links for consistency
 	pEdict->free = false;
+
+	SV_LinkSphereGrid( pEdict );
+	SV_SyncEdictStrings( pEdict );
+	SV_AddFreshEdict( pEdict );
+	SV_DirtyPhysEnt( pEdict );
+	SV_WakeEdict( pEdict );
 }
 
 void SV_FreeEdict( edict_t *pEdict )
@@ -913,6 +921,9 @@ void SV_FreeEdict( edict_t *pEdict )
 	VectorClear(pEdict->v.angles);
 	VectorClear(pEdict->v.origin);
 	pEdict->free = true;
+
+	SV_UnlinkSphereGrid( pEdict );
+	SV_SyncEdictStrings( pEdict );
 }
 
 edict_t *GAME_EXPORT SV_AllocEdict( void )
@@ -1349,6 +1360,212 @@ void GAME_EXPORT pfnChangePitch( edict_t* ent )
 	ent->v.angles[PITCH] = SV_AngleMod( ent->v.idealpitch, ent->v.angles[PITCH], ent->v.pitch_speed );	
 }
 
+/*
+===============================================================================
+
+STRING INDEX
+
+classname, targetname and target of every edict are hashed by the string
+contents, string_t is not unique for the same text. Game dll may write the
+entvars at any time, so edicts are synced at frame start, on relink and
+while they are allocated in the current frame. A target changed on an
+existing edict without relink (trigger_changetarget, path trains) is
+not seen until the next frame, that's why the index is off by default
+
+===============================================================================
+*/
+static const char *sv_stringfields[STRING_INDEX_FIELDS] = { "classname", "targetname", "target" };
+static const int sv_stringoffsets[STRING_INDEX_FIELDS] =
+{
+	offsetof( entvars_t, classname ),
+	offsetof( entvars_t, targetname ),
+	offsetof( entvars_t, target ),
+};
+
+static int	sv_stringindex_table[STRING_INDEX_FIELDS][STRING_INDEX_SIZE];	// first edict or -1
+static int	sv_stringfresh[STRING_INDEX_FRESH];	// edicts allocated this frame
+static int	sv_numstringfresh;			// may exceed STRING_INDEX_FRESH
+
+static struct
+{
+	int		indexed;		// lookups served from the index
+	int		scanned;		// lookups by the full scan
+} sv_stringstats;
+
+_inline string_t SV_EdictStringField( edict_t *ent, int field )
+{
+	return *(string_t *)((byte *)&ent->v + sv_stringoffsets[field] );
+}
+
+static void SV_RemoveStringLink( sv_stringlink_t *state, int field )
+{
+	if( !state->strbucket[field] ) return;
+
+	if( state->strprev[field] != -1 )
+		svgame.stringlinks[state->strprev[field]].strnext[field] = state->strnext[field];
+	else sv_stringindex_table[field][state->strbucket[field] - 1] = state->strnext[field];
+
+	if( state->strnext[field] != -1 )
+		svgame.stringlinks[state->strnext[field]].strprev[field] = state->strprev[field];
+
+	state->strbucket[field] = 0;
+}
+
+/*
+===============
+SV_SyncEdictStrings
+
+move edict to the buckets of its current strings
+===============
+*/
+void SV_SyncEdictStrings( edict_t *ent )
+{
+	int		e = NUM_FOR_EDICT( ent );
+	sv_stringlink_t	*state;
+	const char	*t;
+	string_t		value;
+	int		i, bucket;
+
+	if( e <= 0 || !svgame.stringlinks ) return;
+
+	state = &svgame.stringlinks[e];
+
+	for( i = 0; i < STRING_INDEX_FIELDS; i++ )
+	{
+		value = ent->free ? 0 : SV_EdictStringField( ent, i );
+
+		if( value == state->strvalue[i] && ( state->strbucket[i] || !value ))
+			continue;
+
+		SV_RemoveStringLink( state, i );
+		state->strvalue[i] = value;
+
+		if( !value ) continue;
+
+		t = STRING( value );
+		if( !t || !*t ) continue;
+
+		bucket = Com_HashKey( t, STRING_INDEX_SIZE );
+		state->strprev[i] = -1;
+		state->strnext[i] = sv_stringindex_table[i][bucket];
+		if( state->strnext[i] != -1 )
+			svgame.stringlinks[state->strnext[i]].strprev[i] = e;
+		sv_stringindex_table[i][bucket] = e;
+		state->strbucket[i] = bucket + 1;
+	}
+}
+
+/*
+===============
+SV_AddFreshEdict
+
+edict strings are likely set right after allocation
+===============
+*/
+static void SV_AddFreshEdict( edict_t *ent )
+{
+	if( sv_numstringfresh < STRING_INDEX_FRESH )
+		sv_stringfresh[sv_numstringfresh] = NUM_FOR_EDICT( ent );
+	sv_numstringfresh++;
+}
+
+/*
+===============
+SV_UpdateStringIndex
+
+full sync, called once per frame
+===============
+*/
+void SV_UpdateStringIndex( void )
+{
+	int	i;
+
+	for( i = 1; i < svgame.numEntities; i++ )
+		SV_SyncEdictStrings( EDICT_NUM( i ));
+	sv_numstringfresh = 0;
+}
+
+/*
+===============
+SV_ClearStringIndex
+
+===============
+*/
+void SV_ClearStringIndex( void )
+{
+	Q_memset( sv_stringindex_table, 0xFF, sizeof( sv_stringindex_table ));
+	sv_numstringfresh = STRING_INDEX_FRESH + 1; // first lookup makes a full sync
+}
+
+/*
+===============
+SV_StringIndexStats_f
+
+===============
+*/
+void SV_StringIndexStats_f( void )
+{
+	Msg( "string index: %i lookups indexed, %i scanned\n", sv_stringstats.indexed, sv_stringstats.scanned );
+	SV_PrintMismatches( CHECK_STRINGINDEX );
+
+	Q_memset( &sv_stringstats, 0, sizeof( sv_stringstats ));
+}
+
+static qboolean SV_EdictStringMatch( edict_t *ed, int e, int fieldOffset, const char *pszValue )
+{
+	const char	*t;
+
+	if( !SV_IsValidEdict( ed ))
+		return false;
+
+	if( e <= sv_maxclients->integer && !SV_ClientFromEdict( ed, ( sv_maxclients->integer != 1 )))
+		return false;
+
+	t = STRING( *(string_t *)&((byte *)&ed->v)[fieldOffset] );
+	if( t == NULL || t == svgame.globals->pStringBase )
+		return false;
+
+	return !Q_strcmp( t, pszValue );
+}
+
+/*
+===============
+SV_FindIndexedString
+
+first edict after e which field has the value
+===============
+*/
+static edict_t *SV_FindIndexedString( int e, int field, const char *pszValue )
+{
+	int	i, check, best = -1;
+
+	// new edicts may got their strings after allocation
+	if( sv_numstringfresh > STRING_INDEX_FRESH )
+	{
+		SV_UpdateStringIndex();
+	}
+	else
+	{
+		for( i = 0; i < sv_numstringfresh; i++ )
+			SV_SyncEdictStrings( EDICT_NUM( sv_stringfresh[i] ));
+	}
+
+	check = sv_stringindex_table[field][Com_HashKey( pszValue, STRING_INDEX_SIZE )];
+
+	for( ; check != -1; check = svgame.stringlinks[check].strnext[field] )
+	{
+		if( check <= e || ( best != -1 && check >= best ))
+			continue;
+
+		if( SV_EdictStringMatch( EDICT_NUM( check ), check, sv_stringoffsets[field], pszValue ))
+			best = check;
+	}
+
+	if( best == -1 )
+		return svgame.edicts;
+	return EDICT_NUM( best );
+}
+
 /*
 =========
 SV_FindEntityByString
@@ -1359,12 +1576,33 @@ edict_t* GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const char *ps
 {
 	int		index = 0, e = 0;
 	TYPEDESCRIPTION	*desc = NULL;
-	edict_t		*ed;
-	const char	*t;
+	edict_t		*indexed = NULL;
+	edict_t		*found = NULL;
 
 	if( pStartEdict ) e = NUM_FOR_EDICT( pStartEdict );
 	if( !pszValue || !*pszValue ) return svgame.edicts;
 
+	if( sv_stringindex->integer && sv.state == ss_active && pszField )
+	{
+		for( index = 0; index < STRING_INDEX_FIELDS; index++ )
+		{
+			if( !Q_strcmp( pszField, sv_stringfields[index] ))
+				break;
+		}
+
+		if( index < STRING_INDEX_FIELDS )
+		{
+			indexed = SV_FindIndexedString( e, index, pszValue );
+			sv_stringstats.indexed++;
+
+			// 2 is check it against full scan
+			if( sv_stringindex->integer < 2 )
+				return indexed;
+		}
+
+		index = 0;
+	}
+
 	while(( desc = SV_GetEntvarsDescirption( index++ )) != NULL )
 	{
 		if( !Q_strcmp( pszField, desc->fieldName ))
@@ -1376,33 +1614,33 @@ edict_t* GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const char *ps
 		MsgDev( D_ERROR, "SV_FindEntityByString: field %s not a string\n", pszField );
 		return svgame.edicts;
 	}
+
+	sv_stringstats.scanned++;
 	
-	for( e++; e < svgame.numEntities; e++ )
+	for( e++; e < svgame.numEntities && !found; e++ )
 	{
-		ed = EDICT_NUM( e );
-		if( !SV_IsValidEdict( ed )) continue;
-
-		if( e <= sv_maxclients->integer && !SV_ClientFromEdict( ed, ( sv_maxclients->integer != 1 )))
-			continue;
-
 		switch( desc->fieldType )
 		{
 		case FIELD_STRING:
 		case FIELD_MODELNAME:
 		case FIELD_SOUNDNAME:
-			t = STRING( *(string_t *)&((byte *)&ed->v)[desc->fieldOffset] );
-			if( t != NULL && t != svgame.globals->pStringBase )
-			{
-				if( !Q_strcmp( t, pszValue ))
-					return ed;
-			}
+			if( SV_EdictStringMatch( EDICT_NUM( e ), e, desc->fieldOffset, pszValue ))
+				found = EDICT_NUM( e );
 			break;
 		default:
 			break;
 		}
 	}
 
-	return svgame.edicts;
+	if( !found ) found = svgame.edicts;
+
+	if( indexed && indexed != found )
+	{
+		MsgDev( D_WARN, "SV_FindEntityByString: index found %i, full scan %i for %s \"%s\"\n", NUM_FOR_EDICT( indexed ), NUM_FOR_EDICT( found ), pszField, pszValue );
+		SV_CheckMismatch( CHECK_STRINGINDEX );
+	}
+
+	return found;
 }
 
 /*
@@ -1432,46 +1670,7 @@ return NULL instead of world!
 */
 edict_t *GAME_EXPORT pfnFindEntityInSphere( edict_t *pStartEdict, const float *org, float flRadius )
 {
-	edict_t	*ent;
-	float	distSquared;
-	float	eorg;
-	int	j, e = 0;
-
-	flRadius *= flRadius;
-
-	if( SV_IsValidEdict( pStartEdict ))
-		e = NUM_FOR_EDICT( pStartEdict );
-
-	for( e++; e < svgame.numEntities; e++ )
-	{
-		ent = EDICT_NUM( e );
-
-		if( !SV_IsValidEdict( ent ))
-			continue;
-
-		// ignore clients that not in a game
-		if( e <= sv_maxclients->integer && !SV_ClientFromEdict( ent, true ))
-			continue;
-
-		distSquared = 0.0f;
-
-		for( j = 0; j < 3 && distSquared <= flRadius; j++ )
-		{
-			if( org[j] < ent->v.absmin[j] )
-				eorg = org[j] - ent->v.absmin[j];
-			else if( org[j] > ent->v.absmax[j] )
-				eorg = org[j] - ent->v.absmax[j];
-			else eorg = 0;
-
-			distSquared += eorg * eorg;
-		}
-
-		if( distSquared > flRadius )
-			continue;
-		return ent;
-	}
-
-	return EDICT_NUM( 0 );
+	return SV_FindEntityInSphere( pStartEdict, org, flRadius );
 }
 
 /*
@@ -2167,7 +2366,7 @@ static void GAME_EXPORT pfnTraceLine( const float *v1, const float *v2, int fNoM
 
 	if( !ptr ) return;
 
-	trace = SV_Move( v1, vec3_origin, vec3_origin, v2, fNoMonsters, pentToSkip );
+	trace = SV_CachedMove( v1, vec3_origin, vec3_origin, v2, fNoMonsters, pentToSkip );
 	if( !SV_IsValidEdict( trace.ent )) trace.ent = svgame.edicts;
 	SV_ConvertTrace( ptr, &trace );
 }
@@ -2213,7 +2412,7 @@ static void GAME_EXPORT pfnTraceHull( const float *v1, const float *v2, int fNoM
 	mins = sv.worldmodel->hulls[hullNumber].clip_mins;
 	maxs = sv.worldmodel->hulls[hullNumber].clip_maxs;
 
-	trace = SV_Move( v1, mins, maxs, v2, fNoMonsters, pentToSkip );
+	trace = SV_CachedMove( v1, mins, maxs, v2, fNoMonsters, pentToSkip );
 	SV_ConvertTrace( ptr, &trace );
 }
 
@@ -5302,6 +5501,15 @@ qboolean SV_LoadProgs( const char *name )
 	svgame.globals->maxEntities = GI->max_edicts;
 	svgame.globals->maxClients = sv_maxclients->integer;
 	svgame.edicts = Mem_Alloc( svgame.mempool, sizeof( edict_t ) * svgame.globals->maxEntities );
+	svgame.linkstate = Mem_Alloc( svgame.mempool, sizeof( sv_linkstate_t ) * svgame.globals->maxEntities );
+	svgame.leafcache = Mem_Alloc( svgame.mempool, sizeof( sv_leafcache_t ) * svgame.globals->maxEntities );
+	svgame.gridlinks = Mem_Alloc( svgame.mempool, sizeof( sv_gridlink_t ) * svgame.globals->maxEntities );
+	svgame.stringlinks = Mem_Alloc( svgame.mempool, sizeof( sv_stringlink_t ) * svgame.globals->maxEntities );
+	svgame.physlinks = Mem_Alloc( svgame.mempool, sizeof( sv_physlink_t ) * svgame.globals->maxEntities );
+	svgame.sleepstate = Mem_Alloc( svgame.mempool, sizeof( sv_sleepstate_t ) * svgame.globals->maxEntities );
+	svgame.spherelist = Mem_Alloc( svgame.mempool, sizeof( int ) * svgame.globals->maxEntities );
+	svgame.pushlist = Mem_Alloc( svgame.mempool, sizeof( edict_t* ) * svgame.globals->maxEntities );
+	svgame.physcache = Mem_Alloc( svgame.mempool, sizeof( physent_t ) * svgame.globals->maxEntities );
 	svgame.numEntities = svgame.globals->maxClients + 1; // clients + world
 
 	for( i = 0, e = svgame.edicts; i < svgame.globals->maxEntities; i++, e++ )
@@ -23,12 +23,28 @@ GNU General Public License for more details.
 
 convar_t	*sv_zmax;
 convar_t	*sv_novis;			// disable server culling entities by vis
+convar_t	*sv_vispass;		// bucket entities by leafs before AddToFullPack
+convar_t	*sv_parallel_send;		// encode client snapshots on worker threads
+convar_t	*sv_deltacache_enable;	// share encoded entity deltas between clients
+convar_t	*sv_entbudget;		// fit snapshots into client rate by entity priority
+convar_t	*sv_deltaring;		// acknowledged frames tried as delta base
+convar_t	*sv_areasplit;		// links per area leaf before it's split
+convar_t	*sv_tracebatch;		// game dll may use pfnTraceBatch
+convar_t	*sv_tracecache;		// remember game dll traces for one frame
+convar_t	*sv_linkcache;		// reuse touched leafs of unmoved edicts
+convar_t	*sv_spheregrid;		// serve sphere and box queries from edict grid
+convar_t	*sv_stringindex;		// find edicts by classname, targetname and target through hash
+convar_t	*sv_physentcache;		// copy unchanged edicts to pmove from frame snapshot
+convar_t	*sv_parallel_pmove;		// run moves of far apart players on the job pool
+convar_t	*sv_sleep;			// skip physics of resting edicts
+convar_t	*sv_pushgrid;		// take pusher candidates from edict grid
 convar_t	*sv_unlag;
 convar_t	*sv_maxunlag;
 convar_t	*sv_maxrate;
 convar_t	*sv_minrate;
 convar_t	*sv_unlagpush;
 convar_t	*sv_unlagsamples;
+convar_t	*sv_unlagcone;		// players out of the aim cone are not moved back
 convar_t	*sv_pausable;
 convar_t	*sv_newunit;
 convar_t	*sv_wateramp;
@@ -94,6 +110,7 @@ convar_t	*sv_corpse_solid;
 convar_t	*sv_fixmulticast;
 convar_t	*sv_allow_split;
 convar_t	*sv_allow_compress;
+convar_t	*sv_allow_lz;
 convar_t	*sv_maxpacket;
 convar_t	*sv_forcesimulating;
 convar_t	*sv_lan;
@@ -133,6 +150,39 @@ convar_t	*sv_allow_hltv;
 static void Master_Heartbeat( void );
 
 char localinfo[MAX_LOCALINFO];
+static int sv_mismatches;	// found by the checks of the sv_* 2 modes
+
+typedef struct
+{
+	const char	*cvar;		// mode 2 runs the check
+	const char	*verify;		// set by sv_verify
+	int		mismatches;	// since the last stats print
+	int		total;
+} sv_checkinfo_t;
+
+// indexed by sv_check_t
+static sv_checkinfo_t	sv_checks[CHECK_COUNT] =
+{
+{ "sv_tracecache",		"2" },
+{ "sv_stringindex",		"2" },
+{ "sv_spheregrid",		"2" },
+{ "sv_physentcache",	"2" },
+{ "sv_pushgrid",		"2" },
+{ "sv_parallel_send",	"2" },
+{ "sv_parallel_pmove",	"2" },
+{ "sv_deltaring",		"8" },	// picks are compared by sv_parallel_send 2
+};
+
+typedef struct
+{
+	int		frames;		// left to run, 0 if not running
+	int		mismatches;	// sv_mismatches at start
+	int		totals[CHECK_COUNT];
+	qboolean		quit;
+	char		saved[CHECK_COUNT][32];
+} sv_verify_t;
+
+static sv_verify_t		sv_verify;
 
 
 //============================================================================
@@ -485,6 +535,11 @@ void SV_ReadPackets( void )
 		if( i != sv_maxclients->integer )
 			continue;
 	}
+
+	// usercmds waiting for parallel player moves
+	SV_RunQueuedCmds();
+	svgame.globals->frametime = host.frametime;
+	svgame.globals->time = sv.time;
 }
 
 /*
@@ -665,6 +720,106 @@ void SV_RunGameFrame( void )
 	sv.time += host.frametime;
 }
 
+/*
+==================
+SV_CheckMismatch
+
+result of a mode 2 check differs from the reference path
+==================
+*/
+void SV_CheckMismatch( sv_check_t check )
+{
+	sv_checks[check].mismatches++;
+	sv_checks[check].total++;
+	sv_mismatches++;
+}
+
+/*
+==================
+SV_PrintMismatches
+
+for the stats commands, prints and resets the count
+==================
+*/
+void SV_PrintMismatches( sv_check_t check )
+{
+	sv_checkinfo_t	*info = &sv_checks[check];
+
+	if( info->mismatches || Cvar_VariableInteger( info->cvar ) >= 2 )
+		Msg( "%s 2: %i results differ from the reference path\n", info->cvar, info->mismatches );
+	info->mismatches = 0;
+}
+
+/*
+==================
+SV_Verify_f
+
+run the given number of frames with the checks of all
+sv_* 2 modes and the delta ring on, and report the
+mismatches. With "quit" the
+engine exits afterwards, with an error code if anything
+was found, so it can run from a script:
+xash -dedicated +map <map> +sv_verify 1000 quit
+==================
+*/
+void SV_Verify_f( void )
+{
+	int	i;
+
+	if( Cmd_Argc() < 2 )
+	{
+		Msg( "Usage: sv_verify <frames> [quit]\n" );
+		return;
+	}
+
+	if( !sv_verify.frames )
+	{
+		for( i = 0; i < CHECK_COUNT; i++ )
+		{
+			Q_strncpy( sv_verify.saved[i], Cvar_VariableString( sv_checks[i].cvar ), sizeof( sv_verify.saved[i] ));
+			Cvar_Set( sv_checks[i].cvar, sv_checks[i].verify );
+		}
+	}
+
+	for( i = 0; i < CHECK_COUNT; i++ )
+		sv_verify.totals[i] = sv_checks[i].total;
+
+	sv_verify.frames = max( Q_atoi( Cmd_Argv( 1 )), 1 );
+	sv_verify.mismatches = sv_mismatches;
+	sv_verify.quit = !Q_stricmp( Cmd_Argv( 2 ), "quit" );
+}
+
+/*
+==================
+SV_VerifyFrame
+
+==================
+*/
+static void SV_VerifyFrame( void )
+{
+	int	i, found;
+
+	if( !sv_verify.frames || --sv_verify.frames > 0 )
+		return;
+
+	for( i = 0; i < CHECK_COUNT; i++ )
+	{
+		Cvar_Set( sv_checks[i].cvar, sv_verify.saved[i] );
+
+		if( sv_checks[i].total != sv_verify.totals[i] )
+			Msg( "%s: %i mismatches\n", sv_checks[i].cvar, sv_checks[i].total - sv_verify.totals[i] );
+	}
+
+	found = sv_mismatches - sv_verify.mismatches;
+	Msg( "sv_verify: %s, %i mismatches\n", found ? "failed" : "passed", found );
+
+	if( sv_verify.quit )
+	{
+		if( found ) error_on_exit = true;
+		Cbuf_AddText( "quit\n" );
+	}
+}
+
 /*
 ==================
 Host_ServerFrame
@@ -703,6 +858,9 @@ void Host_ServerFrame( void )
 	// let everything in the world think and move
 	SV_RunGameFrame ();
 
+	// positions the clients are going to see, for lag compensation
+	SV_RecordUnlagHistory ();
+
 	// send messages back to the clients that had packets read this frame
 	SV_SendClientMessages ();
 
@@ -711,6 +869,9 @@ void Host_ServerFrame( void )
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
+
+	// sv_verify countdown
+	SV_VerifyFrame ();
 }
 
 //============================================================================
@@ -954,6 +1115,7 @@ void SV_Init( void )
 	sv_minrate = Cvar_Get( "sv_minrate", "5000", 0, "minimum network bandwith rate, 0 == unlimited" );
 	sv_unlagpush = Cvar_Get( "sv_unlagpush", "0.0", 0, "unlag push bias" );
 	sv_unlagsamples = Cvar_Get( "sv_unlagsamples", "1", 0, "max samples to interpolate" );
+	sv_unlagcone = Cvar_Get( "sv_unlagcone", "0", 0, "half angle of the aim cone players are compensated in, 0 compensates all" );
 	sv_allow_upload = Cvar_Get( "sv_allow_upload", "1", 0, "allow uploading custom resources from clients" );
 	sv_allow_download = Cvar_Get( "sv_allow_download", "0", CVAR_ARCHIVE, "allow clients to download missing resources" );
 	sv_allow_fragment = Cvar_Get( "sv_allow_fragment", "0", CVAR_ARCHIVE, "allow direct download from server (unstable & unsafe)" );
@@ -965,11 +1127,27 @@ void SV_Init( void )
 	mp_consistency = Cvar_Get( "mp_consistency", "1", CVAR_SERVERNOTIFY, "enable consistency check in multiplayer" );
 	clockwindow = Cvar_Get( "clockwindow", "0.5", 0, "timewindow to execute client moves" );
 	sv_novis = Cvar_Get( "sv_novis", "0", 0, "disable server-side visibility checking" );
+	sv_vispass = Cvar_Get( "sv_vispass", "1", 0, "cull entities by PVS leafs before calling AddToFullPack" );
+	sv_parallel_send = Cvar_Get( "sv_parallel_send", "0", 0, "encode client snapshots on worker threads (2 - verify against serial encode)" );
+	sv_deltacache_enable = Cvar_Get( "sv_deltacache", "1", 0, "encode identical entity transitions once per frame for all clients" );
+	sv_deltaring = Cvar_Get( "sv_deltaring", "0", 0, "number of recent acknowledged frames tried as delta base, the smallest encoding is sent" );
+	sv_areasplit = Cvar_Get( "sv_areasplit", "16", 0, "split area tree leafs holding more edicts than this, 0 keeps the fixed tree" );
+	sv_tracebatch = Cvar_Get( "sv_tracebatch", "1", 0, "allow game dll to trace groups of rays at once, 2 also groups the pellets of a shot" );
+	sv_tracecache = Cvar_Get( "sv_tracecache", "0", 0, "reuse identical game dll traces within a frame, 2 checks them against fresh traces" );
+	sv_stringindex = Cvar_Get( "sv_stringindex", "0", 0, "experimental: find edicts by classname, targetname and target through the hash index, 2 checks it against full scan" );
+	sv_spheregrid = Cvar_Get( "sv_spheregrid", "1", 0, "find edicts in sphere or box through the edict grid, 2 checks it against full scan" );
+	sv_physentcache = Cvar_Get( "sv_physentcache", "1", 0, "copy edicts not relinked during the frame to player physics from snapshot, 2 checks it against fresh copy" );
+	sv_sleep = Cvar_Get( "sv_sleep", "0", 0, "experimental: skip physics of edicts resting on the ground or waiting for a think" );
+	sv_pushgrid = Cvar_Get( "sv_pushgrid", "0", 0, "take edicts touched by doors, platforms and trains from the edict grid, 2 checks them against full scan" );
+	sv_parallel_pmove = Cvar_Get( "sv_parallel_pmove", "0", 0, "experimental: run moves of far apart players on worker threads if game dll allows, 2 checks them against serial move" );
+	sv_linkcache = Cvar_Get( "sv_linkcache", "1", 0, "skip BSP leaf search and area relink for edicts linked with unchanged bounds" );
+	sv_entbudget = Cvar_Get( "sv_entbudget", "0", 0, "send most important entity updates first when snapshot exceeds client rate" );
 	sv_skipshield = Cvar_Get( "sv_skipshield", "0", CVAR_ARCHIVE, "skip shield hitbox");
 	sv_trace_messages = Cvar_Get( "sv_trace_messages", "0", CVAR_ARCHIVE|CVAR_LATCH, "enable server usermessages tracing (good for developers)" );
 	sv_corpse_solid = Cvar_Get( "sv_corpse_solid", "0", CVAR_ARCHIVE, "make corpses solid" );
 	sv_fixmulticast = Cvar_Get( "sv_fixmulticast", "1", CVAR_ARCHIVE, "do not send multicast to not spawned clients" );
 	sv_allow_compress = Cvar_Get( "sv_allow_compress", DEFAULT_SV_ALLOWCOMPRESSION, CVAR_ARCHIVE, "allow Huffman compression on server" );
+	sv_allow_lz = Cvar_Get( "sv_allow_lz", "0", CVAR_ARCHIVE, "allow LZ compression of fragments and split packets on server" );
 	sv_allow_split= Cvar_Get( "sv_allow_split", "1", CVAR_ARCHIVE, "allow splitting packets on server" );
 	sv_maxpacket = Cvar_Get( "sv_maxpacket", "2000", CVAR_ARCHIVE, "limit cl_maxpacket for all clients" );
 	sv_forcesimulating = Cvar_Get( "sv_forcesimulating", DEFAULT_SV_FORCESIMULATING, 0, "forcing world simulating when server don't have active players" );
@@ -260,6 +260,9 @@ void SV_Impact( edict_t *e1, edict_t *e2, trace_t *trace )
 {
 	svgame.globals->time = sv.time;
 
+	SV_WakeEdict( e1 );
+	SV_WakeEdict( e2 );
+
 	if(( e1->v.flags|e2->v.flags ) & FL_KILLME )
 		return;
 
@@ -857,6 +860,297 @@ static qboolean SV_CanBlock( edict_t *ent )
 	return true;
 }
 
+/*
+===============================================================================
+
+PUSHER CANDIDATES
+
+doors, platforms and trains tested every edict of the world, the ones
+around the pusher are taken from the edict grid now and rejected by
+absbox four at once before the position tests
+===============================================================================
+*/
+#define PUSH_RIDER_EPSILON	4.0f	// riders may stand a bit above the pusher
+
+typedef struct
+{
+	int		moves;		// pushers which gathered candidates
+	int		gridmoves;	// served by the edict grid
+	int		scanned;		// edicts tested by absbox
+	int		candidates;	// passed the absbox test
+	int		regathers;	// touch callbacks moved other edicts
+} pushcounts_t;
+
+static pushcounts_t	sv_pushstats;
+
+#if defined( __SSE__ ) || defined( _M_IX86_FP ) || defined( __SSE2__ )
+#include <xmmintrin.h>
+
+/*
+============
+SV_PushBoxes4
+
+bit is set for every of four edicts which absbox overlaps the box
+============
+*/
+static int SV_PushBoxes4( edict_t **list, const vec3_t mins, const vec3_t maxs )
+{
+	float	absmin[3][4], absmax[3][4];
+	__m128	reject = _mm_setzero_ps();
+	int	i, j;
+
+	for( i = 0; i < 4; i++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			absmin[j][i] = list[i]->v.absmin[j];
+			absmax[j][i] = list[i]->v.absmax[j];
+		}
+	}
+
+	// same comparisons as the scalar test, NaN is not rejected
+	for( j = 0; j < 3; j++ )
+	{
+		reject = _mm_or_ps( reject, _mm_cmpge_ps( _mm_loadu_ps( absmin[j] ), _mm_set1_ps( maxs[j] )));
+		reject = _mm_or_ps( reject, _mm_cmple_ps( _mm_loadu_ps( absmax[j] ), _mm_set1_ps( mins[j] )));
+	}
+
+	return ~_mm_movemask_ps( reject ) & 15;
+}
+#else
+static int SV_PushBoxes4( edict_t **list, const vec3_t mins, const vec3_t maxs )
+{
+	int	i, j, bits = 15;
+
+	for( i = 0; i < 4; i++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			if( list[i]->v.absmin[j] >= maxs[j] || list[i]->v.absmax[j] <= mins[j] )
+			{
+				bits &= ~BIT( i );
+				break;
+			}
+		}
+	}
+
+	return bits;
+}
+#endif
+
+/*
+============
+SV_PushRider
+
+entity is standing on the pusher, it will be moved anyway
+============
+*/
+_inline qboolean SV_PushRider( edict_t *check, edict_t *pusher )
+{
+	return (( check->v.flags & FL_ONGROUND ) && check->v.groundentity == pusher ) ? true : false;
+}
+
+/*
+============
+SV_PushCandidate
+
+single edict version of the absbox test
+============
+*/
+static qboolean SV_PushCandidate( edict_t *check, edict_t *pusher, const vec3_t mins, const vec3_t maxs )
+{
+	if( SV_PushRider( check, pusher ))
+		return true;
+
+	if( check->v.absmin[0] >= maxs[0]
+	 || check->v.absmin[1] >= maxs[1]
+	 || check->v.absmin[2] >= maxs[2]
+	 || check->v.absmax[0] <= mins[0]
+	 || check->v.absmax[1] <= mins[1]
+	 || check->v.absmax[2] <= mins[2] )
+		return false;
+
+	return true;
+}
+
+/*
+============
+SV_FilterPushCandidates
+
+drop edicts which can't be touched by the pusher,
+keeps the edict order
+============
+*/
+static int SV_FilterPushCandidates( edict_t *pusher, edict_t **list, int count, const vec3_t mins, const vec3_t maxs )
+{
+	int	i, j, bits, numcands = 0;
+
+	sv_pushstats.scanned += count;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		bits = SV_PushBoxes4( list + i, mins, maxs );
+
+		// nothing is written past the current four
+		for( j = 0; j < 4; j++ )
+		{
+			if(( bits & BIT( j )) || SV_PushRider( list[i+j], pusher ))
+				list[numcands++] = list[i+j];
+		}
+	}
+
+	for( ; i < count; i++ )
+	{
+		if( SV_PushCandidate( list[i], pusher, mins, maxs ))
+			list[numcands++] = list[i];
+	}
+
+	sv_pushstats.candidates += numcands;
+
+	return numcands;
+}
+
+/*
+============
+SV_ScanPushCandidates
+
+full scan over the edicts numbered above after
+============
+*/
+static int SV_ScanPushCandidates( edict_t **list, int after )
+{
+	int	e, count = 0;
+	edict_t	*check;
+
+	for( e = after + 1; e < svgame.numEntities; e++ )
+	{
+		check = EDICT_NUM( e );
+		if( SV_IsValidEdict( check ))
+			list[count++] = check;
+	}
+
+	return count;
+}
+
+/*
+============
+SV_ReservePushed
+
+rollback arena is kept between the frames and only grows
+============
+*/
+static void SV_ReservePushed( int count )
+{
+	int	maxpushed;
+
+	if( count <= svgame.maxpushed )
+		return;
+
+	maxpushed = max( svgame.maxpushed * 2, MAX_PUSHED_ENTS );
+	while( maxpushed < count ) maxpushed <<= 1;
+
+	svgame.pushed = Mem_Realloc( svgame.mempool, svgame.pushed, sizeof( sv_pushed_t ) * maxpushed );
+	svgame.maxpushed = maxpushed;
+}
+
+/*
+============
+SV_GatherPushCandidates
+
+fill svgame.pushlist with edicts numbered above after which absbox
+touches the box or riders of the pusher, old box of the pusher is
+searched for riders too. Room for numpushed edicts already moved is
+kept in the rollback arena, so it may be moved here
+============
+*/
+static int SV_GatherPushCandidates( edict_t *pusher, const vec3_t oldmins, const vec3_t oldmaxs, const vec3_t mins, const vec3_t maxs, int after, int numpushed )
+{
+	vec3_t	qmins, qmaxs;
+	int	i, e, count = -1;
+	int	numgrid;
+
+	if( !after ) sv_pushstats.moves++;
+	else sv_pushstats.regathers++;
+
+	if( sv_pushgrid->integer )
+	{
+		for( i = 0; i < 3; i++ )
+		{
+			qmins[i] = min( min( oldmins[i], mins[i] ), pusher->v.absmin[i] ) - PUSH_RIDER_EPSILON;
+			qmaxs[i] = max( max( oldmaxs[i], maxs[i] ), pusher->v.absmax[i] ) + PUSH_RIDER_EPSILON;
+		}
+
+		count = SV_EntitiesInBox( qmins, qmaxs, svgame.pushlist, svgame.globals->maxEntities );
+	}
+
+	if( count >= 0 )
+	{
+		sv_pushstats.gridmoves++;
+
+		// both lists keep the edict order
+		for( i = numgrid = 0; i < count; i++ )
+		{
+			if( NUM_FOR_EDICT( svgame.pushlist[i] ) > after )
+				svgame.pushlist[numgrid++] = svgame.pushlist[i];
+		}
+
+		count = SV_FilterPushCandidates( pusher, svgame.pushlist, numgrid, mins, maxs );
+
+		if( sv_pushgrid->integer >= 2 )
+		{
+			// every edict the full scan finds must be in the grid list at the same place
+			for( e = after + 1, numgrid = 0; e < svgame.numEntities; e++ )
+			{
+				edict_t	*check = EDICT_NUM( e );
+
+				if( !SV_IsValidEdict( check ) || !SV_PushCandidate( check, pusher, mins, maxs ))
+					continue;
+
+				if( numgrid >= count || svgame.pushlist[numgrid] != check )
+					break;
+				numgrid++;
+			}
+
+			if( e != svgame.numEntities || numgrid != count )
+			{
+				MsgDev( D_WARN, "SV_PushMove: grid and full scan disagree at edict %i for %s\n", e, SV_ClassName( pusher ));
+				SV_CheckMismatch( CHECK_PUSHGRID );
+				count = -1;
+			}
+		}
+	}
+
+	if( count < 0 )
+	{
+		count = SV_ScanPushCandidates( svgame.pushlist, after );
+		count = SV_FilterPushCandidates( pusher, svgame.pushlist, count, mins, maxs );
+	}
+
+	// pusher and every candidate at most once
+	SV_ReservePushed( numpushed + count );
+
+	return count;
+}
+
+/*
+============
+SV_PushStats_f
+
+============
+*/
+void SV_PushStats_f( void )
+{
+	pushcounts_t	*t = &sv_pushstats;
+	int		moves = max( t->moves, 1 );
+
+	Msg( "%i pusher moves, %i from edict grid, %i gathered again\n", t->moves, t->gridmoves, t->regathers );
+	Msg( "%.1f edicts tested, %.1f candidates per move, rollback arena %i\n",
+		(float)t->scanned / moves, (float)t->candidates / moves, svgame.maxpushed );
+	SV_PrintMismatches( CHECK_PUSHGRID );
+
+	Q_memset( t, 0, sizeof( *t ));
+}
+
 /*
 ============
 SV_PushMove
@@ -865,9 +1159,11 @@ SV_PushMove
 */
 static edict_t *SV_PushMove( edict_t *pusher, float movetime )
 {
-	int		i, e, block;
+	int		i, block, count;
 	int		num_moved, oldsolid;
+	int		numpushed, relinks;
 	vec3_t		mins, maxs, lmove;
+	vec3_t		oldmins, oldmaxs;
 	sv_pushed_t	*p, *pushed_p;
 	edict_t		*check;	
 
@@ -884,6 +1180,9 @@ static edict_t *SV_PushMove( edict_t *pusher, float movetime )
 		maxs[i] = pusher->v.absmax[i] + lmove[i];
 	}
 
+	VectorCopy( pusher->v.absmin, oldmins );
+	VectorCopy( pusher->v.absmax, oldmaxs );
+	SV_ReservePushed( 1 );
 	pushed_p = svgame.pushed;
 
 	// save the pusher's original position
@@ -904,10 +1203,13 @@ static edict_t *SV_PushMove( edict_t *pusher, float movetime )
 
 	// see if any solid entities are inside the final position
 	num_moved = 0;
+	count = SV_GatherPushCandidates( pusher, oldmins, oldmaxs, mins, maxs, 0, 1 );
+	pushed_p = svgame.pushed + 1; // arena may be moved by the gather
+	relinks = svgame.pushrelinks;
 
-	for( e = 1; e < svgame.numEntities; e++ )
+	for( i = 0; i < count; i++ )
 	{
-		check = EDICT_NUM( e );
+		check = svgame.pushlist[i];
 		if( !SV_IsValidEdict( check )) continue;
 
 		// filter movetypes to collide with
@@ -947,9 +1249,21 @@ static edict_t *SV_PushMove( edict_t *pusher, float movetime )
 
 		// try moving the contacted entity 
 		pusher->v.solid = SOLID_NOT;
+		svgame.pushcheck = check;
 		SV_PushEntity( check, lmove, vec3_origin, &block );
+		svgame.pushcheck = NULL;
 		pusher->v.solid = oldsolid;
 
+		// touch callbacks moved other edicts, gather the rest again
+		if( svgame.pushrelinks != relinks )
+		{
+			numpushed = pushed_p - svgame.pushed;
+			count = SV_GatherPushCandidates( pusher, oldmins, oldmaxs, mins, maxs, NUM_FOR_EDICT( check ), numpushed );
+			pushed_p = svgame.pushed + numpushed;
+			relinks = svgame.pushrelinks;
+			i = -1;
+		}
+
 		// if it is still inside the pusher, block
 		if( SV_TestEntityPosition( check, NULL ) && block )
 		{	
@@ -982,9 +1296,11 @@ SV_PushRotate
 */
 static edict_t *SV_PushRotate( edict_t *pusher, float movetime )
 {
-	int		i, e, block, oldsolid;
+	int		i, block, oldsolid, count;
+	int		numpushed, relinks;
 	matrix4x4		start_l, end_l;
 	vec3_t		lmove, amove;
+	vec3_t		oldmins, oldmaxs;
 	sv_pushed_t	*p, *pushed_p;
 	vec3_t		org, org2, temp;
 	edict_t		*check;
@@ -1001,6 +1317,9 @@ static edict_t *SV_PushRotate( edict_t *pusher, float movetime )
 	// create pusher initial position
 	Matrix4x4_CreateFromEntity( start_l, pusher->v.angles, pusher->v.origin, 1.0f );
 
+	VectorCopy( pusher->v.absmin, oldmins );
+	VectorCopy( pusher->v.absmax, oldmaxs );
+	SV_ReservePushed( 1 );
 	pushed_p = svgame.pushed;
 
 	// save the pusher's original position
@@ -1023,9 +1342,13 @@ static edict_t *SV_PushRotate( edict_t *pusher, float movetime )
 	Matrix4x4_CreateFromEntity( end_l, pusher->v.angles, pusher->v.origin, 1.0f );
 
 	// see if any solid entities are inside the final position
-	for( e = 1; e < svgame.numEntities; e++ )
+	count = SV_GatherPushCandidates( pusher, oldmins, oldmaxs, pusher->v.absmin, pusher->v.absmax, 0, 1 );
+	pushed_p = svgame.pushed + 1; // arena may be moved by the gather
+	relinks = svgame.pushrelinks;
+
+	for( i = 0; i < count; i++ )
 	{
-		check = EDICT_NUM( e );
+		check = svgame.pushlist[i];
 		if( !SV_IsValidEdict( check ))
 			continue;
 
@@ -1080,9 +1403,21 @@ static edict_t *SV_PushRotate( edict_t *pusher, float movetime )
 
 		// try moving the contacted entity 
 		pusher->v.solid = SOLID_NOT;
+		svgame.pushcheck = check;
 		SV_PushEntity( check, lmove, amove, &block );
+		svgame.pushcheck = NULL;
 		pusher->v.solid = oldsolid;
 
+		// touch callbacks moved other edicts, gather the rest again
+		if( svgame.pushrelinks != relinks )
+		{
+			numpushed = pushed_p - svgame.pushed;
+			count = SV_GatherPushCandidates( pusher, oldmins, oldmaxs, pusher->v.absmin, pusher->v.absmax, NUM_FOR_EDICT( check ), numpushed );
+			pushed_p = svgame.pushed + numpushed;
+			relinks = svgame.pushrelinks;
+			i = -1;
+		}
+
 		// pushed entity blocked by wall
 		if( block && check->v.movetype != MOVETYPE_WALK )
 			check->v.flags &= ~FL_ONGROUND;
@@ -1737,6 +2072,250 @@ static void SV_Physics_Entity( edict_t *ent )
 		SV_FreeEdict( ent );
 }
 
+/*
+===============================================================================
+
+SLEEPING EDICTS
+
+edict resting on the ground or waiting for a far think is put asleep
+after its physics run and skipped while the fields its physics reads
+are the same. Game dll writes them directly, so these are compared
+every frame instead of keeping the thinks in a queue
+===============================================================================
+*/
+typedef struct
+{
+	int		total;		// edicts SV_Physics looked at last frame
+	int		asleep;		// skipped last frame
+	int		frames;
+	int		sumtotal;
+	int		sumasleep;
+	int		wakeups;
+} sleepcounts_t;
+
+static sleepcounts_t	sv_sleepstats;
+
+/*
+=============
+SV_WakeEdict
+
+something touched, moved or relinked the edict
+=============
+*/
+void SV_WakeEdict( edict_t *ent )
+{
+	int	e = NUM_FOR_EDICT( ent );
+
+	if( svgame.sleepstate && e > 0 && e < svgame.globals->maxEntities )
+		svgame.sleepstate[e].asleep = false;
+}
+
+/*
+=============
+SV_GetSleepKey
+
+=============
+*/
+static void SV_GetSleepKey( edict_t *ent, sv_sleepkey_t *key )
+{
+	Q_memset( key, 0, sizeof( *key ));	// padding is compared too
+
+	VectorCopy( ent->v.origin, key->origin );
+	VectorCopy( ent->v.angles, key->angles );
+	VectorCopy( ent->v.velocity, key->velocity );
+	VectorCopy( ent->v.avelocity, key->avelocity );
+	VectorCopy( ent->v.basevelocity, key->basevelocity );
+	key->nextthink = ent->v.nextthink;
+	key->air_finished = ent->v.air_finished;
+	key->pain_finished = ent->v.pain_finished;
+	key->health = ent->v.health;
+	key->flags = ent->v.flags;
+	key->movetype = ent->v.movetype;
+	key->solid = ent->v.solid;
+	key->waterlevel = ent->v.waterlevel;
+	key->watertype = ent->v.watertype;
+	key->groundentity = ent->v.groundentity;
+}
+
+/*
+=============
+SV_RestingOnGround
+
+ground the resting edict doesn't slide or fall from
+=============
+*/
+static qboolean SV_RestingOnGround( edict_t *ent )
+{
+	edict_t	*ground = ent->v.groundentity;
+
+	if(!( ent->v.flags & FL_ONGROUND ))
+		return false;
+
+	if( !SV_IsValidEdict( ground ) || ( ground->v.flags & ( FL_MONSTER|FL_CLIENT|FL_CONVEYOR )))
+		return false;
+
+	return true;
+}
+
+/*
+=============
+SV_CanSleep
+
+physics of the edict would do nothing but the think
+check until one of the sleep key fields is changed
+=============
+*/
+static qboolean SV_CanSleep( edict_t *ent )
+{
+	if( ent->v.flags & ( FL_KILLME|FL_BASEVELOCITY ))
+		return false;
+
+	if( !VectorIsNull( ent->v.basevelocity ))
+		return false;
+
+	switch( ent->v.movetype )
+	{
+	case MOVETYPE_NONE:
+		// conveyor would give it basevelocity
+		return !( ent->v.flags & FL_ONGROUND ) || SV_RestingOnGround( ent );
+	case MOVETYPE_FLY:
+	case MOVETYPE_TOSS:
+	case MOVETYPE_BOUNCE:
+	case MOVETYPE_FLYMISSILE:
+	case MOVETYPE_BOUNCEMISSILE:
+		// see "at rest" in SV_Physics_Toss
+		if( !VectorIsNull( ent->v.velocity ) || !VectorIsNull( ent->v.avelocity ))
+			return false;
+		return SV_RestingOnGround( ent );
+	case MOVETYPE_STEP:
+	case MOVETYPE_PUSHSTEP:
+		if( !VectorIsNull( ent->v.velocity ) || ent->v.waterlevel != 0 || ( ent->v.flags & FL_INWATER ))
+			return false;
+
+		// SV_WaterMove keeps counting drown damage
+		if(!( ent->v.flags & ( FL_IMMUNE_WATER|FL_GODMODE )) && !(( ent->v.flags & FL_MONSTER ) && ent->v.health <= 0.0f ))
+		{
+			if( ent->v.air_finished > sv.time && ent->v.pain_finished > sv.time )
+				return false;
+		}
+		return SV_RestingOnGround( ent );
+	}
+
+	return false;
+}
+
+/*
+=============
+SV_WaterChanged
+
+water may move around the resting edict (func_water
+on a door), test it the same way its physics would
+=============
+*/
+static qboolean SV_WaterChanged( edict_t *ent )
+{
+	int	waterlevel = ent->v.waterlevel;
+	int	watertype = ent->v.watertype;
+	vec3_t	basevelocity;
+	qboolean	changed;
+
+	if( ent->v.movetype == MOVETYPE_NONE )
+		return false; // SV_Physics_None doesn't check water
+
+	VectorCopy( ent->v.basevelocity, basevelocity );
+	SV_CheckWater( ent );
+
+	changed = ( ent->v.waterlevel != waterlevel || ent->v.watertype != watertype || !VectorCompare( ent->v.basevelocity, basevelocity ));
+
+	// the physics compares with the old values for water transition
+	ent->v.waterlevel = waterlevel;
+	ent->v.watertype = watertype;
+	VectorCopy( basevelocity, ent->v.basevelocity );
+
+	return changed;
+}
+
+/*
+=============
+SV_StillAsleep
+
+true if the physics of the edict can be skipped this frame
+=============
+*/
+static qboolean SV_StillAsleep( edict_t *ent )
+{
+	sv_sleepstate_t	*state = &svgame.sleepstate[NUM_FOR_EDICT( ent )];
+	sv_sleepkey_t	key;
+	float		thinktime;
+
+	if( !state->asleep )
+		return false;
+
+	state->asleep = false;
+
+	if( !sv_sleep->integer || svgame.globals->force_retouch != 0.0f || svgame.globals->changelevel )
+		return false;
+
+	thinktime = ent->v.nextthink;
+	if( thinktime > 0.0f && thinktime <= sv.time + host.frametime )
+		return false;	// think is due
+
+	SV_GetSleepKey( ent, &key );
+	if( Q_memcmp( &key, &state->sleepkey, sizeof( key )))
+		return false;
+
+	// ground could be removed or turned into a monster
+	if(( ent->v.flags & FL_ONGROUND ) && !SV_RestingOnGround( ent ))
+		return false;
+
+	if( SV_WaterChanged( ent ))
+		return false;
+
+	state->asleep = true;
+	return true;
+}
+
+/*
+=============
+SV_TrySleep
+
+=============
+*/
+static void SV_TrySleep( edict_t *ent )
+{
+	sv_sleepstate_t	*state = &svgame.sleepstate[NUM_FOR_EDICT( ent )];
+
+	if( !sv_sleep->integer || svgame.physFuncs.SV_PhysicsEntity != NULL )
+		return; // dll physics may depend on anything
+
+	if( svgame.globals->force_retouch != 0.0f || svgame.globals->changelevel )
+		return;
+
+	if( !SV_CanSleep( ent ))
+		return;
+
+	SV_GetSleepKey( ent, &state->sleepkey );
+	state->asleep = true;
+}
+
+/*
+=============
+SV_SleepStats_f
+
+=============
+*/
+void SV_SleepStats_f( void )
+{
+	sleepcounts_t	*t = &sv_sleepstats;
+	int		frames = max( t->frames, 1 );
+
+	Msg( "last frame: %i awake, %i asleep, %i total\n", t->total - t->asleep, t->asleep, t->total );
+	Msg( "%i frames: %.1f awake, %.1f asleep in average, %i wake-ups\n", t->frames,
+		(float)( t->sumtotal - t->sumasleep ) / frames, (float)t->sumasleep / frames, t->wakeups );
+
+	t->frames = t->sumtotal = t->sumasleep = t->wakeups = 0;
+}
+
 /*
 ================
 SV_Physics
@@ -1750,11 +2329,25 @@ void SV_Physics( void )
 	
 	SV_CheckAllEnts ();
 
+	// adapt area tree to the entities moved last frame
+	SV_UpdateAreaNodes ();
+
+	// cached traces live for one frame
+	SV_NewTraceCacheFrame ();
+	SV_NewLinkFrame ();
+	SV_NewPhysEntFrame ();
+
+	// edicts moved outside of SV_LinkEdict
+	SV_UpdateSphereGrid ();
+	SV_UpdateStringIndex ();
+
 	svgame.globals->time = sv.time;
 
 	// let the progs know that a new frame has started
 	svgame.dllFuncs.pfnStartFrame();
 
+	sv_sleepstats.total = sv_sleepstats.asleep = 0;
+
 	// treat each object in turn
 	for( i = 0; i < svgame.numEntities; i++ )
 	{
@@ -1766,9 +2359,28 @@ void SV_Physics( void )
 		if( i > 0 && i <= svgame.globals->maxClients )
 			continue;
 
+		sv_sleepstats.total++;
+
+		if( i > 0 && svgame.sleepstate[i].asleep )
+		{
+			if( SV_StillAsleep( ent ))
+			{
+				sv_sleepstats.asleep++;
+				continue;
+			}
+			sv_sleepstats.wakeups++;
+		}
+
 		SV_Physics_Entity( ent );
+
+		if( i > 0 && !ent->free )
+			SV_TrySleep( ent );
 	}
 
+	sv_sleepstats.frames++;
+	sv_sleepstats.sumtotal += sv_sleepstats.total;
+	sv_sleepstats.sumasleep += sv_sleepstats.asleep;
+
 	if( svgame.physFuncs.SV_EndFrame != NULL )
 		svgame.physFuncs.SV_EndFrame();
 
@@ -1932,6 +2544,50 @@ static void pfnMem_Free( void *mem, const char *filename, const int fileline )
 	_Mem_Free( mem, filename, fileline );
 }
 
+/*
+=============
+pfnTraceBatch
+
+=============
+*/
+static void pfnTraceBatch( const tracerequest_t *requests, int count, TraceResult *results )
+{
+	trace_t	traces[MAX_TRACE_BATCH];
+	int	traceflags = svgame.globals->trace_flags;
+	int	i, num;
+
+	if( !requests || !results ) return;
+
+	while( count > 0 )
+	{
+		num = min( count, MAX_TRACE_BATCH );
+		svgame.globals->trace_flags = traceflags;	// SV_ConvertTrace resets them
+		SV_MoveBatch( requests, num, traces );
+
+		for( i = 0; i < num; i++ )
+		{
+			// match pfnTraceLine
+			if( requests[i].hullNumber < 0 && !SV_IsValidEdict( traces[i].ent ))
+				traces[i].ent = svgame.edicts;
+			SV_ConvertTrace( &results[i], &traces[i] );
+		}
+
+		requests += num;
+		results += num;
+		count -= num;
+	}
+}
+
+/*
+=============
+pfnEntitiesInBox
+
+=============
+*/
+static int pfnEntitiesInBox( const float *mins, const float *maxs, edict_t **list, int maxcount )
+{
+	return SV_EntitiesInBox( mins, maxs, list, maxcount );
+}
 
 static server_physics_api_t gPhysicsAPI =
 {
@@ -1959,6 +2615,8 @@ static server_physics_api_t gPhysicsAPI =
 	GL_TextureData,
 	pfnMem_Alloc,
 	pfnMem_Free,
+	pfnTraceBatch,
+	pfnEntitiesInBox,
 };
 
 /*
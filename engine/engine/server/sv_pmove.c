@@ -155,6 +155,161 @@ qboolean SV_CopyEdictToPhysEnt( physent_t *pe, edict_t *ed )
 	return true;
 }
 
+/*
+=============================================================================
+
+PHYSENT SNAPSHOTS
+
+every usercmd gathers the edicts around the player again, but
+most of them did not change since the previous command. Snapshot
+of an edict is taken once per frame into compact array and copied
+to the pmove lists until SV_LinkEdict touches the edict. Clients
+are never cached because their origin depends on the lag of the
+current player, studio models traced by hitboxes are animated
+without relinking so they are always copied too
+=============================================================================
+*/
+typedef struct
+{
+	int		hits;		// served from snapshot
+	int		builds;		// snapshot taken
+	int		fresh;		// uncacheable edict copied
+} physentcounts_t;
+
+static int		sv_physentframe = 1;	// snapshots from other frames are stale
+static int		sv_physentslots;		// used svgame.physcache entries this frame
+static physentcounts_t	sv_physentstats;
+
+/*
+====================
+SV_NewPhysEntFrame
+
+forget the snapshots of the previous frame
+====================
+*/
+void SV_NewPhysEntFrame( void )
+{
+	sv_physentframe++;
+	sv_physentslots = 0;
+}
+
+/*
+====================
+SV_DirtyPhysEnt
+
+edict was moved or changed by SV_LinkEdict
+====================
+*/
+void SV_DirtyPhysEnt( edict_t *ent )
+{
+	int	e = NUM_FOR_EDICT( ent );
+
+	if( svgame.physlinks && e > 0 && e < svgame.globals->maxEntities )
+		svgame.physlinks[e].physvalid = false;
+}
+
+/*
+====================
+SV_CopyCachedPhysEnt
+
+same as SV_CopyEdictToPhysEnt but reuses the snapshot
+taken earlier in this frame
+====================
+*/
+static qboolean SV_CopyCachedPhysEnt( physent_t *pe, edict_t *ed )
+{
+	sv_physlink_t	*state;
+	physent_t		*snap, test;
+	int		e = NUM_FOR_EDICT( ed );
+
+	if( !sv_physentcache->integer || !svgame.physcache || e <= svgame.globals->maxClients )
+	{
+		// zeroed to compare pmove inputs by memcmp, see SV_PMoveInputChanged
+		Q_memset( pe, 0, sizeof( *pe ));
+		return SV_CopyEdictToPhysEnt( pe, ed );
+	}
+
+	state = &svgame.physlinks[e];
+
+	if( state->physframe == sv_physentframe && state->physvalid )
+	{
+		snap = &svgame.physcache[state->physslot];
+
+		if( sv_physentcache->integer >= 2 )
+		{
+			Q_memset( &test, 0, sizeof( test ));
+
+			if( !SV_CopyEdictToPhysEnt( &test, ed ))
+			{
+				state->physvalid = false;
+				return false;
+			}
+
+			if( Q_memcmp( &test, snap, sizeof( test )))
+			{
+				MsgDev( D_WARN, "SV_CopyCachedPhysEnt: stale snapshot of %s (%i)\n", STRING( ed->v.classname ), e );
+				SV_CheckMismatch( CHECK_PHYSENTCACHE );
+				state->physvalid = false;
+				*pe = test;
+				return true;
+			}
+		}
+
+		sv_physentstats.hits++;
+		*pe = *snap;
+		return true;
+	}
+
+	// keep the slot when edict is relinked twice in a frame
+	if( state->physframe != sv_physentframe )
+	{
+		state->physframe = sv_physentframe;
+		state->physslot = sv_physentslots++;
+	}
+
+	// zeroed to compare snapshots by memcmp
+	snap = &svgame.physcache[state->physslot];
+	Q_memset( snap, 0, sizeof( *snap ));
+
+	if( !SV_CopyEdictToPhysEnt( snap, ed ))
+	{
+		state->physvalid = false;
+		return false;
+	}
+
+	if( snap->studiomodel != NULL )
+	{
+		sv_physentstats.fresh++;
+		state->physvalid = false;
+	}
+	else
+	{
+		sv_physentstats.builds++;
+		state->physvalid = true;
+	}
+
+	*pe = *snap;
+	return true;
+}
+
+/*
+====================
+SV_PhysEntStats_f
+
+====================
+*/
+void SV_PhysEntStats_f( void )
+{
+	physentcounts_t	*t = &sv_physentstats;
+	int		total = max( t->hits + t->builds + t->fresh, 1 );
+
+	Msg( "%i physents: %i from snapshot (%.1f%%), %i snapshots taken, %i uncacheable\n",
+		t->hits + t->builds + t->fresh, t->hits, t->hits * 100.0f / total, t->builds, t->fresh );
+	SV_PrintMismatches( CHECK_PHYSENTCACHE );
+
+	Q_memset( t, 0, sizeof( *t ));
+}
+
 /*
 ====================
 SV_AddLinksToPmove
@@ -162,14 +317,14 @@ SV_AddLinksToPmove
 collect solid entities
 ====================
 */
-void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
+void SV_AddLinksToPmove( playermove_t *pmove, areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
 {
 	link_t	*l, *next;
 	edict_t	*check, *pl;
 	vec3_t	mins, maxs;
 	physent_t	*pe;
 
-	pl = EDICT_NUM( svgame.pmove->player_index + 1 );
+	pl = EDICT_NUM( pmove->player_index + 1 );
 	//ASSERT( SV_IsValidEdict( pl ));
 	if( !SV_IsValidEdict( pl ) )
 	{
@@ -193,11 +348,11 @@ void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t
 		if( ( ( check->v.owner != 0) && check->v.owner == pl ) || check->v.solid == SOLID_TRIGGER )
 			continue; // player or player's own missile
 
-		if( svgame.pmove->numvisent < MAX_PHYSENTS )
+		if( pmove->numvisent < MAX_PHYSENTS )
 		{
-			pe = &svgame.pmove->visents[svgame.pmove->numvisent];
-			if( SV_CopyEdictToPhysEnt( pe, check ))
-				svgame.pmove->numvisent++;
+			pe = &pmove->visents[pmove->numvisent];
+			if( SV_CopyCachedPhysEnt( pe, check ))
+				pmove->numvisent++;
 		}
 
 		if( check->v.solid == SOLID_NOT && ( check->v.skin == CONTENTS_NONE || check->v.modelindex == 0 ))
@@ -233,12 +388,12 @@ void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t
 		if( !BoundsIntersect( pmove_mins, pmove_maxs, mins, maxs ))
 			continue;
 
-		if( svgame.pmove->numphysent < MAX_PHYSENTS )
+		if( pmove->numphysent < MAX_PHYSENTS )
 		{
-			pe = &svgame.pmove->physents[svgame.pmove->numphysent];
+			pe = &pmove->physents[pmove->numphysent];
 
-			if( SV_CopyEdictToPhysEnt( pe, check ))
-				svgame.pmove->numphysent++;
+			if( SV_CopyCachedPhysEnt( pe, check ))
+				pmove->numphysent++;
 		}
 	}
 	
@@ -246,9 +401,9 @@ void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t
 	if( node->axis == -1 ) return;
 
 	if( pmove_maxs[node->axis] > node->dist )
-		SV_AddLinksToPmove( node->children[0], pmove_mins, pmove_maxs );
+		SV_AddLinksToPmove( pmove, node->children[0], pmove_mins, pmove_maxs );
 	if( pmove_mins[node->axis] < node->dist )
-		SV_AddLinksToPmove( node->children[1], pmove_mins, pmove_maxs );
+		SV_AddLinksToPmove( pmove, node->children[1], pmove_mins, pmove_maxs );
 }
 
 /*
@@ -256,7 +411,7 @@ void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t
 SV_AddLaddersToPmove
 ====================
 */
-void SV_AddLaddersToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
+void SV_AddLaddersToPmove( playermove_t *pmove, areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
 {
 	link_t	*l, *next;
 	edict_t	*check;
@@ -278,26 +433,210 @@ void SV_AddLaddersToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3
 		if( !BoundsIntersect( pmove_mins, pmove_maxs, check->v.absmin, check->v.absmax ))
 			continue;
 
-		if( svgame.pmove->nummoveent == MAX_MOVEENTS )
+		if( pmove->nummoveent == MAX_MOVEENTS )
 			return;
 
-		pe = &svgame.pmove->moveents[svgame.pmove->nummoveent];
-		if( SV_CopyEdictToPhysEnt( pe, check ))
-			svgame.pmove->nummoveent++;
+		pe = &pmove->moveents[pmove->nummoveent];
+		if( SV_CopyCachedPhysEnt( pe, check ))
+			pmove->nummoveent++;
 	}
 	
 	// recurse down both sides
 	if( node->axis == -1 ) return;
 	
 	if( pmove_maxs[node->axis] > node->dist )
-		SV_AddLaddersToPmove( node->children[0], pmove_mins, pmove_maxs );
+		SV_AddLaddersToPmove( pmove, node->children[0], pmove_mins, pmove_maxs );
 	if( pmove_mins[node->axis] < node->dist )
-		SV_AddLaddersToPmove( node->children[1], pmove_mins, pmove_maxs );
+		SV_AddLaddersToPmove( pmove, node->children[1], pmove_mins, pmove_maxs );
+}
+
+/*
+=============================================================================
+
+PARALLEL PLAYER MOVES
+
+with sv_parallel_pmove usercmds of a frame are queued and run in
+rounds. A round walks the queue in order and takes the next command of
+every client which player is far from the players taken or passed over
+before it, so only commands of far apart players change their order.
+Commands of a client always run in order. For the taken commands
+CmdStart and the thinks run in order, PM_Move runs on the worker threads
+with own copy of playermove_t and the rest of the command runs in order
+again. A command that can't be moved on a worker runs as a whole when
+it's first in the queue. The result of the worker is taken only when
+the pmove set up at that time is the same as the one the worker was
+given, so earlier commands of the round could not affect it, otherwise
+the move runs again in order.
+Sounds, events and prints of the worker are replayed with the result.
+A move that draws random numbers runs again in order too, the engine
+generator can't be shared with the workers.
+
+Queued commands don't run while clc_move is parsed. They run after
+all the packets of the frame are read, before a string command or a
+second move of the same client, or when the queue is full. Nothing is
+queued with sv_parallel_pmove 0, the commands run during parsing
+=============================================================================
+*/
+#define PM_MAX_DEFERRED	32	// side effects of a single move
+#define PM_MAX_QUEUED	1024	// usercmds waiting for SV_RunQueuedCmds
+
+enum
+{
+	PM_DEFER_PARTICLE = 0,
+	PM_DEFER_SOUND,
+	PM_DEFER_EVENT,
+	PM_DEFER_PRINT,
+	PM_DEFER_DPRINT,
+	PM_DEFER_NPRINT,
+};
+
+typedef struct
+{
+	int		type;		// PM_DEFER_*
+	union
+	{
+		struct
+		{
+			vec3_t	origin;
+			int	color;
+			float	life;
+			int	zpos;
+			int	zvel;
+		} particle;
+		struct
+		{
+			int	channel;
+			const char	*sample;		// game dll string
+			float	volume;
+			float	attenuation;
+			int	flags;
+			int	pitch;
+		} sound;
+		struct
+		{
+			int	flags;
+			int	clientindex;
+			word	eventindex;
+			float	delay;
+			qboolean	hasorigin;
+			qboolean	hasangles;
+			vec3_t	origin;
+			vec3_t	angles;
+			float	fparam1;
+			float	fparam2;
+			int	iparam1;
+			int	iparam2;
+			int	bparam1;
+			int	bparam2;
+		} event;
+		struct
+		{
+			int	idx;		// Con_NPrintf line
+			char	text[256];
+		} print;
+	};
+} pmdeferred_t;
+
+typedef struct
+{
+	sv_client_t	*cl;
+	usercmd_t		cmd;
+	int		random_seed;
+	double		timebase;		// cl->timebase the command starts with
+	usercmd_t		lastcmd;		// cl->lastcmd when it was parsed
+} pmqueued_t;
+
+typedef struct
+{
+	pmqueued_t	*queued;
+	qboolean		parallel;		// PM_Move is given to the workers
+	qboolean		overflow;		// too many side effects, move again in order
+	qboolean		random;		// drew random numbers, move again in order
+	int		infoindex;
+	char		infovalue[2][MAX_INFO_STRING];
+	int		numdeferred;
+	pmdeferred_t	deferred[PM_MAX_DEFERRED];
+	playermove_t	pmove;
+} pmslot_t;
+
+typedef struct
+{
+	int		rounds;
+	int		parallel;		// moves taken from workers
+	int		serial;		// commands run in order
+	int		unsafe;		// physents the workers can't trace
+	int		reruns;		// input changed, moved again in order
+	int		random;		// of the reruns, drew random numbers
+	double		jobtime;
+} pmovecounts_t;
+
+static pmqueued_t		sv_cmdqueue[PM_MAX_QUEUED];
+static int		sv_numqueued;
+static pmslot_t		*sv_pmslots;		// [sv_maxclients]
+static int		sv_numpmslots;
+static pmslot_t		*sv_activeslot[MAX_WORKERS+1];	// move running on the thread
+static void		*sv_pminfolock;		// Info_ValueForKey uses static buffers
+static pmovecounts_t	sv_pmovestats;
+
+/*
+====================
+SV_ActiveSlot
+
+slot of the move this thread runs or NULL, a single
+job runs in place on the main thread
+====================
+*/
+static pmslot_t *SV_ActiveSlot( void )
+{
+	return sv_activeslot[Sys_WorkerIndex()];
+}
+
+/*
+====================
+SV_ActivePMove
+
+pmove the callbacks of PM_Move should use
+====================
+*/
+static playermove_t *SV_ActivePMove( void )
+{
+	pmslot_t	*slot = SV_ActiveSlot();
+
+	return slot ? &slot->pmove : svgame.pmove;
+}
+
+/*
+====================
+SV_DeferPMoveCall
+
+record for a side effect of the move running on the worker,
+NULL when called in order and the effect can be done now
+====================
+*/
+static pmdeferred_t *SV_DeferPMoveCall( int type )
+{
+	static pmdeferred_t	discard[MAX_WORKERS+1];
+	pmslot_t		*slot = SV_ActiveSlot();
+	pmdeferred_t	*rec;
+
+	if( !slot ) return NULL;
+
+	if( slot->numdeferred >= PM_MAX_DEFERRED )
+	{
+		// result is dropped, the move runs again in order
+		slot->overflow = true;
+		rec = &discard[Sys_WorkerIndex()];
+	}
+	else rec = &slot->deferred[slot->numdeferred++];
+
+	rec->type = type;
+	return rec;
 }
 
 static void pfnParticle( float *origin, int color, float life, int zpos, int zvel )
 {
-	int	v;
+	pmdeferred_t	*rec;
+	int		v;
 
 	if( !origin )
 	{
@@ -305,6 +644,16 @@ static void pfnParticle( float *origin, int color, float life, int zpos, int zve
 		return;
 	}
 
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_PARTICLE )) != NULL )
+	{
+		VectorCopy( origin, rec->particle.origin );
+		rec->particle.color = color;
+		rec->particle.life = life;
+		rec->particle.zpos = zpos;
+		rec->particle.zvel = zvel;
+		return;
+	}
+
 	BF_WriteByte( &sv.reliable_datagram, svc_particle );
 	BF_WriteVec3Coord( &sv.reliable_datagram, origin );
 	BF_WriteChar( &sv.reliable_datagram, 0 ); // no x-vel
@@ -318,29 +667,32 @@ static void pfnParticle( float *origin, int color, float life, int zpos, int zve
 
 static int GAME_EXPORT pfnTestPlayerPosition( float *pos, pmtrace_t *ptrace )
 {
-	return PM_TestPlayerPosition( svgame.pmove, pos, ptrace, NULL );
+	playermove_t	*pmove = SV_ActivePMove();
+
+	return PM_TestPlayerPosition( pmove, pos, ptrace, NULL );
 }
 
 static void GAME_EXPORT pfnStuckTouch( int hitent, pmtrace_t *tr )
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	int	i;
 
-	for( i = 0; i < svgame.pmove->numtouch; i++ )
+	for( i = 0; i < pmove->numtouch; i++ )
 	{
-		if( svgame.pmove->touchindex[i].ent == hitent )
+		if( pmove->touchindex[i].ent == hitent )
 			return;
 	}
 
-	if( svgame.pmove->numtouch >= MAX_PHYSENTS )
+	if( pmove->numtouch >= MAX_PHYSENTS )
 	{
 		MsgDev( D_ERROR, "PM_StuckTouch: MAX_TOUCHENTS limit exceeded\n" );
 		return;
 	}
 
-	VectorCopy( svgame.pmove->velocity, tr->deltavelocity );
+	VectorCopy( pmove->velocity, tr->deltavelocity );
 	tr->ent = hitent;
 
-	svgame.pmove->touchindex[svgame.pmove->numtouch++] = *tr;
+	pmove->touchindex[pmove->numtouch++] = *tr;
 }
 
 static int GAME_EXPORT pfnPointContents( float *p, int *truecontents )
@@ -372,47 +724,55 @@ static int GAME_EXPORT pfnHullPointContents( struct hull_s *hull, int num, float
 #if defined(DLL_LOADER) || defined(__MINGW32__)
 static pmtrace_t *GAME_EXPORT pfnPlayerTrace_w32(pmtrace_t * retvalue, float *start, float *end, int traceFlags, int ignore_pe)
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	pmtrace_t tmp;
-	tmp = PM_PlayerTraceExt( svgame.pmove, start, end, traceFlags, svgame.pmove->numphysent, svgame.pmove->physents, ignore_pe, NULL );
+	tmp = PM_PlayerTraceExt( pmove, start, end, traceFlags, pmove->numphysent, pmove->physents, ignore_pe, NULL );
 	*retvalue = tmp;
 	return retvalue;
 }
 #endif
 static pmtrace_t GAME_EXPORT pfnPlayerTrace(float *start, float *end, int traceFlags, int ignore_pe)
 {
-	return PM_PlayerTraceExt( svgame.pmove, start, end, traceFlags, svgame.pmove->numphysent, svgame.pmove->physents, ignore_pe, NULL );
+	playermove_t	*pmove = SV_ActivePMove();
+
+	return PM_PlayerTraceExt( pmove, start, end, traceFlags, pmove->numphysent, pmove->physents, ignore_pe, NULL );
 }
 
 static pmtrace_t *GAME_EXPORT pfnTraceLine( float *start, float *end, int flags, int usehull, int ignore_pe )
 {
-	static pmtrace_t	tr;
+	playermove_t	*pmove = SV_ActivePMove();
+	static pmtrace_t	tr[MAX_WORKERS+1];
+	int		thread = Sys_WorkerIndex();
 	int		old_usehull;
 
-	old_usehull = svgame.pmove->usehull;
-	svgame.pmove->usehull = usehull;	
+	old_usehull = pmove->usehull;
+	pmove->usehull = usehull;	
 
 	switch( flags )
 	{
 	case PM_TRACELINE_PHYSENTSONLY:
-		tr = PM_PlayerTraceExt( svgame.pmove, start, end, 0, svgame.pmove->numphysent, svgame.pmove->physents, ignore_pe, NULL );
+		tr[thread] = PM_PlayerTraceExt( pmove, start, end, 0, pmove->numphysent, pmove->physents, ignore_pe, NULL );
 		break;
 	case PM_TRACELINE_ANYVISIBLE:
-		tr = PM_PlayerTraceExt( svgame.pmove, start, end, 0, svgame.pmove->numvisent, svgame.pmove->visents, ignore_pe, NULL );
+		tr[thread] = PM_PlayerTraceExt( pmove, start, end, 0, pmove->numvisent, pmove->visents, ignore_pe, NULL );
 		break;
 	}
 
-	svgame.pmove->usehull = old_usehull;
+	pmove->usehull = old_usehull;
 
-	return &tr;
+	return &tr[thread];
 }
 
 static hull_t *GAME_EXPORT pfnHullForBsp( physent_t *pe, float *offset )
 {
-	return PM_HullForBsp( pe, svgame.pmove, offset );
+	playermove_t	*pmove = SV_ActivePMove();
+
+	return PM_HullForBsp( pe, pmove, offset );
 }
 
 static float GAME_EXPORT pfnTraceModel( physent_t *pe, float *start, float *end, trace_t *trace )
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	int	old_usehull;
 	vec3_t	start_l, end_l;
 	vec3_t	offset, temp;
@@ -420,12 +780,12 @@ static float GAME_EXPORT pfnTraceModel( physent_t *pe, float *start, float *end,
 	matrix4x4	matrix;
 	hull_t	*hull;
 
-	old_usehull = svgame.pmove->usehull;
-	svgame.pmove->usehull = 2;
+	old_usehull = pmove->usehull;
+	pmove->usehull = 2;
 
-	hull = PM_HullForBsp( pe, svgame.pmove, offset );
+	hull = PM_HullForBsp( pe, pmove, offset );
 
-	svgame.pmove->usehull = old_usehull;
+	pmove->usehull = old_usehull;
 
 	if( pe->solid == SOLID_BSP && !VectorIsNull( pe->angles ))
 		rotated = true;
@@ -459,12 +819,13 @@ static float GAME_EXPORT pfnTraceModel( physent_t *pe, float *start, float *end,
 
 static const char *GAME_EXPORT pfnTraceTexture( int ground, float *vstart, float *vend )
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	physent_t *pe;
 
-	if( ground < 0 || ground >= svgame.pmove->numphysent )
+	if( ground < 0 || ground >= pmove->numphysent )
 		return NULL; // bad ground
 
-	pe = &svgame.pmove->physents[ground];
+	pe = &pmove->physents[ground];
 	return PM_TraceTexture( pe, vstart, vend );
 }			
 
@@ -473,6 +834,18 @@ static void GAME_EXPORT pfnPlaySound( int channel, const char *sample, float vol
 	edict_t	*ent;
 	sv_client_t *cl = svs.clients + svgame.pmove->player_index;
 	qboolean exclude;
+	pmdeferred_t *rec;
+
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_SOUND )) != NULL )
+	{
+		rec->sound.channel = channel;
+		rec->sound.sample = sample;
+		rec->sound.volume = volume;
+		rec->sound.attenuation = attenuation;
+		rec->sound.flags = fFlags;
+		rec->sound.pitch = pitch;
+		return;
+	}
 
 	ent = EDICT_NUM( svgame.pmove->player_index + 1 );
 	if( !SV_IsValidEdict( ent )) return;
@@ -486,7 +859,27 @@ static void GAME_EXPORT pfnPlaySound( int channel, const char *sample, float vol
 static void GAME_EXPORT pfnPlaybackEventFull( int flags, int clientindex, word eventindex, float delay, float *origin,
 	float *angles, float fparam1, float fparam2, int iparam1, int iparam2, int bparam1, int bparam2 )
 {
-	edict_t	*ent;
+	pmdeferred_t	*rec;
+	edict_t		*ent;
+
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_EVENT )) != NULL )
+	{
+		rec->event.flags = flags;
+		rec->event.clientindex = clientindex;
+		rec->event.eventindex = eventindex;
+		rec->event.delay = delay;
+		rec->event.hasorigin = ( origin != NULL );
+		rec->event.hasangles = ( angles != NULL );
+		if( origin ) VectorCopy( origin, rec->event.origin );
+		if( angles ) VectorCopy( angles, rec->event.angles );
+		rec->event.fparam1 = fparam1;
+		rec->event.fparam2 = fparam2;
+		rec->event.iparam1 = iparam1;
+		rec->event.iparam2 = iparam2;
+		rec->event.bparam1 = bparam1;
+		rec->event.bparam2 = bparam2;
+		return;
+	}
 
 	ent = EDICT_NUM( clientindex + 1 );
 	if( !SV_IsValidEdict( ent )) return;
@@ -503,8 +896,9 @@ static void GAME_EXPORT pfnPlaybackEventFull( int flags, int clientindex, word e
 #if defined(DLL_LOADER) || defined(__MINGW32__)
 static pmtrace_t *GAME_EXPORT pfnPlayerTraceEx_w32( pmtrace_t * retvalue, float *start, float *end, int traceFlags, pfnIgnore pmFilter )
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	pmtrace_t tmp;
-	tmp = PM_PlayerTraceExt( svgame.pmove, start, end, traceFlags, svgame.pmove->numphysent, svgame.pmove->physents, -1, pmFilter );
+	tmp = PM_PlayerTraceExt( pmove, start, end, traceFlags, pmove->numphysent, pmove->physents, -1, pmFilter );
 	*retvalue = tmp;
 	return retvalue;
 }
@@ -512,48 +906,157 @@ static pmtrace_t *GAME_EXPORT pfnPlayerTraceEx_w32( pmtrace_t * retvalue, float
 
 static pmtrace_t GAME_EXPORT pfnPlayerTraceEx( float *start, float *end, int traceFlags, pfnIgnore pmFilter )
 {
-	return PM_PlayerTraceExt( svgame.pmove, start, end, traceFlags, svgame.pmove->numphysent, svgame.pmove->physents, -1, pmFilter );
+	playermove_t	*pmove = SV_ActivePMove();
+
+	return PM_PlayerTraceExt( pmove, start, end, traceFlags, pmove->numphysent, pmove->physents, -1, pmFilter );
 }
 
 static int GAME_EXPORT pfnTestPlayerPositionEx( float *pos, pmtrace_t *ptrace, pfnIgnore pmFilter )
 {
-	return PM_TestPlayerPosition( svgame.pmove, pos, ptrace, pmFilter );
+	playermove_t	*pmove = SV_ActivePMove();
+
+	return PM_TestPlayerPosition( pmove, pos, ptrace, pmFilter );
 }
 
 static pmtrace_t *GAME_EXPORT pfnTraceLineEx( float *start, float *end, int flags, int usehull, pfnIgnore pmFilter )
 {
-	static pmtrace_t	tr;
+	playermove_t	*pmove = SV_ActivePMove();
+	static pmtrace_t	tr[MAX_WORKERS+1];
+	int		thread = Sys_WorkerIndex();
 	int		old_usehull;
 
-	old_usehull = svgame.pmove->usehull;
-	svgame.pmove->usehull = usehull;	
+	old_usehull = pmove->usehull;
+	pmove->usehull = usehull;	
 
 	switch( flags )
 	{
 	case PM_TRACELINE_PHYSENTSONLY:
-		tr = PM_PlayerTraceExt( svgame.pmove, start, end, 0, svgame.pmove->numphysent, svgame.pmove->physents, -1, pmFilter );
+		tr[thread] = PM_PlayerTraceExt( pmove, start, end, 0, pmove->numphysent, pmove->physents, -1, pmFilter );
 		break;
 	case PM_TRACELINE_ANYVISIBLE:
-		tr = PM_PlayerTraceExt( svgame.pmove, start, end, 0, svgame.pmove->numvisent, svgame.pmove->visents, -1, pmFilter );
+		tr[thread] = PM_PlayerTraceExt( pmove, start, end, 0, pmove->numvisent, pmove->visents, -1, pmFilter );
 		break;
 	}
 
-	svgame.pmove->usehull = old_usehull;
+	pmove->usehull = old_usehull;
 
-	return &tr;
+	return &tr[thread];
 }
 
 static struct msurface_s *GAME_EXPORT pfnTraceSurface( int ground, float *vstart, float *vend )
 {
+	playermove_t	*pmove = SV_ActivePMove();
 	physent_t *pe;
 
-	if( ground < 0 || ground >= svgame.pmove->numphysent )
+	if( ground < 0 || ground >= pmove->numphysent )
 		return NULL; // bad ground
 
-	pe = &svgame.pmove->physents[ground];
+	pe = &pmove->physents[ground];
 	return PM_TraceSurface( pe, vstart, vend );
 }
 
+static void pfnConNPrintf( int idx, char *fmt, ... )
+{
+	pmdeferred_t	*rec;
+	char		text[256];
+	va_list		args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_NPRINT )) != NULL )
+	{
+		rec->print.idx = idx;
+		Q_strncpy( rec->print.text, text, sizeof( rec->print.text ));
+		return;
+	}
+
+	Con_NPrintf( idx, "%s", text );
+}
+
+static void pfnConDPrintf( char *fmt, ... )
+{
+	pmdeferred_t	*rec;
+	char		text[256];
+	va_list		args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_DPRINT )) != NULL )
+	{
+		Q_strncpy( rec->print.text, text, sizeof( rec->print.text ));
+		return;
+	}
+
+	Con_DPrintf( "%s", text );
+}
+
+static void pfnConPrintf( char *fmt, ... )
+{
+	pmdeferred_t	*rec;
+	char		text[256];
+	va_list		args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	if(( rec = SV_DeferPMoveCall( PM_DEFER_PRINT )) != NULL )
+	{
+		Q_strncpy( rec->print.text, text, sizeof( rec->print.text ));
+		return;
+	}
+
+	Con_Printf( "%s", text );
+}
+
+static const char *pfnInfoValueForKey( const char *s, const char *key )
+{
+	pmslot_t	*slot = SV_ActiveSlot();
+	char	*value;
+
+	if( !slot ) return Info_ValueForKey( s, key );
+
+	// copied to the slot, two buffers like in Info_ValueForKey
+	value = slot->infovalue[slot->infoindex ^= 1];
+	Sys_LockMutex( sv_pminfolock );
+	Q_strncpy( value, Info_ValueForKey( s, key ), MAX_INFO_STRING );
+	Sys_UnlockMutex( sv_pminfolock );
+
+	return value;
+}
+
+/*
+====================
+pfnRandomLong
+
+the worker move can't draw from the engine generator
+in order, so it is given up and runs again in order
+====================
+*/
+static long pfnRandomLong( long lLow, long lHigh )
+{
+	pmslot_t	*slot = SV_ActiveSlot();
+
+	if( !slot ) return Com_RandomLong( lLow, lHigh );
+
+	slot->random = true;
+	return lLow;
+}
+
+static float pfnRandomFloat( float flLow, float flHigh )
+{
+	pmslot_t	*slot = SV_ActiveSlot();
+
+	if( !slot ) return Com_RandomFloat( flLow, flHigh );
+
+	slot->random = true;
+	return flLow;
+}
+
 /*
 ===============
 SV_InitClientMove
@@ -566,6 +1069,7 @@ void SV_InitClientMove( void )
 
 	Pmove_Init ();
 
+	sv_numqueued = 0;
 	svgame.pmove->server = true;
 	svgame.pmove->movevars = &svgame.movevars;
 	svgame.pmove->runfuncs = false;
@@ -585,12 +1089,12 @@ void SV_InitClientMove( void )
 	Q_memcpy( svgame.pmove->player_maxs, svgame.player_maxs, sizeof( svgame.player_maxs ));
 
 	// common utilities
-	svgame.pmove->PM_Info_ValueForKey = (void*)Info_ValueForKey;
+	svgame.pmove->PM_Info_ValueForKey = pfnInfoValueForKey;
 	svgame.pmove->PM_Particle = pfnParticle;
 	svgame.pmove->PM_TestPlayerPosition = pfnTestPlayerPosition;
-	svgame.pmove->Con_NPrintf = Con_NPrintf;
-	svgame.pmove->Con_DPrintf = Con_DPrintf;
-	svgame.pmove->Con_Printf = Con_Printf;
+	svgame.pmove->Con_NPrintf = pfnConNPrintf;
+	svgame.pmove->Con_DPrintf = pfnConDPrintf;
+	svgame.pmove->Con_Printf = pfnConPrintf;
 	svgame.pmove->Sys_FloatTime = Sys_DoubleTime;
 	svgame.pmove->PM_StuckTouch = pfnStuckTouch;
 	svgame.pmove->PM_PointContents = pfnPointContents;
@@ -598,8 +1102,8 @@ void SV_InitClientMove( void )
 	svgame.pmove->PM_HullPointContents = pfnHullPointContents;
 	svgame.pmove->PM_PlayerTrace = pfnPlayerTrace;
 	svgame.pmove->PM_TraceLine = pfnTraceLine;
-	svgame.pmove->RandomLong = (void*)Com_RandomLong;
-	svgame.pmove->RandomFloat = Com_RandomFloat;
+	svgame.pmove->RandomLong = pfnRandomLong;
+	svgame.pmove->RandomFloat = pfnRandomFloat;
 	svgame.pmove->PM_GetModelType = pfnGetModelType;
 	svgame.pmove->PM_GetModelBounds = pfnGetModelBounds;
 	svgame.pmove->PM_HullForBsp = (void*)pfnHullForBsp;
@@ -724,13 +1228,14 @@ static void SV_SetupPMove( playermove_t *pmove, sv_client_t *cl, usercmd_t *ucmd
 		absmax[i] = clent->v.origin[i] + 256.0f;
 	}
 
-	SV_CopyEdictToPhysEnt( &svgame.pmove->physents[0], &svgame.edicts[0] );
-	svgame.pmove->visents[0] = svgame.pmove->physents[0];
-	svgame.pmove->numphysent = 1;	// always have world
-	svgame.pmove->numvisent = 1;
+	Q_memset( &pmove->physents[0], 0, sizeof( physent_t ));
+	SV_CopyEdictToPhysEnt( &pmove->physents[0], &svgame.edicts[0] );
+	pmove->visents[0] = pmove->physents[0];
+	pmove->numphysent = 1;	// always have world
+	pmove->numvisent = 1;
 
-	SV_AddLinksToPmove( sv_areanodes, absmin, absmax );
-	SV_AddLaddersToPmove( sv_areanodes, absmin, absmax );
+	SV_AddLinksToPmove( pmove, sv_areanodes, absmin, absmax );
+	SV_AddLaddersToPmove( pmove, sv_areanodes, absmin, absmax );
 }
 
 static void SV_FinishPMove( playermove_t *pmove, sv_client_t *cl )
@@ -774,14 +1279,14 @@ static void SV_FinishPMove( playermove_t *pmove, sv_client_t *cl )
 	VectorCopy( pmove->vuser3, clent->v.vuser3 );
 	VectorCopy( pmove->vuser4, clent->v.vuser4 );
 
-	if( svgame.pmove->onground == -1 )
+	if( pmove->onground == -1 )
 	{
 		clent->v.flags &= ~FL_ONGROUND;
 	}
 	else if( pmove->onground >= 0 && pmove->onground < pmove->numphysent )
 	{
 		clent->v.flags |= FL_ONGROUND;
-		clent->v.groundentity = EDICT_NUM( svgame.pmove->physents[svgame.pmove->onground].info );
+		clent->v.groundentity = EDICT_NUM( pmove->physents[pmove->onground].info );
 	}
 
 	// angles
@@ -909,22 +1414,164 @@ qboolean SV_UnlagCheckTeleport( vec3_t old_pos, vec3_t new_pos )
 	return false;
 }
 
+typedef struct
+{
+	int		setups;		// SV_SetupMoveInterpolant with unlag
+	int		candidates;	// other players looked at
+	int		rewound;		// moved back in time
+	int		culled;		// out of the aim cone
+	int		nohistory;	// target time not in history
+	double		time;
+} unlagcounts_t;
+
+static unlagcounts_t	sv_unlagstats;
+
+/*
+================
+SV_ClearUnlagHistory
+
+================
+*/
+void SV_ClearUnlagHistory( void )
+{
+	Q_memset( &svgame.unlag, 0, sizeof( svgame.unlag ));
+}
+
+/*
+================
+SV_RecordUnlagHistory
+
+sample positions of the players at the time they are sent,
+samples closer than SV_UNLAG_INTERVAL replace the newest one
+================
+*/
+void SV_RecordUnlagHistory( void )
+{
+	sv_unlaghistory_t	*h = &svgame.unlag;
+	sv_unlagframe_t	*frame, *prev = NULL;
+	sv_client_t	*cl;
+	edict_t		*ent;
+	int		i;
+
+	if( sv.state != ss_active || sv_maxclients->integer <= 1 )
+		return;
+
+	if( h->head > 0 )
+	{
+		frame = &h->frames[(h->head - 1) & SV_UNLAG_MASK];
+		if( host.realtime - frame->time < SV_UNLAG_INTERVAL )
+			h->head--; // merge with the newest sample
+	}
+
+	if( h->head > 0 )
+		prev = &h->frames[(h->head - 1) & SV_UNLAG_MASK];
+
+	frame = &h->frames[h->head & SV_UNLAG_MASK];
+	frame->time = host.realtime;
+	h->head++;
+
+	for( i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++ )
+	{
+		frame->flags[i] = 0;
+
+		if( i >= sv_maxclients->integer || cl->state != cs_spawned || !cl->edict )
+			continue;
+
+		ent = cl->edict;
+		frame->flags[i] = UNLAG_PRESENT;
+		VectorCopy( ent->v.origin, frame->origin[i] );
+
+		if( ent->v.health <= 0.0f || ( ent->v.effects & EF_NOINTERP ))
+		{
+			frame->flags[i] |= UNLAG_NOINTERP;
+			h->lastbreak[i] = frame->time;
+		}
+		else if( prev && ( prev->flags[i] & UNLAG_PRESENT ) && SV_UnlagCheckTeleport( prev->origin[i], frame->origin[i] ))
+		{
+			// teleported between the samples
+			h->lastbreak[i] = max( h->lastbreak[i], prev->time );
+		}
+	}
+}
+
+/*
+================
+SV_FindUnlagFrame
+
+newest sample taken before the time, binary search
+over the ring. Returns sample number or -1
+================
+*/
+static int SV_FindUnlagFrame( double time )
+{
+	sv_unlaghistory_t	*h = &svgame.unlag;
+	int		lo, hi, mid;
+
+	lo = max( h->head - SV_UNLAG_HISTORY, 0 );
+	hi = h->head - 1;
+
+	if( hi < lo || !( time > h->frames[lo & SV_UNLAG_MASK].time ))
+		return -1;
+
+	while( lo < hi )
+	{
+		mid = ( lo + hi + 1 ) >> 1;
+
+		if( time > h->frames[mid & SV_UNLAG_MASK].time )
+			lo = mid;
+		else hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/*
+================
+SV_UnlagInCone
+
+sphere around the swept bounds against the aim cone
+================
+*/
+static qboolean SV_UnlagInCone( const vec3_t eye, const vec3_t dir, float cone, const vec3_t mins, const vec3_t maxs )
+{
+	vec3_t	center, delta;
+	float	radius, dist, angle;
+
+	VectorAverage( mins, maxs, center );
+	VectorSubtract( maxs, center, delta );
+	radius = VectorLength( delta );
+
+	VectorSubtract( center, eye, delta );
+	dist = VectorLength( delta );
+	if( dist <= radius ) return true;
+
+	angle = acos( bound( -1.0f, DotProduct( delta, dir ) / dist, 1.0f ));
+
+	return ( angle <= cone + asin( radius / dist ));
+}
+
 /*
 ================
 SV_SetupMoveInterpolant
 
+move other players back to where the client saw them
+when the command was made, from the unlag history
 ================
 */
-void SV_SetupMoveInterpolant( sv_client_t *cl )
+void SV_SetupMoveInterpolant( sv_client_t *cl, usercmd_t *ucmd )
 {
-	int		i, j, clientnum;
+	int		i, older, newer;
 	float		finalpush, lerp_msec;
-	float		latency, lerpFrac;
-	client_frame_t	*frame, *frame2;
-	entity_state_t	*state, *lerpstate;
+	float		latency, lerpFrac, cone;
+	sv_unlagframe_t	*frame, *frame2;
+	client_frame_t	*seen;
+	entity_state_t	*state;
+	uint		seenmask;
 	vec3_t		curpos, newpos;
+	vec3_t		eye, dir, mins, maxs;
 	sv_client_t	*check;
 	sv_interp_t	*lerp;
+	double		start;
 
 	Q_memset( svgame.interp, 0, sizeof( svgame.interp ));
 	has_update = false;
@@ -938,6 +1585,8 @@ void SV_SetupMoveInterpolant( sv_client_t *cl )
 		return;
 
 	has_update = true;
+	start = Sys_DoubleTime();
+	sv_unlagstats.setups++;
 
 	for( i = 0, check = svs.clients; i < sv_maxclients->integer; i++, check++ )
 	{
@@ -973,118 +1622,140 @@ void SV_SetupMoveInterpolant( sv_client_t *cl )
 	if( finalpush > host.realtime )
 		finalpush = host.realtime; // pushed too much ?
 
-	frame = frame2 = NULL;
+	older = SV_FindUnlagFrame( finalpush );
+	frame = ( older != -1 ) ? &svgame.unlag.frames[older & SV_UNLAG_MASK] : NULL;
 
-	for( i = 0; i < SV_UPDATE_BACKUP; i++, frame2 = frame )
+	if( !frame || finalpush - frame->time > 1.0 )
 	{
-		frame = &cl->frames[(cl->netchan.outgoing_sequence - (i+1)) & SV_UPDATE_MASK];
+		Q_memset( svgame.interp, 0, sizeof( svgame.interp ));
+		sv_unlagstats.nohistory++;
+		has_update = false;
+		return;
+	}
 
-		for( j = 0; j < frame->num_entities; j++ )
-		{
-			state = &svs.packet_entities[(frame->first_entity+j)%svs.num_client_entities];
-
-			if( state->number <= 0 || state->number > sv_maxclients->integer )
-				continue;
-
-			lerp = &svgame.interp[state->number-1];
-
-			if( lerp->nointerp )
-				continue;
-
-			if( state->health <= 0 || ( state->effects & EF_NOINTERP ))
-				lerp->nointerp = true;
-
-			if( lerp->firstframe )
-			{
-				if( SV_UnlagCheckTeleport( state->origin, lerp->finalpos ))
-					lerp->nointerp = true;
-			}
-			else
-			{
-				lerp->firstframe = true;
-			}
-
-			VectorCopy( state->origin, lerp->finalpos );
-		}
-
-		if( finalpush > frame->senttime )
+	// only players of the packet the client saw at that time are compensated
+	for( i = 0; i < SV_UPDATE_BACKUP; i++ )
+	{
+		seen = &cl->frames[(cl->netchan.outgoing_sequence - (i+1)) & SV_UPDATE_MASK];
+		if( finalpush > seen->senttime )
 			break;
 	}
 
-	if( i == SV_UPDATE_BACKUP || finalpush - frame->senttime > 1.0 )
+	if( i == SV_UPDATE_BACKUP )
 	{
 		Q_memset( svgame.interp, 0, sizeof( svgame.interp ));
+		sv_unlagstats.nohistory++;
 		has_update = false;
 		return;
 	}
 
-	if( !frame2 )
+	// packet is sorted by number, so the players lead it
+	for( i = 0, seenmask = 0; i < seen->num_entities; i++ )
+	{
+		state = &svs.packet_entities[(seen->first_entity+i)%svs.num_client_entities];
+		if( state->number > sv_maxclients->integer )
+			break;
+		if( state->number > 0 )
+			seenmask |= BIT( state->number - 1 );
+	}
+
+	newer = older + 1;
+
+	if( newer >= svgame.unlag.head )
 	{
 		frame2 = frame;
 		lerpFrac = 0;
 	}
 	else
 	{
-		if( frame2->senttime - frame->senttime == 0.0 )
+		frame2 = &svgame.unlag.frames[newer & SV_UNLAG_MASK];
+
+		if( frame2->time - frame->time == 0.0 )
 		{
 			lerpFrac = 0;
 		}
 		else
 		{
-			lerpFrac = (finalpush - frame->senttime) / (frame2->senttime - frame->senttime);
+			lerpFrac = (finalpush - frame->time) / (frame2->time - frame->time);
 			lerpFrac = bound( 0.0f, lerpFrac, 1.0f );
 		}
 	}
 
-	for( i = 0; i < frame->num_entities; i++ )
+	cone = DEG2RAD( bound( 0.0f, sv_unlagcone->value, 180.0f ));
+	VectorAdd( cl->edict->v.origin, cl->edict->v.view_ofs, eye );
+	AngleVectors( ucmd->viewangles, dir, NULL, NULL );
+
+	for( i = 0, check = svs.clients; i < sv_maxclients->integer; i++, check++ )
 	{
-		state = &svs.packet_entities[(frame->first_entity+i)%svs.num_client_entities];
+		lerp = &svgame.interp[i];
 
-		if( state->number <= 0 || state->number > sv_maxclients->integer )
+		if( !lerp->active || !( frame->flags[i] & UNLAG_PRESENT ))
 			continue;
 
-		clientnum = state->number - 1;
-		check = &svs.clients[clientnum];
-
-		if( check->state != cs_spawned || check == cl )
+		if(!( seenmask & BIT( i )))
 			continue;
 
-		lerp = &svgame.interp[clientnum];
-
-		if( lerp->nointerp )
-			continue;
+		sv_unlagstats.candidates++;
 
-		if( !lerp->active )
+		// died, teleported or asked for no interpolation since then
+		if( svgame.unlag.lastbreak[i] >= frame->time )
 		{
-			MsgDev( D_ERROR, "SV_SetupMoveInterpolate: tried to store off position of bogus player %i/%s\n", i, check->name );
+			lerp->nointerp = true;
 			continue;
 		}
 
-		lerpstate = SV_FindEntInPack( state->number, frame2 );
-
-		if( !lerpstate )
-		{
-			VectorCopy( state->origin, curpos );
-		}
-		else
+		if( frame2->flags[i] & UNLAG_PRESENT )
 		{
-			VectorSubtract( lerpstate->origin, state->origin, newpos );
-			VectorMA( state->origin, lerpFrac, newpos, curpos );
+			VectorSubtract( frame2->origin[i], frame->origin[i], newpos );
+			VectorMA( frame->origin[i], lerpFrac, newpos, curpos );
 		}
+		else VectorCopy( frame->origin[i], curpos );
 
 		VectorCopy( curpos, lerp->curpos );
 		VectorCopy( curpos, lerp->newpos );
 
-		if( !VectorCompare( curpos, check->edict->v.origin ))
+		if( VectorCompare( curpos, check->edict->v.origin ))
+			continue;
+
+		if( sv_unlagcone->value > 0.0f && sv_unlagcone->value < 180.0f )
 		{
-			/*MsgDev(D_NOTE, "Updated position for %i/%s from %.2f/%.2f/%.2f to %.2f/%.2f/%.2f\n",
-				i, check->name, lerp->oldpos[0], lerp->oldpos[1], lerp->oldpos[2],
-				 lerp->curpos[0], lerp->curpos[1], lerp->curpos[2] );*/
-			VectorCopy( curpos, check->edict->v.origin );
-			SV_LinkEdict( check->edict, false );
-			lerp->moving = true;
+			// swept from the past position to the current one
+			VectorSubtract( curpos, check->edict->v.origin, newpos );
+			VectorAdd( lerp->mins, newpos, mins );
+			VectorAdd( lerp->maxs, newpos, maxs );
+			AddPointToBounds( lerp->mins, mins, maxs );
+			AddPointToBounds( lerp->maxs, mins, maxs );
+
+			if( !SV_UnlagInCone( eye, dir, cone, mins, maxs ))
+			{
+				sv_unlagstats.culled++;
+				continue;
+			}
 		}
+
+		VectorCopy( curpos, check->edict->v.origin );
+		SV_LinkEdict( check->edict, false );
+		lerp->moving = true;
+		sv_unlagstats.rewound++;
 	}
+
+	sv_unlagstats.time += Sys_DoubleTime() - start;
+}
+
+/*
+================
+SV_UnlagStats_f
+
+================
+*/
+void SV_UnlagStats_f( void )
+{
+	unlagcounts_t	*t = &sv_unlagstats;
+
+	Msg( "%i setups: %i players looked at, %i moved back, %i out of aim cone, %i without history, %.3f ms per setup\n",
+		t->setups, t->candidates, t->rewound, t->culled, t->nohistory, t->time * 1000.0 / max( t->setups, 1 ));
+
+	Q_memset( t, 0, sizeof( *t ));
 }
 
 /*
@@ -1138,47 +1809,15 @@ void SV_RestoreMoveInterpolant( sv_client_t *cl )
 
 /*
 ===========
-SV_RunCmd
+SV_RunCmdStart
+
+command up to the player move: thinks of the player
 ===========
 */
-void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
+static void SV_RunCmdStart( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
 {
-	usercmd_t lastcmd;
-	edict_t	*clent, *touch;
+	edict_t	*clent = cl->edict;
 	double	frametime;
-	int	i, oldmsec;
-	pmtrace_t	*pmtrace;
-	trace_t	trace;
-	vec3_t	oldvel;
-   
-	if( cl->next_movetime > host.realtime )
-	{
-		cl->last_movetime += ( ucmd->msec * 0.001f );
-		return;
-	}
-
-	clent = cl->edict;
-	cl->next_movetime = 0.0;
-	lastcmd = *ucmd;
-
-	// chop up very long commands
-	if( ucmd->msec > 50 )
-	{
-		oldmsec = ucmd->msec;
-
-		lastcmd.msec = oldmsec / 2;
-		SV_RunCmd( cl, &lastcmd, random_seed );
-
-		lastcmd.msec = oldmsec / 2;
-		lastcmd.impulse = 0;
-		SV_RunCmd( cl, &lastcmd, random_seed );
-		return;
-	}
-
-	if( !cl->fakeclient )
-	{
-		SV_SetupMoveInterpolant( cl );
-	}
 
 	svgame.dllFuncs.pfnCmdStart( clent, ucmd, random_seed );
 
@@ -1212,12 +1851,24 @@ void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
 	// If conveyor, or think, set basevelocity, then send to client asap too.
 	if( !VectorIsNull( clent->v.basevelocity ))
 		VectorCopy( clent->v.basevelocity, clent->v.clbasevelocity );
+}
 
-	// setup playermove state
-	SV_SetupPMove( svgame.pmove, cl, ucmd, cl->physinfo );
+/*
+===========
+SV_RunCmdFinish
 
-	// motor!
-	svgame.dllFuncs.pfnPM_Move( svgame.pmove, true );
+copy the result of svgame.pmove to the player
+and finish the command
+===========
+*/
+static void SV_RunCmdFinish( sv_client_t *cl, double frametime )
+{
+	edict_t	*clent = cl->edict;
+	edict_t	*touch;
+	pmtrace_t	*pmtrace;
+	trace_t	trace;
+	vec3_t	oldvel;
+	int	i;
 
 	// copy results back to client
 	SV_FinishPMove( svgame.pmove, cl );
@@ -1252,9 +1903,557 @@ void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
 	// run post-think
 	svgame.dllFuncs.pfnPlayerPostThink( clent );
 	svgame.dllFuncs.pfnCmdEnd( clent );
+}
+
+/*
+===========
+SV_RunCmd
+===========
+*/
+void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
+{
+	usercmd_t lastcmd;
+	int	oldmsec;
+   
+	if( cl->next_movetime > host.realtime )
+	{
+		cl->last_movetime += ( ucmd->msec * 0.001f );
+		return;
+	}
+
+	cl->next_movetime = 0.0;
+	lastcmd = *ucmd;
+
+	// chop up very long commands
+	if( ucmd->msec > 50 )
+	{
+		oldmsec = ucmd->msec;
+
+		lastcmd.msec = oldmsec / 2;
+		SV_RunCmd( cl, &lastcmd, random_seed );
+
+		lastcmd.msec = oldmsec / 2;
+		lastcmd.impulse = 0;
+		SV_RunCmd( cl, &lastcmd, random_seed );
+		return;
+	}
+
+	if( !cl->fakeclient )
+	{
+		SV_SetupMoveInterpolant( cl, ucmd );
+	}
+
+	SV_RunCmdStart( cl, ucmd, random_seed );
+
+	// setup playermove state
+	SV_SetupPMove( svgame.pmove, cl, ucmd, cl->physinfo );
+
+	// motor!
+	svgame.dllFuncs.pfnPM_Move( svgame.pmove, true );
+
+	SV_RunCmdFinish( cl, ucmd->msec * 0.001 );
+
+	if( !cl->fakeclient )
+	{
+		SV_RestoreMoveInterpolant( cl );
+	}
+}
+
+/*
+===========
+SV_ParallelPMove
+
+true when usercmds should wait for SV_RunQueuedCmds
+===========
+*/
+static qboolean SV_ParallelPMove( void )
+{
+	if( !sv_parallel_pmove->integer || sv_maxclients->integer <= 1 )
+		return false;
+
+	if( !( host.features & ENGINE_PARALLEL_PMOVE ))
+		return false; // game dll keeps the move in globals
+
+	return ( Sys_NumWorkers() > 0 );
+}
+
+/*
+===========
+SV_QueueCmd
+
+run the usercmd now or put it in the queue, the timebase
+it would start with is kept to run it later the same way
+===========
+*/
+void SV_QueueCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed )
+{
+	pmqueued_t	*queued;
+
+	// a command that only adds up the movetime runs the same at any time,
+	// unless earlier commands of the client still wait in the queue
+	if( !SV_ParallelPMove() || ( cl->next_movetime > host.realtime && !SV_ClientHasQueuedCmds( cl )))
+	{
+		SV_RunCmd( cl, ucmd, random_seed );
+		return;
+	}
+
+	if( sv_numqueued == PM_MAX_QUEUED )
+		SV_RunQueuedCmds();
+
+	queued = &sv_cmdqueue[sv_numqueued++];
+	queued->cl = cl;
+	queued->cmd = *ucmd;
+	queued->random_seed = random_seed;
+	queued->timebase = cl->timebase;
+	queued->lastcmd = cl->lastcmd;
+
+	cl->timebase += ucmd->msec * 0.001;
+}
+
+/*
+===========
+SV_ClientHasQueuedCmds
+
+===========
+*/
+qboolean SV_ClientHasQueuedCmds( sv_client_t *cl )
+{
+	int	i;
+
+	for( i = 0; i < sv_numqueued; i++ )
+	{
+		if( sv_cmdqueue[i].cl == cl )
+			return true;
+	}
+	return false;
+}
+
+/*
+===========
+SV_PMoveUnsafe
+
+physents the worker can't trace: studio hulls are built
+in shared buffers and custom clipping is a game callback
+===========
+*/
+static qboolean SV_PMoveUnsafe( const physent_t *list, int count )
+{
+	int	i;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( list[i].studiomodel != NULL || list[i].solid == SOLID_CUSTOM )
+			return true;
+	}
+	return false;
+}
+
+/*
+===========
+SV_PMoveInputChanged
+
+compare the move set up now with the one the worker was given,
+fields the move sets before reading are skipped
+===========
+*/
+static qboolean SV_PMoveInputChanged( const playermove_t *pmove, const pmslot_t *slot, const playermove_t *input )
+{
+	const playermove_t	*given = &slot->pmove;
+
+	if( pmove->player_index != input->player_index || pmove->time != input->time )
+		return true;
+
+	if( memcmp( pmove->origin, input->origin, (byte *)&pmove->sztexturename - (byte *)pmove->origin ))
+		return true;
+
+	if( memcmp( &pmove->maxspeed, &input->maxspeed, (byte *)&pmove->numphysent - (byte *)&pmove->maxspeed ))
+		return true;
+
+	if( memcmp( &pmove->cmd, &input->cmd, sizeof( pmove->cmd )) || Q_strcmp( pmove->physinfo, input->physinfo ))
+		return true;
+
+	// lists are not written by the move
+	if( pmove->numphysent != given->numphysent || pmove->numvisent != given->numvisent || pmove->nummoveent != given->nummoveent )
+		return true;
+
+	if( memcmp( pmove->physents, given->physents, pmove->numphysent * sizeof( physent_t )))
+		return true;
+
+	if( memcmp( pmove->visents, given->visents, pmove->numvisent * sizeof( physent_t )))
+		return true;
+
+	if( memcmp( pmove->moveents, given->moveents, pmove->nummoveent * sizeof( physent_t )))
+		return true;
+
+	return false;
+}
+
+/*
+===========
+SV_PMoveResultDiffers
+
+sv_parallel_pmove 2: compare the worker result with the move in order
+===========
+*/
+static qboolean SV_PMoveResultDiffers( const playermove_t *pmove, const playermove_t *result )
+{
+	if( memcmp( pmove->origin, result->origin, (byte *)&pmove->sztexturename - (byte *)pmove->origin ))
+		return true;
+
+	if( memcmp( &pmove->maxspeed, &result->maxspeed, (byte *)&pmove->numphysent - (byte *)&pmove->maxspeed ))
+		return true;
+
+	return ( pmove->numtouch != result->numtouch );
+}
+
+/*
+===========
+SV_ReplayPMoveCalls
+
+side effects of the worker move in the order they were made
+===========
+*/
+static void SV_ReplayPMoveCalls( pmslot_t *slot )
+{
+	pmdeferred_t	*rec;
+	int		i;
+
+	for( i = 0; i < slot->numdeferred; i++ )
+	{
+		rec = &slot->deferred[i];
+
+		switch( rec->type )
+		{
+		case PM_DEFER_PARTICLE:
+			pfnParticle( rec->particle.origin, rec->particle.color, rec->particle.life, rec->particle.zpos, rec->particle.zvel );
+			break;
+		case PM_DEFER_SOUND:
+			pfnPlaySound( rec->sound.channel, rec->sound.sample, rec->sound.volume, rec->sound.attenuation, rec->sound.flags, rec->sound.pitch );
+			break;
+		case PM_DEFER_EVENT:
+			pfnPlaybackEventFull( rec->event.flags, rec->event.clientindex, rec->event.eventindex, rec->event.delay,
+				rec->event.hasorigin ? rec->event.origin : NULL, rec->event.hasangles ? rec->event.angles : NULL,
+				rec->event.fparam1, rec->event.fparam2, rec->event.iparam1, rec->event.iparam2,
+				rec->event.bparam1, rec->event.bparam2 );
+			break;
+		case PM_DEFER_PRINT:
+			Con_Printf( "%s", rec->print.text );
+			break;
+		case PM_DEFER_DPRINT:
+			Con_DPrintf( "%s", rec->print.text );
+			break;
+		case PM_DEFER_NPRINT:
+			Con_NPrintf( rec->print.idx, "%s", rec->print.text );
+			break;
+		}
+	}
+}
+
+/*
+===========
+SV_PMoveJob
+
+===========
+*/
+static void SV_PMoveJob( void *data, int index )
+{
+	pmslot_t	*slot = ((pmslot_t **)data)[index];
+	int	thread = Sys_WorkerIndex();
+
+	sv_activeslot[thread] = slot;
+	svgame.dllFuncs.pfnPM_Move( &slot->pmove, true );
+	sv_activeslot[thread] = NULL;
+}
+
+/*
+===========
+SV_PrepareQueuedCmd
+
+first stage for a move given to the workers, in order: thinks
+and the pmove for the worker. Returns false and runs nothing if
+the command can't be moved on a worker
+===========
+*/
+static qboolean SV_PrepareQueuedCmd( pmslot_t *slot )
+{
+	pmqueued_t	*queued = slot->queued;
+	sv_client_t	*cl = queued->cl;
+	playermove_t	*pmove = &slot->pmove;
+	size_t		tail = offsetof( playermove_t, movevars );
+
+	slot->parallel = slot->overflow = slot->random = false;
+	slot->numdeferred = 0;
+
+	// chopped commands run in order as a whole
+	if( queued->cmd.msec > 50 || cl->next_movetime > host.realtime )
+		return false;
+
+	if( !cl->fakeclient )
+		SV_SetupMoveInterpolant( cl, &queued->cmd );
+
+	// look for the physents the workers can't trace before the thinks run
+	SV_SetupPMove( pmove, cl, &queued->cmd, cl->physinfo );
+
+	if( SV_PMoveUnsafe( pmove->physents, pmove->numphysent ) || SV_PMoveUnsafe( pmove->visents, pmove->numvisent ))
+	{
+		if( !cl->fakeclient )
+			SV_RestoreMoveInterpolant( cl );
+		sv_pmovestats.unsafe++;
+		return false;
+	}
+
+	cl->next_movetime = 0.0;
+	SV_RunCmdStart( cl, &queued->cmd, queued->random_seed );
+
+	// state the move keeps between calls and the engine callbacks
+	Q_memcpy( pmove, svgame.pmove, offsetof( playermove_t, numphysent ));
+	Q_memcpy( (byte *)pmove + tail, (byte *)svgame.pmove + tail, sizeof( playermove_t ) - tail );
+	SV_SetupPMove( pmove, cl, &queued->cmd, cl->physinfo );
+	pmove->numtouch = 0;
+
+	// thinks may have changed the neighbourhood, PM_Move runs in order then
+	slot->parallel = true;
+	if( SV_PMoveUnsafe( pmove->physents, pmove->numphysent ) || SV_PMoveUnsafe( pmove->visents, pmove->numvisent ))
+	{
+		sv_pmovestats.unsafe++;
+		slot->parallel = false;
+	}
+
+	if( !cl->fakeclient )
+		SV_RestoreMoveInterpolant( cl );
+
+	return true;
+}
+
+/*
+===========
+SV_FinishQueuedCmd
+
+last stage of the round, in order: take the move of the
+worker if its input is still the same and finish the command
+===========
+*/
+static void SV_FinishQueuedCmd( pmslot_t *slot, playermove_t *input )
+{
+	pmqueued_t	*queued = slot->queued;
+	sv_client_t	*cl = queued->cl;
+	qboolean		moved = false;
+
+	if( cl->state != cs_spawned || !cl->edict )
+		return; // dropped by an earlier command
 
 	if( !cl->fakeclient )
+		SV_SetupMoveInterpolant( cl, &queued->cmd );
+
+	SV_SetupPMove( svgame.pmove, cl, &queued->cmd, cl->physinfo );
+
+	if( slot->parallel )
+	{
+		if( !slot->overflow && !slot->random && !SV_PMoveInputChanged( svgame.pmove, slot, input ))
+		{
+			if( sv_parallel_pmove->integer == 2 )
+			{
+				svgame.dllFuncs.pfnPM_Move( svgame.pmove, true );
+
+				if( SV_PMoveResultDiffers( svgame.pmove, &slot->pmove ))
+				{
+					MsgDev( D_WARN, "SV_RunQueuedCmds: move of %s differs from serial\n", cl->name );
+					SV_CheckMismatch( CHECK_PARALLEL_PMOVE );
+				}
+			}
+			else
+			{
+				SV_ReplayPMoveCalls( slot );
+				Q_memcpy( svgame.pmove, &slot->pmove, offsetof( playermove_t, numphysent ));
+				svgame.pmove->cmd = slot->pmove.cmd;
+				svgame.pmove->numtouch = slot->pmove.numtouch;
+				Q_memcpy( svgame.pmove->touchindex, slot->pmove.touchindex, slot->pmove.numtouch * sizeof( pmtrace_t ));
+			}
+			sv_pmovestats.parallel++;
+			moved = true;
+		}
+		else
+		{
+			if( slot->random ) sv_pmovestats.random++;
+			sv_pmovestats.reruns++;
+		}
+	}
+	else sv_pmovestats.serial++;
+
+	if( !moved )
 	{
+		// motor!
+		svgame.dllFuncs.pfnPM_Move( svgame.pmove, true );
+	}
+
+	SV_RunCmdFinish( cl, queued->cmd.msec * 0.001 );
+
+	if( !cl->fakeclient )
 		SV_RestoreMoveInterpolant( cl );
+}
+
+/*
+===========
+SV_RunQueuedCmds
+
+run the usercmds of the frame in rounds, player moves
+of the round run on the workers
+===========
+*/
+void SV_RunQueuedCmds( void )
+{
+	static playermove_t	*input;
+	pmslot_t		*jobs[MAX_CLIENTS];
+	vec3_t		absmin[MAX_CLIENTS];
+	vec3_t		absmax[MAX_CLIENTS];
+	qboolean		taken[MAX_CLIENTS];
+	qboolean		done[PM_MAX_QUEUED];
+	pmqueued_t	*queued;
+	sv_client_t	*cl, *oldplayer;
+	usercmd_t		lastcmd;
+	int		i, j, k, first;
+	int		numslots, numjobs, numboxes;
+	qboolean		near;
+	double		start;
+
+	if( !sv_numqueued )
+		return;
+
+	if( sv_numpmslots != sv_maxclients->integer )
+	{
+		if( sv_pmslots ) Mem_Free( sv_pmslots );
+		sv_numpmslots = sv_maxclients->integer;
+		sv_pmslots = Mem_Alloc( host.mempool, sizeof( pmslot_t ) * sv_numpmslots );
 	}
+
+	if( !input ) input = Mem_Alloc( host.mempool, sizeof( playermove_t ) * MAX_CLIENTS );
+	if( !sv_pminfolock ) sv_pminfolock = Sys_CreateMutex();
+
+	oldplayer = svs.currentPlayer;
+	Q_memset( done, 0, sv_numqueued * sizeof( qboolean ));
+
+	for( first = 0; first < sv_numqueued; )
+	{
+		Q_memset( taken, 0, sizeof( taken ));
+		numslots = numjobs = numboxes = 0;
+		sv_pmovestats.rounds++;
+
+		for( j = first; j < sv_numqueued; j++ )
+		{
+			if( done[j] ) continue;
+
+			queued = &sv_cmdqueue[j];
+			cl = queued->cl;
+			k = cl - svs.clients;
+
+			// later commands of the client wait for the next round
+			if( taken[k] ) continue;
+			taken[k] = true;
+
+			if( cl->state != cs_spawned || !cl->edict )
+			{
+				done[j] = true;
+				continue;
+			}
+
+			// players closer than their pmove boxes keep the queue order
+			for( i = 0; i < 3; i++ )
+			{
+				absmin[numboxes][i] = cl->edict->v.origin[i] - 256.0f;
+				absmax[numboxes][i] = cl->edict->v.origin[i] + 256.0f;
+			}
+
+			for( i = 0, near = false; i < numboxes; i++ )
+			{
+				if( BoundsIntersect( absmin[numboxes], absmax[numboxes], absmin[i], absmax[i] ))
+					near = true;
+			}
+			numboxes++;
+
+			svs.currentPlayer = cl;
+			svs.currentPlayerNum = k;
+			cl->timebase = queued->timebase;
+			lastcmd = cl->lastcmd;
+			cl->lastcmd = queued->lastcmd;
+
+			if( !near )
+			{
+				sv_pmslots[numslots].queued = queued;
+
+				if( SV_PrepareQueuedCmd( &sv_pmslots[numslots] ))
+				{
+					if( sv_pmslots[numslots].parallel )
+					{
+						// the worker changes the pmove of the slot
+						Q_memcpy( &input[numjobs], &sv_pmslots[numslots].pmove, offsetof( playermove_t, numphysent ));
+						input[numjobs].cmd = sv_pmslots[numslots].pmove.cmd;
+						Q_strncpy( input[numjobs].physinfo, sv_pmslots[numslots].pmove.physinfo, MAX_PHYSINFO_STRING );
+						jobs[numjobs++] = &sv_pmslots[numslots];
+					}
+
+					queued->lastcmd = cl->lastcmd;
+					cl->lastcmd = lastcmd;
+					numslots++;
+					done[j] = true;
+					continue;
+				}
+			}
+
+			if( j == first && !numslots )
+			{
+				// first in the queue and nothing was taken, run it as a whole
+				SV_RunCmd( cl, &queued->cmd, queued->random_seed );
+				sv_pmovestats.serial++;
+				done[j] = true;
+			}
+
+			cl->lastcmd = lastcmd;
+			if( done[j] ) break;
+		}
+
+		start = Sys_DoubleTime();
+		Sys_RunJobs( SV_PMoveJob, jobs, numjobs );
+		sv_pmovestats.jobtime += Sys_DoubleTime() - start;
+
+		for( j = numjobs = 0; j < numslots; j++ )
+		{
+			queued = sv_pmslots[j].queued;
+
+			svs.currentPlayer = queued->cl;
+			svs.currentPlayerNum = queued->cl - svs.clients;
+			lastcmd = queued->cl->lastcmd;
+			queued->cl->lastcmd = queued->lastcmd;
+
+			SV_FinishQueuedCmd( &sv_pmslots[j], sv_pmslots[j].parallel ? &input[numjobs++] : NULL );
+			queued->cl->lastcmd = lastcmd;
+		}
+
+		while( first < sv_numqueued && done[first] )
+			first++;
+	}
+
+	svs.currentPlayer = oldplayer;
+	if( oldplayer ) svs.currentPlayerNum = oldplayer - svs.clients;
+	sv_numqueued = 0;
+}
+
+/*
+===========
+SV_PMoveStats_f
+
+===========
+*/
+void SV_PMoveStats_f( void )
+{
+	pmovecounts_t	*t = &sv_pmovestats;
+	int		total = max( t->parallel + t->serial + t->reruns, 1 );
+
+	Msg( "%i commands in %i rounds: %i moved on workers (%.1f%%), %i in order, %i moved again, %i unsafe, %.2f ms in jobs\n",
+		t->parallel + t->serial + t->reruns, t->rounds, t->parallel, t->parallel * 100.0f / total, t->serial,
+		t->reruns, t->unsafe, t->jobtime * 1000.0 );
+	Msg( "%i worker moves thrown away for random numbers (%.1f%%), step sounds of the game dll draw them\n",
+		t->random, t->random * 100.0f / total );
+	SV_PrintMismatches( CHECK_PARALLEL_PMOVE );
+
+	Q_memset( t, 0, sizeof( *t ));
 }
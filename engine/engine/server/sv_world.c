@@ -30,6 +30,8 @@ typedef struct moveclip_s
 	trace_t		trace;
 	int		type;		// move type
 	int		flags;		// trace flags
+	vec3_t		trace_endpos;	// where the world trace has stopped
+	float		trace_fraction;
 } moveclip_t;
 
 /*
@@ -365,6 +367,84 @@ static int	iTouchLinkSemaphore = 0;	// prevent recursion when SV_TouchLinks is a
 areanode_t	sv_areanodes[AREA_NODES];
 static int	sv_numareanodes;
 
+typedef struct
+{
+	vec3_t		mins, maxs;	// node bounds
+	int		depth;
+	int		splitcount;	// leaf failed to split, wait for more links
+	qboolean		queued;
+} areainfo_t;
+
+static areainfo_t	sv_areainfo[AREA_NODES];
+static areanode_t	*sv_areaqueue[AREA_NODES];	// leafs to split at the next frame
+static int	sv_numareaqueue;
+static int	sv_areasplit_limit;		// links per leaf before split, 0 is fixed tree
+static double	sv_areacheck_time;		// next check for the emptied split leafs
+
+#define AREA_CHECK_TIME	10.0	// seconds between the checks
+
+static struct
+{
+	qboolean		counting;		// SV_TraceBench_f wants numtraces and numcandidates
+	int		numtraces;
+	int		numcandidates;	// links examined by SV_ClipToLinks
+	int		numsplits;
+	int		numrebuilds;	// split leafs were emptied
+	int		maxdepth;
+} sv_areastats;
+
+// what kind of traces can see the linked edict
+#define LINK_NONE		0
+#define LINK_MONSTER	1	// skipped by MOVE_NOMONSTERS
+#define LINK_WORLD		2	// brushes, custom bodies and pushables
+
+typedef struct
+{
+	vec3_t		start;
+	vec3_t		end;
+	vec3_t		mins;
+	vec3_t		maxs;
+	int		type;
+	int		passent;
+	int		traceflags;
+	int		generation;	// must be last, see SV_CachedMove
+} tracekey_t;
+
+typedef struct
+{
+	tracekey_t	key;
+	int		framenum;
+	trace_t		trace;
+} tracecache_t;
+
+static int	sv_linkgeneration[3];	// changed by any solid edict or by LINK_WORLD ones
+static int	sv_traceframe;		// cache entries from other frames are free
+static tracecache_t	sv_tracecache_table[TRACE_CACHE_SIZE];
+
+static struct
+{
+	int		hits;
+	int		misses;
+	int		stale;		// same trace, something moved since
+} sv_tracestats;
+
+typedef struct
+{
+	int		full;		// leafs searched in the BSP
+	int		leafskips;	// leafs reused from the previous link
+	int		areaskips;	// area link was kept in place
+} linkcounts_t;
+
+static struct
+{
+	linkcounts_t	frame;		// current frame
+	linkcounts_t	last;		// previous frame
+	linkcounts_t	total;
+	int		numframes;
+} sv_linkstats;
+
+static void SV_ClearSphereGrid( void );
+
 /*
 ===============
 SV_CreateAreaNode
@@ -375,17 +455,24 @@ builds a uniformly subdivided tree for the given world size
 areanode_t *SV_CreateAreaNode( int depth, vec3_t mins, vec3_t maxs )
 {
 	areanode_t	*anode;
+	areainfo_t	*info;
 	vec3_t		size;
 	vec3_t		mins1, maxs1;
 	vec3_t		mins2, maxs2;
 
+	info = &sv_areainfo[sv_numareanodes];
 	anode = &sv_areanodes[sv_numareanodes++];
 
 	ClearLink( &anode->trigger_edicts );
 	ClearLink( &anode->solid_edicts );
 	ClearLink( &anode->water_edicts );
+
+	VectorCopy( mins, info->mins );
+	VectorCopy( maxs, info->maxs );
+	info->depth = depth;
+	sv_areastats.maxdepth = max( sv_areastats.maxdepth, depth );
 	
-	if( depth == AREA_DEPTH )
+	if( depth >= AREA_DEPTH )
 	{
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
@@ -410,6 +497,356 @@ areanode_t *SV_CreateAreaNode( int depth, vec3_t mins, vec3_t maxs )
 	return anode;
 }
 
+_inline link_t *SV_AreaNodeList( areanode_t *node, int list )
+{
+	switch( list )
+	{
+	case 0: return &node->solid_edicts;
+	case 1: return &node->trigger_edicts;
+	default: return &node->water_edicts;
+	}
+}
+
+/*
+===============
+SV_CountAreaLinks
+
+count edicts linked to the node, stop at limit
+===============
+*/
+static int SV_CountAreaLinks( areanode_t *node, int limit )
+{
+	link_t	*head, *l;
+	int	i, count = 0;
+
+	for( i = 0; i < 3; i++ )
+	{
+		head = SV_AreaNodeList( node, i );
+
+		for( l = head->next; l != head && count < limit; l = l->next )
+			count++;
+	}
+
+	return count;
+}
+
+/*
+===============
+SV_CheckAreaNode
+
+queue the crowded leaf for split, the lists can't be
+changed here because they may be walked by the caller
+===============
+*/
+static void SV_CheckAreaNode( areanode_t *node )
+{
+	areainfo_t	*info = &sv_areainfo[node - sv_areanodes];
+	int		limit;
+
+	if( sv_areasplit_limit <= 0 || node->axis != -1 || info->queued )
+		return;
+
+	if( info->depth >= AREA_MAX_DEPTH || sv_numareanodes + 2 > AREA_NODES )
+		return;
+
+	limit = max( sv_areasplit_limit, info->splitcount );
+
+	if( SV_CountAreaLinks( node, limit + 1 ) > limit )
+	{
+		sv_areaqueue[sv_numareaqueue++] = node;
+		info->queued = true;
+	}
+}
+
+/*
+===============
+SV_SplitAreaNode
+
+split the leaf at the mean of linked edicts along the axis
+with the largest spread, so the tree follows entity clusters
+===============
+*/
+static void SV_SplitAreaNode( areanode_t *node )
+{
+	areainfo_t	*info = &sv_areainfo[node - sv_areanodes];
+	double		sum[3], sum2[3], spread, best;
+	int		i, j, axis, count, movable;
+	link_t		*head, *l, *next;
+	vec3_t		mins, maxs;
+	areanode_t	*child;
+	edict_t		*ent;
+	float		dist, center;
+
+	if( sv_numareanodes + 2 > AREA_NODES )
+		return;
+
+	VectorClear( sum );
+	VectorClear( sum2 );
+	count = 0;
+
+	for( i = 0; i < 3; i++ )
+	{
+		head = SV_AreaNodeList( node, i );
+
+		for( l = head->next; l != head; l = l->next )
+		{
+			ent = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+
+			for( j = 0; j < 3; j++ )
+			{
+				center = 0.5f * ( ent->v.absmin[j] + ent->v.absmax[j] );
+				sum[j] += center;
+				sum2[j] += center * center;
+			}
+			count++;
+		}
+	}
+
+	if( count < 2 ) return;
+
+	for( j = 0, axis = -1, best = 0.0; j < 3; j++ )
+	{
+		// node is too small to be split along this axis
+		if( info->maxs[j] - info->mins[j] < AREA_MIN_SIZE * 2 )
+			continue;
+
+		spread = sum2[j] / count - ( sum[j] / count ) * ( sum[j] / count );
+		if( axis == -1 || spread > best )
+		{
+			best = spread;
+			axis = j;
+		}
+	}
+
+	if( axis == -1 )
+	{
+		info->splitcount = count * 2;
+		return;
+	}
+
+	dist = sum[axis] / count;
+	dist = bound( info->mins[axis] + AREA_MIN_SIZE, dist, info->maxs[axis] - AREA_MIN_SIZE );
+
+	// edicts that cross the plane would stay at this node
+	for( i = 0, movable = 0; i < 3; i++ )
+	{
+		head = SV_AreaNodeList( node, i );
+
+		for( l = head->next; l != head; l = l->next )
+		{
+			ent = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+			if( ent->v.absmin[axis] > dist || ent->v.absmax[axis] < dist )
+				movable++;
+		}
+	}
+
+	if( movable < count / 2 )
+	{
+		info->splitcount = count * 2;
+		return;
+	}
+
+	node->axis = axis;
+	node->dist = dist;
+
+	// leafs are below the uniform tree depth
+	VectorCopy( info->mins, mins );
+	VectorCopy( info->maxs, maxs );
+	mins[axis] = dist;
+	node->children[0] = SV_CreateAreaNode( info->depth + 1, mins, maxs );
+
+	VectorCopy( info->mins, mins );
+	maxs[axis] = dist;
+	node->children[1] = SV_CreateAreaNode( info->depth + 1, mins, maxs );
+
+	for( i = 0; i < 3; i++ )
+	{
+		head = SV_AreaNodeList( node, i );
+
+		for( l = head->next; l != head; l = next )
+		{
+			next = l->next;
+			ent = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+
+			if( ent->v.absmin[axis] > dist )
+				child = node->children[0];
+			else if( ent->v.absmax[axis] < dist )
+				child = node->children[1];
+			else continue;
+
+			RemoveLink( l );
+			InsertLinkBefore( l, SV_AreaNodeList( child, i ));
+		}
+	}
+
+	sv_areastats.numsplits++;
+
+	SV_CheckAreaNode( node->children[0] );
+	SV_CheckAreaNode( node->children[1] );
+}
+
+/*
+===============
+SV_LinkAreaNode
+
+link edict to the first node that the box crosses
+===============
+*/
+static link_t *SV_AreaListForEdict( edict_t *ent, areanode_t **out )
+{
+	areanode_t	*node = sv_areanodes;
+
+	while( 1 )
+	{
+		if( node->axis == -1 ) break;
+		if( ent->v.absmin[node->axis] > node->dist )
+			node = node->children[0];
+		else if( ent->v.absmax[node->axis] < node->dist )
+			node = node->children[1];
+		else break; // crosses the node
+	}
+
+	*out = node;
+
+	if( ent->v.solid == SOLID_TRIGGER )
+		return &node->trigger_edicts;
+	else if( ent->v.solid == SOLID_NOT && ent->v.skin < CONTENTS_EMPTY )
+		return &node->water_edicts;
+	return &node->solid_edicts;
+}
+
+static void SV_LinkAreaNode( edict_t *ent )
+{
+	areanode_t	*node;
+	link_t		*list;
+
+	// link it in	
+	list = SV_AreaListForEdict( ent, &node );
+	InsertLinkBefore( &ent->area, list );
+
+	if( node->axis == -1 )
+		SV_CheckAreaNode( node );
+}
+
+/*
+===============
+SV_SplitQueuedNodes
+
+===============
+*/
+static void SV_SplitQueuedNodes( void )
+{
+	areanode_t	*node;
+
+	// split may queue the children again
+	while( sv_numareaqueue > 0 )
+	{
+		node = sv_areaqueue[--sv_numareaqueue];
+		sv_areainfo[node - sv_areanodes].queued = false;
+
+		if( node->axis == -1 && sv_areasplit_limit > 0 )
+			SV_SplitAreaNode( node );
+	}
+}
+
+/*
+===============
+SV_RebuildAreaNodes
+
+reset the tree and link all the edicts again
+===============
+*/
+static void SV_RebuildAreaNodes( int splitlimit )
+{
+	edict_t	*ent;
+	int	i;
+
+	Q_memset( sv_areanodes, 0, sizeof( sv_areanodes ));
+	Q_memset( sv_areainfo, 0, sizeof( sv_areainfo ));
+	sv_numareanodes = 0;
+	sv_numareaqueue = 0;
+	sv_areastats.maxdepth = 0;
+	sv_areasplit_limit = splitlimit;
+
+	SV_CreateAreaNode( 0, sv.worldmodel->mins, sv.worldmodel->maxs );
+
+	for( i = 1; i < svgame.numEntities; i++ )
+	{
+		ent = EDICT_NUM( i );
+
+		// lists were cleared, link edicts that were in
+		if( !ent->area.prev ) continue;
+
+		ent->area.prev = ent->area.next = NULL;
+		SV_LinkAreaNode( ent );
+	}
+
+	SV_SplitQueuedNodes();
+}
+
+/*
+===============
+SV_AreaNodesEmptied
+
+leafs are never merged back, so the split part of the tree
+only grows. It's worth a rebuild when the split nodes hold
+a lot fewer links than they were split for
+===============
+*/
+static qboolean SV_AreaNodesEmptied( void )
+{
+	int	i, numsplit, count;
+
+	for( i = numsplit = count = 0; i < sv_numareanodes; i++ )
+	{
+		// uniform tree is never rebuilt
+		if( sv_areainfo[i].depth <= AREA_DEPTH )
+			continue;
+
+		count += SV_CountAreaLinks( &sv_areanodes[i], sv_areasplit_limit );
+		numsplit++;
+	}
+
+	// each split leaves about a half of the limit in a child
+	return ( numsplit > 0 && count * 4 < numsplit * sv_areasplit_limit );
+}
+
+/*
+===============
+SV_UpdateAreaNodes
+
+split crowded leafs, called once per frame
+when no one walks the lists
+===============
+*/
+void SV_UpdateAreaNodes( void )
+{
+	if( sv_areasplit->modified )
+	{
+		sv_areasplit->modified = false;
+
+		if( sv_areasplit->integer != sv_areasplit_limit )
+		{
+			SV_RebuildAreaNodes( sv_areasplit->integer );
+			return;
+		}
+	}
+
+	if( sv_areasplit_limit > 0 && sv.time >= sv_areacheck_time )
+	{
+		sv_areacheck_time = sv.time + AREA_CHECK_TIME;
+
+		if( SV_AreaNodesEmptied( ))
+		{
+			sv_areastats.numrebuilds++;
+			SV_RebuildAreaNodes( sv_areasplit_limit );
+			return;
+		}
+	}
+
+	SV_SplitQueuedNodes();
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -430,8 +867,25 @@ void SV_ClearWorld( void )
 	}
 
 	Q_memset( sv_areanodes, 0, sizeof( sv_areanodes ));
+	Q_memset( sv_areainfo, 0, sizeof( sv_areainfo ));
+	Q_memset( &sv_areastats, 0, sizeof( sv_areastats ));
+	Q_memset( svgame.linkstate, 0, sizeof( sv_linkstate_t ) * svgame.globals->maxEntities );
+	Q_memset( svgame.leafcache, 0, sizeof( sv_leafcache_t ) * svgame.globals->maxEntities );
+	Q_memset( svgame.gridlinks, 0, sizeof( sv_gridlink_t ) * svgame.globals->maxEntities );
+	Q_memset( svgame.stringlinks, 0, sizeof( sv_stringlink_t ) * svgame.globals->maxEntities );
+	Q_memset( svgame.physlinks, 0, sizeof( sv_physlink_t ) * svgame.globals->maxEntities );
+	Q_memset( svgame.sleepstate, 0, sizeof( sv_sleepstate_t ) * svgame.globals->maxEntities );
+	SV_ClearSphereGrid();
+	SV_ClearStringIndex();
+	SV_NewPhysEntFrame();
+	SV_ClearUnlagHistory();
+	sv_traceframe++;
 	iTouchLinkSemaphore = 0;
 	sv_numareanodes = 0;
+	sv_numareaqueue = 0;
+	sv_areasplit_limit = sv_areasplit->integer;
+	sv_areasplit->modified = false;
+	sv_areacheck_time = 0.0;
 
 	SV_CreateAreaNode( 0, sv.worldmodel->mins, sv.worldmodel->maxs );
 }
@@ -441,14 +895,60 @@ void SV_ClearWorld( void )
 SV_UnlinkEdict
 ===============
 */
+static void SV_RemoveAreaLink( edict_t *ent )
+{
+	RemoveLink( &ent->area );
+	ent->area.prev = NULL;
+	ent->area.next = NULL;
+}
+
+/*
+===============
+SV_CheckLinkState
+
+bump the link generation when the edict became visible or
+invisible to traces or moved while visible
+===============
+*/
+static void SV_CheckLinkState( edict_t *ent )
+{
+	sv_linkstate_t	*state = &svgame.linkstate[NUM_FOR_EDICT( ent )];
+	int		linkclass = LINK_NONE;
+
+	if( ent->area.prev && ent->v.solid != SOLID_NOT && ent->v.solid != SOLID_TRIGGER )
+	{
+		if( ent->v.solid == SOLID_BSP || ent->v.solid == SOLID_CUSTOM || ent->v.movetype == MOVETYPE_PUSHSTEP )
+			linkclass = LINK_WORLD;
+		else linkclass = LINK_MONSTER;
+	}
+
+	if( linkclass == LINK_NONE && state->linkclass == LINK_NONE )
+		return;
+
+	if( linkclass == state->linkclass && state->modelindex == ent->v.modelindex && VectorCompare( state->absmin, ent->v.absmin )
+	&& VectorCompare( state->absmax, ent->v.absmax ) && VectorCompare( state->angles, ent->v.angles ))
+		return;
+
+	sv_linkgeneration[LINK_MONSTER]++;
+	if( linkclass == LINK_WORLD || state->linkclass == LINK_WORLD )
+		sv_linkgeneration[LINK_WORLD]++;
+
+	VectorCopy( ent->v.absmin, state->absmin );
+	VectorCopy( ent->v.absmax, state->absmax );
+	VectorCopy( ent->v.angles, state->angles );
+	state->modelindex = ent->v.modelindex;
+	state->linkclass = linkclass;
+}
+
 void SV_UnlinkEdict( edict_t *ent )
 {
+	SV_DirtyPhysEnt( ent );
+
 	// not linked in anywhere
 	if( !ent->area.prev ) return;
 
-	RemoveLink( &ent->area );
-	ent->area.prev = NULL;
-	ent->area.next = NULL;
+	SV_RemoveAreaLink( ent );
+	SV_CheckLinkState( ent );
 }
 
 /*
@@ -590,11 +1090,15 @@ SV_HeadnodeVisible
 */
 qboolean SV_HeadnodeVisible( mnode_t *node, byte *visbits, int *lastleaf )
 {
-	int	leafnum;
+	int	leafnum, result;
 
 	if( !node || node->contents == CONTENTS_SOLID )
 		return false;
 
+	// test whole subtree by leaf range if we have one
+	if(( result = Mod_HeadnodeVisible( node, visbits, lastleaf )) != -1 )
+		return result;
+
 	if( node->contents < 0 )
 	{
 		leafnum = ((mleaf_t *)node - sv.worldmodel->leafs) - 1;
@@ -615,68 +1119,121 @@ qboolean SV_HeadnodeVisible( mnode_t *node, byte *visbits, int *lastleaf )
 
 /*
 ===============
-SV_LinkEdict
+SV_FindEdictLeafs
+
+reuse the leafs from previous link if the box is the same
 ===============
 */
-void SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
+static void SV_FindEdictLeafs( edict_t *ent )
 {
-	areanode_t	*node;
+	sv_leafcache_t	*state = &svgame.leafcache[NUM_FOR_EDICT( ent )];
 	int		headnode;
 
-	if( ent->area.prev ) SV_UnlinkEdict( ent );	// unlink from old position
-	if( ent == svgame.edicts ) return;		// don't add the world
-	if( !SV_IsValidEdict( ent )) return;		// never add freed ents
-
-	// set the abs box
-	svgame.dllFuncs.pfnSetAbsBox( ent );
-
-	if( ent->v.movetype == MOVETYPE_FOLLOW && SV_IsValidEdict( ent->v.aiment ))
+	if( sv_linkcache->integer && state->leafvalid && ( ent->v.modelindex != 0 ) == ( state->leafcount != -1 )
+	&& ent->headnode == state->leafheadnode && ( ent->headnode >= 0 || ent->num_leafs == state->leafcount )
+	&& VectorCompare( ent->v.absmin, state->leafmin ) && VectorCompare( ent->v.absmax, state->leafmax ))
 	{
-		ent->headnode = ent->v.aiment->headnode;
-		ent->num_leafs = ent->v.aiment->num_leafs;
-		Q_memcpy( ent->leafnums, ent->v.aiment->leafnums, sizeof( ent->leafnums ));
+		sv_linkstats.frame.leafskips++;
+		return;
 	}
-	else
-	{
-		// link to PVS leafs
-		ent->num_leafs = 0;
-		ent->headnode = -1;
-		headnode = -1;
 
-		if( ent->v.modelindex )
-			SV_FindTouchedLeafs( ent, sv.worldmodel->nodes, &headnode );
+	// link to PVS leafs
+	ent->num_leafs = 0;
+	ent->headnode = -1;
+	headnode = -1;
 
-		if( ent->num_leafs > MAX_ENT_LEAFS )
-		{
-			Q_memset( ent->leafnums, -1, sizeof( ent->leafnums ));
-			ent->num_leafs = 0;	// so we use headnode instead
-			ent->headnode = headnode;
-		}
+	if( ent->v.modelindex )
+		SV_FindTouchedLeafs( ent, sv.worldmodel->nodes, &headnode );
+
+	if( ent->num_leafs > MAX_ENT_LEAFS )
+	{
+		Q_memset( ent->leafnums, -1, sizeof( ent->leafnums ));
+		ent->num_leafs = 0;	// so we use headnode instead
+		ent->headnode = headnode;
 	}
 
-	// ignore non-solid bodies
-	if( ent->v.solid == SOLID_NOT && ent->v.skin >= CONTENTS_EMPTY )
-		return;
+	// headnode edicts keep visible leafs in leafnums, see pfnCheckVisibility
+	VectorCopy( ent->v.absmin, state->leafmin );
+	VectorCopy( ent->v.absmax, state->leafmax );
+	state->leafheadnode = ent->headnode;
+	state->leafcount = ent->v.modelindex ? ent->num_leafs : -1;
+	state->leafvalid = true;
 
-	// find the first node that the ent's box crosses
-	node = sv_areanodes;
+	sv_linkstats.frame.full++;
+}
 
-	while( 1 )
+/*
+===============
+SV_LinkEdict
+===============
+*/
+void SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
+{
+	areanode_t	*node;
+	link_t		*list;
+
+	if( ent == svgame.edicts )
 	{
-		if( node->axis == -1 ) break;
-		if( ent->v.absmin[node->axis] > node->dist )
-			node = node->children[0];
-		else if( ent->v.absmax[node->axis] < node->dist )
-			node = node->children[1];
-		else break; // crosses the node
+		// don't add the world
+		if( ent->area.prev ) SV_RemoveAreaLink( ent );
+		return;
 	}
-	
-	// link it in	
-	if( ent->v.solid == SOLID_TRIGGER )
-		InsertLinkBefore( &ent->area, &node->trigger_edicts );
-	else if( ent->v.solid == SOLID_NOT && ent->v.skin < CONTENTS_EMPTY )
-		InsertLinkBefore( &ent->area, &node->water_edicts );
-	else InsertLinkBefore( &ent->area, &node->solid_edicts );
+
+	SV_DirtyPhysEnt( ent );
+	SV_WakeEdict( ent );
+
+	// pusher gathers its candidates again when touch callbacks move something
+	if( ent != svgame.pushcheck ) svgame.pushrelinks++;
+
+	if( !SV_IsValidEdict( ent ))
+	{
+		// never add freed ents
+		if( ent->area.prev ) SV_RemoveAreaLink( ent );
+		SV_UnlinkSphereGrid( ent );
+		SV_CheckLinkState( ent );
+		return;
+	}
+
+	// set the abs box
+	svgame.dllFuncs.pfnSetAbsBox( ent );
+	SV_LinkSphereGrid( ent );
+	SV_SyncEdictStrings( ent );
+
+	if( ent->v.movetype == MOVETYPE_FOLLOW && SV_IsValidEdict( ent->v.aiment ))
+	{
+		ent->headnode = ent->v.aiment->headnode;
+		ent->num_leafs = ent->v.aiment->num_leafs;
+		Q_memcpy( ent->leafnums, ent->v.aiment->leafnums, sizeof( ent->leafnums ));
+		svgame.leafcache[NUM_FOR_EDICT( ent )].leafvalid = false;
+	}
+	else SV_FindEdictLeafs( ent );
+
+	// ignore non-solid bodies
+	if( ent->v.solid == SOLID_NOT && ent->v.skin >= CONTENTS_EMPTY )
+	{
+		if( ent->area.prev ) SV_RemoveAreaLink( ent );
+		SV_CheckLinkState( ent );
+		return;
+	}
+
+	// find the first node that the ent's box crosses
+	list = SV_AreaListForEdict( ent, &node );
+
+	// relink would put it back to the same place (lists are appended)
+	if( sv_linkcache->integer && ent->area.prev && ent->area.next == list )
+	{
+		sv_linkstats.frame.areaskips++;
+	}
+	else
+	{
+		if( ent->area.prev ) SV_RemoveAreaLink( ent );	// unlink from old position
+		InsertLinkBefore( &ent->area, list );
+
+		if( node->axis == -1 )
+			SV_CheckAreaNode( node );
+	}
+
+	SV_CheckLinkState( ent );
 
 	if( touch_triggers && !iTouchLinkSemaphore )
 	{
@@ -845,17 +1402,6 @@ LINE TESTING IN HULLS
 ===============================================================================
 */
 
-/* "Not a number" possible here.
- * Enable this macro to debug it */
-#ifdef DEBUGNAN
-static void _assertNAN(const char *f, int l, const char *x)
-{
-	MsgDev( D_WARN, "NAN detected at %s:%i (%s)\n", f, l, x );
-}
-#define ASSERTNAN(x) if( !finitef(x) ) _assertNAN( __FILE__, __LINE__, #x );
-#else
-#define ASSERTNAN(x)
-#endif
 /*
 ==================
 SV_RecursiveHullCheck
@@ -864,124 +1410,17 @@ SV_RecursiveHullCheck
 */
 qboolean SV_RecursiveHullCheck( hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace )
 {
-	dclipnode_t	*node;
-	mplane_t		*plane;
-	float		t1, t2;
-	float		frac, midf;
-	int		side;
-	vec3_t		mid;
-
-	// check for empty
-	if( num < 0 )
-	{
-		if( num != CONTENTS_SOLID )
-		{
-			trace->allsolid = false;
-			if( num == CONTENTS_EMPTY )
-				trace->inopen = true;
-			else trace->inwater = true;
-		}
-		else trace->startsolid = true;
+	hulltrace_t	ht;
+	qboolean		result;
 
-		return true; // empty
-	}
-
-	if( num < hull->firstclipnode || num > hull->lastclipnode )
-		Host_Error( "SV_RecursiveHullCheck: bad node number\n" );
-
-	if( !hull->clipnodes )
-		return false;
-	// find the point distances
-	node = hull->clipnodes + num;
-	plane = hull->planes + node->planenum;
-
-	if( plane->type < 3 )
-	{
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-	}
-	else
-	{
-		t1 = DotProduct( plane->normal, p1 ) - plane->dist;
-		t2 = DotProduct( plane->normal, p2 ) - plane->dist;
-	}
-
-	ASSERTNAN( t1 )
-	ASSERTNAN( t2 )
-	
-	if( t1 >= 0 && t2 >= 0 )
-		return SV_RecursiveHullCheck( hull, node->children[0], p1f, p2f, p1, p2, trace );
-	if( t1 < 0 && t2 < 0 )
-		return SV_RecursiveHullCheck( hull, node->children[1], p1f, p2f, p1, p2, trace );
-
-	ASSERTNAN( t1 )
-	ASSERTNAN( t2 )
-
-	// put the crosspoint DIST_EPSILON pixels on the near side
-	if( t1 < 0 ) frac = ( t1 + DIST_EPSILON ) / ( t1 - t2 );
-	else frac = ( t1 - DIST_EPSILON ) / ( t1 - t2 );
-
-	ASSERTNAN( frac )
-
-	if( frac < 0.0f ) frac = 0.0f;
-	if( frac > 1.0f ) frac = 1.0f;
-		
-	midf = p1f + ( p2f - p1f ) * frac;
-	VectorLerp( p1, frac, p2, mid );
-
-	side = (t1 < 0);
-
-	ASSERTNAN( frac )
-
-	// move up to the node
-	if( !SV_RecursiveHullCheck( hull, node->children[side], p1f, midf, p1, mid, trace ))
+	if( num >= 0 && !hull->clipnodes )
 		return false;
 
-	if( PM_HullPointContents( hull, node->children[side^1], mid ) != CONTENTS_SOLID )
-	{
-		// go past the node
-		return SV_RecursiveHullCheck (hull, node->children[side^1], midf, p2f, mid, p2, trace);
-	}	
-
-	if( trace->allsolid )
-		return false; // never got out of the solid area
-		
-	//==================
-	// the other side of the node is solid, this is the impact point
-	//==================
-	if( !side )
-	{
-		VectorCopy( plane->normal, trace->plane.normal );
-		trace->plane.dist = plane->dist;
-	}
-	else
-	{
-		VectorNegate( plane->normal, trace->plane.normal );
-		trace->plane.dist = -plane->dist;
-	}
-
-	while( PM_HullPointContents( hull, hull->firstclipnode, mid ) == CONTENTS_SOLID )
-	{
-		ASSERTNAN( frac )
-		// shouldn't really happen, but does occasionally
-		frac -= 0.1f;
-
-		if( ( frac < 0.0f ) || IS_NAN( frac ) )
-		{
-			trace->fraction = midf;
-			VectorCopy( mid, trace->endpos );
-			MsgDev( D_WARN, "trace backed up past 0.0\n" );
-			return false;
-		}
-
-		midf = p1f + (p2f - p1f) * frac;
-		VectorLerp( p1, frac, p2, mid );
-	}
-
-	trace->fraction = midf;
-	VectorCopy( mid, trace->endpos );
+	HULLTRACE_LOAD( &ht, trace );
+	result = PM_HullTrace( hull, Mod_PackedHull( hull ), num, p1f, p2f, p1, p2, &ht );
+	HULLTRACE_STORE( &ht, trace );
 
-	return false;
+	return result;
 }
 
 /*
@@ -1078,10 +1517,17 @@ void SV_ClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t
 	}
 	else
 	{
+		byte	hitmask[MAXSTUDIOBONES];
+
 		last_hitgroup = 0;
+		Mod_StudioHitboxMask( start_l, end_l, hullcount, hitmask );
 
 		for( i = 0; i < hullcount; i++ )
 		{
+			// segment can't reach it, first hitbox always sets the initial trace
+			if( i > 0 && !hitmask[i] )
+				continue;
+
 			Q_memset( &trace_hitbox, 0, sizeof( trace_t ));
 			VectorCopy( end, trace_hitbox.endpos );
 			trace_hitbox.fraction = 1.0;
@@ -1155,107 +1601,131 @@ void SV_CustomClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, v
 
 /*
 ====================
-SV_ClipToLinks
+SV_ClipToEntity
 
-Mins and maxs enclose the entire area swept by the move
+returns false if trace is allsolid and there is nothing to clip
 ====================
 */
-static void SV_ClipToLinks( areanode_t *node, moveclip_t *clip )
+static qboolean SV_ClipToEntity( edict_t *touch, moveclip_t *clip )
 {
-	link_t	*l, *next;
-	edict_t	*touch;
 	trace_t	trace;
 
-	// touch linked edicts
-	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = next )
+	if( touch->v.groupinfo != 0 && SV_IsValidEdict( clip->passedict ) && clip->passedict->v.groupinfo != 0 )
 	{
-		next = l->next;
+		if(( svs.groupop == 0 && ( touch->v.groupinfo & clip->passedict->v.groupinfo ) == 0) ||
+		( svs.groupop == 1 && (touch->v.groupinfo & clip->passedict->v.groupinfo ) != 0 ))
+			return true;
+	}
 
-		touch = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+	if( touch == clip->passedict || touch->v.solid == SOLID_NOT )
+		return true;
 
-		if( touch->v.groupinfo != 0 && SV_IsValidEdict( clip->passedict ) && clip->passedict->v.groupinfo != 0 )
-		{
-			if(( svs.groupop == 0 && ( touch->v.groupinfo & clip->passedict->v.groupinfo ) == 0) ||
-			( svs.groupop == 1 && (touch->v.groupinfo & clip->passedict->v.groupinfo ) != 0 ))
-				continue;
-		}
+	if( touch->v.solid == SOLID_TRIGGER )
+	{
+		Host_MapDesignError( "trigger in clipping list\n" );
+		touch->v.solid = SOLID_NOT;
+	}
 
-		if( touch == clip->passedict || touch->v.solid == SOLID_NOT )
-			continue;
+	// custom user filter
+	if( svgame.dllFuncs2.pfnShouldCollide )
+	{
+		if( !svgame.dllFuncs2.pfnShouldCollide( touch, clip->passedict ))
+			return true;	// originally this was 'return' but is completely wrong!
+	}
 
-		if( touch->v.solid == SOLID_TRIGGER )
+	// monsterclip filter (solid custom is a static or dynamic bodies)
+	if( touch->v.solid == SOLID_BSP || touch->v.solid == SOLID_CUSTOM )
+	{
+		if( touch->v.flags & FL_MONSTERCLIP )
 		{
-			Host_MapDesignError( "trigger in clipping list\n" );
-			touch->v.solid = SOLID_NOT;
+			// func_monsterclip works only with monsters that have same flag!
+			if( !SV_IsValidEdict( clip->passedict ) || !( clip->passedict->v.flags & FL_MONSTERCLIP ))
+				return true;
 		}
+	}
+	else
+	{
+		// ignore all monsters but pushables
+		if( clip->type == MOVE_NOMONSTERS && touch->v.movetype != MOVETYPE_PUSHSTEP )
+			return true;
+	}
 
-		// custom user filter
-		if( svgame.dllFuncs2.pfnShouldCollide )
-		{
-			if( !svgame.dllFuncs2.pfnShouldCollide( touch, clip->passedict ))
-				continue;	// originally this was 'return' but is completely wrong!
-		}
+	if( Mod_GetType( touch->v.modelindex ) == mod_brush && clip->flags & FMOVE_IGNORE_GLASS )
+	{
+		// we ignore brushes with rendermode != kRenderNormal and without FL_WORLDBRUSH set
+		if( touch->v.rendermode != kRenderNormal && !( touch->v.flags & FL_WORLDBRUSH ))
+			return true;
+	}
 
-		// monsterclip filter (solid custom is a static or dynamic bodies)
-		if( touch->v.solid == SOLID_BSP || touch->v.solid == SOLID_CUSTOM )
-		{
-			if( touch->v.flags & FL_MONSTERCLIP )
-			{
-				// func_monsterclip works only with monsters that have same flag!
-				if( !SV_IsValidEdict( clip->passedict ) || !( clip->passedict->v.flags & FL_MONSTERCLIP ))
-					continue;
-			}
-		}
-		else
-		{
-			// ignore all monsters but pushables
-			if( clip->type == MOVE_NOMONSTERS && touch->v.movetype != MOVETYPE_PUSHSTEP )
-				continue;
-		}
+	if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, touch->v.absmin, touch->v.absmax ))
+		return true;
 
-		if( Mod_GetType( touch->v.modelindex ) == mod_brush && clip->flags & FMOVE_IGNORE_GLASS )
-		{
-			// we ignore brushes with rendermode != kRenderNormal and without FL_WORLDBRUSH set
-			if( touch->v.rendermode != kRenderNormal && !( touch->v.flags & FL_WORLDBRUSH ))
-				continue;
-		}
+	// Xash3D extension
+	if( SV_IsValidEdict( clip->passedict ) && clip->passedict->v.solid == SOLID_TRIGGER )
+	{
+		// never collide items and player (because call "give" always stuck item in player
+		// and total trace returns fail (old half-life bug)
+		// items touch should be done in SV_TouchLinks not here
+		if( touch->v.flags & ( FL_CLIENT|FL_FAKECLIENT ))
+			return true;
+	}
 
-		if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, touch->v.absmin, touch->v.absmax ))
-			continue;
+	// g-cont. make sure what size is really zero - check all the components
+	if( SV_IsValidEdict( clip->passedict ) && !VectorIsNull( clip->passedict->v.size ) && VectorIsNull( touch->v.size ))
+		return true;	// points never interact
 
-		// Xash3D extension
-		if( SV_IsValidEdict( clip->passedict ) && clip->passedict->v.solid == SOLID_TRIGGER )
-		{
-			// never collide items and player (because call "give" always stuck item in player
-			// and total trace returns fail (old half-life bug)
-			// items touch should be done in SV_TouchLinks not here
-			if( touch->v.flags & ( FL_CLIENT|FL_FAKECLIENT ))
-				continue;
-		}
+	// might intersect, so do an exact clip
+	if( clip->trace.allsolid ) return false;
 
-		// g-cont. make sure what size is really zero - check all the components
-		if( SV_IsValidEdict( clip->passedict ) && !VectorIsNull( clip->passedict->v.size ) && VectorIsNull( touch->v.size ))
-			continue;	// points never interact
+	if( SV_IsValidEdict( clip->passedict ))
+	{
+	 	if( touch->v.owner == clip->passedict )
+			return true;	// don't clip against own missiles
+		if( clip->passedict->v.owner == touch )
+			return true;	// don't clip against owner
+	}
 
-		// might intersect, so do an exact clip
-		if( clip->trace.allsolid ) return;
+	if( touch->v.solid == SOLID_CUSTOM )
+		SV_CustomClipMoveToEntity( touch, clip->start, clip->mins, clip->maxs, clip->end, &trace );
+	else if( touch->v.flags & FL_MONSTER )
+		SV_ClipMoveToEntity( touch, clip->start, clip->mins2, clip->maxs2, clip->end, &trace );
+	else SV_ClipMoveToEntity( touch, clip->start, clip->mins, clip->maxs, clip->end, &trace );
 
-		if( SV_IsValidEdict( clip->passedict ))
-		{
-		 	if( touch->v.owner == clip->passedict )
-				continue;	// don't clip against own missiles
-			if( clip->passedict->v.owner == touch )
-				continue;	// don't clip against owner
-		}
+	clip->trace = World_CombineTraces( &clip->trace, &trace, touch );
 
-		if( touch->v.solid == SOLID_CUSTOM )
-			SV_CustomClipMoveToEntity( touch, clip->start, clip->mins, clip->maxs, clip->end, &trace );
-		else if( touch->v.flags & FL_MONSTER )
-			SV_ClipMoveToEntity( touch, clip->start, clip->mins2, clip->maxs2, clip->end, &trace );
-		else SV_ClipMoveToEntity( touch, clip->start, clip->mins, clip->maxs, clip->end, &trace );
+	return true;
+}
 
-		clip->trace = World_CombineTraces( &clip->trace, &trace, touch );
+/*
+====================
+SV_ClipToLinks
+
+Mins and maxs enclose the entire area swept by the move
+====================
+*/
+static void SV_ClipToLinks( areanode_t *node, moveclip_t *clip )
+{
+	link_t	*l, *next;
+	edict_t	*touch;
+	int	count = 0;
+
+	// touch linked edicts
+	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = next )
+	{
+		next = l->next;
+		count++;
+
+		touch = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+
+		if( !SV_ClipToEntity( touch, clip ))
+			break;
 	}
+
+	if( sv_areastats.counting )
+		sv_areastats.numcandidates += count;
+
+	if( l != &node->solid_edicts )
+		return;
 	
 	// recurse down both sides
 	if( node->axis == -1 ) return;
@@ -1310,88 +1780,62 @@ void SV_ClipToWorldBrush( areanode_t *node, moveclip_t *clip )
 
 /*
 ==================
-SV_Move
+SV_InitMoveClip
+
+clip against the world, returns false if
+there is no room to hit the entities
 ==================
 */
-trace_t SV_Move( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
+static qboolean SV_InitMoveClip( moveclip_t *clip, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
 {
-	moveclip_t	clip;
-	vec3_t		trace_endpos;
-	float		trace_fraction;
+	Q_memset( clip, 0, sizeof( moveclip_t ));
+	SV_ClipMoveToEntity( EDICT_NUM( 0 ), start, mins, maxs, end, &clip->trace );
 
-	Q_memset( &clip, 0, sizeof( moveclip_t ));
-	SV_ClipMoveToEntity( EDICT_NUM( 0 ), start, mins, maxs, end, &clip.trace );
+	if( clip->trace.fraction == 0.0f )
+		return false;
 
-	if( clip.trace.fraction != 0.0f )
+	VectorCopy( clip->trace.endpos, clip->trace_endpos );
+	clip->trace_fraction = clip->trace.fraction;
+	clip->trace.fraction = 1.0f;
+	clip->start = start;
+	clip->end = clip->trace_endpos;
+	clip->type = (type & 0xFF);
+	clip->flags = (type & 0xFF00);
+	clip->passedict = (e) ? e : EDICT_NUM( 0 );
+	clip->mins = mins;
+	clip->maxs = maxs;
+
+	if( clip->type == MOVE_MISSILE )
 	{
-		VectorCopy( clip.trace.endpos, trace_endpos );
-		trace_fraction = clip.trace.fraction;
-		clip.trace.fraction = 1.0f;
-		clip.start = start;
-		clip.end = trace_endpos;
-		clip.type = (type & 0xFF);
-		clip.flags = (type & 0xFF00);
-		clip.passedict = (e) ? e : EDICT_NUM( 0 );
-		clip.mins = mins;
-		clip.maxs = maxs;
-
-		if( clip.type == MOVE_MISSILE )
-		{
-			VectorSet( clip.mins2, -15.0f, -15.0f, -15.0f );
-			VectorSet( clip.maxs2,  15.0f,  15.0f,  15.0f );
-		}
-		else
-		{
-			VectorCopy( mins, clip.mins2 );
-			VectorCopy( maxs, clip.maxs2 );
-		}
-
-		World_MoveBounds( start, clip.mins2, clip.maxs2, trace_endpos, clip.boxmins, clip.boxmaxs );
-		SV_ClipToLinks( sv_areanodes, &clip );
-
-		clip.trace.fraction *= trace_fraction;
-		svgame.globals->trace_ent = clip.trace.ent;
+		VectorSet( clip->mins2, -15.0f, -15.0f, -15.0f );
+		VectorSet( clip->maxs2,  15.0f,  15.0f,  15.0f );
+	}
+	else
+	{
+		VectorCopy( mins, clip->mins2 );
+		VectorCopy( maxs, clip->maxs2 );
 	}
 
-	SV_CopyTraceToGlobal( &clip.trace );
+	World_MoveBounds( start, clip->mins2, clip->maxs2, clip->trace_endpos, clip->boxmins, clip->boxmaxs );
 
-	return clip.trace;
+	return true;
 }
 
 /*
 ==================
-SV_MoveNoEnts
+SV_Move
 ==================
 */
-trace_t SV_MoveNoEnts( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
+trace_t SV_Move( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
 {
 	moveclip_t	clip;
-	vec3_t		trace_endpos;
-	float		trace_fraction;
-
-	Q_memset( &clip, 0, sizeof( moveclip_t ));
-	SV_ClipMoveToEntity( EDICT_NUM( 0 ), start, mins, maxs, end, &clip.trace );
 
-	if( clip.trace.fraction != 0.0f )
+	if( SV_InitMoveClip( &clip, start, mins, maxs, end, type, e ))
 	{
-		VectorCopy( clip.trace.endpos, trace_endpos );
-		trace_fraction = clip.trace.fraction;
-		clip.trace.fraction = 1.0f;
-		clip.start = start;
-		clip.end = trace_endpos;
-		clip.type = (type & 0xFF);
-		clip.flags = (type & 0xFF00);
-		clip.passedict = (e) ? e : EDICT_NUM( 0 );
-		clip.mins = mins;
-		clip.maxs = maxs;
-
-		VectorCopy( mins, clip.mins2 );
-		VectorCopy( maxs, clip.maxs2 );
-
-		World_MoveBounds( start, clip.mins2, clip.maxs2, trace_endpos, clip.boxmins, clip.boxmaxs );
-		SV_ClipToWorldBrush( sv_areanodes, &clip );
+		SV_ClipToLinks( sv_areanodes, &clip );
+		if( sv_areastats.counting ) sv_areastats.numtraces++;
 
-		clip.trace.fraction *= trace_fraction;
+		clip.trace.fraction *= clip.trace_fraction;
 		svgame.globals->trace_ent = clip.trace.ent;
 	}
 
@@ -1402,15 +1846,519 @@ trace_t SV_MoveNoEnts( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_
 
 /*
 ==================
-SV_TraceSurface
+SV_NewTraceCacheFrame
 
-find the face where the traceline hit
-assume pTextureEntity is valid
+forget the traces of the previous frame
 ==================
 */
-msurface_t *SV_TraceSurface( edict_t *ent, const vec3_t start, const vec3_t end )
+void SV_NewTraceCacheFrame( void )
 {
-	matrix4x4		matrix;
+	sv_traceframe++;
+}
+
+static uint SV_TraceCacheHash( const tracekey_t *key )
+{
+	const uint	*data = (const uint *)key;
+	uint		i, hash = 2166136261U;
+
+	// generation is not hashed, stale entry is replaced in place
+	for( i = 0; i < sizeof( *key ) / sizeof( uint ) - 1; i++ )
+		hash = ( hash ^ data[i] ) * 16777619U;
+
+	return hash;
+}
+
+static qboolean SV_CompareTraces( const trace_t *a, const trace_t *b )
+{
+	if( a->fraction != b->fraction || a->ent != b->ent || a->hitgroup != b->hitgroup )
+		return false;
+	if( a->allsolid != b->allsolid || a->startsolid != b->startsolid )
+		return false;
+	if( a->inopen != b->inopen || a->inwater != b->inwater )
+		return false;
+	if( !VectorCompare( a->endpos, b->endpos ) || !VectorCompare( a->plane.normal, b->plane.normal ))
+		return false;
+	return true;
+}
+
+/*
+==================
+SV_CachedMove
+
+SV_Move for the game dll, identical traces within one frame are
+answered from the cache until a solid edict is moved. Clipping state
+that changes without relinking the edict is not tracked
+==================
+*/
+trace_t SV_CachedMove( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
+{
+	tracecache_t	*entry;
+	tracekey_t	key;
+	trace_t		trace;
+	qboolean		samequery;
+
+	if( !sv_tracecache->integer )
+		return SV_Move( start, mins, maxs, end, type, e );
+
+	Q_memset( &key, 0, sizeof( key ));
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	VectorCopy( mins, key.mins );
+	VectorCopy( maxs, key.maxs );
+	key.type = type;
+	key.passent = e ? e - svgame.edicts : -1;
+	key.traceflags = svgame.globals->trace_flags;
+
+	// monsters can't change the traces which ignore them
+	if(( type & 0xFF ) == MOVE_NOMONSTERS )
+		key.generation = sv_linkgeneration[LINK_WORLD];
+	else key.generation = sv_linkgeneration[LINK_MONSTER];
+
+	entry = &sv_tracecache_table[SV_TraceCacheHash( &key ) & ( TRACE_CACHE_SIZE - 1 )];
+	samequery = ( entry->framenum == sv_traceframe && !Q_memcmp( &entry->key, &key, sizeof( key ) - sizeof( int )));
+
+	if( samequery && entry->key.generation == key.generation )
+	{
+		sv_tracestats.hits++;
+
+		if( sv_tracecache->integer >= 2 )
+		{
+			trace = SV_Move( start, mins, maxs, end, type, e );
+
+			if( !SV_CompareTraces( &trace, &entry->trace ))
+			{
+				MsgDev( D_WARN, "SV_CachedMove: stale trace from (%g %g %g) to (%g %g %g), fraction %g instead of %g\n",
+					start[0], start[1], start[2], end[0], end[1], end[2], entry->trace.fraction, trace.fraction );
+				SV_CheckMismatch( CHECK_TRACECACHE );
+				entry->trace = trace;
+			}
+			return trace;
+		}
+
+		svgame.globals->trace_ent = entry->trace.ent;
+		SV_CopyTraceToGlobal( &entry->trace );
+
+		return entry->trace;
+	}
+
+	if( samequery ) sv_tracestats.stale++;
+	sv_tracestats.misses++;
+
+	trace = SV_Move( start, mins, maxs, end, type, e );
+
+	entry->key = key;
+	entry->framenum = sv_traceframe;
+	entry->trace = trace;
+
+	return trace;
+}
+
+/*
+==================
+SV_TraceCacheStats_f
+
+==================
+*/
+void SV_TraceCacheStats_f( void )
+{
+	int	total = sv_tracestats.hits + sv_tracestats.misses;
+
+	Msg( "trace cache: %i traces, %.1f%% hits, %i invalidated by moved edicts\n", total,
+		total ? sv_tracestats.hits * 100.0f / total : 0.0f, sv_tracestats.stale );
+	SV_PrintMismatches( CHECK_TRACECACHE );
+
+	Q_memset( &sv_tracestats, 0, sizeof( sv_tracestats ));
+}
+
+/*
+==================
+SV_NewLinkFrame
+
+==================
+*/
+void SV_NewLinkFrame( void )
+{
+	sv_linkstats.total.full += sv_linkstats.frame.full;
+	sv_linkstats.total.leafskips += sv_linkstats.frame.leafskips;
+	sv_linkstats.total.areaskips += sv_linkstats.frame.areaskips;
+	sv_linkstats.last = sv_linkstats.frame;
+	Q_memset( &sv_linkstats.frame, 0, sizeof( sv_linkstats.frame ));
+	sv_linkstats.numframes++;
+}
+
+/*
+==================
+SV_LinkStats_f
+
+==================
+*/
+void SV_LinkStats_f( void )
+{
+	linkcounts_t	*t = &sv_linkstats.total;
+	int		frames = max( sv_linkstats.numframes, 1 );
+
+	Msg( "last frame: %i leaf searches, %i leafs reused, %i area links kept\n",
+		sv_linkstats.last.full, sv_linkstats.last.leafskips, sv_linkstats.last.areaskips );
+	Msg( "%i frames: %.1f leaf searches, %.1f leafs reused, %.1f area links kept per frame\n", sv_linkstats.numframes,
+		(float)t->full / frames, (float)t->leafskips / frames, (float)t->areaskips / frames );
+
+	Q_memset( t, 0, sizeof( *t ));
+	sv_linkstats.numframes = 0;
+}
+
+/*
+==================
+SV_GatherLinks
+
+collect solid edicts in the order SV_ClipToLinks would visit them,
+returns false if the list is overflowed
+==================
+*/
+static qboolean SV_GatherLinks( areanode_t *node, const vec3_t mins, const vec3_t maxs, edict_t **list, int *count, int maxcount )
+{
+	link_t	*l;
+
+	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = l->next )
+	{
+		if( *count == maxcount )
+			return false;
+		list[(*count)++] = (edict_t *)((byte *)l - ADDRESS_OF_AREA);
+	}
+
+	if( node->axis == -1 ) return true;
+
+	if( maxs[node->axis] > node->dist && !SV_GatherLinks( node->children[0], mins, maxs, list, count, maxcount ))
+		return false;
+	if( mins[node->axis] < node->dist && !SV_GatherLinks( node->children[1], mins, maxs, list, count, maxcount ))
+		return false;
+
+	return true;
+}
+
+/*
+==================
+SV_MoveBatch
+
+trace the group of moves with a single area tree walk,
+results are the same as SV_Move gives for each of them
+==================
+*/
+void SV_MoveBatch( const tracerequest_t *requests, int count, trace_t *traces )
+{
+	moveclip_t	clips[MAX_TRACE_BATCH];
+	edict_t		*touch[MAX_BATCH_TOUCH];
+	vec3_t		mins, maxs;
+	int		i, j, numclips, numtouch;
+	float		*hullmins, *hullmaxs;
+	qboolean		active[MAX_TRACE_BATCH];
+	int		traceflags = svgame.globals->trace_flags;
+	moveclip_t	*clip;
+
+	while( count > 0 )
+	{
+		numclips = min( count, MAX_TRACE_BATCH );
+		svgame.globals->trace_flags = traceflags;
+		ClearBounds( mins, maxs );
+
+		for( i = 0; i < numclips; i++ )
+		{
+			const tracerequest_t	*req = &requests[i];
+
+			if( req->hullNumber >= 0 && req->hullNumber <= 3 )
+			{
+				hullmins = sv.worldmodel->hulls[req->hullNumber].clip_mins;
+				hullmaxs = sv.worldmodel->hulls[req->hullNumber].clip_maxs;
+			}
+			else hullmins = hullmaxs = vec3_origin;
+
+			active[i] = SV_InitMoveClip( &clips[i], req->start, hullmins, hullmaxs, req->end, req->flags, req->pentIgnore );
+
+			if( active[i] )
+			{
+				AddPointToBounds( clips[i].boxmins, mins, maxs );
+				AddPointToBounds( clips[i].boxmaxs, mins, maxs );
+			}
+		}
+
+		numtouch = 0;
+
+		// traces are too far apart, walk the tree for each
+		if( mins[0] <= maxs[0] && !SV_GatherLinks( sv_areanodes, mins, maxs, touch, &numtouch, MAX_BATCH_TOUCH ))
+			numtouch = -1;
+
+		for( i = 0, clip = clips; i < numclips; i++, clip++ )
+		{
+			// every trace of the batch sees the same flags
+			svgame.globals->trace_flags = traceflags;
+
+			if( active[i] )
+			{
+				if( numtouch >= 0 )
+				{
+					for( j = 0; j < numtouch; j++ )
+					{
+						// outside of this trace, SV_ClipToLinks wouldn't get there
+						if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, touch[j]->v.absmin, touch[j]->v.absmax ))
+							continue;
+
+						if( !SV_ClipToEntity( touch[j], clip ))
+							break;
+					}
+				}
+				else SV_ClipToLinks( sv_areanodes, clip );
+
+				if( sv_areastats.counting ) sv_areastats.numtraces++;
+				clip->trace.fraction *= clip->trace_fraction;
+				svgame.globals->trace_ent = clip->trace.ent;
+			}
+
+			SV_CopyTraceToGlobal( &clip->trace );
+			traces[i] = clip->trace;
+		}
+
+		requests += numclips;
+		traces += numclips;
+		count -= numclips;
+	}
+}
+
+/*
+==================
+SV_MoveNoEnts
+==================
+*/
+trace_t SV_MoveNoEnts( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e )
+{
+	moveclip_t	clip;
+	vec3_t		trace_endpos;
+	float		trace_fraction;
+
+	Q_memset( &clip, 0, sizeof( moveclip_t ));
+	SV_ClipMoveToEntity( EDICT_NUM( 0 ), start, mins, maxs, end, &clip.trace );
+
+	if( clip.trace.fraction != 0.0f )
+	{
+		VectorCopy( clip.trace.endpos, trace_endpos );
+		trace_fraction = clip.trace.fraction;
+		clip.trace.fraction = 1.0f;
+		clip.start = start;
+		clip.end = trace_endpos;
+		clip.type = (type & 0xFF);
+		clip.flags = (type & 0xFF00);
+		clip.passedict = (e) ? e : EDICT_NUM( 0 );
+		clip.mins = mins;
+		clip.maxs = maxs;
+
+		VectorCopy( mins, clip.mins2 );
+		VectorCopy( maxs, clip.maxs2 );
+
+		World_MoveBounds( start, clip.mins2, clip.maxs2, trace_endpos, clip.boxmins, clip.boxmaxs );
+		SV_ClipToWorldBrush( sv_areanodes, &clip );
+
+		clip.trace.fraction *= trace_fraction;
+		svgame.globals->trace_ent = clip.trace.ent;
+	}
+
+	SV_CopyTraceToGlobal( &clip.trace );
+
+	return clip.trace;
+}
+
+/*
+==================
+SV_RunTraceBench
+
+run the traces against current area tree
+==================
+*/
+static void SV_RunTraceBench( const char *name, vec3_t *points, edict_t **ents, int count )
+{
+	int	i, candidates;
+	double	start, time;
+
+	sv_areastats.numtraces = 0;
+	sv_areastats.numcandidates = 0;
+	sv_areastats.counting = true;
+	start = Sys_DoubleTime();
+
+	for( i = 0; i < count; i++ )
+		SV_Move( points[i*2+0], vec3_origin, vec3_origin, points[i*2+1], MOVE_NORMAL, ents[i] );
+
+	time = Sys_DoubleTime() - start;
+	sv_areastats.counting = false;
+	candidates = sv_areastats.numcandidates;
+
+	Msg( "%s: %i nodes, depth %i, %.1f candidates per trace, %.2f usec per trace\n", name, sv_numareanodes,
+		sv_areastats.maxdepth, (float)candidates / max( sv_areastats.numtraces, 1 ), time * 1000000.0 / count );
+}
+
+/*
+==================
+SV_TraceBench_f
+
+fire random traces from the solid edicts with the fixed
+and the adaptive area trees
+==================
+*/
+void SV_TraceBench_f( void )
+{
+	int	i, count, numsources;
+	vec3_t	*points, dir;
+	edict_t	**ents, **sources;
+	edict_t	*ent;
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	count = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : 10000;
+	count = bound( 1, count, 100000 );
+
+	sources = Z_Malloc( svgame.numEntities * sizeof( edict_t* ));
+
+	for( i = 1, numsources = 0; i < svgame.numEntities; i++ )
+	{
+		ent = EDICT_NUM( i );
+
+		if( !SV_IsValidEdict( ent ) || !ent->area.prev )
+			continue;
+
+		if( ent->v.solid == SOLID_NOT || ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_BSP )
+			continue;
+
+		sources[numsources++] = ent;
+	}
+
+	if( !numsources )
+	{
+		Msg( "no solid entities to trace from\n" );
+		Mem_Free( sources );
+		return;
+	}
+
+	points = Z_Malloc( count * 2 * sizeof( vec3_t ));
+	ents = Z_Malloc( count * sizeof( edict_t* ));
+
+	for( i = 0; i < count; i++ )
+	{
+		ent = ents[i] = sources[i % numsources];
+
+		VectorAverage( ent->v.absmin, ent->v.absmax, points[i*2+0] );
+		VectorSet( dir, Com_RandomFloat( -1.0f, 1.0f ), Com_RandomFloat( -1.0f, 1.0f ), Com_RandomFloat( -0.5f, 0.5f ));
+		VectorNormalize( dir );
+		VectorMA( points[i*2+0], Com_RandomFloat( 64.0f, 1024.0f ), dir, points[i*2+1] );
+	}
+
+	Msg( "%i traces from %i entities\n", count, numsources );
+
+	SV_RebuildAreaNodes( 0 );
+	SV_RunTraceBench( "fixed tree", points, ents, count );
+
+	SV_RebuildAreaNodes( sv_areasplit->integer );
+
+	if( sv_areasplit->integer > 0 )
+		SV_RunTraceBench( "adaptive tree", points, ents, count );
+	Msg( "%i leaf splits, %i rebuilds since map start\n", sv_areastats.numsplits, sv_areastats.numrebuilds );
+
+	Mem_Free( sources );
+	Mem_Free( points );
+	Mem_Free( ents );
+}
+
+/*
+==================
+SV_HullBench_f
+
+trace random segments through the world hulls
+with packed and plain clipnodes
+==================
+*/
+void SV_HullBench_f( void )
+{
+	int		i, j, count, mismatches = 0;
+	hulltrace_t	trace[2];
+	double		start, time[2];
+	vec3_t		*points;
+	model_t		*world;
+	hull_t		*hull;
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	count = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : 1000000;
+	count = bound( 1, count, 10000000 );
+
+	world = sv.worldmodel;
+	points = Z_Malloc( 4096 * 2 * sizeof( vec3_t ));
+
+	for( i = 0; i < 4096; i++ )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			points[i*2+0][j] = Com_RandomFloat( world->mins[j], world->maxs[j] );
+			points[i*2+1][j] = points[i*2+0][j] + Com_RandomFloat( -512.0f, 512.0f );
+		}
+	}
+
+	for( j = 0; j < 2; j++ )
+	{
+		start = Sys_DoubleTime();
+
+		for( i = 0; i < count; i++ )
+		{
+			hull = &world->hulls[i & 3];
+			Q_memset( &trace[j], 0, sizeof( hulltrace_t ));
+			trace[j].allsolid = true;
+			trace[j].fraction = 1.0f;
+			PM_HullTrace( hull, j ? NULL : Mod_PackedHull( hull ), hull->firstclipnode, 0.0f, 1.0f,
+				points[(i & 4095)*2+0], points[(i & 4095)*2+1], &trace[j] );
+		}
+
+		time[j] = Sys_DoubleTime() - start;
+	}
+
+	// same traces must give the same results
+	for( i = 0; i < 4096 * 4; i++ )
+	{
+		hull = &world->hulls[i & 3];
+
+		for( j = 0; j < 2; j++ )
+		{
+			Q_memset( &trace[j], 0, sizeof( hulltrace_t ));
+			trace[j].allsolid = true;
+			trace[j].fraction = 1.0f;
+			PM_HullTrace( hull, j ? NULL : Mod_PackedHull( hull ), hull->firstclipnode, 0.0f, 1.0f,
+				points[(i & 4095)*2+0], points[(i & 4095)*2+1], &trace[j] );
+		}
+
+		if( memcmp( &trace[0], &trace[1], sizeof( hulltrace_t )))
+			mismatches++;
+	}
+
+	Msg( "%i traces, packed hulls %s\n", count, Mod_PackedHull( &world->hulls[1] ) ? "ready" : "missed" );
+	Msg( "packed: %.0f traces/sec\n", count / max( time[0], 0.000001 ));
+	Msg( "plain: %.0f traces/sec\n", count / max( time[1], 0.000001 ));
+	if( mismatches ) Msg( "^1%i mismatches\n", mismatches );
+
+	Mem_Free( points );
+}
+
+/*
+==================
+SV_TraceSurface
+
+find the face where the traceline hit
+assume pTextureEntity is valid
+==================
+*/
+msurface_t *SV_TraceSurface( edict_t *ent, const vec3_t start, const vec3_t end )
+{
+	matrix4x4		matrix;
 	model_t		*bmodel;
 	hull_t		*hull;
 	vec3_t		start_l, end_l;
@@ -1734,3 +2682,558 @@ int SV_LightForEntity( edict_t *pEdict )
 
 	return VectorAvg( sv_pointColor );
 }
+
+/*
+==================
+SV_HitboxBench_f
+
+trace random segments through studio models with and without
+the hitbox cache, results must be the same
+==================
+*/
+void SV_HitboxBench_f( void )
+{
+	int	i, j, k, count, numents, mismatches = 0;
+	float	oldcache = mod_studiocache->value;
+	trace_t	*traces[2];
+	double	start, time[2];
+	vec3_t	*points;
+	edict_t	**ents, *ent;
+	model_t	*mod;
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	count = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : 100000;
+	count = bound( 1, count, 1000000 );
+
+	ents = Z_Malloc( svgame.numEntities * sizeof( edict_t* ));
+
+	for( i = 1, numents = 0; i < svgame.numEntities; i++ )
+	{
+		ent = EDICT_NUM( i );
+		if( !SV_IsValidEdict( ent ) || ent->v.solid == SOLID_NOT || ent->v.solid == SOLID_TRIGGER )
+			continue;
+
+		mod = Mod_Handle( ent->v.modelindex );
+		if( mod && mod->type == mod_studio )
+			ents[numents++] = ent;
+	}
+
+	if( !numents )
+	{
+		Msg( "no studio models to trace\n" );
+		Mem_Free( ents );
+		return;
+	}
+
+	points = Z_Malloc( count * 2 * sizeof( vec3_t ));
+	traces[0] = Z_Malloc( count * sizeof( trace_t ));
+	traces[1] = Z_Malloc( count * sizeof( trace_t ));
+
+	// segments crossing the models from every side
+	for( i = 0; i < count; i++ )
+	{
+		ent = ents[i % numents];
+
+		for( k = 0; k < 3; k++ )
+		{
+			points[i*2+0][k] = ent->v.origin[k] + Com_RandomFloat( -128.0f, 128.0f );
+			points[i*2+1][k] = ent->v.origin[k] + Com_RandomFloat( -48.0f, 48.0f );
+		}
+	}
+
+	for( j = 0; j < 2; j++ )
+	{
+		Cvar_SetFloat( "r_studiocache", j ? 0.0f : 1.0f );
+		start = Sys_DoubleTime();
+
+		for( i = 0; i < count; i++ )
+			SV_ClipMoveToEntity( ents[i % numents], points[i*2+0], vec3_origin, vec3_origin, points[i*2+1], &traces[j][i] );
+
+		time[j] = Sys_DoubleTime() - start;
+	}
+
+	Cvar_SetFloat( "r_studiocache", oldcache );
+
+	for( i = 0; i < count; i++ )
+	{
+		if( memcmp( &traces[0][i], &traces[1][i], sizeof( trace_t )))
+			mismatches++;
+	}
+
+	Msg( "%i traces against %i studio models\n", count, numents );
+	Msg( "cached: %.0f traces/sec\n", count / max( time[0], 0.000001 ));
+	Msg( "plain: %.0f traces/sec\n", count / max( time[1], 0.000001 ));
+	if( mismatches ) Msg( "^1%i mismatches\n", mismatches );
+
+	Mem_Free( traces[1] );
+	Mem_Free( traces[0] );
+	Mem_Free( points );
+	Mem_Free( ents );
+}
+
+/*
+===============================================================================
+
+SPHERE AND BOX QUERIES
+
+every edict except world is kept in one bucket of uniform 2D grid,
+keyed by the center of its absbox. Edicts bigger than a cell are
+kept in the separate bucket which is always tested
+
+===============================================================================
+*/
+#define SPHERE_GRID_LARGE	SPHERE_GRID_SIZE	// bucket for the big edicts
+#define SPHERE_GRID_COORD	65536.0f		// edicts outside are large too
+
+static int	sv_gridbuckets[SPHERE_GRID_SIZE+1];	// first edict in bucket or -1
+static int	sv_spheregeneration;		// changed by any grid update
+
+static struct
+{
+	vec3_t		org;
+	float		radius;
+	int		generation;
+	int		count;		// sorted candidates in svgame.spherelist
+} sv_spherequery;
+
+_inline int SV_SphereCell( float value )
+{
+	return (int)floor( value * ( 1.0f / SPHERE_GRID_CELL ));
+}
+
+_inline int SV_SphereBucket( int x, int y )
+{
+	return (( x * 73856093 ) ^ ( y * 19349663 )) & ( SPHERE_GRID_SIZE - 1 );
+}
+
+/*
+===============
+SV_ClearSphereGrid
+
+===============
+*/
+static void SV_ClearSphereGrid( void )
+{
+	Q_memset( sv_gridbuckets, 0xFF, sizeof( sv_gridbuckets ));
+	sv_spherequery.count = -1;
+	sv_spheregeneration++;
+}
+
+/*
+===============
+SV_UnlinkSphereGrid
+
+===============
+*/
+void SV_UnlinkSphereGrid( edict_t *ent )
+{
+	sv_gridlink_t	*state;
+
+	if( !svgame.gridlinks ) return;
+
+	state = &svgame.gridlinks[NUM_FOR_EDICT( ent )];
+	if( !state->gridbucket ) return;
+
+	if( state->gridprev != -1 )
+		svgame.gridlinks[state->gridprev].gridnext = state->gridnext;
+	else sv_gridbuckets[state->gridbucket - 1] = state->gridnext;
+
+	if( state->gridnext != -1 )
+		svgame.gridlinks[state->gridnext].gridprev = state->gridprev;
+
+	state->gridbucket = 0;
+	sv_spheregeneration++;
+}
+
+/*
+===============
+SV_LinkSphereGrid
+
+put the edict into the bucket of its current absbox
+===============
+*/
+void SV_LinkSphereGrid( edict_t *ent )
+{
+	int		e = NUM_FOR_EDICT( ent );
+	sv_gridlink_t	*state = &svgame.gridlinks[e];
+	vec3_t		center;
+	int		i, bucket;
+
+	if( e <= 0 || !svgame.gridlinks ) return;
+
+	if( state->gridbucket && VectorCompare( state->gridmin, ent->v.absmin ) && VectorCompare( state->gridmax, ent->v.absmax ))
+		return; // not moved
+
+	SV_UnlinkSphereGrid( ent );
+
+	VectorCopy( ent->v.absmin, state->gridmin );
+	VectorCopy( ent->v.absmax, state->gridmax );
+	VectorAverage( ent->v.absmin, ent->v.absmax, center );
+	bucket = -1;
+
+	for( i = 0; i < 2; i++ )
+	{
+		// NOTE: NaN fails here too
+		if(!( ent->v.absmax[i] - ent->v.absmin[i] <= SPHERE_GRID_CELL ))
+			bucket = SPHERE_GRID_LARGE;
+		else if(!( center[i] > -SPHERE_GRID_COORD && center[i] < SPHERE_GRID_COORD ))
+			bucket = SPHERE_GRID_LARGE;
+	}
+
+	if( bucket == -1 )
+		bucket = SV_SphereBucket( SV_SphereCell( center[0] ), SV_SphereCell( center[1] ));
+
+	state->gridprev = -1;
+	state->gridnext = sv_gridbuckets[bucket];
+	if( state->gridnext != -1 )
+		svgame.gridlinks[state->gridnext].gridprev = e;
+	sv_gridbuckets[bucket] = e;
+	state->gridbucket = bucket + 1;
+	sv_spheregeneration++;
+}
+
+/*
+===============
+SV_UpdateSphereGrid
+
+catch the edicts that was moved without SV_LinkEdict (savegame
+restore, direct absmin writes), called once per frame
+===============
+*/
+void SV_UpdateSphereGrid( void )
+{
+	edict_t	*ent;
+	int	i;
+
+	for( i = 1; i < svgame.numEntities; i++ )
+	{
+		ent = EDICT_NUM( i );
+
+		if( SV_IsValidEdict( ent ))
+			SV_LinkSphereGrid( ent );
+		else SV_UnlinkSphereGrid( ent );
+	}
+}
+
+/*
+===============
+SV_EdictInSphere
+
+===============
+*/
+static qboolean SV_EdictInSphere( edict_t *ent, const vec3_t org, float radiusSquared )
+{
+	float	distSquared = 0.0f;
+	float	eorg;
+	int	j;
+
+	if( !SV_IsValidEdict( ent ))
+		return false;
+
+	// ignore clients that not in a game
+	if( NUM_FOR_EDICT( ent ) <= sv_maxclients->integer && !SV_ClientFromEdict( ent, true ))
+		return false;
+
+	for( j = 0; j < 3 && distSquared <= radiusSquared; j++ )
+	{
+		if( org[j] < ent->v.absmin[j] )
+			eorg = org[j] - ent->v.absmin[j];
+		else if( org[j] > ent->v.absmax[j] )
+			eorg = org[j] - ent->v.absmax[j];
+		else eorg = 0;
+
+		distSquared += eorg * eorg;
+	}
+
+	return ( distSquared <= radiusSquared );
+}
+
+static edict_t *SV_FindEntityInSphereLinear( int e, const vec3_t org, float radiusSquared )
+{
+	edict_t	*ent;
+
+	for( e++; e < svgame.numEntities; e++ )
+	{
+		ent = EDICT_NUM( e );
+
+		if( SV_EdictInSphere( ent, org, radiusSquared ))
+			return ent;
+	}
+
+	return EDICT_NUM( 0 );
+}
+
+static int SV_CompareEdictNums( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+===============
+SV_GatherGridEdicts
+
+sorted unique list of edicts which boxes intersect the given box,
+returns -1 if box covers too many cells
+===============
+*/
+static int SV_GatherGridEdicts( const vec3_t mins, const vec3_t maxs, int *list )
+{
+	int		x, y, x0, y0, x1, y1;
+	int		i, e, count = 0;
+	int		buckets[SPHERE_GRID_CELLS+1];
+	int		b, numbuckets = 0;
+	sv_gridlink_t	*state;
+
+	// centers of small edicts are half a cell away at most
+	for( i = 0; i < 2; i++ )
+	{
+		if(!( mins[i] > -SPHERE_GRID_COORD && maxs[i] < SPHERE_GRID_COORD ))
+			return -1;
+	}
+
+	x0 = SV_SphereCell( mins[0] - SPHERE_GRID_CELL * 0.5f );
+	y0 = SV_SphereCell( mins[1] - SPHERE_GRID_CELL * 0.5f );
+	x1 = SV_SphereCell( maxs[0] + SPHERE_GRID_CELL * 0.5f );
+	y1 = SV_SphereCell( maxs[1] + SPHERE_GRID_CELL * 0.5f );
+
+	if(( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) > SPHERE_GRID_CELLS )
+		return -1;
+
+	buckets[numbuckets++] = SPHERE_GRID_LARGE;
+
+	for( x = x0; x <= x1; x++ )
+	{
+		for( y = y0; y <= y1; y++ )
+		{
+			b = SV_SphereBucket( x, y );
+
+			// cells may share the bucket
+			for( i = 0; i < numbuckets && buckets[i] != b; i++ );
+			if( i == numbuckets ) buckets[numbuckets++] = b;
+		}
+	}
+
+	for( i = 0; i < numbuckets; i++ )
+	{
+		for( e = sv_gridbuckets[buckets[i]]; e != -1; e = state->gridnext )
+		{
+			state = &svgame.gridlinks[e];
+
+			if( !BoundsIntersect( mins, maxs, state->gridmin, state->gridmax ))
+				continue;
+			list[count++] = e;
+		}
+	}
+
+	// keep the edict order of the full scan
+	qsort( list, count, sizeof( int ), SV_CompareEdictNums );
+
+	return count;
+}
+
+/*
+===============
+SV_FindEntityInSphere
+
+same as full scan over the edicts, candidates of one query
+are gathered once and walked in order by successive calls
+===============
+*/
+edict_t *SV_FindEntityInSphere( edict_t *pStartEdict, const vec3_t org, float radius )
+{
+	int	e = 0, first, last, mid;
+	float	radiusSquared = radius * radius;
+	edict_t	*ent, *check;
+	vec3_t	mins, maxs;
+	int	i;
+
+	if( SV_IsValidEdict( pStartEdict ))
+		e = NUM_FOR_EDICT( pStartEdict );
+
+	if( !sv_spheregrid->integer || !org || radius < 0.0f )
+		return SV_FindEntityInSphereLinear( e, org, radiusSquared );
+
+	if( sv_spherequery.count < 0 || sv_spherequery.generation != sv_spheregeneration
+	|| sv_spherequery.radius != radius || !VectorCompare( sv_spherequery.org, org ))
+	{
+		for( i = 0; i < 3; i++ )
+		{
+			mins[i] = org[i] - radius;
+			maxs[i] = org[i] + radius;
+		}
+
+		sv_spherequery.count = SV_GatherGridEdicts( mins, maxs, svgame.spherelist );
+		sv_spherequery.generation = sv_spheregeneration;
+		sv_spherequery.radius = radius;
+		VectorCopy( org, sv_spherequery.org );
+	}
+
+	if( sv_spherequery.count < 0 )
+		return SV_FindEntityInSphereLinear( e, org, radiusSquared );
+
+	// first candidate after the start edict
+	first = 0;
+	last = sv_spherequery.count;
+
+	while( first < last )
+	{
+		mid = ( first + last ) >> 1;
+		if( svgame.spherelist[mid] <= e )
+			first = mid + 1;
+		else last = mid;
+	}
+
+	ent = EDICT_NUM( 0 );
+
+	for( ; first < sv_spherequery.count; first++ )
+	{
+		check = EDICT_NUM( svgame.spherelist[first] );
+
+		if( SV_EdictInSphere( check, org, radiusSquared ))
+		{
+			ent = check;
+			break;
+		}
+	}
+
+	if( sv_spheregrid->integer >= 2 )
+	{
+		check = SV_FindEntityInSphereLinear( e, org, radiusSquared );
+
+		if( check != ent )
+		{
+			MsgDev( D_WARN, "SV_FindEntityInSphere: grid found %i, full scan %i\n", NUM_FOR_EDICT( ent ), NUM_FOR_EDICT( check ));
+			SV_CheckMismatch( CHECK_SPHEREGRID );
+			ent = check;
+		}
+	}
+
+	return ent;
+}
+
+/*
+===============
+SV_EntitiesInBox
+
+fill the list with edicts which absbox touches the given box
+in edict order, returns -1 if the grid can't answer or list
+is too small
+===============
+*/
+int SV_EntitiesInBox( const vec3_t mins, const vec3_t maxs, edict_t **list, int maxcount )
+{
+	int	i, count, numents = 0;
+	edict_t	*ent;
+
+	if( !sv_spheregrid->integer || !mins || !maxs || !list )
+		return -1;
+
+	count = SV_GatherGridEdicts( mins, maxs, svgame.spherelist );
+	sv_spherequery.count = -1; // list is overwritten
+	if( count < 0 ) return -1;
+
+	for( i = 0; i < count; i++ )
+	{
+		ent = EDICT_NUM( svgame.spherelist[i] );
+
+		// grid box may be outdated until the edict is linked again
+		if( !SV_IsValidEdict( ent ) || !BoundsIntersect( mins, maxs, ent->v.absmin, ent->v.absmax ))
+			continue;
+
+		if( numents >= maxcount )
+			return -1;
+		list[numents++] = ent;
+	}
+
+	return numents;
+}
+
+/*
+==================
+SV_SphereBench_f
+
+radius damage like loops with the grid and the full scan,
+optionally spawns extra edicts to have the crowd
+==================
+*/
+void SV_SphereBench_f( void )
+{
+	int	i, j, k, numextra, numqueries;
+	int	found[2];
+	float	oldgrid = sv_spheregrid->value;
+	edict_t	**extra, *ent;
+	vec3_t	*points;
+	double	start, time[2];
+
+	if( sv.state != ss_active )
+	{
+		Msg( "^3No server running.\n" );
+		return;
+	}
+
+	numextra = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : 512;
+	numextra = bound( 0, numextra, svgame.globals->maxEntities - svgame.numEntities - 1 );
+	numqueries = ( Cmd_Argc() > 2 ) ? Q_atoi( Cmd_Argv( 2 )) : 1000;
+	numqueries = bound( 1, numqueries, 100000 );
+
+	extra = Z_Malloc( max( numextra, 1 ) * sizeof( edict_t* ));
+	points = Z_Malloc( numqueries * sizeof( vec3_t ));
+
+	// grenade-sized edicts scattered over the world
+	for( i = 0; i < numextra; i++ )
+	{
+		ent = extra[i] = SV_AllocEdict();
+
+		for( k = 0; k < 3; k++ )
+		{
+			ent->v.origin[k] = Com_RandomFloat( sv.worldmodel->mins[k], sv.worldmodel->maxs[k] );
+			ent->v.absmin[k] = ent->v.origin[k] - 16.0f;
+			ent->v.absmax[k] = ent->v.origin[k] + 16.0f;
+		}
+
+		SV_LinkSphereGrid( ent );
+	}
+
+	for( i = 0; i < numqueries; i++ )
+	{
+		for( k = 0; k < 3; k++ )
+			points[i][k] = Com_RandomFloat( sv.worldmodel->mins[k], sv.worldmodel->maxs[k] );
+	}
+
+	for( j = 0; j < 2; j++ )
+	{
+		Cvar_SetFloat( "sv_spheregrid", j ? 0.0f : 1.0f );
+		start = Sys_DoubleTime();
+		found[j] = 0;
+
+		for( i = 0; i < numqueries; i++ )
+		{
+			ent = NULL;
+
+			// every radius damage walks the whole sphere
+			while(( ent = SV_FindEntityInSphere( ent, points[i], 350.0f )) != svgame.edicts )
+				found[j]++;
+		}
+
+		time[j] = Sys_DoubleTime() - start;
+	}
+
+	Cvar_SetFloat( "sv_spheregrid", oldgrid );
+
+	for( i = 0; i < numextra; i++ )
+		SV_FreeEdict( extra[i] );
+
+	Msg( "%i queries of 350 units among %i edicts (%i extra)\n", numqueries, svgame.numEntities, numextra );
+	Msg( "grid: %.0f queries/sec, %i found\n", numqueries / max( time[0], 0.000001 ), found[0] );
+	Msg( "full scan: %.0f queries/sec, %i found\n", numqueries / max( time[1], 0.000001 ), found[1] );
+	if( found[0] != found[1] ) Msg( "^1results differ\n" );
+	SV_PrintMismatches( CHECK_SPHEREGRID );
+
+	Mem_Free( points );
+	Mem_Free( extra );
+}